@@ -0,0 +1,227 @@
+#!/usr/bin/env bun
+
+// zip-bun against Bun's built-in zlib, node:zlib and, when installed, the
+// pure-JS fflate library, on the corpus sets of the benchmark suite. Every
+// library compresses and decompresses the same entries at level 6; zip-bun
+// and fflate produce whole archives, the zlib bindings bare deflate streams.
+// Each library/set pair runs in its own process so peak RSS is its own. Run
+// with `bun run bench:compare`, optionally with --filter and --out (default
+// compare-results.json); BENCH_SCALE and BENCH_ITERATIONS work as for
+// `bun run bench`. fflate is optional: `bun add -d fflate` to include it.
+
+import { parseArgs } from "node:util";
+import { deflateRawSync, inflateRawSync } from "node:zlib";
+import {
+  CompressionLevel,
+  createMemoryArchive,
+  openMemoryArchive,
+} from "../src/index.ts";
+import { type CorpusEntry, corpusSets } from "./corpus.ts";
+
+const scale = Number(process.env.BENCH_SCALE ?? 1);
+const iterations = Number(process.env.BENCH_ITERATIONS ?? 3);
+const sets = ["text", "json", "binary", "incompressible", "tiny"];
+
+interface Library {
+  /** Compresses the entries, returning whatever decompress needs. */
+  compress(entries: CorpusEntry[]): Uint8Array[];
+  /** Decompresses everything compress produced. */
+  decompress(compressed: Uint8Array[]): void;
+}
+
+type Fflate = {
+  zipSync(files: Record<string, Uint8Array>, options: { level: 6 }): Uint8Array;
+  unzipSync(data: Uint8Array): Record<string, Uint8Array>;
+};
+
+async function loadFflate(): Promise<Fflate | undefined> {
+  try {
+    // A variable specifier keeps bundlers and type checks from requiring it
+    const name = "fflate";
+    return (await import(name)) as Fflate;
+  } catch {
+    return undefined;
+  }
+}
+
+const libraries: Record<string, () => Promise<Library | undefined>> = {
+  "zip-bun": async () => ({
+    compress: (entries) => {
+      const writer = createMemoryArchive();
+      writer.addFiles(entries, CompressionLevel.DEFAULT);
+      return [writer.finalizeToMemory()];
+    },
+    decompress: ([archive]) => {
+      const reader = openMemoryArchive(archive as Uint8Array);
+      const count = reader.getFileCount();
+      for (let i = 0; i < count; i++) {
+        reader.extractFile(i);
+      }
+      reader.close();
+    },
+  }),
+  "Bun zlib": async () => ({
+    compress: (entries) =>
+      entries.map(({ data }) => Bun.deflateSync(data, { level: 6 })),
+    decompress: (compressed) => {
+      for (const data of compressed) {
+        Bun.inflateSync(data);
+      }
+    },
+  }),
+  "node:zlib": async () => ({
+    compress: (entries) =>
+      entries.map(({ data }) => deflateRawSync(data, { level: 6 })),
+    decompress: (compressed) => {
+      for (const data of compressed) {
+        inflateRawSync(data);
+      }
+    },
+  }),
+  fflate: async () => {
+    const fflate = await loadFflate();
+    if (!fflate) return undefined;
+    return {
+      compress: (entries) => [
+        fflate.zipSync(
+          Object.fromEntries(entries.map((e) => [e.filename, e.data])),
+          { level: 6 },
+        ),
+      ],
+      decompress: ([archive]) => {
+        fflate.unzipSync(archive as Uint8Array);
+      },
+    };
+  },
+};
+
+interface CompareResult {
+  library: string;
+  set: string;
+  "compress MB/s": number;
+  "decompress MB/s": number;
+  ratio: number;
+  "peak RSS MB": number;
+}
+
+// Child process: run one library on one set, or return undefined if the
+// library is not installed
+async function runCase(
+  name: string,
+  set: string,
+): Promise<CompareResult | undefined> {
+  const library = await libraries[name]?.();
+  const makeEntries = corpusSets[set];
+  if (!library || !makeEntries) return undefined;
+
+  const entries = makeEntries(scale);
+  const bytes = entries.reduce((sum, entry) => sum + entry.data.length, 0);
+  let compressNs = Number.POSITIVE_INFINITY;
+  let decompressNs = Number.POSITIVE_INFINITY;
+  let compressedBytes = 0;
+
+  for (let i = 0; i < iterations; i++) {
+    let start = Bun.nanoseconds();
+    const compressed = library.compress(entries);
+    compressNs = Math.min(compressNs, Bun.nanoseconds() - start);
+    compressedBytes = compressed.reduce((sum, data) => sum + data.length, 0);
+
+    start = Bun.nanoseconds();
+    library.decompress(compressed);
+    decompressNs = Math.min(decompressNs, Bun.nanoseconds() - start);
+  }
+
+  return {
+    library: name,
+    set,
+    "compress MB/s": Number((bytes / 1e6 / (compressNs / 1e9)).toFixed(1)),
+    "decompress MB/s": Number((bytes / 1e6 / (decompressNs / 1e9)).toFixed(1)),
+    ratio: Number((compressedBytes / bytes).toFixed(4)),
+    // maxRSS is in kilobytes
+    "peak RSS MB": Number(
+      ((process.resourceUsage().maxRSS * 1024) / 1e6).toFixed(1),
+    ),
+  };
+}
+
+const { values } = parseArgs({
+  args: Bun.argv.slice(2),
+  options: {
+    case: { type: "string" },
+    filter: { type: "string" },
+    out: { type: "string", default: "compare-results.json" },
+  },
+});
+
+if (values.case) {
+  const [name = "", set = ""] = values.case.split("/");
+  console.log(JSON.stringify((await runCase(name, set)) ?? null));
+  process.exit(0);
+}
+
+const results: CompareResult[] = [];
+const missing = new Set<string>();
+for (const set of sets) {
+  for (const name of Object.keys(libraries)) {
+    const label = `${name}/${set}`;
+    if (values.filter && !label.includes(values.filter)) continue;
+
+    const child = Bun.spawnSync(
+      [process.execPath, import.meta.path, "--case", label],
+      { stdout: "pipe", stderr: "inherit", env: process.env },
+    );
+    if (!child.success) {
+      throw new Error(`Comparison case ${label} failed`);
+    }
+
+    const result = JSON.parse(
+      child.stdout.toString().trim().split("\n").pop() ?? "null",
+    );
+    if (result) {
+      results.push(result);
+    } else {
+      missing.add(name);
+    }
+  }
+}
+
+// Speed relative to zip-bun, compress / decompress
+function relative(result: CompareResult, reference?: CompareResult): string {
+  if (!reference) return "";
+  const compress = result["compress MB/s"] / reference["compress MB/s"];
+  const decompress = result["decompress MB/s"] / reference["decompress MB/s"];
+  return `${compress.toFixed(2)}x / ${decompress.toFixed(2)}x`;
+}
+
+for (const set of new Set(results.map((result) => result.set))) {
+  const rows = results.filter((result) => result.set === set);
+  const reference = rows.find((result) => result.library === "zip-bun");
+  console.log(`\n${set}`);
+  console.table(
+    rows.map(({ set: _, ...result }) => ({
+      ...result,
+      "vs zip-bun": relative({ set, ...result }, reference),
+    })),
+  );
+}
+
+for (const name of missing) {
+  console.log(`\n${name} is not installed, skipped`);
+}
+
+await Bun.write(
+  values.out,
+  `${JSON.stringify(
+    {
+      date: new Date().toISOString(),
+      bun: Bun.version,
+      platform: `${process.platform}-${process.arch}`,
+      scale,
+      iterations,
+      results,
+    },
+    null,
+    2,
+  )}\n`,
+);
+console.log(`\nResults written to ${values.out}`);
@@ -0,0 +1,141 @@
+// Deterministic sample inputs shared by the benchmarks.
+
+const encoder = new TextEncoder();
+
+export function telemetry(lines: number): Uint8Array {
+  const rows: string[] = [];
+  for (let i = 0; i < lines; i++) {
+    rows.push(
+      JSON.stringify({
+        ts: 1_700_000_000 + i,
+        host: `node-${i % 8}`,
+        cpu: (i * 37) % 100,
+        mem: (i * 7) % 4096,
+        status: i % 97 === 0 ? "degraded" : "ok",
+      }),
+    );
+  }
+  return encoder.encode(rows.join("\n"));
+}
+
+export function prose(bytes: number): Uint8Array {
+  const words = [
+    "archive",
+    "deflate",
+    "entry",
+    "header",
+    "stream",
+    "buffer",
+    "native",
+    "the",
+    "of",
+    "and",
+  ];
+  let seed = 1;
+  const parts: string[] = [];
+  let length = 0;
+  while (length < bytes) {
+    seed = (seed * 1_103_515_245 + 12_345) >>> 0;
+    const word = words[seed % words.length] as string;
+    parts.push(word);
+    length += word.length + 1;
+  }
+  return encoder.encode(parts.join(" "));
+}
+
+export function sparse(bytes: number): Uint8Array {
+  const data = new Uint8Array(bytes);
+  for (let i = 0; i < bytes; i += 509) {
+    data[i] = i & 0xff;
+  }
+  return data;
+}
+
+// xorshift32, so every run sees the same bytes
+function random(seed: number): () => number {
+  let state = seed >>> 0 || 1;
+  return () => {
+    state ^= state << 13;
+    state ^= state >>> 17;
+    state ^= state << 5;
+    return state >>> 0;
+  };
+}
+
+export function noise(bytes: number, seed = 1): Uint8Array {
+  const next = random(seed);
+  const data = new Uint8Array(bytes);
+  const words = new Uint32Array(data.buffer, 0, bytes >>> 2);
+  for (let i = 0; i < words.length; i++) {
+    words[i] = next();
+  }
+  for (let i = words.length * 4; i < bytes; i++) {
+    data[i] = next() & 0xff;
+  }
+  return data;
+}
+
+// Fixed-size little-endian records, like a columnar dump or a game save:
+// slowly changing counters and ids next to noisy measurements
+export function records(bytes: number, seed = 1): Uint8Array {
+  const next = random(seed);
+  const data = new Uint8Array(bytes);
+  const view = new DataView(data.buffer);
+  for (let offset = 0, i = 0; offset + 16 <= bytes; offset += 16, i++) {
+    view.setUint32(offset, i, true);
+    view.setUint32(offset + 4, 1_700_000_000 + (i >>> 4), true);
+    view.setUint16(offset + 8, i % 251, true);
+    view.setUint16(offset + 10, next() & 0x3ff, true);
+    view.setFloat32(offset + 12, (next() & 0xffff) / 64, true);
+  }
+  return data;
+}
+
+export interface CorpusEntry {
+  filename: string;
+  data: Uint8Array;
+}
+
+/** Entry sets of the benchmark suite, scaled by `scale` (1 is the default). */
+export const corpusSets: Record<string, (scale: number) => CorpusEntry[]> = {
+  text: (scale) => [
+    { filename: "prose.txt", data: prose(Math.round(8_000_000 * scale)) },
+  ],
+  json: (scale) => [
+    {
+      filename: "telemetry.jsonl",
+      data: telemetry(Math.round(80_000 * scale)),
+    },
+  ],
+  binary: (scale) => [
+    { filename: "records.bin", data: records(Math.round(8_000_000 * scale)) },
+  ],
+  incompressible: (scale) => [
+    { filename: "noise.bin", data: noise(Math.round(8_000_000 * scale)) },
+  ],
+  tiny: (scale) =>
+    Array.from({ length: Math.round(5_000 * scale) }, (_, i) => ({
+      filename: `files/${i % 50}/${i}.json`,
+      data: encoder.encode(
+        JSON.stringify({
+          id: i,
+          name: `item-${i}`,
+          tags: ["alpha", "beta", "gamma"].slice(0, 1 + (i % 3)),
+          payload: "x".repeat((i * 37) % 700),
+        }),
+      ),
+    })),
+  huge: (scale) => [
+    { filename: "huge/prose.txt", data: prose(Math.round(64_000_000 * scale)) },
+    {
+      filename: "huge/records.bin",
+      data: records(Math.round(64_000_000 * scale), 2),
+    },
+  ],
+};
+
+export const corpus: Record<string, Uint8Array> = {
+  "telemetry.jsonl": telemetry(50_000),
+  "prose.txt": prose(4 * 1024 * 1024),
+  "sparse.bin": sparse(4 * 1024 * 1024),
+};
@@ -0,0 +1,44 @@
+#!/usr/bin/env bun
+
+// Extraction latency with each CRC mode. "deferred" returns the data as soon
+// as it is inflated; the total includes waiting for the background check.
+// Run with `bun run bench:crc`.
+
+import {
+  CompressionLevel,
+  type CrcMode,
+  createMemoryArchive,
+  openMemoryArchive,
+} from "../src/index.ts";
+import { prose } from "./corpus.ts";
+
+const data = prose(32 * 1024 * 1024);
+const writer = createMemoryArchive();
+writer.addFile("prose.txt", data, CompressionLevel.BEST_SPEED);
+const archive = writer.finalizeToMemory();
+
+const iterations = Number(process.env.BENCH_ITERATIONS ?? 10);
+const rows = [];
+for (const crc of ["verify", "skip", "deferred"] as CrcMode[]) {
+  const reader = openMemoryArchive(archive, { crc });
+  let latency = Number.POSITIVE_INFINITY;
+  let total = Number.POSITIVE_INFINITY;
+  for (let i = 0; i < iterations; i++) {
+    const start = Bun.nanoseconds();
+    reader.extractFile(0);
+    const returned = Bun.nanoseconds();
+    reader.verifyDeferred();
+    latency = Math.min(latency, returned - start);
+    total = Math.min(total, Bun.nanoseconds() - start);
+  }
+  reader.close();
+
+  rows.push({
+    crc,
+    "data ready ms": Number((latency / 1e6).toFixed(1)),
+    "checked ms": Number((total / 1e6).toFixed(1)),
+  });
+}
+
+console.log(`\nprose.txt (${(data.length / 1e6).toFixed(1)} MB)`);
+console.table(rows);
@@ -0,0 +1,326 @@
+#!/usr/bin/env bun
+
+// Benchmark suite covering every public operation over the corpus sets in
+// corpus.ts. Each set/operation case runs in its own process, so peak RSS is
+// that of the case alone. Run with `bun run bench`, optionally with:
+//   --filter <text>    only run cases whose "set/operation" name contains it
+//   --out <file>       where to write the JSON results (bench-results.json)
+//   --baseline <file>  compare against the results of an earlier run
+// BENCH_SCALE scales the corpus (default 1) and BENCH_ITERATIONS sets how
+// many times each case is repeated (default 3).
+
+import { mkdirSync, mkdtempSync, rmSync } from "node:fs";
+import { tmpdir } from "node:os";
+import { parseArgs } from "node:util";
+import {
+  CompressionLevel,
+  createArchive,
+  createMemoryArchive,
+  extractArchive,
+  getCodecBackend,
+  openArchive,
+  openMemoryArchive,
+  zipDirectory,
+} from "../src/index.ts";
+import { type CorpusEntry, corpusSets } from "./corpus.ts";
+
+const scale = Number(process.env.BENCH_SCALE ?? 1);
+const iterations = Number(process.env.BENCH_ITERATIONS ?? 3);
+const level = CompressionLevel.DEFAULT;
+
+interface CaseContext {
+  entries: CorpusEntry[];
+  /** The entries zipped in memory. */
+  archive: Uint8Array;
+  /** The same archive on disk. */
+  archiveFile: string;
+  /** A directory holding the entries as plain files. */
+  sourceDir: string;
+  /** A scratch directory, emptied before every iteration. */
+  workDir: string;
+  /** Time one operation that processes `bytes` bytes. */
+  measure<T>(bytes: number, fn: () => T): T;
+  /** Time one asynchronous operation that processes `bytes` bytes. */
+  measureAsync(bytes: number, fn: () => Promise<unknown>): Promise<void>;
+}
+
+function totalBytes(entries: CorpusEntry[]): number {
+  return entries.reduce((sum, entry) => sum + entry.data.length, 0);
+}
+
+function writeArchive(entries: CorpusEntry[]) {
+  const writer = createMemoryArchive();
+  for (const { filename, data } of entries) {
+    writer.addFile(filename, data, level);
+  }
+  return writer;
+}
+
+const operations: Record<string, (ctx: CaseContext) => unknown> = {
+  addFile: (ctx) => {
+    const writer = createMemoryArchive();
+    for (const { filename, data } of ctx.entries) {
+      ctx.measure(data.length, () => writer.addFile(filename, data, level));
+    }
+    writer.finalizeToMemory();
+  },
+  addFiles: (ctx) => {
+    const writer = createMemoryArchive();
+    ctx.measure(totalBytes(ctx.entries), () =>
+      writer.addFiles(ctx.entries, level),
+    );
+    writer.finalizeToMemory();
+  },
+  finalize: (ctx) => {
+    const writer = createArchive(`${ctx.workDir}/out.zip`);
+    for (const { filename, data } of ctx.entries) {
+      writer.addFile(filename, data, level);
+    }
+    ctx.measure(ctx.archive.length, () => writer.finalize());
+  },
+  finalizeToMemory: (ctx) => {
+    const writer = writeArchive(ctx.entries);
+    ctx.measure(ctx.archive.length, () => writer.finalizeToMemory());
+  },
+  openArchive: (ctx) => {
+    for (let i = 0; i < 20; i++) {
+      ctx.measure(0, () => openArchive(ctx.archiveFile)).close();
+    }
+  },
+  openMemoryArchive: (ctx) => {
+    for (let i = 0; i < 20; i++) {
+      ctx.measure(0, () => openMemoryArchive(ctx.archive)).close();
+    }
+  },
+  files: (ctx) => {
+    const reader = openMemoryArchive(ctx.archive);
+    for (let i = 0; i < 5; i++) {
+      ctx.measure(0, () => reader.files());
+    }
+    reader.close();
+  },
+  getFileByIndex: (ctx) => {
+    const reader = openMemoryArchive(ctx.archive);
+    for (let i = 0; i < ctx.entries.length; i++) {
+      ctx.measure(0, () => reader.getFileByIndex(i));
+    }
+    reader.close();
+  },
+  findFile: (ctx) => {
+    const reader = openMemoryArchive(ctx.archive);
+    for (const { filename } of ctx.entries) {
+      ctx.measure(0, () => reader.findFile(filename));
+    }
+    reader.close();
+  },
+  extractFile: (ctx) => {
+    const reader = openMemoryArchive(ctx.archive);
+    ctx.entries.forEach(({ data }, i) => {
+      ctx.measure(data.length, () => reader.extractFile(i));
+    });
+    reader.close();
+  },
+  extractFileByName: (ctx) => {
+    const reader = openArchive(ctx.archiveFile);
+    for (const { filename, data } of ctx.entries) {
+      ctx.measure(data.length, () => reader.extractFileByName(filename));
+    }
+    reader.close();
+  },
+  validate: (ctx) => {
+    const reader = openArchive(ctx.archiveFile);
+    ctx.measure(totalBytes(ctx.entries), () => reader.validate());
+    reader.close();
+  },
+  zipDirectory: (ctx) =>
+    ctx.measureAsync(totalBytes(ctx.entries), () =>
+      zipDirectory(ctx.sourceDir, `${ctx.workDir}/out.zip`, level),
+    ),
+  extractArchive: (ctx) =>
+    ctx.measureAsync(totalBytes(ctx.entries), () =>
+      extractArchive(ctx.archiveFile, ctx.workDir),
+    ),
+};
+
+interface CaseResult {
+  set: string;
+  operation: string;
+  ops: number;
+  "ops/s": number;
+  "MB/s": number | null;
+  "p50 ms": number;
+  "p99 ms": number;
+  "peak RSS MB": number;
+}
+
+function percentile(sorted: number[], fraction: number): number {
+  const index = Math.ceil(sorted.length * fraction) - 1;
+  return sorted[Math.min(Math.max(index, 0), sorted.length - 1)] ?? 0;
+}
+
+function round(value: number, digits = 3): number {
+  return Number(value.toFixed(digits));
+}
+
+// Child process: run a single case and print its result as JSON
+async function runCase(set: string, operation: string): Promise<CaseResult> {
+  const makeEntries = corpusSets[set];
+  const run = operations[operation];
+  if (!makeEntries || !run) {
+    throw new Error(`Unknown benchmark case: ${set}/${operation}`);
+  }
+
+  const entries = makeEntries(scale);
+  const root = mkdtempSync(`${tmpdir()}/zip-bun-bench-`);
+  const samples: number[] = [];
+  let bytes = 0;
+  let peakRss = 0;
+
+  try {
+    const archive = writeArchive(entries).finalizeToMemory();
+    const archiveFile = `${root}/archive.zip`;
+    await Bun.write(archiveFile, archive);
+
+    const sourceDir = `${root}/source`;
+    if (operation === "zipDirectory") {
+      for (const { filename, data } of entries) {
+        await Bun.write(`${sourceDir}/${filename}`, data);
+      }
+    }
+
+    const record = (start: number, size: number) => {
+      samples.push(Bun.nanoseconds() - start);
+      bytes += size;
+      peakRss = Math.max(peakRss, process.memoryUsage.rss());
+    };
+    const ctx: CaseContext = {
+      entries,
+      archive,
+      archiveFile,
+      sourceDir,
+      workDir: `${root}/work`,
+      measure(size, fn) {
+        const start = Bun.nanoseconds();
+        const result = fn();
+        record(start, size);
+        return result;
+      },
+      async measureAsync(size, fn) {
+        const start = Bun.nanoseconds();
+        await fn();
+        record(start, size);
+      },
+    };
+
+    for (let i = 0; i < iterations; i++) {
+      rmSync(ctx.workDir, { recursive: true, force: true });
+      mkdirSync(ctx.workDir);
+      await run(ctx);
+    }
+  } finally {
+    rmSync(root, { recursive: true, force: true });
+  }
+
+  // maxRSS is in kilobytes and also covers allocations freed before sampling
+  peakRss = Math.max(peakRss, process.resourceUsage().maxRSS * 1024);
+
+  const seconds = samples.reduce((sum, ns) => sum + ns, 0) / 1e9;
+  const sorted = samples.slice().sort((a, b) => a - b);
+  return {
+    set,
+    operation,
+    ops: samples.length,
+    "ops/s": round(samples.length / seconds, 1),
+    "MB/s": bytes ? round(bytes / 1e6 / seconds, 1) : null,
+    "p50 ms": round(percentile(sorted, 0.5) / 1e6, 4),
+    "p99 ms": round(percentile(sorted, 0.99) / 1e6, 4),
+    "peak RSS MB": round(peakRss / 1e6, 1),
+  };
+}
+
+// Relative change against the baseline, as a signed percentage
+function change(current: number | null, previous: number | null | undefined) {
+  if (current === null || !previous) return "";
+  const percent = ((current - previous) / previous) * 100;
+  return `${percent >= 0 ? "+" : ""}${percent.toFixed(1)}%`;
+}
+
+const { values } = parseArgs({
+  args: Bun.argv.slice(2),
+  options: {
+    case: { type: "string" },
+    filter: { type: "string" },
+    out: { type: "string", default: "bench-results.json" },
+    baseline: { type: "string" },
+  },
+});
+
+if (values.case) {
+  const [set = "", operation = ""] = values.case.split("/");
+  console.log(JSON.stringify(await runCase(set, operation)));
+  process.exit(0);
+}
+
+const results: CaseResult[] = [];
+for (const set of Object.keys(corpusSets)) {
+  for (const operation of Object.keys(operations)) {
+    const name = `${set}/${operation}`;
+    if (values.filter && !name.includes(values.filter)) continue;
+
+    const child = Bun.spawnSync(
+      [process.execPath, import.meta.path, "--case", name],
+      { stdout: "pipe", stderr: "inherit", env: process.env },
+    );
+    if (!child.success) {
+      throw new Error(`Benchmark case ${name} failed`);
+    }
+
+    const output = child.stdout.toString().trim().split("\n").pop() ?? "";
+    results.push(JSON.parse(output));
+    process.stderr.write(".");
+  }
+}
+process.stderr.write("\n");
+
+const baseline: CaseResult[] = values.baseline
+  ? (await Bun.file(values.baseline).json()).results
+  : [];
+
+for (const set of new Set(results.map((result) => result.set))) {
+  console.log(`\n${set}`);
+  console.table(
+    results
+      .filter((result) => result.set === set)
+      .map(({ set: _, ...result }) => {
+        const previous = baseline.find(
+          (other) => other.set === set && other.operation === result.operation,
+        );
+        return previous
+          ? {
+              ...result,
+              "vs ops/s": change(result["ops/s"], previous["ops/s"]),
+              "vs p99": change(result["p99 ms"], previous["p99 ms"]),
+            }
+          : result;
+      }),
+  );
+}
+
+await Bun.write(
+  values.out,
+  `${JSON.stringify(
+    {
+      date: new Date().toISOString(),
+      bun: Bun.version,
+      platform: `${process.platform}-${process.arch}`,
+      cpus: navigator.hardwareConcurrency,
+      codec: getCodecBackend(),
+      scale,
+      iterations,
+      results,
+    },
+    null,
+    2,
+  )}\n`,
+);
+console.log(`\nResults written to ${values.out}`);
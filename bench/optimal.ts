@@ -0,0 +1,67 @@
+#!/usr/bin/env bun
+
+// Ratio gain and cost of the optimal parse (MAX_COMPRESSION) against tdefl's
+// best levels, plus thread scaling of addFiles. Run with
+// `bun run bench:optimal`.
+
+import { CompressionLevel, createMemoryArchive } from "../src/index.ts";
+import { prose, telemetry } from "./corpus.ts";
+
+const samples: Record<string, Uint8Array> = {
+  "telemetry.jsonl": telemetry(10_000),
+  "prose.txt": prose(512 * 1024),
+  "miniz.c": await Bun.file(new URL("../src/miniz.c", import.meta.url)).bytes(),
+};
+
+const levels = {
+  "level 9": CompressionLevel.BEST_COMPRESSION,
+  "level 10 (uber)": CompressionLevel.UBER_COMPRESSION,
+  max: CompressionLevel.MAX_COMPRESSION,
+};
+
+for (const [name, data] of Object.entries(samples)) {
+  const rows = [];
+  let baseline = 0;
+  for (const [label, level] of Object.entries(levels)) {
+    const writer = createMemoryArchive();
+    const start = Bun.nanoseconds();
+    writer.addFile(name, data, level);
+    const seconds = (Bun.nanoseconds() - start) / 1e9;
+    const size = writer.getCompressionReport().bytesOut;
+    writer.finalizeToMemory();
+
+    baseline ||= size;
+    rows.push({
+      level: label,
+      bytes: size,
+      "vs level 9": `${(((size - baseline) / baseline) * 100).toFixed(2)}%`,
+      seconds: Number(seconds.toFixed(3)),
+      "MB/s": Number((data.length / 1e6 / seconds).toFixed(2)),
+    });
+  }
+
+  console.log(`\n${name} (${(data.length / 1e6).toFixed(2)} MB)`);
+  console.table(rows);
+}
+
+// addFiles spreads MAX_COMPRESSION entries over threads
+const entries = Object.entries(samples).flatMap(([name, data]) =>
+  [0, 1].map((copy) => ({ filename: `${copy}/${name}`, data })),
+);
+const scaling = [];
+for (const threads of [1, 2, 4, navigator.hardwareConcurrency]) {
+  const writer = createMemoryArchive();
+  const start = Bun.nanoseconds();
+  writer.addFiles(entries, {
+    level: CompressionLevel.MAX_COMPRESSION,
+    threads,
+  });
+  scaling.push({
+    threads,
+    seconds: Number(((Bun.nanoseconds() - start) / 1e9).toFixed(3)),
+  });
+  writer.finalizeToMemory();
+}
+
+console.log(`\naddFiles, ${entries.length} entries`);
+console.table(scaling);
@@ -0,0 +1,93 @@
+#!/usr/bin/env bun
+
+// Cold-start cost of zip-bun: every sample is a fresh process that imports
+// the library, optionally warms it up, then creates and reads a small
+// archive. Importing should be close to free, the native library is only
+// compiled on first use (or by warmup()). Run with `bun run bench:startup`;
+// BENCH_ITERATIONS sets the number of processes per case (default 5).
+
+import { parseArgs } from "node:util";
+
+const iterations = Number(process.env.BENCH_ITERATIONS ?? 5);
+
+interface Sample {
+  /** Time to import the package. */
+  import: number;
+  /** Time spent in warmup(), 0 without it. */
+  warmup: number;
+  /** Time to write and read back a one-entry archive. */
+  first: number;
+  /** Wall time of the whole process, as seen by the parent. */
+  process?: number;
+}
+
+// Child process: time the import and the first archive
+async function runCase(warm: boolean): Promise<Sample> {
+  let start = Bun.nanoseconds();
+  const zip = await import("../src/index.ts");
+  const imported = Bun.nanoseconds() - start;
+
+  start = Bun.nanoseconds();
+  if (warm) zip.warmup();
+  const warmedUp = Bun.nanoseconds() - start;
+
+  start = Bun.nanoseconds();
+  const writer = zip.createMemoryArchive();
+  writer.addFile("hello.txt", new TextEncoder().encode("Hello, World!"));
+  const reader = zip.openMemoryArchive(writer.finalizeToMemory());
+  reader.extractFile(0);
+  reader.close();
+  const first = Bun.nanoseconds() - start;
+
+  return { import: imported / 1e6, warmup: warmedUp / 1e6, first: first / 1e6 };
+}
+
+function median(values: number[]): number {
+  const sorted = values.slice().sort((a, b) => a - b);
+  return sorted[Math.floor(sorted.length / 2)] ?? 0;
+}
+
+const { values } = parseArgs({
+  args: Bun.argv.slice(2),
+  options: {
+    case: { type: "string" },
+  },
+});
+
+if (values.case) {
+  console.log(JSON.stringify(await runCase(values.case === "warmup")));
+  process.exit(0);
+}
+
+const rows = [];
+for (const name of ["lazy", "warmup"]) {
+  const samples: Sample[] = [];
+  for (let i = 0; i < iterations; i++) {
+    const start = Bun.nanoseconds();
+    const child = Bun.spawnSync(
+      [process.execPath, import.meta.path, "--case", name],
+      { stdout: "pipe", stderr: "inherit", env: process.env },
+    );
+    if (!child.success) {
+      throw new Error(`Startup case ${name} failed`);
+    }
+
+    const output = child.stdout.toString().trim().split("\n").pop() ?? "";
+    samples.push({
+      ...JSON.parse(output),
+      process: (Bun.nanoseconds() - start) / 1e6,
+    });
+  }
+
+  const column = (key: keyof Sample) =>
+    Number(median(samples.map((sample) => sample[key] ?? 0)).toFixed(2));
+  rows.push({
+    case: name,
+    "import ms": column("import"),
+    "warmup ms": column("warmup"),
+    "first archive ms": column("first"),
+    "process ms": column("process"),
+  });
+}
+
+console.table(rows);
@@ -0,0 +1,53 @@
+#!/usr/bin/env bun
+
+// Per-entry cost of adding many tiny files, where compressor setup rather
+// than compression dominates. Entries of up to 4KB reuse the deflate tables
+// of the previous one instead of clearing them, so the setup cost grows with
+// the entry instead of the tables. Run with `bun run bench:tiny`;
+// BENCH_SCALE scales the number of files (default 1) and BENCH_ITERATIONS
+// sets the number of runs per level (default 5).
+
+import { CompressionLevel, createMemoryArchive } from "../src/index.ts";
+import { corpusSets } from "./corpus.ts";
+
+const scale = Number(process.env.BENCH_SCALE ?? 1);
+const iterations = Number(process.env.BENCH_ITERATIONS ?? 5);
+
+const entries = corpusSets.tiny?.(scale) ?? [];
+const bytes = entries.reduce((sum, entry) => sum + entry.data.length, 0);
+
+const levels = {
+  fast: CompressionLevel.BEST_SPEED,
+  default: CompressionLevel.DEFAULT,
+  best: CompressionLevel.BEST_COMPRESSION,
+};
+
+const rows = [];
+for (const [name, level] of Object.entries(levels)) {
+  let total = Number.POSITIVE_INFINITY;
+  let deflate = Number.POSITIVE_INFINITY;
+  let size = 0;
+  for (let i = 0; i < iterations; i++) {
+    const writer = createMemoryArchive();
+    const start = Bun.nanoseconds();
+    for (const { filename, data } of entries) {
+      writer.addFile(filename, data, level);
+    }
+    total = Math.min(total, Bun.nanoseconds() - start);
+    deflate = Math.min(deflate, writer.getStats().deflateSeconds * 1e9);
+    size = writer.finalizeToMemory().length;
+  }
+
+  rows.push({
+    level: name,
+    "entries/s": Math.round(entries.length / (total / 1e9)),
+    "us/entry": Number((total / entries.length / 1e3).toFixed(2)),
+    "deflate us/entry": Number((deflate / entries.length / 1e3).toFixed(2)),
+    ratio: Number((size / bytes).toFixed(3)),
+  });
+}
+
+console.log(
+  `${entries.length} entries, ${Math.round(bytes / entries.length)} bytes on average`,
+);
+console.table(rows);
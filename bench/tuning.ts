@@ -0,0 +1,66 @@
+#!/usr/bin/env bun
+
+// Speed/ratio matrix over the deflate tuning surface (levels, strategies,
+// probe counts and parsing mode). Run with `bun run bench:tuning`.
+
+import {
+  type AddFileOptions,
+  CompressionStrategy,
+  createMemoryArchive,
+} from "../src/index.ts";
+import { corpus } from "./corpus.ts";
+
+const configurations: Record<string, AddFileOptions> = {
+  "level 1": { level: 1 },
+  "level 3": { level: 3 },
+  "level 6": { level: 6 },
+  "level 9": { level: 9 },
+  "level 10 (uber)": { level: 10 },
+  "6 filtered": { level: 6, strategy: CompressionStrategy.FILTERED },
+  "6 huffman-only": { level: 6, strategy: CompressionStrategy.HUFFMAN_ONLY },
+  "6 rle": { level: 6, strategy: CompressionStrategy.RLE },
+  "6 fixed": { level: 6, strategy: CompressionStrategy.FIXED },
+  "6 greedy": { level: 6, greedy: true },
+  "9 lazy, 4 probes": { level: 9, probes: 4 },
+  "9 lazy, 4095 probes": { level: 9, probes: 4095 },
+};
+
+const iterations = Number(process.env.BENCH_ITERATIONS ?? 3);
+
+for (const [name, data] of Object.entries(corpus)) {
+  const rows = [];
+  for (const [label, options] of Object.entries(configurations)) {
+    let best = Number.POSITIVE_INFINITY;
+    let compressed = 0;
+    for (let i = 0; i < iterations; i++) {
+      const writer = createMemoryArchive();
+      const start = Bun.nanoseconds();
+      writer.addFile(name, data, options);
+      best = Math.min(best, Bun.nanoseconds() - start);
+      compressed = writer.getCompressionReport().bytesOut;
+      writer.finalizeToMemory();
+    }
+    rows.push({
+      configuration: label,
+      "MB/s": Number((data.length / 1e6 / (best / 1e9)).toFixed(1)),
+      ratio: Number((compressed / data.length).toFixed(4)),
+    });
+  }
+
+  // Mark the configurations no other one beats on both speed and size
+  const frontier = rows.map(
+    (row) =>
+      !rows.some(
+        (other) =>
+          other !== row &&
+          other["MB/s"] >= row["MB/s"] &&
+          other.ratio <= row.ratio &&
+          (other["MB/s"] > row["MB/s"] || other.ratio < row.ratio),
+      ),
+  );
+
+  console.log(`\n${name} (${(data.length / 1e6).toFixed(1)} MB)`);
+  console.table(
+    rows.map((row, i) => ({ ...row, frontier: frontier[i] ? "*" : "" })),
+  );
+}
@@ -0,0 +1,46 @@
+#!/usr/bin/env bun
+
+// Thread scaling of reader.validate() on a file-backed archive, with full
+// data checks and with headers only. Run with `bun run bench:validate`.
+
+import { tmpdir } from "node:os";
+import { createArchive, openArchive } from "../src/index.ts";
+import { prose, telemetry } from "./corpus.ts";
+
+const filename = `${tmpdir()}/zip-bun-validate.zip`;
+const writer = createArchive(filename);
+let bytes = 0;
+for (let i = 0; i < 64; i++) {
+  const data = i % 2 ? prose(2 * 1024 * 1024) : telemetry(10_000);
+  writer.addFile(`${i}.dat`, data);
+  bytes += data.length;
+}
+writer.finalize();
+
+const reader = openArchive(filename);
+const rows = [];
+for (const threads of [1, 2, 4, navigator.hardwareConcurrency]) {
+  const row: Record<string, number> = { threads };
+  for (const headersOnly of [false, true]) {
+    const start = Bun.nanoseconds();
+    const result = reader.validate({ threads, headersOnly });
+    const seconds = (Bun.nanoseconds() - start) / 1e9;
+    if (!result.valid) {
+      throw new Error("Benchmark archive failed validation");
+    }
+
+    const ms = Number((seconds * 1e3).toFixed(1));
+    if (headersOnly) {
+      row["headers ms"] = ms;
+    } else {
+      row["full ms"] = ms;
+      row["MB/s"] = Number((bytes / 1e6 / seconds).toFixed(1));
+    }
+  }
+  rows.push(row);
+}
+reader.close();
+await Bun.file(filename).delete();
+
+console.log(`\n64 entries, ${(bytes / 1e6).toFixed(1)} MB uncompressed`);
+console.table(rows);
@@ -0,0 +1,107 @@
+import { readFileSync, writeFileSync } from "node:fs";
+import type { AccessRecord } from "./interfaces/reader.ts";
+
+/** "ZBAT" read as a little-endian u32, at the start of a trace file. */
+const TRACE_MAGIC = 0x5441425a;
+/** Version of the trace file layout. */
+const TRACE_VERSION = 1;
+/** Size of the magic and version. */
+const TRACE_HEADER_SIZE = 8;
+/** Size of a record: the entry index and the time, both u32. */
+const TRACE_RECORD_SIZE = 8;
+
+/**
+ * Collects the first access of each entry of a reader, saved to the trace
+ * file when the reader is closed.
+ */
+export class AccessTrace {
+  /** When the reader was opened, in performance.now() milliseconds. */
+  private start = performance.now();
+  /** Indices already recorded. */
+  private seen = new Set<number>();
+  /** The accesses recorded so far, in order. */
+  private records: AccessRecord[] = [];
+
+  /**
+   * @param path - The trace file to save to.
+   */
+  constructor(private path: string) {}
+
+  /**
+   * Records an access to an entry, unless it was already accessed.
+   * @param index - The zero-based index of the entry.
+   */
+  record(index: number): void {
+    if (this.seen.has(index)) {
+      return;
+    }
+    this.seen.add(index);
+    this.records.push({ index, time: performance.now() - this.start });
+  }
+
+  /**
+   * Writes the recorded accesses to the trace file.
+   */
+  save(): void {
+    writeAccessTrace(this.path, this.records);
+  }
+}
+
+/**
+ * Writes an access trace file: an 8-byte header followed by 8 bytes per
+ * record, the entry index and the time in whole milliseconds.
+ * @param path - The trace file to write.
+ * @param records - The accesses, in order.
+ */
+export function writeAccessTrace(path: string, records: AccessRecord[]): void {
+  const view = new DataView(
+    new ArrayBuffer(TRACE_HEADER_SIZE + records.length * TRACE_RECORD_SIZE),
+  );
+  view.setUint32(0, TRACE_MAGIC, true);
+  view.setUint32(4, TRACE_VERSION, true);
+  for (const [i, record] of records.entries()) {
+    const offset = TRACE_HEADER_SIZE + i * TRACE_RECORD_SIZE;
+    view.setUint32(offset, record.index, true);
+    view.setUint32(
+      offset + 4,
+      Math.min(Math.round(record.time), 0xffffffff),
+      true,
+    );
+  }
+  writeFileSync(path, new Uint8Array(view.buffer));
+}
+
+/**
+ * Reads an access trace file written by a reader opened with the
+ * `accessTrace` option.
+ * @param path - The trace file.
+ * @returns The accesses, in the order they happened.
+ * @throws Error if the file cannot be read or is not an access trace.
+ */
+export function readAccessTrace(path: string): AccessRecord[] {
+  const data = readFileSync(path);
+  const view = new DataView(data.buffer, data.byteOffset, data.byteLength);
+  if (
+    data.length < TRACE_HEADER_SIZE ||
+    (data.length - TRACE_HEADER_SIZE) % TRACE_RECORD_SIZE !== 0 ||
+    view.getUint32(0, true) !== TRACE_MAGIC
+  ) {
+    throw new Error(`Not an access trace: ${path}`);
+  }
+  if (view.getUint32(4, true) !== TRACE_VERSION) {
+    throw new Error(`Unsupported access trace version: ${path}`);
+  }
+
+  const records: AccessRecord[] = [];
+  for (
+    let offset = TRACE_HEADER_SIZE;
+    offset < data.length;
+    offset += TRACE_RECORD_SIZE
+  ) {
+    records.push({
+      index: view.getUint32(offset, true),
+      time: view.getUint32(offset + 4, true),
+    });
+  }
+  return records;
+}
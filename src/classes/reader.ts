@@ -1,17 +1,70 @@
 import { ptr } from "bun:ffi";
+import { AccessTrace } from "../access.ts";
+import { ZipLimitError } from "../errors.ts";
 import type { FileData, ZipFile } from "../interfaces/file.ts";
-import type { ZipReader } from "../interfaces/reader.ts";
-import { symbols } from "../symbols.ts";
-
-const {
-  open_zip,
-  open_zip_from_memory,
-  find_file,
-  get_file_count,
-  get_file_info,
-  extract_file_to_buffer,
-  close_zip,
-} = symbols;
+import type { ProgressOptions } from "../interfaces/progress.ts";
+import type {
+  CrcMode,
+  ExtractLimit,
+  ExtractLimits,
+  ExtractOptions,
+  ValidateOptions,
+  ValidationFailure,
+  ValidationFailureReason,
+  ValidationResult,
+  ZipReader,
+  ZipReaderOptions,
+} from "../interfaces/reader.ts";
+import type { ZipStats } from "../interfaces/stats.ts";
+import type { TraceSpan } from "../interfaces/tracing.ts";
+import {
+  pinData,
+  trackHandle,
+  unpinData,
+  untrackHandle,
+} from "../memory.ts";
+import { hasProgress, withProgress } from "../progress.ts";
+import { decodeString, NameBuffer } from "../scratch.ts";
+import { readHandleStats } from "../stats.ts";
+import { native } from "../symbols.ts";
+import { startSpan, traceCallback, traced } from "../tracing.ts";
+
+/** Native values of each CRC mode passed to extract_file_to_buffer. */
+const CRC_MODES: Record<CrcMode, number> = {
+  verify: 0,
+  skip: 1,
+  deferred: 2,
+};
+
+/** Failed entries named in a deferred CRC error. */
+const MAX_REPORTED_CRC_FAILURES = 16;
+
+/** Failure reasons by the native code reported by validate_zip. */
+const VALIDATION_REASONS: ValidationFailureReason[] = [
+  "header",
+  "unsupported",
+  "password",
+  "data",
+  "read",
+];
+
+/** Budgets by the native code reported for a failed extraction, with their message. */
+const LIMIT_ERRORS: [ExtractLimit, string][] = [
+  ["entrySize", "Entry exceeds the size limit"],
+  ["totalSize", "Extraction would exceed the total size limit"],
+  ["ratio", "Entry exceeds the compression ratio limit"],
+  ["deadline", "Extraction deadline has passed"],
+];
+
+/**
+ * file_info_t filled by get_file_info. Calls are synchronous, so every reader
+ * shares one struct instead of allocating it per lookup.
+ */
+const fileInfo = new ArrayBuffer(1024);
+const fileInfoPtr = ptr(fileInfo);
+const fileInfoView = new DataView(fileInfo);
+const fileInfoName = new Uint8Array(fileInfo, 0, 256);
+const fileInfoComment = new Uint8Array(fileInfo, 256, 256);
 
 /**
  * Implementation of {@link ZipReader} for reading and extracting files from ZIP archives.
@@ -37,23 +90,57 @@ const {
 export class ZipArchiveReader implements ZipReader {
   /** Internal handle ID for the native zip archive. */
   private handleId: number;
+  /** Default CRC mode of extractions. */
+  private crcMode: CrcMode = "verify";
+  /**
+   * Whether extracted data is pinned (see pinData) until the CRC checks of
+   * the `deferred` mode are waited for.
+   */
+  private deferred = false;
+  /** Counters captured when the native handle was released. */
+  private finalStats?: ZipStats;
+  /**
+   * Data of a memory-based archive, which the native side reads in place, so
+   * it stays referenced for as long as the reader is open.
+   */
+  private source?: Uint8Array;
+  /** Path of a file-based archive, mapped by mapFile. */
+  private path?: string;
+  /** The archive file mapped into memory, once mapFile needs it. */
+  private mapping?: Uint8Array;
+  /** Scratch buffer the names of lookups are encoded into. */
+  private names = new NameBuffer();
+  /** Whether extraction budgets are set, checked before each extraction. */
+  private limited = false;
+  /** The access trace being recorded, with the accessTrace option. */
+  private trace?: AccessTrace;
 
   /**
    * Creates a new ZIP archive reader.
    * @param filenameOrData - Either a file path (string) or binary data (Uint8Array, ArrayBuffer, or DataView)
+   * @param options - Optional reader settings such as the password.
    * @throws Error if the archive cannot be opened or is invalid.
    */
-  constructor(filenameOrData: string | FileData) {
+  constructor(
+    filenameOrData: string | FileData,
+    options: ZipReaderOptions = {},
+  ) {
+    if (options.crc !== undefined) {
+      this.crcMode = options.crc;
+      this.getCrcMode();
+    }
+
     if (typeof filenameOrData === "string") {
       // File-based zip
       const filenameBuffer = Buffer.from(`${filenameOrData}\0`, "utf8");
       const filenamePtr = ptr(filenameBuffer);
 
-      this.handleId = open_zip(filenamePtr);
+      this.handleId = native().open_zip(filenamePtr);
 
       if (this.handleId < 0) {
         throw new Error(`Failed to open zip archive: ${filenameOrData}`);
       }
+      this.path = filenameOrData;
     } else {
       // Memory-based zip
       let dataLength = 0;
@@ -62,10 +149,12 @@ export class ZipArchiveReader implements ZipReader {
       if (filenameOrData instanceof Uint8Array) {
         dataLength = filenameOrData.length;
         dataPtr = ptr(filenameOrData);
+        this.source = filenameOrData;
       } else if (filenameOrData instanceof ArrayBuffer) {
         dataLength = filenameOrData.byteLength;
         const buffer = new Uint8Array(filenameOrData);
         dataPtr = ptr(buffer);
+        this.source = buffer;
       } else if (filenameOrData instanceof DataView) {
         dataLength = filenameOrData.byteLength;
         const buffer = new Uint8Array(
@@ -74,15 +163,41 @@ export class ZipArchiveReader implements ZipReader {
           filenameOrData.byteLength,
         );
         dataPtr = ptr(buffer);
+        this.source = buffer;
       } else {
         throw new Error("Unsupported data type for memory-based zip archive");
       }
 
-      this.handleId = open_zip_from_memory(dataPtr, dataLength);
+      this.handleId = native().open_zip_from_memory(dataPtr, dataLength);
       if (this.handleId < 0) {
         throw new Error("Failed to open memory-based zip archive");
       }
     }
+    trackHandle(this, this.handleId);
+
+    if (options.password !== undefined) {
+      this.setPassword(options.password);
+    }
+    if (options.limits) {
+      this.setLimits(options.limits);
+    }
+    if (options.accessTrace !== undefined) {
+      this.trace = new AccessTrace(options.accessTrace);
+    }
+  }
+
+  /**
+   * Resolves the native CRC mode of an extraction.
+   * @param options - The per-call options, if any.
+   * @returns The value passed to extract_file_to_buffer.
+   * @throws Error if the mode is unknown.
+   */
+  private getCrcMode(options?: ExtractOptions): number {
+    const mode = options?.crc ?? this.crcMode;
+    if (!Object.hasOwn(CRC_MODES, mode)) {
+      throw new Error(`Invalid CRC mode: ${mode}`);
+    }
+    return CRC_MODES[mode];
   }
 
   /**
@@ -131,7 +246,7 @@ export class ZipArchiveReader implements ZipReader {
    * @returns The number of files in the archive.
    */
   getFileCount(): number {
-    return get_file_count(this.handleId);
+    return native().get_file_count(this.handleId);
   }
 
   /**
@@ -141,34 +256,22 @@ export class ZipArchiveReader implements ZipReader {
    * @throws Error if the file info cannot be retrieved.
    */
   getFileByIndex(index: number): ZipFile {
-    // Create a buffer for the file_info_t struct
-    const infoBuffer = new ArrayBuffer(1024); // Size for file_info_t struct
-    const infoPtr = ptr(infoBuffer);
-
-    const success = get_file_info(this.handleId, index, infoPtr);
+    const success = native().get_file_info(this.handleId, index, fileInfoPtr);
     if (!success) {
       throw new Error(`Failed to get file info for index ${index}`);
     }
 
-    // Read the struct data
-    const view = new DataView(infoBuffer);
-    const decoder = new TextDecoder();
-
-    // Read filename (first 256 bytes)
-    const filenameBytes = new Uint8Array(infoBuffer, 0, 256);
-    const filename = decoder.decode(filenameBytes).replace(/\0/g, "");
-
-    // Read comment (next 256 bytes)
-    const commentBytes = new Uint8Array(infoBuffer, 256, 256);
-    const comment = decoder.decode(commentBytes).replace(/\0/g, "");
+    // Filename and comment are the first two 256-byte fields
+    const filename = decodeString(fileInfoName);
+    const comment = decodeString(fileInfoComment);
 
     // Read sizes (assuming size_t is 8 bytes on 64-bit systems)
-    const uncompressedSize = Number(view.getBigUint64(512, true));
-    const compressedSize = Number(view.getBigUint64(520, true));
+    const uncompressedSize = Number(fileInfoView.getBigUint64(512, true));
+    const compressedSize = Number(fileInfoView.getBigUint64(520, true));
 
     // Read flags
-    const directory = Boolean(view.getInt32(528, true));
-    const encrypted = Boolean(view.getInt32(532, true));
+    const directory = Boolean(fileInfoView.getInt32(528, true));
+    const encrypted = Boolean(fileInfoView.getInt32(532, true));
 
     return {
       filename,
@@ -184,120 +287,190 @@ export class ZipArchiveReader implements ZipReader {
    * Reads a file from the archive by index as a Uint8Array.
    * Alias for {@link extractFile}.
    * @param index - The zero-based index of the file to read.
+   * @param options - Optional per-call settings such as the CRC mode.
    * @returns The decompressed file content as Uint8Array.
    */
-  readFile(index: number): Uint8Array {
-    return this.extractFile(index);
+  readFile(index: number, options?: ExtractOptions): Uint8Array {
+    return this.extractFile(index, options);
   }
 
   /**
    * Reads a file from the archive by its filename as a Uint8Array.
    * Alias for {@link extractFileByName}.
    * @param filename - The name/path of the file within the archive.
+   * @param options - Optional per-call settings such as the CRC mode.
    * @returns The decompressed file content as Uint8Array.
    * @throws Error if the file is not found in the archive.
    */
-  readFileByName(filename: string): Uint8Array {
-    return this.extractFileByName(filename);
+  readFileByName(filename: string, options?: ExtractOptions): Uint8Array {
+    return this.extractFileByName(filename, options);
   }
 
   /**
    * Reads a file from the archive by index as an ArrayBuffer.
    * Alias for {@link extractFileArrayBuffer}.
    * @param index - The zero-based index of the file to read.
+   * @param options - Optional per-call settings such as the CRC mode.
    * @returns The decompressed file content as ArrayBuffer.
    */
-  readFileArrayBuffer(index: number): ArrayBuffer {
-    return this.extractFileArrayBuffer(index);
+  readFileArrayBuffer(index: number, options?: ExtractOptions): ArrayBuffer {
+    return this.extractFileArrayBuffer(index, options);
   }
 
   /**
    * Reads a file from the archive by index as a Node.js Buffer.
    * Alias for {@link extractFileBuffer}.
    * @param index - The zero-based index of the file to read.
+   * @param options - Optional per-call settings such as the CRC mode.
    * @returns The decompressed file content as Buffer.
    */
-  readFileBuffer(index: number): Buffer {
-    return this.extractFileBuffer(index);
+  readFileBuffer(index: number, options?: ExtractOptions): Buffer {
+    return this.extractFileBuffer(index, options);
   }
 
   /**
    * Extracts a file from the archive by its filename as a Uint8Array.
    * @param filename - The name/path of the file within the archive.
+   * @param options - Optional per-call settings such as the CRC mode.
    * @returns The decompressed file content as Uint8Array.
    * @throws Error if the file is not found in the archive or extraction fails.
    */
-  extractFileByName(filename: string): Uint8Array {
-    // First find the file index
-    const filenameBuffer = Buffer.from(`${filename}\0`, "utf8");
-    const filenamePtr = ptr(filenameBuffer);
-    const fileIndex = find_file(this.handleId, filenamePtr);
-
-    if (fileIndex < 0) {
-      throw new Error(`File not found in archive: ${filename}`);
+  extractFileByName(filename: string, options?: ExtractOptions): Uint8Array {
+    const crcMode = this.getCrcMode(options);
+    if (!traceCallback) {
+      return this.extractByName(filename, crcMode, options);
     }
 
-    // Get file info to know the size
-    const infoBuffer = new ArrayBuffer(1024);
-    const infoPtr = ptr(infoBuffer);
-    const success = get_file_info(this.handleId, fileIndex, infoPtr);
+    const span = startSpan("extract", filename);
+    return traced(span, () =>
+      this.extractByName(filename, crcMode, options, span),
+    );
+  }
 
-    if (!success) {
-      throw new Error(`Failed to get file info for: ${filename}`);
+  /**
+   * Extracts a file from the archive by index as a Uint8Array.
+   * @param index - The zero-based index of the file to extract.
+   * @param options - Optional per-call settings such as the CRC mode.
+   * @returns The decompressed file content as Uint8Array.
+   * @throws Error if the file info cannot be retrieved or extraction fails.
+   */
+  extractFile(index: number, options?: ExtractOptions): Uint8Array {
+    const crcMode = this.getCrcMode(options);
+    if (!traceCallback) {
+      return this.extractEntry(index, crcMode, ` at index ${index}`, options);
     }
 
-    // Read the uncompressed size from the struct
-    const view = new DataView(infoBuffer);
-    const size = Number(view.getBigUint64(512, true));
+    const span = startSpan("extract");
+    return traced(span, () =>
+      this.extractEntry(index, crcMode, ` at index ${index}`, options, span),
+    );
+  }
 
-    // Create buffer and extract directly to it
-    const data = new Uint8Array(size);
-    const result = extract_file_to_buffer(
+  /**
+   * Locates an entry by name and extracts it.
+   * @param filename - The name/path of the file within the archive.
+   * @param crcMode - The native CRC mode.
+   * @param progress - The progress callback and abort signal, if any.
+   * @param span - The trace span to fill in, when tracing.
+   * @returns The decompressed file content.
+   * @throws Error if the file is not found in the archive or extraction fails.
+   */
+  private extractByName(
+    filename: string,
+    crcMode: number,
+    progress?: ProgressOptions,
+    span?: TraceSpan,
+  ): Uint8Array {
+    const fileIndex = native().find_file(
       this.handleId,
-      fileIndex,
-      ptr(data),
-      size,
+      this.names.encode(filename),
     );
 
-    if (result < 0) {
-      throw new Error(`Failed to extract file: ${filename}`);
+    if (fileIndex < 0) {
+      throw new Error(`File not found in archive: ${filename}`);
     }
-
-    return data;
+    return this.extractEntry(
+      fileIndex,
+      crcMode,
+      `: ${filename}`,
+      progress,
+      span,
+    );
   }
 
   /**
-   * Extracts a file from the archive by index as a Uint8Array.
-   * @param index - The zero-based index of the file to extract.
-   * @returns The decompressed file content as Uint8Array.
-   * @throws Error if the file info cannot be retrieved or extraction fails.
+   * Extracts an entry into a new buffer sized from its file info.
+   * @param index - The zero-based index of the entry.
+   * @param crcMode - The native CRC mode.
+   * @param label - Names the entry in error messages.
+   * @param progress - The progress callback and abort signal, if any.
+   * @param span - The trace span to fill in, when tracing.
+   * @returns The decompressed file content.
+   * @throws Error if the file info cannot be retrieved or extraction fails,
+   * or the signal's reason if it was aborted.
    */
-  extractFile(index: number): Uint8Array {
+  private extractEntry(
+    index: number,
+    crcMode: number,
+    label: string,
+    progress?: ProgressOptions,
+    span?: TraceSpan,
+  ): Uint8Array {
+    if (progress && hasProgress(progress)) {
+      return withProgress(this.handleId, progress, () =>
+        this.extractEntry(index, crcMode, label, undefined, span),
+      );
+    }
+
+    // Refuse entries over budget before allocating their output
+    if (this.limited) {
+      this.throwIfOverLimit(
+        native().check_extract_limits(this.handleId, index),
+        label,
+      );
+    }
+
     // Get file info to know the size
-    const infoBuffer = new ArrayBuffer(1024);
-    const infoPtr = ptr(infoBuffer);
-    const success = get_file_info(this.handleId, index, infoPtr);
+    const success = native().get_file_info(this.handleId, index, fileInfoPtr);
 
     if (!success) {
-      throw new Error(`Failed to get file info for index ${index}`);
+      throw new Error(`Failed to get file info${label}`);
     }
 
     // Read the uncompressed size from the struct
-    const view = new DataView(infoBuffer);
-    const size = Number(view.getBigUint64(512, true));
+    const size = Number(fileInfoView.getBigUint64(512, true));
+
+    if (span) {
+      span.name ??= decodeString(fileInfoName);
+      span.index = index;
+      span.bytesIn = Number(fileInfoView.getBigUint64(520, true));
+      span.bytesOut = size;
+    }
 
     // Create buffer and extract directly to it
     const data = new Uint8Array(size);
-    const result = extract_file_to_buffer(
+    const result = native().extract_file_to_buffer(
       this.handleId,
       index,
       ptr(data),
       size,
+      crcMode,
     );
 
     if (result < 0) {
-      throw new Error(`Failed to extract file at index ${index}`);
+      if (this.limited) {
+        this.throwIfOverLimit(
+          native().get_limit_violation(this.handleId),
+          label,
+        );
+      }
+      throw new Error(`Failed to extract file${label}`);
+    }
+    if (crcMode === CRC_MODES.deferred) {
+      pinData(this.handleId, data);
+      this.deferred = true;
     }
+    this.trace?.record(index);
 
     return data;
   }
@@ -305,20 +478,22 @@ export class ZipArchiveReader implements ZipReader {
   /**
    * Extracts a file from the archive by index as a Node.js Buffer.
    * @param index - The zero-based index of the file to extract.
+   * @param options - Optional per-call settings such as the CRC mode.
    * @returns The decompressed file content as Buffer.
    */
-  extractFileBuffer(index: number): Buffer {
-    const data = this.extractFile(index);
+  extractFileBuffer(index: number, options?: ExtractOptions): Buffer {
+    const data = this.extractFile(index, options);
     return Buffer.from(data);
   }
 
   /**
    * Extracts a file from the archive by index as an ArrayBuffer.
    * @param index - The zero-based index of the file to extract.
+   * @param options - Optional per-call settings such as the CRC mode.
    * @returns The decompressed file content as ArrayBuffer.
    */
-  extractFileArrayBuffer(index: number): ArrayBuffer {
-    const data = this.extractFile(index);
+  extractFileArrayBuffer(index: number, options?: ExtractOptions): ArrayBuffer {
+    const data = this.extractFile(index, options);
 
     return data.buffer.slice(
       data.byteOffset,
@@ -326,29 +501,277 @@ export class ZipArchiveReader implements ZipReader {
     ) as ArrayBuffer;
   }
 
+  /**
+   * Gets the data of a stored (uncompressed, unencrypted) entry without
+   * copying it. File-based archives are mapped with `Bun.mmap` on first use,
+   * privately, so writing to a view never reaches the file.
+   * @param index - The zero-based index of the file.
+   * @returns A view of the entry data, valid after the reader is closed.
+   * @throws Error if the entry is compressed or encrypted, or cannot be read.
+   */
+  mapFile(index: number): Uint8Array {
+    const offset = native().get_entry_data_offset(this.handleId, index);
+    if (offset < 0) {
+      throw new Error(
+        `Entry at index ${index} is not stored uncompressed and cannot be mapped`,
+      );
+    }
+
+    const { compressedSize } = this.getFileByIndex(index);
+    const archive =
+      this.source ??
+      (this.mapping ??= Bun.mmap(this.path as string, { shared: false }));
+    this.trace?.record(index);
+    return archive.subarray(offset, offset + compressedSize);
+  }
+
   /**
    * Finds a file in the archive by its filename.
    * @param filename - The name/path of the file to find.
    * @returns The zero-based index of the file, or -1 if not found.
    */
   findFile(filename: string): number {
-    const filenameBuffer = Buffer.from(`${filename}\0`, "utf8");
-    const filenamePtr = ptr(filenameBuffer);
-    return find_file(this.handleId, filenamePtr);
+    const filenamePtr = this.names.encode(filename);
+    if (!traceCallback) {
+      return native().find_file(this.handleId, filenamePtr);
+    }
+
+    const span = startSpan("locate", filename);
+    return traced(span, () => {
+      span.index = native().find_file(this.handleId, filenamePtr);
+      return span.index;
+    });
+  }
+
+  /**
+   * Sets the password used to decrypt WinZip AES encrypted entries. Keys
+   * derived for an entry are cached, so reading it again is cheap.
+   * @param password - The password, or undefined to forget it.
+   * @throws Error if the password cannot be set.
+   */
+  setPassword(password: string | undefined): void {
+    const passwordBuffer = Buffer.from(`${password ?? ""}\0`, "utf8");
+    if (!native().set_password(this.handleId, ptr(passwordBuffer), 0, 0)) {
+      throw new Error("Failed to set archive password");
+    }
+  }
+
+  /**
+   * Replaces the extraction budgets. The total size starts counting again
+   * from zero, and an extraction that would exceed a budget throws a
+   * {@link ZipLimitError}.
+   * @param limits - The new budgets, or an empty object to remove them.
+   * @throws Error if a limit is negative or not a number.
+   */
+  setLimits(limits: ExtractLimits): void {
+    for (const key of ["maxEntrySize", "maxTotalSize", "maxRatio"] as const) {
+      const value = limits[key];
+      if (value !== undefined && !(value >= 0)) {
+        throw new Error(`Invalid ${key} limit: ${value}`);
+      }
+    }
+
+    const deadline =
+      limits.deadline === undefined ? undefined : Number(limits.deadline);
+    if (deadline !== undefined && Number.isNaN(deadline)) {
+      throw new Error(`Invalid deadline: ${limits.deadline}`);
+    }
+
+    const success = native().set_extract_limits(
+      this.handleId,
+      limits.maxEntrySize ?? 0,
+      limits.maxTotalSize ?? 0,
+      limits.maxRatio ?? 0,
+      deadline === undefined ? -1 : Math.max(deadline - Date.now(), 0),
+    );
+    if (!success) {
+      throw new Error("Failed to set extraction limits");
+    }
+
+    this.limited = Boolean(
+      limits.maxEntrySize ||
+        limits.maxTotalSize ||
+        limits.maxRatio ||
+        deadline !== undefined,
+    );
+  }
+
+  /**
+   * Throws the error of a budget the native layer reported as exceeded.
+   * @param violation - The native code of the budget, 0 if none.
+   * @param label - Names the entry in the error message.
+   * @throws ZipLimitError if a budget was exceeded.
+   */
+  private throwIfOverLimit(violation: number, label: string): void {
+    const error = LIMIT_ERRORS[violation - 1];
+    if (error) {
+      throw new ZipLimitError(error[0], `${error[1]}${label}`);
+    }
+  }
+
+  /**
+   * Waits for the CRC checks of entries extracted with the `deferred` CRC
+   * mode, after which their data is no longer referenced by the reader.
+   * @throws Error naming the entries whose data did not match its CRC.
+   */
+  verifyDeferred(): void {
+    const failureBuffer = new Int32Array(MAX_REPORTED_CRC_FAILURES);
+    const failed = native().wait_deferred_crc(
+      this.handleId,
+      ptr(failureBuffer),
+      failureBuffer.length,
+    );
+    unpinData(this.handleId);
+    this.deferred = false;
+
+    if (failed < 0) {
+      throw new Error("Failed to wait for deferred CRC checks");
+    }
+    if (failed > 0) {
+      const names = Array.from(
+        failureBuffer.subarray(0, Math.min(failed, failureBuffer.length)),
+        (index) => this.getFileByIndex(index).filename,
+      );
+      throw new Error(
+        `CRC mismatch in ${failed} deferred entries: ${names.join(", ")}`,
+      );
+    }
+  }
+
+  /**
+   * Checks the integrity of every entry. Entries are spread over native
+   * threads, each with its own decoder and positioned reads, so large archives
+   * verify at close to the combined speed of all cores.
+   * @param options - Optional thread count, header-only mode and failure limit.
+   * @returns The entries checked and the failures found, ordered by index.
+   * @throws Error if the options are invalid or the archive cannot be validated.
+   */
+  validate(options: ValidateOptions = {}): ValidationResult {
+    if (!traceCallback) {
+      return this.validateEntries(options);
+    }
+
+    const span = startSpan("validate");
+    return traced(span, () => this.validateEntries(options));
+  }
+
+  /**
+   * Runs the native validation for {@link validate}.
+   * @param options - Optional thread count, header-only mode and failure limit.
+   * @returns The entries checked and the failures found, ordered by index.
+   * @throws Error if the options are invalid or the archive cannot be validated.
+   */
+  private validateEntries(options: ValidateOptions): ValidationResult {
+    const threads = options.threads ?? navigator.hardwareConcurrency;
+    if (!Number.isInteger(threads) || threads < 1) {
+      throw new Error(`Invalid thread count: ${threads}`);
+    }
+
+    if (options.maxFailures !== undefined && !(options.maxFailures >= 1)) {
+      throw new Error(`Invalid failure limit: ${options.maxFailures}`);
+    }
+
+    // Room for every failure the native side may report
+    const fileCount = this.getFileCount();
+    const maxFailures = Math.max(
+      1,
+      Math.min(Math.floor(options.maxFailures ?? fileCount), fileCount),
+    );
+    const failureBuffer = new Int32Array(maxFailures * 2);
+    const checkedBuffer = new Int32Array(1);
+    const failureCount = native().validate_zip(
+      this.handleId,
+      threads,
+      options.headersOnly ? 1 : 0,
+      maxFailures,
+      ptr(failureBuffer),
+      ptr(checkedBuffer),
+    );
+
+    if (failureCount < 0) {
+      throw new Error("Failed to validate archive");
+    }
+
+    const failures: ValidationFailure[] = [];
+    for (let i = 0; i < failureCount; i++) {
+      const index = failureBuffer[i * 2] as number;
+      const reason = failureBuffer[i * 2 + 1] as number;
+      failures.push({
+        index,
+        filename: this.getFileByIndex(index).filename,
+        reason: VALIDATION_REASONS[reason - 1] ?? "data",
+      });
+    }
+    failures.sort((a, b) => a.index - b.index);
+
+    const entriesChecked = checkedBuffer[0] as number;
+    return {
+      valid: failureCount === 0 && entriesChecked === fileCount,
+      entriesChecked,
+      failures,
+    };
+  }
+
+  /**
+   * Gets the performance counters of this reader, including the work of
+   * validation threads. Still available after the reader has been closed.
+   * @returns Bytes, entries, allocations and time spent so far.
+   * @throws Error if the stats cannot be read from the native archive.
+   */
+  getStats(): ZipStats {
+    if (this.handleId === -1 && this.finalStats) {
+      return this.finalStats;
+    }
+
+    const stats = readHandleStats(this.handleId);
+    if (!stats) {
+      throw new Error("Failed to get archive stats");
+    }
+    return stats;
   }
 
   /**
    * Closes the archive and releases associated resources.
    * After closing, the reader instance should not be used.
+   * With the accessTrace option, this also writes the trace file.
    * @returns True if the archive was successfully closed.
-   * @throws Error if the archive has already been closed.
+   * @throws Error if the archive has already been closed, if the access trace
+   * cannot be written, or if deferred CRC checks failed (the archive is
+   * closed regardless).
    */
   close(): boolean {
     if (this.handleId === -1) {
       throw new Error("ZipArchiveReader has already been closed");
     }
-    const result = close_zip(this.handleId);
+
+    let crcError: unknown;
+    if (this.deferred) {
+      try {
+        this.verifyDeferred();
+      } catch (error) {
+        crcError = error;
+      }
+    }
+
+    this.finalStats = readHandleStats(this.handleId);
+    untrackHandle(this);
+    const result = native().close_zip(this.handleId);
+    unpinData(this.handleId);
     this.handleId = -1;
+    this.source = undefined;
+    this.trace?.save();
+    if (crcError) {
+      throw crcError;
+    }
     return Boolean(result);
   }
+
+  /**
+   * Closes the archive unless it already is, for `using` declarations.
+   */
+  [Symbol.dispose](): void {
+    if (this.handleId !== -1) {
+      this.close();
+    }
+  }
 }
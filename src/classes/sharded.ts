@@ -0,0 +1,342 @@
+import { ptr } from "bun:ffi";
+import { readFileSync, writeFileSync } from "node:fs";
+import { basename, dirname, join } from "node:path";
+import { CompressionLevel, type CompressionLevelType } from "../compression.ts";
+import type { FileData } from "../interfaces/file.ts";
+import type {
+  ShardedZipWriterOptions,
+  ShardManifest,
+} from "../interfaces/writer.ts";
+import { trackedHandle } from "../memory.ts";
+import { encodeNames } from "../scratch.ts";
+import { native } from "../symbols.ts";
+import { ZipArchiveWriter } from "./writer.ts";
+
+/** Size of one entry descriptor passed to add_files_to_shards. */
+const BATCH_ENTRY_SIZE = 32;
+/** Size of one shard descriptor passed to add_files_to_shards. */
+const SHARD_BATCH_SIZE = 24;
+/** Most shards a writer can have, one native thread each. */
+const MAX_SHARDS = 64;
+/** Bytes of entry data queued before a flush, by default. */
+const DEFAULT_BATCH_SIZE = 64 * 1024 * 1024;
+
+const encoder = new TextEncoder();
+
+/** An entry waiting for the next flush. */
+interface QueuedEntry {
+  filename: string;
+  data: FileData;
+  level: number;
+}
+
+/** One of the archives of a sharded writer. */
+interface Shard {
+  writer: ZipArchiveWriter;
+  /** Entries waiting for the next flush. */
+  queue: QueuedEntry[];
+  /** Bytes of entry data routed to the shard, for the `size` routing. */
+  bytes: number;
+}
+
+/**
+ * Hashes an entry name for the `hash` routing.
+ * @param name - The name of the entry.
+ * @returns The 32-bit FNV-1a hash of the UTF-8 name.
+ */
+function hashName(name: string): number {
+  let hash = 0x811c9dc5;
+  for (const byte of encoder.encode(name)) {
+    hash = Math.imul(hash ^ byte, 0x01000193);
+  }
+  return hash >>> 0;
+}
+
+/**
+ * Writes entries to several ZIP archives at once, so that both writing them
+ * and reading them back later can use a core (and a disk) per archive. Each
+ * shard is an ordinary archive; a JSON manifest written next to them maps
+ * every entry name to its shard.
+ *
+ * Entries are queued and written in batches, every shard on its own native
+ * thread. The data of a queued entry is read when its batch is written, so
+ * it must not be modified until then.
+ *
+ * @example
+ * ```typescript
+ * const writer = new ShardedZipWriter("out/assets", { shards: 4 });
+ * writer.addFile("a.json", data, CompressionLevel.DEFAULT);
+ * writer.finalize(); // out/assets-0.zip ... out/assets-3.zip, out/assets.json
+ * ```
+ */
+export class ShardedZipWriter implements Disposable {
+  /** The shard archives. */
+  private shards: Shard[] = [];
+  /** Path of the manifest. */
+  private manifestPath: string;
+  /** The manifest, filled in as batches are written. */
+  private manifest: ShardManifest;
+  /** Shard of every name added so far, written or still queued. */
+  private routes = new Map<string, number>();
+  /** Bytes of entry data waiting for the next flush. */
+  private queuedBytes = 0;
+  /** Bytes of entry data queued before a flush. */
+  private batchSize: number;
+  /** Lower-cased extensions of entries that are always stored. */
+  private storeExtensions = new Set<string>();
+  /** Whether the shards have been finalized. */
+  private finalized = false;
+
+  /**
+   * Creates the shard archives.
+   * @param basePath - Path the shards are named after: `<basePath>-<n>.zip`,
+   * with the manifest in `<basePath>.json`.
+   * @param options - The shard count, routing and the options of every shard.
+   * @throws Error if an option is invalid or a shard cannot be created.
+   */
+  constructor(basePath: string, options: ShardedZipWriterOptions = {}) {
+    const {
+      shards = Math.min(navigator.hardwareConcurrency, MAX_SHARDS),
+      routing = "size",
+      batchSize = DEFAULT_BATCH_SIZE,
+      ...writerOptions
+    } = options;
+
+    if (!Number.isInteger(shards) || shards < 1 || shards > MAX_SHARDS) {
+      throw new Error(`Invalid shard count: ${shards}`);
+    }
+    if (routing !== "size" && routing !== "hash") {
+      throw new Error(`Invalid shard routing: ${routing}`);
+    }
+    if (!(batchSize > 0 && Number.isFinite(batchSize))) {
+      throw new Error(`Invalid batch size: ${batchSize}`);
+    }
+    if (writerOptions.expectedSize !== undefined) {
+      writerOptions.expectedSize /= shards;
+    }
+    if (typeof writerOptions.autoStore === "object") {
+      for (const extension of writerOptions.autoStore.extensions ?? []) {
+        this.storeExtensions.add(extension.toLowerCase());
+      }
+    }
+
+    const paths = Array.from(
+      { length: shards },
+      (_, i) => `${basePath}-${i}.zip`,
+    );
+    try {
+      for (const path of paths) {
+        this.shards.push({
+          writer: new ZipArchiveWriter(path, writerOptions),
+          queue: [],
+          bytes: 0,
+        });
+      }
+    } catch (error) {
+      for (const { writer } of this.shards) {
+        writer[Symbol.dispose]();
+      }
+      throw error;
+    }
+
+    this.manifestPath = `${basePath}.json`;
+    this.manifest = {
+      version: 1,
+      routing,
+      shards: paths.map((path) => basename(path)),
+      entries: Object.create(null),
+    };
+    this.batchSize = batchSize;
+  }
+
+  /**
+   * Picks the shard of an entry.
+   * @param filename - The name of the entry.
+   * @returns The index of the shard.
+   */
+  private route(filename: string): number {
+    if (this.manifest.routing === "hash") {
+      return hashName(filename) % this.shards.length;
+    }
+
+    let shard = 0;
+    for (const [i, { bytes }] of this.shards.entries()) {
+      if (bytes < (this.shards[shard] as Shard).bytes) {
+        shard = i;
+      }
+    }
+    return shard;
+  }
+
+  /**
+   * Queues a file for the shard it is routed to, writing the queued batch
+   * once it reaches the batch size. A name that was already added goes to
+   * the same shard as before.
+   * @param filename - The name/path for the file within the archive.
+   * @param data - The file content, read when its batch is written.
+   * @param level - Optional compression level (0-11). Defaults to no compression.
+   * @returns The index of the shard the file goes to.
+   * @throws Error if the shards have already been finalized, or the batch
+   * this file completed failed to be written.
+   */
+  addFile(
+    filename: string,
+    data: FileData,
+    level?: CompressionLevelType,
+  ): number {
+    if (this.finalized) {
+      throw new Error("ShardedZipWriter has already been finalized");
+    }
+
+    const dot = filename.lastIndexOf(".");
+    const stored =
+      dot >= 0 && this.storeExtensions.has(filename.slice(dot).toLowerCase());
+    // A name added again stays in its shard, so the manifest never leaves
+    // an earlier copy behind in another one
+    const shard = this.routes.get(filename) ?? this.route(filename);
+    const target = this.shards[shard] as Shard;
+
+    target.queue.push({
+      filename,
+      data,
+      level: stored
+        ? CompressionLevel.NO_COMPRESSION
+        : (level ?? CompressionLevel.NO_COMPRESSION),
+    });
+    this.routes.set(filename, shard);
+    target.bytes += data.byteLength;
+    this.queuedBytes += data.byteLength;
+
+    if (this.queuedBytes >= this.batchSize) {
+      this.flush();
+    }
+    return shard;
+  }
+
+  /**
+   * Writes the queued entries, every shard on its own thread. Only the
+   * entries written make it into the manifest.
+   * @throws Error if the shards have already been finalized, or an entry
+   * could not be added (the entries after it in its shard are not added).
+   */
+  flush(): void {
+    if (this.finalized) {
+      throw new Error("ShardedZipWriter has already been finalized");
+    }
+
+    const batches = this.shards.flatMap(({ writer, queue }, shard) =>
+      queue.length > 0 ? [{ shard, writer, queue }] : [],
+    );
+    for (const target of this.shards) {
+      target.queue = [];
+    }
+    this.queuedBytes = 0;
+    if (batches.length === 0) {
+      return;
+    }
+
+    // The native side reads the tables, names and data in place, so keep
+    // them referenced until the call returns
+    const table = new DataView(
+      new ArrayBuffer(batches.length * SHARD_BATCH_SIZE),
+    );
+    const buffers: { names: Uint8Array; entries: DataView }[] = [];
+    for (const [slot, { writer, queue }] of batches.entries()) {
+      const names = encodeNames(queue.map((entry) => entry.filename));
+      const entries = new DataView(
+        new ArrayBuffer(queue.length * BATCH_ENTRY_SIZE),
+      );
+      for (const [i, entry] of queue.entries()) {
+        const offset = i * BATCH_ENTRY_SIZE;
+        entries.setBigUint64(
+          offset,
+          BigInt(ptr(names.buffer, names.offsets[i])),
+          true,
+        );
+        entries.setBigUint64(offset + 8, BigInt(ptr(entry.data)), true);
+        entries.setBigUint64(offset + 16, BigInt(entry.data.byteLength), true);
+        entries.setInt32(offset + 24, entry.level, true);
+      }
+      buffers.push({ names: names.buffer, entries });
+
+      const offset = slot * SHARD_BATCH_SIZE;
+      table.setInt32(offset, trackedHandle(writer) ?? -1, true);
+      table.setInt32(offset + 4, queue.length, true);
+      table.setBigUint64(offset + 8, BigInt(ptr(entries)), true);
+    }
+
+    const written = native().add_files_to_shards(ptr(table), batches.length);
+    for (const [slot, { shard, queue }] of batches.entries()) {
+      const added = table.getInt32(slot * SHARD_BATCH_SIZE + 16, true);
+      for (const { filename } of queue.slice(0, added)) {
+        this.manifest.entries[filename] = shard;
+      }
+    }
+    if (written) {
+      return;
+    }
+    for (const [slot, { shard, queue }] of batches.entries()) {
+      const added = table.getInt32(slot * SHARD_BATCH_SIZE + 16, true);
+      if (added < queue.length) {
+        throw new Error(
+          `Failed to add ${queue[added]?.filename} to shard ${shard}`,
+        );
+      }
+    }
+    throw new Error("Failed to write the queued entries to the shards");
+  }
+
+  /**
+   * Writes the queued entries, finalizes every shard and writes the manifest.
+   * @returns The manifest.
+   * @throws Error if the shards have already been finalized, or an entry,
+   * a shard or the manifest could not be written.
+   */
+  finalize(): ShardManifest {
+    this.flush();
+    this.finalized = true;
+
+    for (const [i, { writer }] of this.shards.entries()) {
+      if (!writer.finalize()) {
+        throw new Error(`Failed to finalize shard ${i}`);
+      }
+    }
+    writeFileSync(this.manifestPath, JSON.stringify(this.manifest));
+    return this.manifest;
+  }
+
+  /**
+   * Abandons the shards unless they have been finalized, for `using`
+   * declarations.
+   */
+  [Symbol.dispose](): void {
+    this.finalized = true;
+    for (const { writer } of this.shards) {
+      writer[Symbol.dispose]();
+    }
+  }
+}
+
+/**
+ * Reads the manifest of a {@link ShardedZipWriter}, with the shard paths
+ * resolved against the manifest's directory so they can be opened directly.
+ * @param path - The manifest, `<basePath>.json`.
+ * @returns The manifest.
+ * @throws Error if the file cannot be read or is not a shard manifest.
+ */
+export function readShardManifest(path: string): ShardManifest {
+  const manifest = JSON.parse(readFileSync(path, "utf8")) as ShardManifest;
+  if (
+    manifest?.version !== 1 ||
+    !Array.isArray(manifest.shards) ||
+    typeof manifest.entries !== "object"
+  ) {
+    throw new Error(`Not a shard manifest: ${path}`);
+  }
+
+  const directory = dirname(path);
+  return {
+    ...manifest,
+    shards: manifest.shards.map((shard) => join(directory, shard)),
+  };
+}
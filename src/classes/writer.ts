@@ -1,17 +1,132 @@
 import { ptr } from "bun:ffi";
-import { CompressionLevel, type CompressionLevelType } from "../compression.ts";
+import {
+  CompressionLevel,
+  type CompressionLevelType,
+  CompressionStrategy,
+  DEFAULT_AUTO_STORE_ENTROPY,
+} from "../compression.ts";
+import { EncryptionStrength, EncryptionVersion } from "../encryption.ts";
+import { ZipCancelledError } from "../errors.ts";
 import type { FileData } from "../interfaces/file.ts";
-import type { ZipWriter } from "../interfaces/writer.ts";
-import { symbols } from "../symbols.ts";
-
-const {
-  create_zip,
-  create_zip_in_memory,
-  finalize_zip,
-  get_zip_final_size,
-  finalize_zip_in_memory_bytes,
-  add_file_to_zip,
-} = symbols;
+import type { ZipReader } from "../interfaces/reader.ts";
+import type { ZipStats } from "../interfaces/stats.ts";
+import type { TraceSpan } from "../interfaces/tracing.ts";
+import type {
+  AdaptiveCompressionOptions,
+  AddFileOptions,
+  AddFilesOptions,
+  CompressionReport,
+  EncryptionOptions,
+  ZipEntryInput,
+  ZipWriter,
+  ZipWriterOptions,
+} from "../interfaces/writer.ts";
+import {
+  noteMemoryGrowth,
+  trackedHandle,
+  trackHandle,
+  untrackHandle,
+} from "../memory.ts";
+import { hasProgress, offsetProgress, withProgress } from "../progress.ts";
+import { encodeNames, NameBuffer } from "../scratch.ts";
+import { readHandleStats } from "../stats.ts";
+import { native } from "../symbols.ts";
+import { startSpan, traceCallback, traced } from "../tracing.ts";
+
+/** Size of one entry descriptor passed to add_files_to_zip. */
+const BATCH_ENTRY_SIZE = 32;
+
+/**
+ * Gets the length of file data the way the native layer expects it.
+ * @param data - The file content.
+ * @returns The length in bytes.
+ */
+function getDataLength(data: FileData): number {
+  if ("length" in data) {
+    return data.length;
+  }
+  if ("byteLength" in data) {
+    return data.byteLength;
+  }
+  return 0;
+}
+
+/**
+ * Converts the auto-store option to the native threshold in millibits per byte.
+ * @param autoStore - The auto-store option passed to the writer.
+ * @returns The threshold, or 0 when the entropy probe is disabled.
+ * @throws Error if the entropy threshold is outside 0-8 bits per byte.
+ */
+function resolveAutoStoreThreshold(
+  autoStore: ZipWriterOptions["autoStore"],
+): number {
+  if (!autoStore) {
+    return 0;
+  }
+
+  const threshold =
+    (typeof autoStore === "object" ? autoStore.entropyThreshold : undefined) ??
+    DEFAULT_AUTO_STORE_ENTROPY;
+
+  if (!(threshold >= 0 && threshold <= 8)) {
+    throw new Error(`Invalid auto-store entropy threshold: ${threshold}`);
+  }
+
+  return Math.round(threshold * 1000);
+}
+
+/**
+ * Validates adaptive compression options.
+ * @param adaptive - The adaptive option passed to the writer.
+ * @throws Error if neither a positive throughput nor a deadline with expected bytes is given.
+ */
+function validateAdaptive(adaptive: AdaptiveCompressionOptions): void {
+  if (adaptive.targetThroughput !== undefined) {
+    if (!(adaptive.targetThroughput > 0)) {
+      throw new Error(
+        `Invalid adaptive target throughput: ${adaptive.targetThroughput}`,
+      );
+    }
+    return;
+  }
+
+  if (
+    adaptive.deadline === undefined ||
+    !(Number(adaptive.expectedBytes) > 0)
+  ) {
+    throw new Error(
+      "Adaptive compression needs a targetThroughput, or a deadline with expectedBytes",
+    );
+  }
+}
+
+/**
+ * Converts encryption options to the native strength (1-3 for AES-128/192/256)
+ * and format version.
+ * @param encryption - The encryption option passed to the writer.
+ * @returns The native strength and version.
+ * @throws Error if the password is empty or the strength or version is unknown.
+ */
+function resolveEncryption(encryption: EncryptionOptions): {
+  strength: number;
+  version: number;
+} {
+  if (!encryption.password) {
+    throw new Error("Encryption needs a non-empty password");
+  }
+
+  const strength = encryption.strength ?? EncryptionStrength.AES_256;
+  if (!Object.values(EncryptionStrength).includes(strength)) {
+    throw new Error(`Invalid encryption strength: ${strength}`);
+  }
+
+  const version = encryption.version ?? EncryptionVersion.AE_2;
+  if (!Object.values(EncryptionVersion).includes(version)) {
+    throw new Error(`Invalid encryption version: ${version}`);
+  }
+
+  return { strength: strength / 64 - 1, version };
+}
 
 /**
  * Implementation of {@link ZipWriter} for creating and writing files to ZIP archives.
@@ -39,19 +154,49 @@ export class ZipArchiveWriter implements ZipWriter {
   private handleId: number;
   /** Flag indicating whether this is a memory-based or file-based archive. */
   private isMemoryBased: boolean;
+  /** Lower-cased extensions that are always stored without compression. */
+  private storeExtensions: Set<string> = new Set();
+  /** Adaptive compression settings, if enabled. */
+  private adaptive?: AdaptiveCompressionOptions;
+  /** Uncompressed bytes submitted so far, used to pace deadline mode. */
+  private bytesSubmitted = 0;
+  /** Report captured when the native handle was released. */
+  private finalReport?: CompressionReport;
+  /** Counters captured when the native handle was released. */
+  private finalStats?: ZipStats;
+  /** Scratch buffer the names of added entries are encoded into. */
+  private names = new NameBuffer();
 
   /**
    * Creates a new ZIP archive writer.
    * @param filename - Optional filename for file-based archives. If omitted, creates a memory-based archive.
-   * @throws Error if the archive cannot be created.
+   * @param options - Optional writer settings such as auto-store.
+   * @throws Error if the archive cannot be created or its expected size cannot be reserved.
    */
-  constructor(filename?: string) {
+  constructor(filename?: string, options: ZipWriterOptions = {}) {
+    const autoStoreThreshold = resolveAutoStoreThreshold(options.autoStore);
+    if (options.adaptive) {
+      validateAdaptive(options.adaptive);
+    }
+    const encryption = options.encryption
+      ? resolveEncryption(options.encryption)
+      : undefined;
+    if (
+      options.expectedSize !== undefined &&
+      !(options.expectedSize > 0 && Number.isFinite(options.expectedSize))
+    ) {
+      throw new Error(`Invalid expected size: ${options.expectedSize}`);
+    }
+    if (options.align !== undefined && !Number.isInteger(options.align)) {
+      throw new Error(`Invalid alignment: ${options.align}`);
+    }
+
     if (filename) {
       // File-based zip
       const filenameBuffer = Buffer.from(`${filename}\0`, "utf8");
       const filenamePtr = ptr(filenameBuffer);
 
-      this.handleId = create_zip(filenamePtr);
+      this.handleId = native().create_zip(filenamePtr);
       this.isMemoryBased = false;
 
       if (this.handleId < 0) {
@@ -59,56 +204,419 @@ export class ZipArchiveWriter implements ZipWriter {
       }
     } else {
       // Memory-based zip
-      this.handleId = create_zip_in_memory();
+      this.handleId = native().create_zip_in_memory();
       this.isMemoryBased = true;
 
       if (this.handleId < 0) {
         throw new Error("Failed to create memory-based zip archive");
       }
     }
+    trackHandle(this, this.handleId);
+
+    if (
+      options.expectedSize !== undefined &&
+      !native().reserve_zip_space(this.handleId, options.expectedSize)
+    ) {
+      throw new Error(
+        `Failed to reserve ${options.expectedSize} bytes for the archive`,
+      );
+    }
+
+    if (
+      options.align !== undefined &&
+      !native().set_alignment(this.handleId, options.align)
+    ) {
+      throw new Error(`Invalid alignment: ${options.align}`);
+    }
+
+    if (options.autoStore) {
+      native().set_auto_store(this.handleId, autoStoreThreshold);
+
+      if (typeof options.autoStore === "object") {
+        for (const extension of options.autoStore.extensions ?? []) {
+          this.storeExtensions.add(extension.toLowerCase());
+        }
+      }
+    }
+
+    if (options.adaptive) {
+      this.adaptive = options.adaptive;
+
+      if (options.adaptive.targetThroughput !== undefined) {
+        native().set_adaptive_target(
+          this.handleId,
+          options.adaptive.targetThroughput * 1e6,
+        );
+      }
+    }
+
+    if (options.encryption && encryption) {
+      const passwordBuffer = Buffer.from(
+        `${options.encryption.password}\0`,
+        "utf8",
+      );
+      const success = native().set_password(
+        this.handleId,
+        ptr(passwordBuffer),
+        encryption.strength,
+        encryption.version,
+      );
+
+      if (!success) {
+        throw new Error("Failed to set archive password");
+      }
+    }
+  }
+
+  /**
+   * Recomputes the adaptive target from the remaining bytes and time when
+   * pacing against a deadline.
+   * @param nextLength - Size of the entry about to be added.
+   */
+  private paceDeadline(nextLength: number): void {
+    if (
+      !this.adaptive ||
+      this.adaptive.deadline === undefined ||
+      this.adaptive.targetThroughput !== undefined
+    ) {
+      return;
+    }
+
+    const remainingBytes = Math.max(
+      (this.adaptive.expectedBytes ?? 0) - this.bytesSubmitted,
+      nextLength,
+    );
+    const remainingSeconds =
+      (Number(this.adaptive.deadline) - Date.now()) / 1000;
+
+    // Past the deadline every entry gets the fastest setting
+    const target =
+      remainingSeconds > 0
+        ? remainingBytes / remainingSeconds
+        : Number.MAX_VALUE;
+    native().set_adaptive_target(this.handleId, target);
+  }
+
+  /**
+   * Checks whether a filename matches one of the auto-store extensions.
+   * @param filename - The name/path of the entry.
+   * @returns True if the entry should be stored without compression.
+   */
+  private isStoredByExtension(filename: string): boolean {
+    if (this.storeExtensions.size === 0) {
+      return false;
+    }
+
+    const dot = filename.lastIndexOf(".");
+    return (
+      dot >= 0 && this.storeExtensions.has(filename.slice(dot).toLowerCase())
+    );
   }
 
   /**
    * Adds a file to the ZIP archive.
    * @param filename - The name/path for the file within the archive.
    * @param data - The file content to add (Uint8Array, ArrayBuffer, Buffer, or DataView).
-   * @param compressionLevel - Optional compression level (0-9). Defaults to no compression if not specified.
+   * @param compression - Optional compression level (0-11) or tuning options. Defaults to no compression if not specified.
    * @returns True if the file was successfully added, false otherwise.
-   * @throws Error if the archive has already been finalized.
+   * @throws Error if the archive has already been finalized, or the signal's
+   * reason if it was aborted before the entry was written.
    */
   addFile(
     filename: string,
     data: FileData,
-    compressionLevel?: CompressionLevelType,
+    compression?: CompressionLevelType | AddFileOptions,
+  ): boolean {
+    if (!traceCallback) {
+      return this.addEntry(filename, data, compression);
+    }
+
+    return this.tracedAdd(startSpan("add", filename), getDataLength(data), () =>
+      this.addEntry(filename, data, compression),
+    );
+  }
+
+  /**
+   * Adds one entry for {@link addFile}.
+   * @param filename - The name/path for the file within the archive.
+   * @param data - The file content to add.
+   * @param compression - Optional compression level or tuning options.
+   * @returns True if the file was successfully added, false otherwise.
+   * @throws Error if the archive has already been finalized.
+   */
+  private addEntry(
+    filename: string,
+    data: FileData,
+    compression?: CompressionLevelType | AddFileOptions,
   ): boolean {
     if (this.handleId === -1) {
       throw new Error("ZipArchiveWriter has already been finalized");
     }
     const dataPtr = ptr(data);
-    const filenameBuffer = Buffer.from(`${filename}\0`, "utf8");
-    const filenamePtr = ptr(filenameBuffer);
+    const filenamePtr = this.names.encode(filename);
+    const dataLength = getDataLength(data);
 
-    let dataLength = 0;
+    const options: AddFileOptions =
+      typeof compression === "object" ? compression : { level: compression };
 
-    if ("length" in data) {
-      dataLength = data.length;
-    } else if ("byteLength" in data) {
-      dataLength = data.byteLength;
-    }
+    // Use NO_COMPRESSION if no compression level is specified, unless the
+    // adaptive controller is in charge of picking it
+    const defaultLevel = this.adaptive
+      ? CompressionLevel.BEST_COMPRESSION
+      : CompressionLevel.NO_COMPRESSION;
+    const actualCompressionLevel = this.isStoredByExtension(filename)
+      ? CompressionLevel.NO_COMPRESSION
+      : (options.level ?? defaultLevel);
 
-    // Use NO_COMPRESSION if no compression level is specified
-    const actualCompressionLevel =
-      compressionLevel ?? CompressionLevel.NO_COMPRESSION;
+    this.paceDeadline(dataLength);
+    this.bytesSubmitted += dataLength;
 
-    return Boolean(
-      add_file_to_zip(
+    const add = () =>
+      native().add_file_to_zip(
         this.handleId,
         filenamePtr,
         dataPtr,
         dataLength,
         actualCompressionLevel,
-      ),
+        options.strategy ?? CompressionStrategy.DEFAULT,
+        options.probes ?? 0,
+        options.greedy === undefined ? -1 : Number(options.greedy),
+      );
+    const added = hasProgress(options)
+      ? withProgress(this.handleId, options, add, Boolean)
+      : add();
+    // Memory-based archives grow in native memory with every entry
+    if (this.isMemoryBased) {
+      noteMemoryGrowth(dataLength);
+    }
+    return Boolean(added);
+  }
+
+  /**
+   * Adds several files to the ZIP archive, in order. With
+   * {@link CompressionLevel.MAX_COMPRESSION} the entries are compressed on
+   * several threads before being written, and report their progress as they
+   * are written; other levels add them one by one.
+   * @param entries - The files to add.
+   * @param compression - Optional compression level (0-11) or options applied to every entry.
+   * @returns True if all files were added, false if one failed (the files after it are not added).
+   * @throws Error if the archive has already been finalized or the thread count is invalid,
+   * or a {@link ZipCancelledError} with the number of files added if it was cancelled.
+   */
+  addFiles(
+    entries: ZipEntryInput[],
+    compression?: CompressionLevelType | AddFilesOptions,
+  ): boolean {
+    if (this.handleId === -1) {
+      throw new Error("ZipArchiveWriter has already been finalized");
+    }
+
+    const options: AddFilesOptions =
+      typeof compression === "object" ? compression : { level: compression };
+    const tuned =
+      options.strategy !== undefined ||
+      options.probes !== undefined ||
+      options.greedy !== undefined;
+
+    if (
+      options.level !== CompressionLevel.MAX_COMPRESSION ||
+      tuned ||
+      entries.length === 0
+    ) {
+      const done = { bytes: 0, entries: 0 };
+      try {
+        return entries.every((entry) => {
+          const added = this.addFile(
+            entry.filename,
+            entry.data,
+            offsetProgress(options, done),
+          );
+          done.bytes += getDataLength(entry.data);
+          done.entries++;
+          return added;
+        });
+      } catch (error) {
+        throw hasProgress(options)
+          ? new ZipCancelledError(done.entries, error)
+          : error;
+      }
+    }
+
+    const threads = options.threads ?? navigator.hardwareConcurrency;
+    if (!Number.isInteger(threads) || threads < 1) {
+      throw new Error(`Invalid thread count: ${threads}`);
+    }
+
+    // The native side reads the names and data in place, so keep the
+    // filename buffer referenced until the call returns
+    const submitted = this.bytesSubmitted;
+    const table = new DataView(
+      new ArrayBuffer(entries.length * BATCH_ENTRY_SIZE),
     );
+    const filenames = encodeNames(entries.map((entry) => entry.filename));
+    for (const [i, entry] of entries.entries()) {
+      const offset = i * BATCH_ENTRY_SIZE;
+      const dataLength = getDataLength(entry.data);
+
+      table.setBigUint64(
+        offset,
+        BigInt(ptr(filenames.buffer, filenames.offsets[i])),
+        true,
+      );
+      table.setBigUint64(offset + 8, BigInt(ptr(entry.data)), true);
+      table.setBigUint64(offset + 16, BigInt(dataLength), true);
+      table.setInt32(
+        offset + 24,
+        this.isStoredByExtension(entry.filename)
+          ? CompressionLevel.NO_COMPRESSION
+          : CompressionLevel.MAX_COMPRESSION,
+        true,
+      );
+      this.bytesSubmitted += dataLength;
+    }
+
+    const addBatch = () => {
+      let added = 0;
+      const add = () => {
+        added = native().add_files_to_zip(
+          this.handleId,
+          ptr(table),
+          entries.length,
+          threads,
+        );
+        return added;
+      };
+      try {
+        if (hasProgress(options)) {
+          withProgress(
+            this.handleId,
+            options,
+            add,
+            (count) => count === entries.length,
+          );
+        } else {
+          add();
+        }
+      } catch (error) {
+        throw hasProgress(options)
+          ? new ZipCancelledError(added, error)
+          : error;
+      } finally {
+        if (this.isMemoryBased) {
+          noteMemoryGrowth(this.bytesSubmitted - submitted);
+        }
+      }
+      return added === entries.length;
+    };
+    return traceCallback
+      ? this.tracedAdd(
+          startSpan("add"),
+          this.bytesSubmitted - submitted,
+          addBatch,
+        )
+      : addBatch();
+  }
+
+  /**
+   * Copies an entry of an open archive into this one as is: its compressed
+   * (or encrypted) data is copied without being inflated or checked. Stored
+   * entries are padded to the larger of this writer's `align` and the
+   * alignment they were written with.
+   * @param reader - The archive to copy from.
+   * @param index - The zero-based index of the entry in that archive.
+   * @returns True if the entry was copied, false otherwise.
+   * @throws Error if the archive has already been finalized or the reader
+   * has been closed.
+   */
+  copyFile(reader: ZipReader, index: number): boolean {
+    if (this.handleId === -1) {
+      throw new Error("ZipArchiveWriter has already been finalized");
+    }
+    const sourceId = trackedHandle(reader);
+    if (sourceId === undefined) {
+      throw new Error("ZipArchiveReader has already been closed");
+    }
+
+    const copied = native().copy_entry(this.handleId, sourceId, index);
+    if (this.isMemoryBased) {
+      noteMemoryGrowth(0);
+    }
+    return Boolean(copied);
+  }
+
+  /**
+   * Runs an add operation under a trace span, recording the bytes it stored.
+   * @param span - The span of the operation.
+   * @param bytesIn - Size of the data being added.
+   * @param add - The operation.
+   * @returns What the operation returned.
+   */
+  private tracedAdd(
+    span: TraceSpan,
+    bytesIn: number,
+    add: () => boolean,
+  ): boolean {
+    span.bytesIn = bytesIn;
+    return traced(span, () => {
+      const stored = this.getStats().compressedBytes;
+      const added = add();
+      span.bytesOut = this.getStats().compressedBytes - stored;
+      return added;
+    });
+  }
+
+  /**
+   * Gets the compression results achieved so far. Still available after the
+   * archive has been finalized.
+   * @returns Totals, ratio, speed and the adaptive controller's current settings.
+   * @throws Error if the report cannot be read from the native archive.
+   */
+  getCompressionReport(): CompressionReport {
+    if (this.handleId === -1 && this.finalReport) {
+      return this.finalReport;
+    }
+
+    const reportBuffer = new ArrayBuffer(48);
+    if (!native().get_compression_report(this.handleId, ptr(reportBuffer))) {
+      throw new Error("Failed to get compression report");
+    }
+
+    const view = new DataView(reportBuffer);
+    const entries = Number(view.getBigUint64(0, true));
+    const bytesIn = Number(view.getBigUint64(8, true));
+    const bytesOut = Number(view.getBigUint64(16, true));
+    const seconds = Number(view.getBigUint64(24, true)) / 1e9;
+    const compressionSeconds = Number(view.getBigUint64(32, true)) / 1e9;
+
+    return {
+      entries,
+      bytesIn,
+      bytesOut,
+      ratio: bytesIn > 0 ? bytesOut / bytesIn : 1,
+      seconds,
+      compressionSeconds,
+      throughput: seconds > 0 ? bytesIn / seconds / 1e6 : 0,
+      level: view.getInt32(40, true),
+      probes: view.getInt32(44, true),
+    };
+  }
+
+  /**
+   * Gets the performance counters of this writer. Still available after the
+   * archive has been finalized, as they stood just before finalizing.
+   * @returns Bytes, entries, allocations and time spent so far.
+   * @throws Error if the stats cannot be read from the native archive.
+   */
+  getStats(): ZipStats {
+    if (this.handleId === -1 && this.finalStats) {
+      return this.finalStats;
+    }
+
+    const stats = readHandleStats(this.handleId);
+    if (!stats) {
+      throw new Error("Failed to get archive stats");
+    }
+    return stats;
   }
 
   /**
@@ -118,6 +626,18 @@ export class ZipArchiveWriter implements ZipWriter {
    * @throws Error if the archive has already been finalized or for memory-based archives.
    */
   finalize(): boolean {
+    if (!traceCallback) {
+      return this.finalizeFile();
+    }
+    return traced(startSpan("finalize"), () => this.finalizeFile());
+  }
+
+  /**
+   * Finalizes a file-based archive for {@link finalize}.
+   * @returns True if finalization was successful.
+   * @throws Error if the archive has already been finalized or for memory-based archives.
+   */
+  private finalizeFile(): boolean {
     if (this.handleId === -1) {
       throw new Error("ZipArchiveWriter has already been finalized");
     }
@@ -126,7 +646,10 @@ export class ZipArchiveWriter implements ZipWriter {
       throw new Error("Use finalizeToMemory() for memory-based zip archives");
     }
 
-    const result = finalize_zip(this.handleId);
+    this.finalReport = this.getCompressionReport();
+    this.finalStats = readHandleStats(this.handleId);
+    untrackHandle(this);
+    const result = native().finalize_zip(this.handleId);
     this.handleId = -1;
     return Boolean(result);
   }
@@ -138,6 +661,24 @@ export class ZipArchiveWriter implements ZipWriter {
    * @throws Error if the archive has already been finalized or for file-based archives.
    */
   finalizeToMemory(): Uint8Array {
+    if (!traceCallback) {
+      return this.finalizeMemory();
+    }
+
+    const span = startSpan("finalize");
+    return traced(span, () => {
+      const data = this.finalizeMemory();
+      span.bytesOut = data.length;
+      return data;
+    });
+  }
+
+  /**
+   * Finalizes a memory-based archive for {@link finalizeToMemory}.
+   * @returns The complete ZIP archive as a Uint8Array.
+   * @throws Error if the archive has already been finalized or for file-based archives.
+   */
+  private finalizeMemory(): Uint8Array {
     if (this.handleId === -1) {
       throw new Error("ZipArchiveWriter has already been finalized");
     }
@@ -146,44 +687,52 @@ export class ZipArchiveWriter implements ZipWriter {
       throw new Error("Use finalize() for file-based zip archives");
     }
 
-    // First, estimate the final size
-    const estimatedSize = get_zip_final_size(this.handleId);
-    if (estimatedSize <= 0) {
-      throw new Error("Failed to estimate final archive size");
-    }
+    this.finalReport = this.getCompressionReport();
+    this.finalStats = readHandleStats(this.handleId);
 
-    // Allocate a buffer that's large enough (add some padding for safety)
-    const bufferSize = Math.max(estimatedSize * 1.2, 1024 * 1024); // 20% padding, minimum 1MB
-
-    const buffer = new ArrayBuffer(bufferSize);
-    const bufferPtr = ptr(buffer);
-
-    const resultSize = finalize_zip_in_memory_bytes(
-      this.handleId,
-      bufferPtr,
-      bufferSize,
-    );
+    // The native side knows the exact size of the finished archive
+    const size = native().get_zip_final_size(this.handleId);
+    const buffer = new Uint8Array(Math.max(size, 0));
+    const resultSize =
+      size > 0
+        ? native().finalize_zip_in_memory_bytes(
+            this.handleId,
+            ptr(buffer),
+            size,
+          )
+        : -1;
 
     if (resultSize <= 0) {
-      if (resultSize === -2) {
-        throw new Error(
-          `Failed to finalize memory-based zip archive - buffer too small. Estimated: ${estimatedSize}, allocated: ${bufferSize}`,
-        );
-      } else {
-        throw new Error(
-          "Failed to finalize memory-based zip archive - archive error",
-        );
-      }
+      // Release the handle now rather than leave a half-finalized archive
+      // for the garbage collector
+      this[Symbol.dispose]();
+      throw new Error(
+        size > 0
+          ? "Failed to finalize memory-based zip archive - archive error"
+          : "Failed to compute the final archive size",
+      );
     }
 
-    // Create a new buffer with the actual size
-    const actualBuffer = new ArrayBuffer(resultSize);
-    const actualView = new Uint8Array(actualBuffer);
-    const originalView = new Uint8Array(buffer, 0, resultSize);
-
-    actualView.set(originalView);
+    untrackHandle(this);
     this.handleId = -1;
 
-    return new Uint8Array(actualBuffer);
+    return resultSize === size ? buffer : buffer.slice(0, resultSize);
+  }
+
+  /**
+   * Releases the native archive unless it has been finalized, for `using`
+   * declarations. An archive disposed of before being finalized is abandoned:
+   * nothing is returned, and a file-based archive is left incomplete.
+   */
+  [Symbol.dispose](): void {
+    if (this.handleId === -1) {
+      return;
+    }
+
+    this.finalReport = this.getCompressionReport();
+    this.finalStats = readHandleStats(this.handleId);
+    untrackHandle(this);
+    native().release_zip(this.handleId);
+    this.handleId = -1;
   }
 }
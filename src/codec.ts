@@ -0,0 +1,57 @@
+import { ptr } from "bun:ffi";
+import { native } from "./symbols.ts";
+
+/**
+ * Whole-buffer deflate/inflate implementations the native layer can route
+ * entries through. `MINIZ` is always available; `LIBDEFLATE` is compiled in
+ * when `ZIP_BUN_LIBDEFLATE=1` is set and the system libdeflate is installed.
+ */
+export const CodecBackend = {
+  MINIZ: "miniz",
+  LIBDEFLATE: "libdeflate",
+} as const;
+
+export type CodecBackendType = (typeof CodecBackend)[keyof typeof CodecBackend];
+
+function readBackendName(index: number): string {
+  const nameBuffer = new Uint8Array(64);
+  const length = native().get_codec_backend_name(index, ptr(nameBuffer), 64);
+  return new TextDecoder().decode(nameBuffer.subarray(0, Math.max(length, 0)));
+}
+
+/**
+ * Lists the codec backends compiled into the native library.
+ * @returns The available backend names, the default first.
+ */
+export function getCodecBackends(): CodecBackendType[] {
+  const count = native().get_codec_backend_count();
+  const backends: CodecBackendType[] = [];
+
+  for (let i = 0; i < count; i++) {
+    backends.push(readBackendName(i) as CodecBackendType);
+  }
+
+  return backends;
+}
+
+/**
+ * Gets the codec backend used by newly created readers and writers.
+ * @returns The name of the current backend.
+ */
+export function getCodecBackend(): CodecBackendType {
+  return readBackendName(native().get_codec_backend()) as CodecBackendType;
+}
+
+/**
+ * Selects the codec backend for readers and writers created afterwards.
+ * Existing handles keep the backend they were created with.
+ * @param backend - The backend to use.
+ * @throws Error if the backend is not compiled into the native library.
+ */
+export function setCodecBackend(backend: CodecBackendType): void {
+  const index = getCodecBackends().indexOf(backend);
+
+  if (index < 0 || !native().set_codec_backend(index)) {
+    throw new Error(`Codec backend not available: ${backend}`);
+  }
+}
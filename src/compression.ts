@@ -2,8 +2,69 @@ export const CompressionLevel = {
   NO_COMPRESSION: 0,
   BEST_SPEED: 1,
   BEST_COMPRESSION: 9,
+  /** miniz's hidden level 10: a little smaller than 9, often much slower. */
+  UBER_COMPRESSION: 10,
+  /**
+   * Iterative optimal parsing with block splitting. Typically 3-8% smaller
+   * than level 9 and two to three orders of magnitude slower; meant for
+   * archives that are written once and read many times.
+   */
+  MAX_COMPRESSION: 11,
   DEFAULT: 6,
 } as const;
 
 export type CompressionLevelType =
   (typeof CompressionLevel)[keyof typeof CompressionLevel];
+
+/**
+ * Deflate strategies, matching zlib's numbering. They change how matches are
+ * searched for, not the output format.
+ */
+export const CompressionStrategy = {
+  DEFAULT: 0,
+  /** Ignore short matches (5 bytes or less), for filtered/noisy data. */
+  FILTERED: 1,
+  /** No match search at all, only Huffman-coded literals. */
+  HUFFMAN_ONLY: 2,
+  /** Only look for runs of the previous byte (distance 1). */
+  RLE: 3,
+  /** Use the fixed Huffman tables instead of building dynamic ones. */
+  FIXED: 4,
+} as const;
+
+export type CompressionStrategyType =
+  (typeof CompressionStrategy)[keyof typeof CompressionStrategy];
+
+/** Default entropy (bits per byte) above which auto-store skips compression. */
+export const DEFAULT_AUTO_STORE_ENTROPY = 7.8;
+
+/**
+ * Extensions of formats that are already compressed, for use with
+ * {@link AutoStoreOptions.extensions}.
+ */
+export const INCOMPRESSIBLE_EXTENSIONS = [
+  ".jpg",
+  ".jpeg",
+  ".png",
+  ".gif",
+  ".webp",
+  ".avif",
+  ".heic",
+  ".mp3",
+  ".aac",
+  ".ogg",
+  ".mp4",
+  ".m4v",
+  ".mov",
+  ".mkv",
+  ".webm",
+  ".zip",
+  ".gz",
+  ".tgz",
+  ".bz2",
+  ".xz",
+  ".zst",
+  ".7z",
+  ".rar",
+  ".woff2",
+];
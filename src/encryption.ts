@@ -0,0 +1,24 @@
+/**
+ * AES key sizes for WinZip AES encrypted entries.
+ */
+export const EncryptionStrength = {
+  AES_128: 128,
+  AES_192: 192,
+  AES_256: 256,
+} as const;
+
+export type EncryptionStrengthType =
+  (typeof EncryptionStrength)[keyof typeof EncryptionStrength];
+
+/**
+ * WinZip AES format versions. AE-2 writes no CRC of the plaintext, which
+ * could otherwise give away the content of small entries; AE-1 keeps it for
+ * readers that insist on a CRC.
+ */
+export const EncryptionVersion = {
+  AE_1: 1,
+  AE_2: 2,
+} as const;
+
+export type EncryptionVersionType =
+  (typeof EncryptionVersion)[keyof typeof EncryptionVersion];
@@ -0,0 +1,43 @@
+import type { ExtractLimit } from "./interfaces/reader.ts";
+
+/**
+ * Thrown when extracting an entry would exceed one of the reader's
+ * extraction limits. Nothing is returned for the entry, and the reader
+ * stays usable.
+ */
+export class ZipLimitError extends Error {
+  /** The budget that was exceeded. */
+  readonly limit: ExtractLimit;
+
+  /**
+   * Creates a limit error.
+   * @param limit - The budget that was exceeded.
+   * @param message - Describes the entry and the budget.
+   */
+  constructor(limit: ExtractLimit, message: string) {
+    super(message);
+    this.name = "ZipLimitError";
+    this.limit = limit;
+  }
+}
+
+/**
+ * Thrown when adding several entries is cancelled partway, by the abort
+ * signal or an error thrown from `onProgress`. The first `added` entries are
+ * in the archive and the others are not; `cause` is why it was cancelled.
+ */
+export class ZipCancelledError extends Error {
+  /** Number of entries added before the cancellation. */
+  readonly added: number;
+
+  /**
+   * Creates a cancellation error.
+   * @param added - Number of entries added before the cancellation.
+   * @param cause - The signal's reason, or what `onProgress` threw.
+   */
+  constructor(added: number, cause: unknown) {
+    super(`Cancelled after adding ${added} entries`, { cause });
+    this.name = "ZipCancelledError";
+    this.added = added;
+  }
+}
@@ -1,45 +1,93 @@
+import { rmSync } from "node:fs";
 import { Glob } from "bun";
+import { readAccessTrace } from "./access.ts";
 import { ZipArchiveReader } from "./classes/reader.ts";
 import { ZipArchiveWriter } from "./classes/writer.ts";
 import type { CompressionLevelType } from "./compression.ts";
 import type { FileData } from "./interfaces/file.ts";
-import { symbols } from "./symbols.ts";
+import type { Progress, ProgressOptions } from "./interfaces/progress.ts";
+import type {
+  AccessRecord,
+  ValidateOptions,
+  ValidationResult,
+  ZipReaderOptions,
+} from "./interfaces/reader.ts";
+import type {
+  AddFileOptions,
+  ZipWriterOptions,
+} from "./interfaces/writer.ts";
+import { hasProgress, offsetProgress } from "./progress.ts";
+import { symbols, warmup } from "./symbols.ts";
 
 //#region Convenience functions
 
-export function createArchive(filename?: string): ZipArchiveWriter {
-  return new ZipArchiveWriter(filename);
+// Options of one entry added by the directory helpers, carrying their
+// progress options offset by the work already done
+function entryOptions(
+  compression: CompressionLevelType | AddFileOptions | undefined,
+  progress: ProgressOptions | undefined,
+  done: Progress,
+): CompressionLevelType | AddFileOptions | undefined {
+  if (!progress || !hasProgress(progress)) {
+    return compression;
+  }
+
+  const options =
+    typeof compression === "object" ? compression : { level: compression };
+  return offsetProgress(
+    { ...options, onProgress: progress.onProgress, signal: progress.signal },
+    done,
+  );
+}
+
+export function createArchive(
+  filename?: string,
+  options?: ZipWriterOptions,
+): ZipArchiveWriter {
+  return new ZipArchiveWriter(filename, options);
 }
 
-export function createMemoryArchive(): ZipArchiveWriter {
-  return new ZipArchiveWriter();
+export function createMemoryArchive(
+  options?: ZipWriterOptions,
+): ZipArchiveWriter {
+  return new ZipArchiveWriter(undefined, options);
 }
 
 export const readArchive = openArchive;
 
-export function openArchive(filename: string): ZipArchiveReader {
-  return new ZipArchiveReader(filename);
+export function openArchive(
+  filename: string,
+  options?: ZipReaderOptions,
+): ZipArchiveReader {
+  return new ZipArchiveReader(filename, options);
 }
 
 export const readMemoryArchive = openMemoryArchive;
 
-export function openMemoryArchive(data: FileData): ZipArchiveReader {
-  return new ZipArchiveReader(data);
+export function openMemoryArchive(
+  data: FileData,
+  options?: ZipReaderOptions,
+): ZipArchiveReader {
+  return new ZipArchiveReader(data, options);
 }
 
 // Utility function to create a zip from a directory
 export async function zipDirectory(
   sourceDir: string,
   outputFile: string,
-  compressionLevel?: CompressionLevelType,
+  compressionLevel?: CompressionLevelType | AddFileOptions,
+  options?: ZipWriterOptions & ProgressOptions,
 ): Promise<void> {
-  const writer = createArchive(outputFile);
+  const writer = createArchive(outputFile, options);
+  const done = { bytes: 0, entries: 0 };
 
   try {
     // Use Glob to recursively scan all files in the directory (including hidden files)
     const glob = new Glob("**/*");
 
     for await (const file of glob.scan(sourceDir)) {
+      options?.signal?.throwIfAborted();
+
       // Skip directories (they will be created automatically when files are added)
       const filePath = `${sourceDir}/${file}`;
       const fileInfo = await Bun.file(filePath).stat();
@@ -49,11 +97,25 @@ export async function zipDirectory(
         const fileContent = await Bun.file(filePath).bytes();
 
         // Add the file to the zip with its relative path
-        writer.addFile(file, fileContent, compressionLevel);
+        writer.addFile(
+          file,
+          fileContent,
+          entryOptions(compressionLevel, options, done),
+        );
+        done.bytes += fileContent.length;
+        done.entries++;
       }
     }
-  } finally {
-    writer.finalize();
+
+    if (!writer.finalize()) {
+      throw new Error(`Failed to finalize zip archive: ${outputFile}`);
+    }
+  } catch (error) {
+    // Abandon the partial output of a run that failed or was aborted rather
+    // than leave an archive without a central directory behind
+    writer[Symbol.dispose]();
+    rmSync(outputFile, { force: true });
+    throw error;
   }
 }
 
@@ -61,17 +123,28 @@ export async function zipDirectory(
 export async function extractArchive(
   zipFile: string,
   outputDir: string,
+  options?: ZipReaderOptions & ProgressOptions,
 ): Promise<void> {
-  const reader = openArchive(zipFile);
+  const reader = openArchive(zipFile, options);
+  const progress = hasProgress(options)
+    ? { onProgress: options?.onProgress, signal: options?.signal }
+    : undefined;
+  const done = { bytes: 0, entries: 0 };
 
   try {
     const fileCount = reader.getFileCount();
 
     for (let i = 0; i < fileCount; i++) {
+      options?.signal?.throwIfAborted();
       const fileInfo = reader.getFileByIndex(i);
 
       if (!fileInfo.directory) {
-        const data = reader.extractFile(i);
+        const data = reader.extractFile(
+          i,
+          progress && offsetProgress(progress, done),
+        );
+        done.bytes += data.length;
+        done.entries++;
         const outputPath = `${outputDir}/${fileInfo.filename}`;
 
         // Ensure the directory exists
@@ -91,18 +164,91 @@ export async function extractArchive(
   }
 }
 
+// Utility function to check the integrity of a zip on several threads
+export function validateArchive(
+  zipFile: string,
+  options?: ValidateOptions & ZipReaderOptions,
+): ValidationResult {
+  const reader = openArchive(zipFile, options);
+
+  try {
+    return reader.validate(options);
+  } finally {
+    reader.close();
+  }
+}
+
+// Utility function to rewrite a zip with the entries of an access trace
+// first, in the order they were first accessed, then the others in their
+// current order. Entries are copied raw, so nothing is recompressed.
+export function repackArchive(
+  zipFile: string,
+  outputFile: string,
+  trace: string | AccessRecord[],
+): void {
+  const records = typeof trace === "string" ? readAccessTrace(trace) : trace;
+  const reader = openArchive(zipFile);
+
+  try {
+    const fileCount = reader.getFileCount();
+    const order: number[] = [];
+    const placed = new Uint8Array(fileCount);
+
+    for (const { index } of records) {
+      if (!Number.isInteger(index) || index < 0 || index >= fileCount) {
+        throw new Error(`Invalid entry index in access trace: ${index}`);
+      }
+      if (!placed[index]) {
+        placed[index] = 1;
+        order.push(index);
+      }
+    }
+    for (let i = 0; i < fileCount; i++) {
+      if (!placed[i]) {
+        order.push(i);
+      }
+    }
+
+    // The copy is about the size of the source, reserve it up front. Stored
+    // entries keep the alignment their padding claims.
+    const writer = createArchive(outputFile, {
+      expectedSize: Bun.file(zipFile).size,
+    });
+    try {
+      for (const index of order) {
+        if (!writer.copyFile(reader, index)) {
+          throw new Error(`Failed to copy entry at index ${index}`);
+        }
+      }
+      if (!writer.finalize()) {
+        throw new Error(`Failed to finalize zip archive: ${outputFile}`);
+      }
+    } catch (error) {
+      writer[Symbol.dispose]();
+      rmSync(outputFile, { force: true });
+      throw error;
+    }
+  } finally {
+    reader.close();
+  }
+}
+
 // Utility function to create a zip from a directory in memory
 export async function zipDirectoryToMemory(
   sourceDir: string,
-  compressionLevel?: CompressionLevelType,
+  compressionLevel?: CompressionLevelType | AddFileOptions,
+  options?: ZipWriterOptions & ProgressOptions,
 ): Promise<Uint8Array> {
-  const writer = createMemoryArchive();
+  const writer = createMemoryArchive(options);
+  const done = { bytes: 0, entries: 0 };
 
   try {
     // Use Glob to recursively scan all files in the directory (including hidden files)
     const glob = new Glob("**/*");
 
     for await (const file of glob.scan(sourceDir)) {
+      options?.signal?.throwIfAborted();
+
       // Skip directories (they will be created automatically when files are added)
       const filePath = `${sourceDir}/${file}`;
       const fileInfo = await Bun.file(filePath).stat();
@@ -112,23 +258,43 @@ export async function zipDirectoryToMemory(
         const fileContent = await Bun.file(filePath).bytes();
 
         // Add the file to the zip with its relative path
-        writer.addFile(file, fileContent, compressionLevel);
+        writer.addFile(
+          file,
+          fileContent,
+          entryOptions(compressionLevel, options, done),
+        );
+        done.bytes += fileContent.length;
+        done.entries++;
       }
     }
 
     return writer.finalizeToMemory();
   } finally {
-    // The writer is automatically cleaned up in finalizeToMemory
+    // finalizeToMemory releases the writer, this only frees the native
+    // archive of an export that failed or was aborted
+    writer[Symbol.dispose]();
   }
 }
 
 //#endregion
 
-export { symbols };
+export { symbols, warmup };
 
+export { readAccessTrace, writeAccessTrace } from "./access.ts";
 export * from "./classes/reader.ts";
+export * from "./classes/sharded.ts";
 export * from "./classes/writer.ts";
+export * from "./codec.ts";
 export * from "./compression.ts";
+export * from "./encryption.ts";
+export { ZipCancelledError, ZipLimitError } from "./errors.ts";
 export * from "./interfaces/file.ts";
+export * from "./interfaces/progress.ts";
 export * from "./interfaces/reader.ts";
+export * from "./interfaces/stats.ts";
+export * from "./interfaces/tracing.ts";
 export * from "./interfaces/writer.ts";
+export { nativeMemoryUsage } from "./memory.ts";
+export { metrics } from "./metrics.ts";
+export { getGlobalStats, setStatsTiming } from "./stats.ts";
+export { loadProbes, setTraceCallback } from "./tracing.ts";
@@ -0,0 +1,273 @@
+// Deflate64 decoder (zip method 9)
+//
+// Included from zip_wrapper.c. Deflate64, also called enhanced deflate, is
+// what Windows Explorer uses for large entries. It is deflate with three
+// changes:
+// - a 64KB window;
+// - length code 285 carries 16 extra bits (lengths 3-65538) instead of
+//   meaning 258;
+// - distance codes 30 and 31 reach back up to 65536 bytes.
+//
+// miniz only understands deflate, so these entries are decoded here. Entries
+// are always inflated into a buffer holding the whole output, so the window
+// is simply everything written so far.
+
+#define ZIP_METHOD_DEFLATE64 9
+
+#define INFLATE64_FAST_BITS 10
+#define INFLATE64_FAST_MASK ((1 << INFLATE64_FAST_BITS) - 1)
+#define INFLATE64_MAX_BITS 15
+
+typedef struct {
+    // Codes up to FAST_BITS long resolve in one lookup: symbol << 4 | length,
+    // or 0 for longer codes which take the canonical slow path
+    mz_uint16 fast[1 << INFLATE64_FAST_BITS];
+    mz_uint16 count[INFLATE64_MAX_BITS + 1];
+    mz_uint16 symbols[288];
+} inflate64_huffman_t;
+
+typedef struct {
+    const mz_uint8* in;
+    size_t in_length;
+    size_t in_pos;
+    mz_uint64 bits;
+    int bit_count;
+    // Zero bytes fed in past the end; only an error if they get consumed
+    size_t overrun;
+} inflate64_reader_t;
+
+static const mz_uint16 inflate64_length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 3};
+static const mz_uint8 inflate64_length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 16};
+static const mz_uint32 inflate64_dist_base[32] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 32769, 49153};
+static const mz_uint8 inflate64_dist_extra[32] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14};
+static const mz_uint8 inflate64_code_length_order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static void inflate64_refill(inflate64_reader_t* r) {
+    while (r->bit_count <= 56) {
+        mz_uint64 byte = 0;
+        if (r->in_pos < r->in_length) {
+            byte = r->in[r->in_pos++];
+        } else {
+            r->overrun++;
+        }
+        r->bits |= byte << r->bit_count;
+        r->bit_count += 8;
+    }
+}
+
+static mz_uint32 inflate64_bits(inflate64_reader_t* r, int count) {
+    if (!count) return 0;
+    if (r->bit_count < count) inflate64_refill(r);
+    mz_uint32 value = (mz_uint32)(r->bits & ((1ull << count) - 1));
+    r->bits >>= count;
+    r->bit_count -= count;
+    return value;
+}
+
+// Build decoding tables from code lengths. Incomplete codes are allowed (a
+// missing code is reported when it is hit), over-subscribed ones are not.
+static int inflate64_build(inflate64_huffman_t* h, const mz_uint8* lengths, int n) {
+    mz_uint16 offsets[INFLATE64_MAX_BITS + 1];
+    mz_uint32 next_code[INFLATE64_MAX_BITS + 1];
+
+    memset(h->count, 0, sizeof(h->count));
+    for (int i = 0; i < n; i++) h->count[lengths[i]]++;
+    h->count[0] = 0;
+
+    int left = 1;
+    for (int len = 1; len <= INFLATE64_MAX_BITS; len++) {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0) return 0;
+    }
+
+    offsets[1] = 0;
+    next_code[1] = 0;
+    for (int len = 1; len < INFLATE64_MAX_BITS; len++) {
+        offsets[len + 1] = (mz_uint16)(offsets[len] + h->count[len]);
+        next_code[len + 1] = (next_code[len] + h->count[len]) << 1;
+    }
+
+    memset(h->fast, 0, sizeof(h->fast));
+    for (int symbol = 0; symbol < n; symbol++) {
+        int len = lengths[symbol];
+        if (!len) continue;
+        h->symbols[offsets[len]++] = (mz_uint16)symbol;
+
+        if (len > INFLATE64_FAST_BITS) continue;
+
+        // Codes are sent most significant bit first, the bit buffer is LSB first
+        mz_uint32 code = next_code[len]++, reversed = 0;
+        for (int b = 0; b < len; b++) reversed |= ((code >> b) & 1) << (len - 1 - b);
+        for (mz_uint32 j = reversed; j < (1u << INFLATE64_FAST_BITS); j += 1u << len) {
+            h->fast[j] = (mz_uint16)((symbol << 4) | len);
+        }
+    }
+    return 1;
+}
+
+// Decode one symbol, or return -1 for a code that is not in the table
+static int inflate64_decode(inflate64_reader_t* r, const inflate64_huffman_t* h) {
+    if (r->bit_count < INFLATE64_MAX_BITS) inflate64_refill(r);
+
+    mz_uint16 entry = h->fast[r->bits & INFLATE64_FAST_MASK];
+    if (entry) {
+        r->bits >>= entry & 15;
+        r->bit_count -= entry & 15;
+        return entry >> 4;
+    }
+
+    // Canonical decoding one bit at a time, for codes longer than FAST_BITS
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len <= INFLATE64_MAX_BITS; len++) {
+        code |= (int)((r->bits >> (len - 1)) & 1);
+        int count = h->count[len];
+        if (code - count < first) {
+            r->bits >>= len;
+            r->bit_count -= len;
+            return h->symbols[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static int inflate64_fixed_tables(inflate64_huffman_t* litlen, inflate64_huffman_t* dist) {
+    mz_uint8 lengths[288];
+    for (int i = 0; i < 288; i++) lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+    if (!inflate64_build(litlen, lengths, 288)) return 0;
+
+    for (int i = 0; i < 32; i++) lengths[i] = 5;
+    return inflate64_build(dist, lengths, 32);
+}
+
+static int inflate64_dynamic_tables(inflate64_reader_t* r, inflate64_huffman_t* litlen, inflate64_huffman_t* dist) {
+    mz_uint8 lengths[286 + 32];
+    mz_uint8 code_lengths[19];
+    inflate64_huffman_t code_length_table;
+
+    int hlit = (int)inflate64_bits(r, 5) + 257;
+    int hdist = (int)inflate64_bits(r, 5) + 1;
+    int hclen = (int)inflate64_bits(r, 4) + 4;
+    if (hlit > 286) return 0;
+
+    memset(code_lengths, 0, sizeof(code_lengths));
+    for (int i = 0; i < hclen; i++) code_lengths[inflate64_code_length_order[i]] = (mz_uint8)inflate64_bits(r, 3);
+    if (!inflate64_build(&code_length_table, code_lengths, 19)) return 0;
+
+    for (int i = 0; i < hlit + hdist;) {
+        int symbol = inflate64_decode(r, &code_length_table);
+        if (symbol < 0) return 0;
+
+        if (symbol < 16) {
+            lengths[i++] = (mz_uint8)symbol;
+            continue;
+        }
+
+        int repeat, value = 0;
+        if (symbol == 16) {
+            if (i == 0) return 0;
+            value = lengths[i - 1];
+            repeat = 3 + (int)inflate64_bits(r, 2);
+        } else if (symbol == 17) {
+            repeat = 3 + (int)inflate64_bits(r, 3);
+        } else {
+            repeat = 11 + (int)inflate64_bits(r, 7);
+        }
+        if (i + repeat > hlit + hdist) return 0;
+        while (repeat--) lengths[i++] = (mz_uint8)value;
+    }
+
+    // A block without an end-of-block code could never finish
+    if (!lengths[256]) return 0;
+
+    return inflate64_build(litlen, lengths, hlit) && inflate64_build(dist, lengths + hlit, hdist);
+}
+
+// Inflate a whole Deflate64 stream. Returns 1 only if exactly dst_len bytes
+// were produced from well-formed input.
+static int inflate64(const void* src, size_t src_len, void* dst, size_t dst_len) {
+    inflate64_reader_t r;
+    inflate64_huffman_t litlen, dist;
+    mz_uint8* out = (mz_uint8*)dst;
+    size_t pos = 0;
+    int final;
+
+    memset(&r, 0, sizeof(r));
+    r.in = (const mz_uint8*)src;
+    r.in_length = src_len;
+
+    do {
+        final = (int)inflate64_bits(&r, 1);
+        int type = (int)inflate64_bits(&r, 2);
+
+        if (type == 0) {
+            // Drop to a byte boundary and hand the whole bytes still in the bit
+            // buffer back to the input
+            inflate64_bits(&r, r.bit_count & 7);
+            size_t buffered = (size_t)(r.bit_count / 8);
+            if (r.overrun > buffered) return 0;
+            r.in_pos -= buffered - r.overrun;
+            r.overrun = 0;
+            r.bits = 0;
+            r.bit_count = 0;
+
+            if (r.in_length - r.in_pos < 4) return 0;
+            size_t len = (size_t)r.in[r.in_pos] | ((size_t)r.in[r.in_pos + 1] << 8);
+            size_t nlen = (size_t)r.in[r.in_pos + 2] | ((size_t)r.in[r.in_pos + 3] << 8);
+            r.in_pos += 4;
+            if (len != (~nlen & 0xFFFF)) return 0;
+            if (len > r.in_length - r.in_pos || len > dst_len - pos) return 0;
+
+            memcpy(out + pos, r.in + r.in_pos, len);
+            r.in_pos += len;
+            pos += len;
+            continue;
+        }
+
+        if (type == 1) {
+            if (!inflate64_fixed_tables(&litlen, &dist)) return 0;
+        } else if (type == 2) {
+            if (!inflate64_dynamic_tables(&r, &litlen, &dist)) return 0;
+        } else {
+            return 0;
+        }
+
+        for (;;) {
+            int symbol = inflate64_decode(&r, &litlen);
+            if (symbol < 0) return 0;
+
+            if (symbol < 256) {
+                if (pos >= dst_len) return 0;
+                out[pos++] = (mz_uint8)symbol;
+                continue;
+            }
+            if (symbol == 256) break;
+
+            symbol -= 257;
+            if (symbol >= 29) return 0;
+            size_t len = inflate64_length_base[symbol] + inflate64_bits(&r, inflate64_length_extra[symbol]);
+
+            symbol = inflate64_decode(&r, &dist);
+            if (symbol < 0 || symbol >= 32) return 0;
+            size_t distance = inflate64_dist_base[symbol] + inflate64_bits(&r, inflate64_dist_extra[symbol]);
+
+            if (distance > pos || len > dst_len - pos) return 0;
+
+            const mz_uint8* from = out + pos - distance;
+            if (distance >= len) {
+                memcpy(out + pos, from, len);
+            } else {
+                for (size_t i = 0; i < len; i++) out[pos + i] = from[i];
+            }
+            pos += len;
+        }
+    } while (!final);
+
+    // Every bit consumed must have come from the input
+    if ((r.in_pos + r.overrun) * 8 - (size_t)r.bit_count > src_len * 8) return 0;
+
+    return pos == dst_len;
+}
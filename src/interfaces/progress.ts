@@ -0,0 +1,28 @@
+/** Work an operation has done so far. */
+export interface Progress {
+  /** Uncompressed entry bytes added or extracted. */
+  bytes: number;
+  /** Entries completed. */
+  entries: number;
+}
+
+/** Receives the progress of an operation. */
+export type ProgressCallback = (progress: Progress) => void;
+
+/**
+ * Progress reporting and cancellation of an operation. Native calls are
+ * synchronous, so both are handled on the calling thread while the call
+ * runs: about every megabyte of a large entry as it is compressed or
+ * decompressed, and as each entry completes.
+ */
+export interface ProgressOptions {
+  /** Called with the work done so far. */
+  onProgress?: ProgressCallback;
+  /**
+   * Stops the operation, which throws the signal's reason. While a native
+   * call runs the event loop does not, so the signal is seen when it was
+   * aborted before the call, from `onProgress`, or (for the asynchronous
+   * helpers) between entries.
+   */
+  signal?: AbortSignal;
+}
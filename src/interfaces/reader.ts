@@ -1,11 +1,14 @@
 import type { ZipFile } from "./file.ts";
+import type { ProgressOptions } from "./progress.ts";
+import type { ZipStats } from "./stats.ts";
 
 /**
  * Interface for reading and extracting files from ZIP archives.
  * Provides methods to access archive contents by index or filename,
- * and extract data in various formats.
+ * and extract data in various formats. Disposing of a reader (`using`)
+ * closes it.
  */
-export interface ZipReader {
+export interface ZipReader extends Disposable {
   /**
    * Gets the total number of files in the archive.
    * @returns The number of files in the archive.
@@ -22,64 +25,83 @@ export interface ZipReader {
   /**
    * Extracts a file from the archive by index as a Uint8Array.
    * @param index - The zero-based index of the file to extract.
+   * @param options - Optional per-call settings such as the CRC mode.
    * @returns The decompressed file content as Uint8Array.
    */
-  extractFile(index: number): Uint8Array;
+  extractFile(index: number, options?: ExtractOptions): Uint8Array;
 
   /**
    * Reads a file from the archive by index as a Uint8Array.
    * Alias for {@link extractFile}.
    * @param index - The zero-based index of the file to read.
+   * @param options - Optional per-call settings such as the CRC mode.
    * @returns The decompressed file content as Uint8Array.
    */
-  readFile(index: number): Uint8Array;
+  readFile(index: number, options?: ExtractOptions): Uint8Array;
 
   /**
    * Extracts a file from the archive by index as an ArrayBuffer.
    * @param index - The zero-based index of the file to extract.
+   * @param options - Optional per-call settings such as the CRC mode.
    * @returns The decompressed file content as ArrayBuffer.
    */
-  extractFileArrayBuffer(index: number): ArrayBuffer;
+  extractFileArrayBuffer(index: number, options?: ExtractOptions): ArrayBuffer;
 
   /**
    * Extracts a file from the archive by index as a Node.js Buffer.
    * @param index - The zero-based index of the file to extract.
+   * @param options - Optional per-call settings such as the CRC mode.
    * @returns The decompressed file content as Buffer.
    */
-  extractFileBuffer(index: number): Buffer;
+  extractFileBuffer(index: number, options?: ExtractOptions): Buffer;
 
   /**
    * Reads a file from the archive by index as an ArrayBuffer.
    * Alias for {@link extractFileArrayBuffer}.
    * @param index - The zero-based index of the file to read.
+   * @param options - Optional per-call settings such as the CRC mode.
    * @returns The decompressed file content as ArrayBuffer.
    */
-  readFileArrayBuffer(index: number): ArrayBuffer;
+  readFileArrayBuffer(index: number, options?: ExtractOptions): ArrayBuffer;
 
   /**
    * Reads a file from the archive by index as a Node.js Buffer.
    * Alias for {@link extractFileBuffer}.
    * @param index - The zero-based index of the file to read.
+   * @param options - Optional per-call settings such as the CRC mode.
    * @returns The decompressed file content as Buffer.
    */
-  readFileBuffer(index: number): Buffer;
+  readFileBuffer(index: number, options?: ExtractOptions): Buffer;
 
   /**
    * Extracts a file from the archive by its filename as a Uint8Array.
    * @param filename - The name/path of the file within the archive.
+   * @param options - Optional per-call settings such as the CRC mode.
    * @returns The decompressed file content as Uint8Array.
    * @throws Error if the file is not found in the archive.
    */
-  extractFileByName(filename: string): Uint8Array;
+  extractFileByName(filename: string, options?: ExtractOptions): Uint8Array;
 
   /**
    * Reads a file from the archive by its filename as a Uint8Array.
    * Alias for {@link extractFileByName}.
    * @param filename - The name/path of the file within the archive.
+   * @param options - Optional per-call settings such as the CRC mode.
    * @returns The decompressed file content as Uint8Array.
    * @throws Error if the file is not found in the archive.
    */
-  readFileByName(filename: string): Uint8Array;
+  readFileByName(filename: string, options?: ExtractOptions): Uint8Array;
+
+  /**
+   * Gets the data of a stored (uncompressed, unencrypted) entry without
+   * copying it: a view into a private memory mapping of the archive file, or
+   * into the data of a memory-based archive. Entries written with the
+   * `align` writer option start on that boundary. The CRC is not checked.
+   * @param index - The zero-based index of the file.
+   * @returns The entry data, which stays valid after the reader is closed.
+   * @throws Error if the entry is compressed or encrypted.
+   */
+  mapFile(index: number): Uint8Array;
 
   /**
    * Finds a file in the archive by its filename.
@@ -88,9 +110,185 @@ export interface ZipReader {
    */
   findFile(filename: string): number;
 
+  /**
+   * Sets the password used to decrypt WinZip AES encrypted entries.
+   * @param password - The password, or undefined to forget it.
+   */
+  setPassword(password: string | undefined): void;
+
+  /**
+   * Replaces the extraction budgets. The total size starts counting again
+   * from zero.
+   * @param limits - The new budgets, or an empty object to remove them.
+   */
+  setLimits(limits: ExtractLimits): void;
+
+  /**
+   * Waits for the CRC checks of entries extracted with the `deferred` CRC mode.
+   * @throws Error naming the entries whose data did not match its CRC.
+   */
+  verifyDeferred(): void;
+
+  /**
+   * Checks the integrity of every entry on several threads.
+   * @param options - Optional thread count, header-only mode and failure limit.
+   * @returns The entries checked and the failures found.
+   */
+  validate(options?: ValidateOptions): ValidationResult;
+
+  /**
+   * Gets the performance counters of this reader, including the work of
+   * validation threads. Still available after the reader has been closed.
+   * @returns Bytes, entries, allocations and time spent so far.
+   */
+  getStats(): ZipStats;
+
   /**
    * Closes the archive and releases associated resources.
    * @returns True if the archive was successfully closed, false otherwise.
    */
   close(): boolean;
 }
+
+/**
+ * Options for opening a ZIP archive reader.
+ */
+export interface ZipReaderOptions {
+  /**
+   * Password for WinZip AES encrypted entries. Can also be set later with
+   * {@link ZipReader.setPassword}.
+   */
+  password?: string;
+  /**
+   * How extracted entries are checked against their CRC. Defaults to
+   * `verify`, and can be overridden per call.
+   */
+  crc?: CrcMode;
+  /**
+   * Budgets for extracting entries, so a hostile or corrupt archive fails
+   * fast with a {@link ZipLimitError} instead of exhausting memory or time.
+   * Can be replaced later with {@link ZipReader.setLimits}.
+   */
+  limits?: ExtractLimits;
+  /**
+   * Path of a file to record the access trace of the reader to: the first
+   * extraction or mapping of each entry, in order, with its time. The file is
+   * written when the reader is closed, and {@link repackArchive} reads it to
+   * move those entries to the front of the archive.
+   */
+  accessTrace?: string;
+}
+
+/** An entry access recorded in an access trace. */
+export interface AccessRecord {
+  /** The zero-based index of the entry. */
+  index: number;
+  /** Milliseconds from opening the reader to the first access. */
+  time: number;
+}
+
+/**
+ * Budgets enforced by the native layer when extracting entries. Sizes are
+ * checked against the central directory before any memory is allocated; an
+ * entry whose data turns out larger than declared fails to extract. Limits
+ * that are unset or 0 are not enforced. Validation is not subject to them.
+ */
+export interface ExtractLimits {
+  /** Largest uncompressed size of a single entry, in bytes. */
+  maxEntrySize?: number;
+  /** Most bytes extracted in total, counted from when the limits are set. */
+  maxTotalSize?: number;
+  /** Highest ratio of uncompressed to compressed size of an entry. */
+  maxRatio?: number;
+  /**
+   * Time (a Date or a timestamp in milliseconds) after which extractions
+   * fail. It is also checked while a deflated entry inflates, about every
+   * megabyte of output.
+   */
+  deadline?: Date | number;
+}
+
+/**
+ * An {@link ExtractLimits} budget, as reported by {@link ZipLimitError}:
+ * - `entrySize`: {@link ExtractLimits.maxEntrySize};
+ * - `totalSize`: {@link ExtractLimits.maxTotalSize};
+ * - `ratio`: {@link ExtractLimits.maxRatio};
+ * - `deadline`: {@link ExtractLimits.deadline}.
+ */
+export type ExtractLimit = "entrySize" | "totalSize" | "ratio" | "deadline";
+
+/**
+ * How an extracted entry is checked against its CRC:
+ * - `verify`: before the data is returned, throwing on a mismatch;
+ * - `skip`: not at all, for trusted archives checksummed as a whole;
+ * - `deferred`: on a background thread, so the data is returned at once.
+ *   Mismatches are reported by {@link ZipReader.verifyDeferred} or when the
+ *   reader is closed. The data must not be modified until then.
+ */
+export type CrcMode = "verify" | "skip" | "deferred";
+
+/**
+ * Per-call options for extracting an entry, with progress reporting and
+ * cancellation.
+ */
+export interface ExtractOptions extends ProgressOptions {
+  /** Overrides the reader's CRC mode for this call. */
+  crc?: CrcMode;
+}
+
+/**
+ * Options for {@link ZipReader.validate}.
+ */
+export interface ValidateOptions {
+  /** Threads checking entries. Defaults to the number of logical CPUs. */
+  threads?: number;
+  /**
+   * Only compare each local header with the central directory, without
+   * reading entry data. Much faster, but does not catch corrupted data.
+   */
+  headersOnly?: boolean;
+  /**
+   * Stop once this many failures have been found. Defaults to checking every
+   * entry.
+   */
+  maxFailures?: number;
+}
+
+/**
+ * Why an entry failed validation:
+ * - `header`: its local header or data descriptor disagrees with the central directory;
+ * - `unsupported`: it uses a compression method that cannot be decoded;
+ * - `password`: it is encrypted and no password was set;
+ * - `data`: it could not be decompressed or failed its CRC or MAC check;
+ * - `read`: it could not be read or did not fit in memory.
+ */
+export type ValidationFailureReason =
+  | "header"
+  | "unsupported"
+  | "password"
+  | "data"
+  | "read";
+
+/**
+ * An entry that failed validation.
+ */
+export interface ValidationFailure {
+  /** The zero-based index of the entry. */
+  index: number;
+  /** The name/path of the entry within the archive. */
+  filename: string;
+  /** Why the entry failed. */
+  reason: ValidationFailureReason;
+}
+
+/**
+ * Result of {@link ZipReader.validate}.
+ */
+export interface ValidationResult {
+  /** True if every entry was checked and none failed. */
+  valid: boolean;
+  /** Number of entries checked, fewer than the file count if the run stopped early. */
+  entriesChecked: number;
+  /** Failed entries ordered by index. */
+  failures: ValidationFailure[];
+}
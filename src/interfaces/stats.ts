@@ -0,0 +1,29 @@
+/**
+ * Performance counters of a reader or writer, or of the whole process.
+ * Times stay 0 until {@link setStatsTiming} enables them, except deflate time
+ * which writers always measure.
+ */
+export interface ZipStats {
+  /** Archive bytes read, including entry data read straight from memory. */
+  bytesRead: number;
+  /** Archive bytes written. */
+  bytesWritten: number;
+  /** Entry data before compression, as added or extracted. */
+  uncompressedBytes: number;
+  /** Entry data as stored in the archive (compressed, stored or encrypted). */
+  compressedBytes: number;
+  /** Entries added or extracted. */
+  entries: number;
+  /** Native allocations made by the archive and its buffers. */
+  allocations: number;
+  /** Calls into the archive's read and write callbacks. */
+  ioCalls: number;
+  /** Seconds spent inside the deflate codec. */
+  deflateSeconds: number;
+  /** Seconds spent inflating (or copying stored) entry data. */
+  inflateSeconds: number;
+  /** Seconds spent computing CRC-32 checksums, including deferred checks. */
+  crcSeconds: number;
+  /** Seconds spent in archive reads and writes. */
+  ioSeconds: number;
+}
@@ -0,0 +1,34 @@
+/** Operations reported to the trace callback. */
+export type TraceOperation =
+  | "locate"
+  | "extract"
+  | "add"
+  | "finalize"
+  | "validate";
+
+/**
+ * A finished reader or writer operation, as passed to the callback installed
+ * with {@link setTraceCallback}. Times are in milliseconds, with the start
+ * relative to the Unix epoch so spans can be handed to any tracing system.
+ */
+export interface TraceSpan {
+  /** What was done. */
+  operation: TraceOperation;
+  /** Entry name, for operations on a single entry. */
+  name?: string;
+  /** Entry index in the archive, once known. */
+  index?: number;
+  /** Bytes consumed: compressed bytes extracted, or input bytes added. */
+  bytesIn?: number;
+  /** Bytes produced: extracted bytes, or bytes stored in the archive. */
+  bytesOut?: number;
+  /** Start of the operation, in milliseconds since the Unix epoch. */
+  startTime: number;
+  /** Duration of the operation in milliseconds. */
+  duration: number;
+  /** The error the operation threw, if it failed. */
+  error?: unknown;
+}
+
+/** Receives every span while installed with {@link setTraceCallback}. */
+export type TraceCallback = (span: TraceSpan) => void;
@@ -1,24 +1,74 @@
-import type { CompressionLevelType } from "../compression.ts";
+import type {
+  CompressionLevelType,
+  CompressionStrategyType,
+} from "../compression.ts";
+import type {
+  EncryptionStrengthType,
+  EncryptionVersionType,
+} from "../encryption.ts";
 import type { FileData } from "./file.ts";
+import type { ProgressOptions } from "./progress.ts";
+import type { ZipReader } from "./reader.ts";
+import type { ZipStats } from "./stats.ts";
 
 /**
  * Interface for creating and writing files to ZIP archives.
- * Supports both file-based and memory-based archive creation.
+ * Supports both file-based and memory-based archive creation. Disposing of a
+ * writer (`using`) that has not been finalized abandons the archive.
  */
-export interface ZipWriter {
+export interface ZipWriter extends Disposable {
   /**
    * Adds a file to the ZIP archive.
    * @param filename - The name/path for the file within the archive.
    * @param data - The file content to add (Uint8Array, ArrayBuffer, or DataView).
-   * @param compressionLevel - Optional compression level (0-9). Defaults to no compression.
+   * @param compression - Optional compression level (0-11) or tuning options. Defaults to no compression.
    * @returns True if the file was successfully added, false otherwise.
    */
   addFile(
     filename: string,
     data: FileData,
-    compressionLevel?: CompressionLevelType,
+    compression?: CompressionLevelType | AddFileOptions,
   ): boolean;
 
+  /**
+   * Adds several files to the ZIP archive, in order. With
+   * {@link CompressionLevel.MAX_COMPRESSION} the entries are compressed in
+   * parallel before being written.
+   * @param entries - The files to add.
+   * @param compression - Optional compression level (0-11) or options applied to every entry.
+   * @returns True if all files were added, false if one failed (the files after it are not added).
+   * @throws {@link ZipCancelledError} with the number of files added if it was cancelled.
+   */
+  addFiles(
+    entries: ZipEntryInput[],
+    compression?: CompressionLevelType | AddFilesOptions,
+  ): boolean;
+
+  /**
+   * Copies an entry of an open archive into this one as is: its compressed
+   * (or encrypted) data is copied without being inflated or checked. Stored
+   * entries are padded to the larger of this writer's `align` and the
+   * alignment they were written with.
+   * @param reader - The archive to copy from.
+   * @param index - The zero-based index of the entry in that archive.
+   * @returns True if the entry was copied, false otherwise.
+   */
+  copyFile(reader: ZipReader, index: number): boolean;
+
+  /**
+   * Gets the compression results achieved so far. Still available after the
+   * archive has been finalized.
+   * @returns Totals, ratio, speed and the adaptive controller's current settings.
+   */
+  getCompressionReport(): CompressionReport;
+
+  /**
+   * Gets the performance counters of this writer. Still available after the
+   * archive has been finalized, as they stood just before finalizing.
+   * @returns Bytes, entries, allocations and time spent so far.
+   */
+  getStats(): ZipStats;
+
   /**
    * Finalizes the ZIP archive and writes it to disk.
    * Must only be called for file-based archives created with a filename.
@@ -27,3 +77,195 @@ export interface ZipWriter {
    */
   finalize(): boolean;
 }
+
+/**
+ * Fine-grained deflate settings for a single entry, with progress reporting
+ * and cancellation. Invalid values are rejected by the native layer and make
+ * addFile return false.
+ */
+export interface AddFileOptions extends ProgressOptions {
+  /**
+   * Compression level, 0 (store) to 10 (uber), or 11 for the optimal parse.
+   * Defaults to no compression.
+   */
+  level?: number;
+  /** Match search strategy. Defaults to {@link CompressionStrategy.DEFAULT}. */
+  strategy?: CompressionStrategyType;
+  /**
+   * Number of hash chain probes per match search (1-4095), replacing the
+   * level's own count. Higher finds longer matches at the cost of speed.
+   */
+  probes?: number;
+  /**
+   * Force greedy (`true`) or lazy (`false`) match parsing. By default levels
+   * 1-3 parse greedily and higher levels lazily.
+   */
+  greedy?: boolean;
+}
+
+/**
+ * Options for {@link ZipWriter.addFiles}.
+ */
+export interface AddFilesOptions extends AddFileOptions {
+  /**
+   * Threads used to compress {@link CompressionLevel.MAX_COMPRESSION} entries.
+   * Defaults to the number of logical CPUs.
+   */
+  threads?: number;
+}
+
+/**
+ * A file to add with {@link ZipWriter.addFiles}.
+ */
+export interface ZipEntryInput {
+  /** The name/path for the file within the archive. */
+  filename: string;
+  /** The file content. */
+  data: FileData;
+}
+
+/**
+ * Controls the entropy probe that stores incompressible entries without
+ * spending any compression effort on them.
+ */
+export interface AutoStoreOptions {
+  /**
+   * Byte-histogram entropy, in bits per byte, at or above which an entry is
+   * stored. Random or already-compressed data sits close to 8. Defaults to 7.8.
+   */
+  entropyThreshold?: number;
+  /**
+   * File extensions (e.g. ".jpg") that are always stored without probing.
+   * See {@link INCOMPRESSIBLE_EXTENSIONS} for a ready-made list.
+   */
+  extensions?: string[];
+}
+
+/**
+ * Lets the writer pick the compression level per entry to stay within a
+ * throughput budget. Give either a fixed target or a deadline together with
+ * the expected amount of input.
+ */
+export interface AdaptiveCompressionOptions {
+  /** Target ingest throughput in MB/s (10^6 bytes per second). */
+  targetThroughput?: number;
+  /** Time (epoch milliseconds or Date) by which all entries should be added. */
+  deadline?: number | Date;
+  /** Total number of bytes expected to be added before the deadline. */
+  expectedBytes?: number;
+}
+
+/**
+ * WinZip AES encryption applied to every entry of a writer. Directory entries
+ * carry no data and are left unencrypted.
+ */
+export interface EncryptionOptions {
+  /** The password entries are encrypted with. */
+  password: string;
+  /** AES key size. Defaults to {@link EncryptionStrength.AES_256}. */
+  strength?: EncryptionStrengthType;
+  /** Format version. Defaults to {@link EncryptionVersion.AE_2}. */
+  version?: EncryptionVersionType;
+}
+
+/**
+ * Achieved compression results of a writer so far.
+ */
+export interface CompressionReport {
+  /** Number of entries added. */
+  entries: number;
+  /** Total uncompressed bytes added. */
+  bytesIn: number;
+  /** Total bytes of entry data written (compressed or stored). */
+  bytesOut: number;
+  /** bytesOut / bytesIn, or 1 when nothing was added. */
+  ratio: number;
+  /** Seconds spent adding entries, including CRC and writing. */
+  seconds: number;
+  /** Seconds spent inside the deflate codec. */
+  compressionSeconds: number;
+  /** Achieved ingest throughput in MB/s. */
+  throughput: number;
+  /** Compression level the adaptive controller currently uses, -1 when disabled. */
+  level: number;
+  /** tdefl probe count the adaptive controller currently uses, -1 when disabled. */
+  probes: number;
+}
+
+/**
+ * Options for creating a ZIP archive writer.
+ */
+export interface ZipWriterOptions {
+  /**
+   * Store entries that look incompressible instead of deflating them.
+   * `true` enables the entropy probe with its default threshold.
+   */
+  autoStore?: boolean | AutoStoreOptions;
+  /**
+   * Adapt the compression level per entry to a throughput target or deadline.
+   * The level passed to addFile becomes the upper bound, and entries added
+   * without a level may use up to {@link CompressionLevel.BEST_COMPRESSION}.
+   * Entries added with a strategy, probe count or greedy setting are left as
+   * requested.
+   */
+  adaptive?: AdaptiveCompressionOptions;
+  /**
+   * Encrypt entries with WinZip AES (AE-1/AE-2). Every entry gets its own
+   * salt, so each one costs a key derivation of about a millisecond.
+   */
+  encryption?: EncryptionOptions;
+  /**
+   * Expected size of the finished archive in bytes. File-based archives
+   * reserve the space on disk up front, so the file system can allocate it
+   * in one contiguous piece, and are cut back to their real size by
+   * finalize(). Memory-based archives allocate their buffer at this size
+   * instead of growing it. Overestimating only costs the reservation.
+   */
+  expectedSize?: number;
+  /**
+   * Start the data of stored (uncompressed, unencrypted) entries on a
+   * multiple of this many bytes, a power of two up to 32768, by padding
+   * their local headers the way zipalign does. With 4096 (the page size)
+   * such entries can be mapped and used in place with
+   * {@link ZipReader.mapFile}; 64 is enough for aligned SIMD loads.
+   */
+  align?: number;
+}
+
+/**
+ * How a {@link ShardedZipWriter} picks the shard of an entry.
+ * - `size`: the shard with the fewest bytes so far, balancing the work.
+ * - `hash`: the 32-bit FNV-1a hash of the UTF-8 name modulo the shard count,
+ *   so the shard of a name can be found without the manifest.
+ */
+export type ShardRouting = "size" | "hash";
+
+/**
+ * Options of a {@link ShardedZipWriter}. The writer options apply to every
+ * shard, except `expectedSize`, which is split evenly between them. Adaptive
+ * compression is not available, entries use the level they are added with.
+ */
+export interface ShardedZipWriterOptions
+  extends Omit<ZipWriterOptions, "adaptive"> {
+  /** Number of archives to split the entries into. Defaults to the core count. */
+  shards?: number;
+  /** How entries are assigned to shards. Defaults to `size`. */
+  routing?: ShardRouting;
+  /**
+   * Bytes of entry data queued before they are written, all shards at once.
+   * Defaults to 64MB.
+   */
+  batchSize?: number;
+}
+
+/** The manifest written next to the shards of a {@link ShardedZipWriter}. */
+export interface ShardManifest {
+  /** Version of the manifest layout. */
+  version: 1;
+  /** How entries were assigned to shards. */
+  routing: ShardRouting;
+  /** Paths of the shard archives, relative to the manifest. */
+  shards: string[];
+  /** Index of the shard holding each entry, by entry name. */
+  entries: Record<string, number>;
+}
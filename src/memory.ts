@@ -0,0 +1,147 @@
+import { ptr } from "bun:ffi";
+import { native } from "./symbols.ts";
+
+/** Native memory below which dropped handles are left to the regular GC. */
+const MIN_COLLECT_THRESHOLD = 64 * 1024 * 1024;
+
+/** Native memory at which the next collection is requested. */
+let collectThreshold = MIN_COLLECT_THRESHOLD;
+
+/** Growth of memory-based writers after which native memory is checked. */
+const CHECK_GROWTH_BYTES = 4 * 1024 * 1024;
+
+/** Writes to memory-based writers after which native memory is checked. */
+const CHECK_GROWTH_CALLS = 256;
+
+/** Bytes written to memory-based writers since the last check. */
+let uncheckedBytes = 0;
+
+/** Writes to memory-based writers since the last check. */
+let uncheckedCalls = 0;
+
+/**
+ * Result of get_handle_usage, reused across calls:
+ * struct { int readers; int writers; uint64_t memory_bytes; }
+ */
+const usage = new BigUint64Array(2);
+
+/**
+ * Buffers a native handle's background threads may still be reading, by
+ * handle. They are held here rather than by their owner, which can be
+ * collected in the same cycle as them, and let go once the handle's threads
+ * are done with them.
+ */
+const pinned = new Map<number, Uint8Array[]>();
+
+/**
+ * Releases the native handle of a reader or writer that was garbage collected
+ * without being closed or finalized. Releasing joins the handle's threads,
+ * so its pinned buffers are only dropped after that.
+ */
+const registry = new FinalizationRegistry<number>((handleId) => {
+  native().release_zip(handleId);
+  pinned.delete(handleId);
+});
+
+/** Handles of the open readers and writers. */
+const handles = new WeakMap<object, number>();
+
+/**
+ * Gets the native memory held by all open readers and writers: the handles,
+ * their scratch buffers, central directories and in-memory archives.
+ * @returns The total in bytes.
+ */
+export function nativeMemoryUsage(): number {
+  native().get_handle_usage(ptr(usage));
+  return Number(usage[1]);
+}
+
+/**
+ * Native memory is invisible to the GC, so a program that drops readers or
+ * writers without closing them would not collect them until the JS heap
+ * grows on its own. Requests a collection once native memory has doubled
+ * since the last one.
+ */
+function applyMemoryPressure(): void {
+  uncheckedBytes = 0;
+  uncheckedCalls = 0;
+
+  const memory = nativeMemoryUsage();
+  if (memory >= collectThreshold) {
+    Bun.gc(false);
+    collectThreshold = Math.max(MIN_COLLECT_THRESHOLD, memory * 2);
+  } else if (memory * 2 < collectThreshold) {
+    collectThreshold = Math.max(MIN_COLLECT_THRESHOLD, memory * 2);
+  }
+}
+
+/**
+ * Counts a write to a memory-based writer, which grows its native memory,
+ * and applies memory pressure once enough bytes or writes have added up
+ * since the last check, so adding small entries stays off the handle table.
+ * @param bytes - Entry data written, or 0 when unknown (raw copies).
+ */
+export function noteMemoryGrowth(bytes: number): void {
+  uncheckedBytes += bytes;
+  uncheckedCalls++;
+  if (
+    uncheckedBytes >= CHECK_GROWTH_BYTES ||
+    uncheckedCalls >= CHECK_GROWTH_CALLS
+  ) {
+    applyMemoryPressure();
+  }
+}
+
+/**
+ * Releases a native handle when its owner is garbage collected.
+ * @param owner - The reader or writer holding the handle.
+ * @param handleId - The native handle.
+ */
+export function trackHandle(owner: object, handleId: number): void {
+  registry.register(owner, handleId, owner);
+  handles.set(owner, handleId);
+  applyMemoryPressure();
+}
+
+/**
+ * Stops tracking a handle that its owner closed or finalized.
+ * @param owner - The reader or writer that held the handle.
+ */
+export function untrackHandle(owner: object): void {
+  registry.unregister(owner);
+  handles.delete(owner);
+}
+
+/**
+ * Gets the native handle of an open reader or writer, for calls that take
+ * another object's handle.
+ * @param owner - The reader or writer.
+ * @returns The handle, or undefined once it is closed or finalized.
+ */
+export function trackedHandle(owner: object): number | undefined {
+  return handles.get(owner);
+}
+
+/**
+ * Keeps a buffer alive while a native background thread of the handle reads
+ * it, even if its owner is garbage collected in the meantime.
+ * @param handleId - The native handle.
+ * @param data - The buffer.
+ */
+export function pinData(handleId: number, data: Uint8Array): void {
+  const buffers = pinned.get(handleId);
+  if (buffers) {
+    buffers.push(data);
+  } else {
+    pinned.set(handleId, [data]);
+  }
+}
+
+/**
+ * Lets go of the buffers pinned for a handle, once its background threads
+ * are done with them.
+ * @param handleId - The native handle.
+ */
+export function unpinData(handleId: number): void {
+  pinned.delete(handleId);
+}
@@ -0,0 +1,118 @@
+import { ptr } from "bun:ffi";
+import { getGlobalStats } from "./stats.ts";
+import { native } from "./symbols.ts";
+
+/** Operation types with a latency histogram, in native order. */
+const OPERATIONS = ["open", "locate", "extract", "add", "finalize"];
+
+// Layout of the native histograms: four sub-buckets per power of two from
+// 2^10 ns, plus one bucket below and one from 2^36 ns up
+const LATENCY_MIN_SHIFT = 10;
+const LATENCY_OCTAVES = 26;
+const LATENCY_SUB_BUCKETS = 4;
+const LATENCY_BUCKETS = LATENCY_OCTAVES * LATENCY_SUB_BUCKETS + 2;
+
+function metric(
+  lines: string[],
+  name: string,
+  type: "counter" | "gauge" | "histogram",
+  help: string,
+) {
+  lines.push(`# HELP ${name} ${help}`, `# TYPE ${name} ${type}`);
+}
+
+function renderLatency(lines: string[]) {
+  const name = "zip_bun_operation_duration_seconds";
+  metric(lines, name, "histogram", "Duration of zip-bun operations.");
+
+  const histogram = new BigUint64Array(LATENCY_BUCKETS + 2);
+  OPERATIONS.forEach((operation, index) => {
+    native().get_latency_histogram(index, ptr(histogram));
+    const label = `operation="${operation}"`;
+
+    // Prometheus buckets are cumulative; export one per power of two, which
+    // always falls on a native bucket boundary
+    let cumulative = histogram[2] as bigint;
+    for (let octave = 0; octave <= LATENCY_OCTAVES; octave++) {
+      if (octave > 0) {
+        for (let sub = 0; sub < LATENCY_SUB_BUCKETS; sub++) {
+          const bucket = 1 + (octave - 1) * LATENCY_SUB_BUCKETS + sub;
+          cumulative += histogram[2 + bucket] as bigint;
+        }
+      }
+      const le = 2 ** (LATENCY_MIN_SHIFT + octave) / 1e9;
+      lines.push(`${name}_bucket{${label},le="${le}"} ${cumulative}`);
+    }
+
+    const count = histogram[0] as bigint;
+    const seconds = Number(histogram[1]) / 1e9;
+    lines.push(
+      `${name}_bucket{${label},le="+Inf"} ${count}`,
+      `${name}_sum{${label}} ${seconds}`,
+      `${name}_count{${label}} ${count}`,
+    );
+  });
+}
+
+/**
+ * Renders latency histograms of every operation type (open, locate, extract,
+ * add, finalize), open handle counts, native memory in use and the global
+ * {@link ZipStats} counters in the Prometheus text exposition format, ready
+ * to be served from a `/metrics` endpoint.
+ * @returns The metrics, one sample per line.
+ */
+export function metrics(): string {
+  const lines: string[] = [];
+  renderLatency(lines);
+
+  const usage = new Int32Array(4);
+  native().get_handle_usage(ptr(usage));
+  const memoryBytes = Number(new BigUint64Array(usage.buffer)[1]);
+
+  metric(lines, "zip_bun_open_handles", "gauge", "Open readers and writers.");
+  lines.push(
+    `zip_bun_open_handles{kind="reader"} ${usage[0]}`,
+    `zip_bun_open_handles{kind="writer"} ${usage[1]}`,
+  );
+  metric(
+    lines,
+    "zip_bun_native_memory_bytes",
+    "gauge",
+    "Native memory held by open readers and writers.",
+  );
+  lines.push(`zip_bun_native_memory_bytes ${memoryBytes}`);
+
+  const stats = getGlobalStats();
+  const counters: [string, string, number][] = [
+    ["read_bytes", "Archive bytes read.", stats.bytesRead],
+    ["written_bytes", "Archive bytes written.", stats.bytesWritten],
+    [
+      "uncompressed_bytes",
+      "Entry data before compression.",
+      stats.uncompressedBytes,
+    ],
+    ["compressed_bytes", "Entry data as stored.", stats.compressedBytes],
+    ["entries", "Entries added or extracted.", stats.entries],
+    ["allocations", "Native allocations.", stats.allocations],
+    ["io_calls", "Archive read and write calls.", stats.ioCalls],
+  ];
+  for (const [name, help, value] of counters) {
+    metric(lines, `zip_bun_${name}_total`, "counter", help);
+    lines.push(`zip_bun_${name}_total ${value}`);
+  }
+
+  metric(
+    lines,
+    "zip_bun_time_seconds_total",
+    "counter",
+    "Time spent per phase, see setStatsTiming.",
+  );
+  lines.push(
+    `zip_bun_time_seconds_total{phase="deflate"} ${stats.deflateSeconds}`,
+    `zip_bun_time_seconds_total{phase="inflate"} ${stats.inflateSeconds}`,
+    `zip_bun_time_seconds_total{phase="crc"} ${stats.crcSeconds}`,
+    `zip_bun_time_seconds_total{phase="io"} ${stats.ioSeconds}`,
+  );
+
+  return `${lines.join("\n")}\n`;
+}
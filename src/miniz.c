@@ -3455,8 +3455,19 @@ static int mz_stat64(const char *path, struct __stat64 *buffer)
             *pDOS_time = 0;
             return;
         }
-#else
+#elif defined(_WIN32)
+        /* The CRT keeps the localtime result per thread */
         struct tm *tm = localtime(&time);
+#else
+        /* Entries can be added on several threads at once (sharded writers) */
+        struct tm tm_struct;
+        struct tm *tm = localtime_r(&time, &tm_struct);
+        if (!tm)
+        {
+            *pDOS_date = 0;
+            *pDOS_time = 0;
+            return;
+        }
 #endif /* #ifdef _MSC_VER */
 
         *pDOS_time = (mz_uint16)(((tm->tm_hour) << 11) + ((tm->tm_min) << 5) + ((tm->tm_sec) >> 1));
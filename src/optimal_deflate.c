@@ -0,0 +1,1065 @@
+// Optimal-parse deflate encoder
+//
+// Included from zip_wrapper.c after miniz.c, whose symbol tables it shares.
+//
+// tdefl picks matches greedily or with one step of lazy evaluation. For
+// archives that are written once and downloaded many times it pays to spend
+// far more CPU on the parse, the way Zopfli does:
+//
+// - Every (length, distance) choice at every position is found once per
+//   chunk and cached.
+// - The cheapest path through the input is found by dynamic programming
+//   under a bit-cost model, re-estimated from the symbol statistics of the
+//   previous pass for a number of iterations.
+// - The resulting symbol stream is split into the blocks that minimise the
+//   total encoded size, each block is re-parsed under its own statistics and
+//   written as whichever of stored, fixed or dynamic Huffman is smallest.
+//
+// The output is ordinary raw deflate. Every function here only touches the
+// state passed to it, so entries can be encoded on several threads at once.
+
+#define OPT_WINDOW_SIZE 32768
+#define OPT_WINDOW_MASK (OPT_WINDOW_SIZE - 1)
+#define OPT_HASH_BITS 15
+#define OPT_HASH_SIZE (1 << OPT_HASH_BITS)
+#define OPT_MIN_MATCH 3
+#define OPT_MAX_MATCH 258
+#define OPT_MAX_CHAIN 1024
+// Distinct (length, distance) improvements kept per position. When there are
+// more, the longest is kept; shorter lengths stay valid at its distance.
+#define OPT_MAX_STEPS 16
+// Input is parsed in chunks so the match cache stays bounded
+#define OPT_CHUNK_SIZE (1 << 20)
+#define OPT_MAX_BLOCKS 15
+#define OPT_MIN_SPLIT_SYMBOLS 10
+#define OPT_COUNT_CHECKPOINT 4096
+#define OPT_STORED_MAX 65535
+#define OPT_DEFAULT_ITERATIONS 15
+#define OPT_LITLEN_CODES 288
+#define OPT_DIST_CODES 30
+#define OPT_INFINITE_COST 1e30f
+
+// A literal (dist 0, len is the byte) or a match
+typedef struct {
+    mz_uint16 len;
+    mz_uint16 dist;
+} opt_symbol_t;
+
+typedef struct {
+    double litlen[OPT_LITLEN_CODES];
+    double dist[OPT_DIST_CODES];
+} opt_stats_t;
+
+typedef struct {
+    float literal[256];
+    float length[OPT_MAX_MATCH + 1];
+    float distance[OPT_DIST_CODES];
+} opt_cost_model_t;
+
+typedef struct {
+    mz_uint32 litlen[OPT_LITLEN_CODES];
+    mz_uint32 dist[OPT_DIST_CODES];
+} opt_counts_t;
+
+typedef struct {
+    mz_uint8* out;
+    size_t capacity;
+    size_t size;
+    mz_uint64 bits;
+    int bit_count;
+    int overflow;
+} opt_bit_writer_t;
+
+typedef struct {
+    const mz_uint8* data;
+    size_t data_length;
+    size_t chunk_start;
+    size_t chunk_end;
+
+    // Match finder
+    int* head;
+    int* prev;
+
+    // Match cache for the current chunk: the steps of position p are
+    // steps[step_index[p - chunk_start] .. step_index[p - chunk_start + 1])
+    mz_uint32* step_index;
+    opt_symbol_t* steps;
+    size_t steps_length;
+    size_t steps_capacity;
+    mz_uint32* run;
+
+    // Shortest path search over a range of the chunk
+    float* costs;
+    mz_uint16* path_length;
+    mz_uint16* path_dist;
+
+    // Symbol streams: scratch, chunk-level best and block-level best
+    opt_symbol_t* current;
+    opt_symbol_t* chunk_symbols;
+    opt_symbol_t* block_symbols;
+    mz_uint32* symbol_pos;
+    opt_counts_t* checkpoints;
+
+    mz_uint32 random_state;
+} opt_state_t;
+
+static int opt_dist_symbol(int dist) {
+    int d = dist - 1;
+    return d < 512 ? s_tdefl_small_dist_sym[d] : s_tdefl_large_dist_sym[d >> 8];
+}
+
+static int opt_dist_extra(int dist) {
+    int d = dist - 1;
+    return d < 512 ? s_tdefl_small_dist_extra[d] : s_tdefl_large_dist_extra[d >> 8];
+}
+
+static int opt_length_symbol(int len) {
+    return s_tdefl_len_sym[len - OPT_MIN_MATCH];
+}
+
+static int opt_length_extra(int len) {
+    return s_tdefl_len_extra[len - OPT_MIN_MATCH];
+}
+
+// Base values of the length and distance symbols, for writing extra bits
+static const mz_uint16 opt_length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const mz_uint16 opt_dist_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+
+// Match finding
+//
+// Hash chains over 3-byte prefixes, walked up to OPT_MAX_CHAIN links. For
+// every position the cache keeps each length at which the nearest match gets
+// longer, which is all the parser needs to price every choice.
+
+static mz_uint32 opt_hash(const mz_uint8* p) {
+    mz_uint32 v = (mz_uint32)p[0] | ((mz_uint32)p[1] << 8) | ((mz_uint32)p[2] << 16);
+    return (v * 2654435761u) >> (32 - OPT_HASH_BITS);
+}
+
+static void opt_insert(opt_state_t* s, size_t pos) {
+    if (pos + OPT_MIN_MATCH > s->data_length) return;
+    mz_uint32 h = opt_hash(s->data + pos);
+    s->prev[pos & OPT_WINDOW_MASK] = s->head[h];
+    s->head[h] = (int)pos;
+}
+
+static int opt_push_step(opt_state_t* s, int count, int len, int dist) {
+    if (count == OPT_MAX_STEPS) {
+        s->steps[s->steps_length - 1].len = (mz_uint16)len;
+        s->steps[s->steps_length - 1].dist = (mz_uint16)dist;
+        return count;
+    }
+
+    if (s->steps_length == s->steps_capacity) {
+        size_t capacity = s->steps_capacity * 2;
+        opt_symbol_t* steps = (opt_symbol_t*)realloc(s->steps, capacity * sizeof(opt_symbol_t));
+        if (!steps) return -1;
+        s->steps = steps;
+        s->steps_capacity = capacity;
+    }
+
+    s->steps[s->steps_length].len = (mz_uint16)len;
+    s->steps[s->steps_length].dist = (mz_uint16)dist;
+    s->steps_length++;
+    return count + 1;
+}
+
+// Length of the common prefix of a and b, up to max_len
+static int opt_match_length(const mz_uint8* a, const mz_uint8* b, int max_len) {
+    int len = 0;
+    while (len + 8 <= max_len) {
+        mz_uint64 x, y;
+        memcpy(&x, a + len, 8);
+        memcpy(&y, b + len, 8);
+        if (x != y) break;
+        len += 8;
+    }
+    while (len < max_len && a[len] == b[len]) len++;
+    return len;
+}
+
+// Record every length at which the nearest match gets longer. Walking the
+// hash chain from the nearest candidate outwards means the first match found
+// for each length is also the one with the cheapest distance.
+static int opt_find_steps(opt_state_t* s, size_t pos) {
+    const mz_uint8* data = s->data;
+    size_t available = s->chunk_end - pos;
+    int max_len = available < OPT_MAX_MATCH ? (int)available : OPT_MAX_MATCH;
+    if (max_len < OPT_MIN_MATCH) return 0;
+
+    int best = OPT_MIN_MATCH - 1;
+    int count = 0;
+    int probes = OPT_MAX_CHAIN;
+    int candidate = s->head[opt_hash(data + pos)];
+
+    while (candidate >= 0 && probes-- > 0) {
+        size_t dist = pos - (size_t)candidate;
+        if (dist > OPT_WINDOW_SIZE) break;
+
+        const mz_uint8* a = data + pos;
+        const mz_uint8* b = data + candidate;
+        if (b[best] == a[best] && b[0] == a[0]) {
+            int len = opt_match_length(a, b, max_len);
+
+            if (len > best) {
+                count = opt_push_step(s, count, len, (int)dist);
+                if (count < 0) return -1;
+                best = len;
+                if (best == max_len) break;
+            }
+        }
+
+        int next = s->prev[candidate & OPT_WINDOW_MASK];
+        if (next >= candidate) break;
+        candidate = next;
+    }
+
+    return count;
+}
+
+// Fill the match cache for [chunk_start, chunk_end), carrying the hash chains
+// over from the previous chunk
+static int opt_find_matches(opt_state_t* s) {
+    size_t n = s->chunk_end - s->chunk_start;
+    s->steps_length = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        size_t pos = s->chunk_start + i;
+        s->step_index[i] = (mz_uint32)s->steps_length;
+        if (opt_find_steps(s, pos) < 0) return 0;
+        opt_insert(s, pos);
+    }
+    s->step_index[n] = (mz_uint32)s->steps_length;
+
+    // Length of the run of identical bytes starting at each position
+    s->run[n - 1] = 1;
+    for (size_t i = n - 1; i > 0; i--) {
+        const mz_uint8* p = s->data + s->chunk_start + i - 1;
+        s->run[i - 1] = p[0] == p[1] ? s->run[i] + 1 : 1;
+    }
+    return 1;
+}
+
+// Cost models
+//
+// Bits per literal, length and distance symbol. The first pass uses the
+// fixed Huffman code; later ones use the entropy of the previous result.
+
+static void opt_fixed_model(opt_cost_model_t* model) {
+    for (int i = 0; i < 256; i++) model->literal[i] = i < 144 ? 8.0f : 9.0f;
+    for (int len = OPT_MIN_MATCH; len <= OPT_MAX_MATCH; len++) {
+        int symbol = opt_length_symbol(len);
+        model->length[len] = (symbol < 280 ? 7.0f : 8.0f) + opt_length_extra(len);
+    }
+    for (int i = 0; i < OPT_DIST_CODES; i++) model->distance[i] = 5.0f;
+}
+
+// Cost of each symbol in bits is its information content under the stats
+static void opt_entropy_bits(const double* counts, int n, float* bits) {
+    double total = 0.0;
+    for (int i = 0; i < n; i++) total += counts[i];
+
+    double log_total = total > 0.0 ? approx_log2(total) : 0.0;
+    for (int i = 0; i < n; i++) {
+        double b = counts[i] > 0.0 ? log_total - approx_log2(counts[i]) : log_total;
+        bits[i] = (float)(b < 0.0 ? 0.0 : b);
+    }
+}
+
+static void opt_stats_model(const opt_stats_t* stats, opt_cost_model_t* model) {
+    float litlen_bits[OPT_LITLEN_CODES];
+    opt_entropy_bits(stats->litlen, OPT_LITLEN_CODES, litlen_bits);
+    opt_entropy_bits(stats->dist, OPT_DIST_CODES, model->distance);
+
+    for (int i = 0; i < 256; i++) model->literal[i] = litlen_bits[i];
+    for (int len = OPT_MIN_MATCH; len <= OPT_MAX_MATCH; len++) {
+        model->length[len] = litlen_bits[opt_length_symbol(len)] + opt_length_extra(len);
+    }
+}
+
+static float opt_dist_cost(const opt_cost_model_t* model, int dist) {
+    return model->distance[opt_dist_symbol(dist)] + opt_dist_extra(dist);
+}
+
+static void opt_collect_stats(const opt_symbol_t* symbols, size_t count, opt_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    for (size_t i = 0; i < count; i++) {
+        if (symbols[i].dist) {
+            stats->litlen[opt_length_symbol(symbols[i].len)] += 1.0;
+            stats->dist[opt_dist_symbol(symbols[i].dist)] += 1.0;
+        } else {
+            stats->litlen[symbols[i].len] += 1.0;
+        }
+    }
+    stats->litlen[256] = 1.0;
+}
+
+static mz_uint32 opt_random(opt_state_t* s) {
+    s->random_state = s->random_state * 1103515245u + 12345u;
+    return s->random_state >> 8;
+}
+
+// Shake the statistics up when iterating gets stuck in a local minimum
+static void opt_randomize_stats(opt_state_t* s, opt_stats_t* stats) {
+    for (int i = 0; i < OPT_LITLEN_CODES; i++) {
+        if (opt_random(s) % 3 == 0) stats->litlen[i] = stats->litlen[opt_random(s) % OPT_LITLEN_CODES];
+    }
+    for (int i = 0; i < OPT_DIST_CODES; i++) {
+        if (opt_random(s) % 3 == 0) stats->dist[i] = stats->dist[opt_random(s) % OPT_DIST_CODES];
+    }
+    stats->litlen[256] = 1.0;
+}
+
+// Shortest path parse
+//
+// Dynamic programming over the positions of a range: the cheapest way to
+// reach each one, by a literal or any cached match ending there.
+
+// Find the cheapest symbol sequence for [from, to) under the model and write
+// it to out. Returns the number of symbols.
+static size_t opt_parse(opt_state_t* s, size_t from, size_t to, const opt_cost_model_t* model, opt_symbol_t* out) {
+    size_t n = to - from;
+    const mz_uint8* data = s->data;
+    float* costs = s->costs;
+    float run_cost = model->length[OPT_MAX_MATCH] + opt_dist_cost(model, 1);
+
+    costs[0] = 0.0f;
+    for (size_t k = 1; k <= n; k++) costs[k] = OPT_INFINITE_COST;
+
+    for (size_t k = 0; k < n; k++) {
+        size_t pos = from + k;
+        size_t cache = pos - s->chunk_start;
+
+        // Inside a long run of one byte, the only sensible choice is a chain of
+        // maximum length matches at distance 1, so skip ahead
+        if (k > OPT_MAX_MATCH && k + 2 * OPT_MAX_MATCH + 1 < n && s->run[cache] > 2 * OPT_MAX_MATCH &&
+            s->run[cache - OPT_MAX_MATCH] > OPT_MAX_MATCH) {
+            for (int j = 0; j < OPT_MAX_MATCH; j++, k++) {
+                costs[k + OPT_MAX_MATCH] = costs[k] + run_cost;
+                s->path_length[k + OPT_MAX_MATCH] = OPT_MAX_MATCH;
+                s->path_dist[k + OPT_MAX_MATCH] = 1;
+            }
+            pos = from + k;
+            cache = pos - s->chunk_start;
+        }
+
+        float base = costs[k];
+        float literal = base + model->literal[data[pos]];
+        if (literal < costs[k + 1]) {
+            costs[k + 1] = literal;
+            s->path_length[k + 1] = 1;
+            s->path_dist[k + 1] = 0;
+        }
+
+        int limit = n - k < OPT_MAX_MATCH ? (int)(n - k) : OPT_MAX_MATCH;
+        int previous = OPT_MIN_MATCH - 1;
+        for (mz_uint32 i = s->step_index[cache]; i < s->step_index[cache + 1] && previous < limit; i++) {
+            int len = s->steps[i].len < limit ? s->steps[i].len : limit;
+            int dist = s->steps[i].dist;
+            float dist_cost = base + opt_dist_cost(model, dist);
+
+            for (int l = previous + 1; l <= len; l++) {
+                float cost = dist_cost + model->length[l];
+                if (cost < costs[k + l]) {
+                    costs[k + l] = cost;
+                    s->path_length[k + l] = (mz_uint16)l;
+                    s->path_dist[k + l] = (mz_uint16)dist;
+                }
+            }
+            if (len > previous) previous = len;
+        }
+    }
+
+    // Walk the path back from the end, then reverse it
+    size_t count = 0;
+    for (size_t k = n; k > 0; k -= s->path_length[k]) {
+        out[count].dist = s->path_dist[k];
+        out[count].len = out[count].dist ? s->path_length[k] : data[from + k - 1];
+        count++;
+    }
+    for (size_t i = 0; i < count / 2; i++) {
+        opt_symbol_t t = out[i];
+        out[i] = out[count - 1 - i];
+        out[count - 1 - i] = t;
+    }
+    return count;
+}
+
+// Huffman codes and block sizes
+//
+// Code lengths and headers of dynamic blocks, and the exact size of a block
+// written as stored, fixed or dynamic Huffman, to pick the smallest.
+
+typedef struct {
+    mz_uint32 count;
+    mz_uint32 symbol;
+} opt_huffman_leaf_t;
+
+static int opt_compare_leaves(const void* a, const void* b) {
+    const opt_huffman_leaf_t* x = (const opt_huffman_leaf_t*)a;
+    const opt_huffman_leaf_t* y = (const opt_huffman_leaf_t*)b;
+    if (x->count != y->count) return x->count < y->count ? -1 : 1;
+    return x->symbol < y->symbol ? -1 : (x->symbol > y->symbol);
+}
+
+// Length-limited Huffman code lengths. Same approach as tdefl (in-place
+// Moffat-Katajainen, then tdefl's length limiter) but with 32-bit counts,
+// since blocks here are not bounded by tdefl's 64K code buffer.
+static void opt_huffman_lengths(const mz_uint32* counts, int n, int limit, mz_uint8* lengths) {
+    opt_huffman_leaf_t leaves[OPT_LITLEN_CODES];
+    mz_uint32 keys[OPT_LITLEN_CODES];
+    int num_codes[1 + TDEFL_MAX_SUPPORTED_HUFF_CODESIZE];
+    int used = 0;
+
+    memset(lengths, 0, (size_t)n);
+    for (int i = 0; i < n; i++) {
+        if (counts[i]) {
+            leaves[used].count = counts[i];
+            leaves[used].symbol = (mz_uint32)i;
+            used++;
+        }
+    }
+    if (used == 0) return;
+    if (used == 1) {
+        lengths[leaves[0].symbol] = 1;
+        return;
+    }
+
+    qsort(leaves, (size_t)used, sizeof(leaves[0]), opt_compare_leaves);
+    for (int i = 0; i < used; i++) keys[i] = leaves[i].count;
+
+    // Moffat-Katajainen: turn sorted weights into code lengths in place
+    int root = 0, leaf = 2, next;
+    keys[0] += keys[1];
+    for (next = 1; next < used - 1; next++) {
+        if (leaf >= used || keys[root] < keys[leaf]) {
+            keys[next] = keys[root];
+            keys[root++] = (mz_uint32)next;
+        } else {
+            keys[next] = keys[leaf++];
+        }
+        if (leaf >= used || (root < next && keys[root] < keys[leaf])) {
+            keys[next] += keys[root];
+            keys[root++] = (mz_uint32)next;
+        } else {
+            keys[next] += keys[leaf++];
+        }
+    }
+    keys[used - 2] = 0;
+    for (next = used - 3; next >= 0; next--) keys[next] = keys[keys[next]] + 1;
+
+    int available = 1, used_nodes = 0, depth = 0;
+    root = used - 2;
+    next = used - 1;
+    while (available > 0) {
+        while (root >= 0 && (int)keys[root] == depth) {
+            used_nodes++;
+            root--;
+        }
+        while (available > used_nodes) {
+            keys[next--] = (mz_uint32)depth;
+            available--;
+        }
+        available = 2 * used_nodes;
+        depth++;
+        used_nodes = 0;
+    }
+
+    memset(num_codes, 0, sizeof(num_codes));
+    for (int i = 0; i < used; i++) {
+        num_codes[keys[i] > TDEFL_MAX_SUPPORTED_HUFF_CODESIZE ? TDEFL_MAX_SUPPORTED_HUFF_CODESIZE : keys[i]]++;
+    }
+    tdefl_huffman_enforce_max_code_size(num_codes, used, limit);
+
+    // The most frequent symbols get the shortest codes
+    int j = used;
+    for (int l = 1; l <= limit; l++) {
+        for (int c = num_codes[l]; c > 0; c--) lengths[leaves[--j].symbol] = (mz_uint8)l;
+    }
+}
+
+static void opt_canonical_codes(const mz_uint8* lengths, int n, mz_uint16* codes) {
+    int bl_count[16];
+    int next_code[16];
+    memset(bl_count, 0, sizeof(bl_count));
+    for (int i = 0; i < n; i++) bl_count[lengths[i]]++;
+    bl_count[0] = 0;
+
+    int code = 0;
+    for (int bits = 1; bits < 16; bits++) {
+        code = (code + bl_count[bits - 1]) << 1;
+        next_code[bits] = code;
+    }
+
+    // Deflate sends Huffman codes most significant bit first
+    for (int i = 0; i < n; i++) {
+        int len = lengths[i];
+        if (!len) {
+            codes[i] = 0;
+            continue;
+        }
+        int c = next_code[len]++, reversed = 0;
+        for (int b = 0; b < len; b++) reversed |= ((c >> b) & 1) << (len - 1 - b);
+        codes[i] = (mz_uint16)reversed;
+    }
+}
+
+// Some inflaters reject a distance code with fewer than two symbols
+static void opt_patch_distance_lengths(mz_uint8* lengths) {
+    int used = 0;
+    for (int i = 0; i < OPT_DIST_CODES; i++) used += lengths[i] != 0;
+
+    if (used == 0) {
+        lengths[0] = lengths[1] = 1;
+    } else if (used == 1) {
+        lengths[lengths[0] ? 1 : 0] = 1;
+    }
+}
+
+// The code length sequence of a dynamic header, run-length encoded with
+// symbols 16-18. Each entry is symbol | extra value << 8.
+typedef struct {
+    mz_uint8 lengths[OPT_LITLEN_CODES + OPT_DIST_CODES];
+    mz_uint16 rle[OPT_LITLEN_CODES + OPT_DIST_CODES];
+    int rle_count;
+    int hlit;
+    int hdist;
+    int hclen;
+    mz_uint8 cl_lengths[19];
+    mz_uint16 cl_codes[19];
+} opt_dynamic_header_t;
+
+static void opt_build_header(const mz_uint8* litlen_lengths, const mz_uint8* dist_lengths, opt_dynamic_header_t* h) {
+    mz_uint32 cl_counts[19];
+
+    h->hlit = 286;
+    while (h->hlit > 257 && !litlen_lengths[h->hlit - 1]) h->hlit--;
+    h->hdist = OPT_DIST_CODES;
+    while (h->hdist > 1 && !dist_lengths[h->hdist - 1]) h->hdist--;
+
+    int total = h->hlit + h->hdist;
+    memcpy(h->lengths, litlen_lengths, (size_t)h->hlit);
+    memcpy(h->lengths + h->hlit, dist_lengths, (size_t)h->hdist);
+
+    memset(cl_counts, 0, sizeof(cl_counts));
+    h->rle_count = 0;
+    for (int i = 0; i < total;) {
+        int len = h->lengths[i], run = 1;
+        while (i + run < total && h->lengths[i + run] == len) run++;
+        i += run;
+
+        if (len == 0) {
+            while (run >= 11) {
+                int r = run > 138 ? 138 : run;
+                h->rle[h->rle_count++] = (mz_uint16)(18 | ((r - 11) << 8));
+                cl_counts[18]++;
+                run -= r;
+            }
+            if (run >= 3) {
+                h->rle[h->rle_count++] = (mz_uint16)(17 | ((run - 3) << 8));
+                cl_counts[17]++;
+                run = 0;
+            }
+        } else {
+            h->rle[h->rle_count++] = (mz_uint16)len;
+            cl_counts[len]++;
+            run--;
+            while (run >= 3) {
+                int r = run > 6 ? 6 : run;
+                h->rle[h->rle_count++] = (mz_uint16)(16 | ((r - 3) << 8));
+                cl_counts[16]++;
+                run -= r;
+            }
+        }
+        while (run-- > 0) {
+            h->rle[h->rle_count++] = (mz_uint16)len;
+            cl_counts[len]++;
+        }
+    }
+
+    opt_huffman_lengths(cl_counts, 19, 7, h->cl_lengths);
+    opt_canonical_codes(h->cl_lengths, 19, h->cl_codes);
+
+    h->hclen = 19;
+    while (h->hclen > 4 && !h->cl_lengths[s_tdefl_packed_code_size_syms_swizzle[h->hclen - 1]]) h->hclen--;
+}
+
+static size_t opt_header_bits(const opt_dynamic_header_t* h) {
+    static const int extra_bits[3] = {2, 3, 7};
+    size_t bits = 3 + 5 + 5 + 4 + 3 * (size_t)h->hclen;
+    for (int i = 0; i < h->rle_count; i++) {
+        int symbol = h->rle[i] & 0xFF;
+        bits += h->cl_lengths[symbol];
+        if (symbol >= 16) bits += extra_bits[symbol - 16];
+    }
+    return bits;
+}
+
+static size_t opt_symbol_bits(const opt_counts_t* counts, const mz_uint8* litlen_lengths, const mz_uint8* dist_lengths) {
+    size_t bits = 0;
+    for (int i = 0; i < OPT_LITLEN_CODES; i++) {
+        if (!counts->litlen[i]) continue;
+        bits += (size_t)counts->litlen[i] * litlen_lengths[i];
+        if (i > 256) bits += (size_t)counts->litlen[i] * s_tdefl_len_extra[opt_length_base[i - 257] - OPT_MIN_MATCH];
+    }
+    for (int i = 0; i < OPT_DIST_CODES; i++) {
+        if (counts->dist[i]) bits += (size_t)counts->dist[i] * (dist_lengths[i] + opt_dist_extra(opt_dist_base[i]));
+    }
+    return bits;
+}
+
+static void opt_fixed_litlen_lengths(mz_uint8* lengths) {
+    for (int i = 0; i < OPT_LITLEN_CODES; i++) lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+}
+
+static const mz_uint8 opt_fixed_dist_lengths[OPT_DIST_CODES] = {
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5};
+
+enum { OPT_BLOCK_STORED = 0, OPT_BLOCK_FIXED = 1, OPT_BLOCK_DYNAMIC = 2 };
+
+typedef struct {
+    int type;
+    size_t bits;
+    mz_uint8 litlen_lengths[OPT_LITLEN_CODES];
+    mz_uint8 dist_lengths[OPT_DIST_CODES];
+    opt_dynamic_header_t header;
+} opt_block_plan_t;
+
+// Pick the smallest encoding of a block with the given symbol counts covering
+// byte_count input bytes
+static void opt_plan_block(const opt_counts_t* counts, size_t byte_count, opt_block_plan_t* plan) {
+    mz_uint8 fixed_litlen[OPT_LITLEN_CODES];
+    opt_fixed_litlen_lengths(fixed_litlen);
+
+    // Stored blocks are byte aligned; assume the worst case of 7 padding bits
+    size_t stored_blocks = byte_count ? (byte_count + OPT_STORED_MAX - 1) / OPT_STORED_MAX : 1;
+    size_t stored = stored_blocks * (3 + 7 + 32) + byte_count * 8;
+    size_t fixed = 3 + opt_symbol_bits(counts, fixed_litlen, opt_fixed_dist_lengths);
+
+    opt_huffman_lengths(counts->litlen, OPT_LITLEN_CODES, 15, plan->litlen_lengths);
+    opt_huffman_lengths(counts->dist, OPT_DIST_CODES, 15, plan->dist_lengths);
+    opt_patch_distance_lengths(plan->dist_lengths);
+    opt_build_header(plan->litlen_lengths, plan->dist_lengths, &plan->header);
+    size_t dynamic = opt_header_bits(&plan->header) + opt_symbol_bits(counts, plan->litlen_lengths, plan->dist_lengths);
+
+    plan->type = OPT_BLOCK_DYNAMIC;
+    plan->bits = dynamic;
+    if (fixed <= plan->bits) {
+        plan->type = OPT_BLOCK_FIXED;
+        plan->bits = fixed;
+    }
+    if (stored <= plan->bits) {
+        plan->type = OPT_BLOCK_STORED;
+        plan->bits = stored;
+    }
+}
+
+static void opt_count_symbols(const opt_symbol_t* symbols, size_t from, size_t to, opt_counts_t* counts) {
+    for (size_t i = from; i < to; i++) {
+        if (symbols[i].dist) {
+            counts->litlen[opt_length_symbol(symbols[i].len)]++;
+            counts->dist[opt_dist_symbol(symbols[i].dist)]++;
+        } else {
+            counts->litlen[symbols[i].len]++;
+        }
+    }
+}
+
+static size_t opt_block_bits(const opt_symbol_t* symbols, size_t count, size_t byte_count) {
+    opt_counts_t counts;
+    opt_block_plan_t plan;
+    memset(&counts, 0, sizeof(counts));
+    opt_count_symbols(symbols, 0, count, &counts);
+    counts.litlen[256] = 1;
+    opt_plan_block(&counts, byte_count, &plan);
+    return plan.bits;
+}
+
+// Iterative optimisation
+//
+// Zopfli-style iterations: parse, re-derive the costs from the result, parse
+// again, with a random shake when the size stops improving.
+
+// Parse [from, to) repeatedly, re-deriving the cost model from the previous
+// result, and leave the smallest result in out. Returns its symbol count.
+static size_t opt_optimize_range(opt_state_t* s, size_t from, size_t to, int iterations, opt_symbol_t* out, size_t* out_bits) {
+    opt_cost_model_t model;
+    opt_stats_t stats, last_stats, best_stats;
+    size_t best_count = 0, best_bits = (size_t)-1, last_bits = 0;
+    int randomized = 0;
+
+    // Start from what the parse looks like under the fixed Huffman code
+    opt_fixed_model(&model);
+    size_t count = opt_parse(s, from, to, &model, s->current);
+    opt_collect_stats(s->current, count, &stats);
+    best_stats = stats;
+
+    for (int i = 0; i <= iterations; i++) {
+        if (i > 0) {
+            opt_stats_model(&stats, &model);
+            count = opt_parse(s, from, to, &model, s->current);
+        }
+
+        size_t bits = opt_block_bits(s->current, count, to - from);
+        if (bits < best_bits) {
+            memcpy(out, s->current, count * sizeof(opt_symbol_t));
+            best_count = count;
+            best_bits = bits;
+            best_stats = stats;
+        }
+
+        last_stats = stats;
+        opt_collect_stats(s->current, count, &stats);
+
+        // Once randomisation has kicked in, blend in the previous statistics so
+        // the model converges more slowly but to a better optimum
+        if (randomized) {
+            for (int j = 0; j < OPT_LITLEN_CODES; j++) stats.litlen[j] += last_stats.litlen[j] * 0.5;
+            for (int j = 0; j < OPT_DIST_CODES; j++) stats.dist[j] += last_stats.dist[j] * 0.5;
+            stats.litlen[256] = 1.0;
+        }
+        if (i > 5 && bits == last_bits) {
+            stats = best_stats;
+            opt_randomize_stats(s, &stats);
+            randomized = 1;
+        }
+        last_bits = bits;
+    }
+
+    *out_bits = best_bits;
+    return best_count;
+}
+
+// Block splitting
+//
+// Symbol counts are checkpointed every OPT_COUNT_CHECKPOINT symbols, so the
+// size of any candidate block can be computed without a full recount.
+
+static void opt_counts_at(const opt_state_t* s, const opt_symbol_t* symbols, size_t index, opt_counts_t* counts) {
+    size_t checkpoint = index / OPT_COUNT_CHECKPOINT;
+    *counts = s->checkpoints[checkpoint];
+    opt_count_symbols(symbols, checkpoint * OPT_COUNT_CHECKPOINT, index, counts);
+}
+
+// Encoded size of symbols [from, to) as one block
+static size_t opt_split_cost(const opt_state_t* s, const opt_symbol_t* symbols, size_t from, size_t to) {
+    opt_counts_t a, b;
+    opt_block_plan_t plan;
+    opt_counts_at(s, symbols, from, &a);
+    opt_counts_at(s, symbols, to, &b);
+    for (int i = 0; i < OPT_LITLEN_CODES; i++) b.litlen[i] -= a.litlen[i];
+    for (int i = 0; i < OPT_DIST_CODES; i++) b.dist[i] -= a.dist[i];
+    b.litlen[256] = 1;
+    opt_plan_block(&b, s->symbol_pos[to] - s->symbol_pos[from], &plan);
+    return plan.bits;
+}
+
+// Best split point of [from, to): exhaustive for small ranges, otherwise a
+// repeated coarse search that narrows in around the best sample
+static size_t opt_find_split(const opt_state_t* s, const opt_symbol_t* symbols, size_t from, size_t to, size_t* best_cost) {
+    enum { SAMPLES = 9 };
+    size_t lo = from + 1, hi = to;
+    size_t best = lo;
+    *best_cost = (size_t)-1;
+
+    if (hi - lo < 1024) {
+        for (size_t p = lo; p < hi; p++) {
+            size_t cost = opt_split_cost(s, symbols, from, p) + opt_split_cost(s, symbols, p, to);
+            if (cost < *best_cost) {
+                *best_cost = cost;
+                best = p;
+            }
+        }
+        return best;
+    }
+
+    while (hi - lo > SAMPLES) {
+        size_t points[SAMPLES];
+        int best_index = 0;
+        size_t round_best = (size_t)-1;
+        for (int i = 0; i < SAMPLES; i++) {
+            points[i] = lo + (hi - lo) * (size_t)(i + 1) / (SAMPLES + 1);
+            size_t cost = opt_split_cost(s, symbols, from, points[i]) + opt_split_cost(s, symbols, points[i], to);
+            if (cost < round_best) {
+                round_best = cost;
+                best_index = i;
+            }
+        }
+        if (round_best < *best_cost) {
+            *best_cost = round_best;
+            best = points[best_index];
+        }
+
+        size_t new_lo = best_index > 0 ? points[best_index - 1] : lo;
+        size_t new_hi = best_index < SAMPLES - 1 ? points[best_index + 1] : hi;
+        if (new_lo == lo && new_hi == hi) break;
+        lo = new_lo;
+        hi = new_hi;
+    }
+    return best;
+}
+
+// Split the symbol stream into up to OPT_MAX_BLOCKS blocks, always splitting
+// the largest block that still gains from it. Returns the number of blocks;
+// bounds[0..blocks] holds the symbol index boundaries.
+static int opt_split_blocks(opt_state_t* s, const opt_symbol_t* symbols, size_t count, size_t* bounds) {
+    int done[OPT_MAX_BLOCKS];
+    int blocks = 1;
+
+    bounds[0] = 0;
+    bounds[1] = count;
+    done[0] = 0;
+
+    // Prefix counts make the cost of any range cheap to evaluate
+    memset(&s->checkpoints[0], 0, sizeof(opt_counts_t));
+    s->symbol_pos[0] = 0;
+    for (size_t i = 0; i < count; i++) {
+        s->symbol_pos[i + 1] = s->symbol_pos[i] + (symbols[i].dist ? symbols[i].len : 1);
+        if ((i + 1) % OPT_COUNT_CHECKPOINT == 0) {
+            size_t c = (i + 1) / OPT_COUNT_CHECKPOINT;
+            s->checkpoints[c] = s->checkpoints[c - 1];
+            opt_count_symbols(symbols, i + 1 - OPT_COUNT_CHECKPOINT, i + 1, &s->checkpoints[c]);
+        }
+    }
+
+    while (blocks < OPT_MAX_BLOCKS) {
+        int largest = -1;
+        for (int b = 0; b < blocks; b++) {
+            if (!done[b] && (largest < 0 || bounds[b + 1] - bounds[b] > bounds[largest + 1] - bounds[largest])) largest = b;
+        }
+        if (largest < 0) break;
+
+        size_t from = bounds[largest], to = bounds[largest + 1];
+        if (to - from < OPT_MIN_SPLIT_SYMBOLS) {
+            done[largest] = 1;
+            continue;
+        }
+
+        size_t split_cost;
+        size_t split = opt_find_split(s, symbols, from, to, &split_cost);
+        if (split_cost >= opt_split_cost(s, symbols, from, to)) {
+            done[largest] = 1;
+            continue;
+        }
+
+        for (int b = blocks; b > largest; b--) {
+            bounds[b + 1] = bounds[b];
+            done[b] = done[b - 1];
+        }
+        bounds[largest + 1] = split;
+        done[largest] = done[largest + 1] = 0;
+        blocks++;
+    }
+
+    return blocks;
+}
+
+// Output
+//
+// Bit writer and block encoders, least significant bit first as deflate
+// requires.
+
+static void opt_put_bits(opt_bit_writer_t* w, mz_uint32 value, int count) {
+    w->bits |= (mz_uint64)value << w->bit_count;
+    w->bit_count += count;
+    while (w->bit_count >= 8) {
+        if (w->size < w->capacity) {
+            w->out[w->size++] = (mz_uint8)w->bits;
+        } else {
+            w->overflow = 1;
+        }
+        w->bits >>= 8;
+        w->bit_count -= 8;
+    }
+}
+
+static void opt_align(opt_bit_writer_t* w) {
+    if (w->bit_count) opt_put_bits(w, 0, 8 - w->bit_count);
+}
+
+static void opt_write_stored(opt_bit_writer_t* w, const mz_uint8* bytes, size_t length, int final) {
+    do {
+        size_t chunk = length > OPT_STORED_MAX ? OPT_STORED_MAX : length;
+        length -= chunk;
+        opt_put_bits(w, (final && !length) ? 1 : 0, 1);
+        opt_put_bits(w, OPT_BLOCK_STORED, 2);
+        opt_align(w);
+        opt_put_bits(w, (mz_uint32)chunk, 16);
+        opt_put_bits(w, (mz_uint32)chunk ^ 0xFFFF, 16);
+        for (size_t i = 0; i < chunk; i++) opt_put_bits(w, bytes[i], 8);
+        bytes += chunk;
+    } while (length);
+}
+
+static void opt_write_symbols(opt_bit_writer_t* w, const opt_symbol_t* symbols, size_t count, const mz_uint8* litlen_lengths, const mz_uint8* dist_lengths) {
+    mz_uint16 litlen_codes[OPT_LITLEN_CODES];
+    mz_uint16 dist_codes[OPT_DIST_CODES];
+    opt_canonical_codes(litlen_lengths, OPT_LITLEN_CODES, litlen_codes);
+    opt_canonical_codes(dist_lengths, OPT_DIST_CODES, dist_codes);
+
+    for (size_t i = 0; i < count; i++) {
+        int len = symbols[i].len, dist = symbols[i].dist;
+        if (!dist) {
+            opt_put_bits(w, litlen_codes[len], litlen_lengths[len]);
+            continue;
+        }
+
+        int symbol = opt_length_symbol(len);
+        opt_put_bits(w, litlen_codes[symbol], litlen_lengths[symbol]);
+        opt_put_bits(w, (mz_uint32)(len - opt_length_base[symbol - 257]), opt_length_extra(len));
+
+        symbol = opt_dist_symbol(dist);
+        opt_put_bits(w, dist_codes[symbol], dist_lengths[symbol]);
+        opt_put_bits(w, (mz_uint32)(dist - opt_dist_base[symbol]), opt_dist_extra(dist));
+    }
+    opt_put_bits(w, litlen_codes[256], litlen_lengths[256]);
+}
+
+static void opt_write_block(opt_bit_writer_t* w, const opt_symbol_t* symbols, size_t count, const mz_uint8* bytes, size_t byte_count, int final) {
+    static const int extra_bits[3] = {2, 3, 7};
+    opt_counts_t counts;
+    opt_block_plan_t plan;
+
+    memset(&counts, 0, sizeof(counts));
+    opt_count_symbols(symbols, 0, count, &counts);
+    counts.litlen[256] = 1;
+    opt_plan_block(&counts, byte_count, &plan);
+
+    if (plan.type == OPT_BLOCK_STORED) {
+        opt_write_stored(w, bytes, byte_count, final);
+        return;
+    }
+
+    opt_put_bits(w, final ? 1 : 0, 1);
+    opt_put_bits(w, (mz_uint32)plan.type, 2);
+
+    if (plan.type == OPT_BLOCK_FIXED) {
+        mz_uint8 fixed_litlen[OPT_LITLEN_CODES];
+        opt_fixed_litlen_lengths(fixed_litlen);
+        opt_write_symbols(w, symbols, count, fixed_litlen, opt_fixed_dist_lengths);
+        return;
+    }
+
+    const opt_dynamic_header_t* h = &plan.header;
+    opt_put_bits(w, (mz_uint32)(h->hlit - 257), 5);
+    opt_put_bits(w, (mz_uint32)(h->hdist - 1), 5);
+    opt_put_bits(w, (mz_uint32)(h->hclen - 4), 4);
+    for (int i = 0; i < h->hclen; i++) opt_put_bits(w, h->cl_lengths[s_tdefl_packed_code_size_syms_swizzle[i]], 3);
+    for (int i = 0; i < h->rle_count; i++) {
+        int symbol = h->rle[i] & 0xFF;
+        opt_put_bits(w, h->cl_codes[symbol], h->cl_lengths[symbol]);
+        if (symbol >= 16) opt_put_bits(w, h->rle[i] >> 8, extra_bits[symbol - 16]);
+    }
+
+    opt_write_symbols(w, symbols, count, plan.litlen_lengths, plan.dist_lengths);
+}
+
+// Entry point
+//
+// State allocation and the driver that chains the stages above.
+
+static void opt_free_state(opt_state_t* s) {
+    free(s->head);
+    free(s->prev);
+    free(s->step_index);
+    free(s->steps);
+    free(s->run);
+    free(s->costs);
+    free(s->path_length);
+    free(s->path_dist);
+    free(s->current);
+    free(s->chunk_symbols);
+    free(s->block_symbols);
+    free(s->symbol_pos);
+    free(s->checkpoints);
+}
+
+static int opt_alloc_state(opt_state_t* s, const mz_uint8* data, size_t data_length) {
+    size_t n = data_length < OPT_CHUNK_SIZE ? data_length : OPT_CHUNK_SIZE;
+
+    memset(s, 0, sizeof(*s));
+    s->data = data;
+    s->data_length = data_length;
+    s->steps_capacity = n * 2 + 16;
+    s->random_state = 1;
+
+    s->head = (int*)malloc(OPT_HASH_SIZE * sizeof(int));
+    s->prev = (int*)malloc(OPT_WINDOW_SIZE * sizeof(int));
+    s->step_index = (mz_uint32*)malloc((n + 1) * sizeof(mz_uint32));
+    s->steps = (opt_symbol_t*)malloc(s->steps_capacity * sizeof(opt_symbol_t));
+    s->run = (mz_uint32*)malloc(n * sizeof(mz_uint32));
+    s->costs = (float*)malloc((n + 1) * sizeof(float));
+    s->path_length = (mz_uint16*)malloc((n + 1) * sizeof(mz_uint16));
+    s->path_dist = (mz_uint16*)malloc((n + 1) * sizeof(mz_uint16));
+    s->current = (opt_symbol_t*)malloc(n * sizeof(opt_symbol_t));
+    s->chunk_symbols = (opt_symbol_t*)malloc(n * sizeof(opt_symbol_t));
+    s->block_symbols = (opt_symbol_t*)malloc(n * sizeof(opt_symbol_t));
+    s->symbol_pos = (mz_uint32*)malloc((n + 1) * sizeof(mz_uint32));
+    s->checkpoints = (opt_counts_t*)malloc((n / OPT_COUNT_CHECKPOINT + 1) * sizeof(opt_counts_t));
+
+    if (!s->head || !s->prev || !s->step_index || !s->steps || !s->run || !s->costs || !s->path_length || !s->path_dist ||
+        !s->current || !s->chunk_symbols || !s->block_symbols || !s->symbol_pos || !s->checkpoints) {
+        opt_free_state(s);
+        return 0;
+    }
+
+    for (int i = 0; i < OPT_HASH_SIZE; i++) s->head[i] = -1;
+    for (int i = 0; i < OPT_WINDOW_SIZE; i++) s->prev[i] = -1;
+    return 1;
+}
+
+// Compress src into dst as raw deflate. Returns the compressed size, or 0 if
+// it does not fit in dst_cap or memory runs out.
+static size_t optimal_deflate(const void* src, size_t src_len, void* dst, size_t dst_cap, int iterations) {
+    opt_state_t s;
+    opt_bit_writer_t w;
+    size_t bounds[OPT_MAX_BLOCKS + 1];
+
+    // Positions in the hash chains are 32-bit
+    if (!src_len || src_len > 0x7FFFFFFF) return 0;
+    if (!opt_alloc_state(&s, (const mz_uint8*)src, src_len)) return 0;
+
+    memset(&w, 0, sizeof(w));
+    w.out = (mz_uint8*)dst;
+    w.capacity = dst_cap;
+
+    for (size_t start = 0; start < src_len && !w.overflow; start += OPT_CHUNK_SIZE) {
+        size_t end = src_len - start > OPT_CHUNK_SIZE ? start + OPT_CHUNK_SIZE : src_len;
+        int last_chunk = end == src_len;
+
+        s.chunk_start = start;
+        s.chunk_end = end;
+        if (!opt_find_matches(&s)) {
+            opt_free_state(&s);
+            return 0;
+        }
+
+        size_t chunk_bits;
+        size_t count = opt_optimize_range(&s, start, end, iterations, s.chunk_symbols, &chunk_bits);
+        int blocks = opt_split_blocks(&s, s.chunk_symbols, count, bounds);
+
+        for (int b = 0; b < blocks; b++) {
+            const opt_symbol_t* symbols = s.chunk_symbols + bounds[b];
+            size_t symbol_count = bounds[b + 1] - bounds[b];
+            size_t from = start + s.symbol_pos[bounds[b]];
+            size_t to = start + s.symbol_pos[bounds[b + 1]];
+
+            // A block's own statistics can lead to a better parse of it than the
+            // statistics of the whole chunk did
+            if (blocks > 1) {
+                size_t block_bits;
+                size_t block_count = opt_optimize_range(&s, from, to, iterations, s.block_symbols, &block_bits);
+                if (block_bits < opt_block_bits(symbols, symbol_count, to - from)) {
+                    symbols = s.block_symbols;
+                    symbol_count = block_count;
+                }
+            }
+
+            opt_write_block(&w, symbols, symbol_count, s.data + from, to - from, last_chunk && b == blocks - 1);
+        }
+    }
+
+    opt_align(&w);
+    opt_free_state(&s);
+    return w.overflow ? 0 : w.size;
+}
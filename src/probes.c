@@ -0,0 +1,68 @@
+// USDT probes for zip-bun
+//
+// Bun compiles zip_wrapper.c with TinyCC, which can't emit the .note.stapsdt
+// sections static tracepoints are made of. This library carries them
+// instead: build it with the system compiler and load it with loadProbes()
+// or the ZIP_BUN_PROBES environment variable.
+//
+//   cc -shared -fPIC -O2 src/probes.c -o libzip_bun_probes.so
+//
+// <sys/sdt.h> comes with systemtap-sdt-dev (Debian/Ubuntu) or
+// systemtap-sdt-devel (Fedora). Without it the library still builds, with
+// the probes compiled out. Probes of the zip_bun provider:
+//
+//   op__start(operation, handle, index, name)
+//   op__done(operation, handle, index, bytes, ok)
+//   io__start(kind, handle, offset, size)
+//   io__done(kind, handle, offset, bytes)
+//   codec__start(kind, handle, index, bytes_in)
+//   codec__done(kind, handle, index, bytes_in, bytes_out)
+//
+// Operations: 0 open, 1 locate, 2 extract, 3 add, 4 finalize, 5 close,
+// 6 validate. I/O kinds: 0 read, 1 write. Codec kinds: 0 deflate, 1 inflate,
+// 2 crc. index is the entry index, or -1 for archive-wide operations and
+// I/O; name is the entry (or archive file) name when the caller passed one.
+// bytes is what the operation produced and ok is 1 on success.
+#include <stdint.h>
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#endif
+#endif
+
+#ifndef DTRACE_PROBE4
+#define DTRACE_PROBE4(provider, name, a, b, c, d) ((void)0)
+#define DTRACE_PROBE5(provider, name, a, b, c, d, e) ((void)0)
+#endif
+
+// Probe codes passed by zip_wrapper.c
+#define TRACE_OP_START 0
+#define TRACE_OP_DONE 1
+#define TRACE_IO_START 2
+#define TRACE_IO_DONE 3
+#define TRACE_CODEC_START 4
+#define TRACE_CODEC_DONE 5
+
+void zip_bun_probe(int probe, int kind, int handle_id, int index, const char* name, uint64_t a, uint64_t b) {
+    switch (probe) {
+    case TRACE_OP_START:
+        DTRACE_PROBE4(zip_bun, op__start, kind, handle_id, index, name);
+        break;
+    case TRACE_OP_DONE:
+        DTRACE_PROBE5(zip_bun, op__done, kind, handle_id, index, a, (int)b);
+        break;
+    case TRACE_IO_START:
+        DTRACE_PROBE4(zip_bun, io__start, kind, handle_id, a, b);
+        break;
+    case TRACE_IO_DONE:
+        DTRACE_PROBE4(zip_bun, io__done, kind, handle_id, a, b);
+        break;
+    case TRACE_CODEC_START:
+        DTRACE_PROBE4(zip_bun, codec__start, kind, handle_id, index, a);
+        break;
+    case TRACE_CODEC_DONE:
+        DTRACE_PROBE5(zip_bun, codec__done, kind, handle_id, index, a, b);
+        break;
+    }
+}
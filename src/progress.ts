@@ -0,0 +1,119 @@
+import { JSCallback } from "bun:ffi";
+import type { Progress, ProgressOptions } from "./interfaces/progress.ts";
+import { native } from "./symbols.ts";
+
+/**
+ * Listeners of the operations running with progress, by native handle. The
+ * entries of several handles can be in progress at once when a progress
+ * callback works on another archive.
+ */
+const listeners = new Map<
+  number,
+  (bytes: number, entries: number) => boolean
+>();
+
+/** The native progress callback, created on first use. */
+let callback: JSCallback | undefined;
+
+/**
+ * Checks whether an operation needs the progress callback.
+ * @param options - The progress options of the operation, if any.
+ * @returns True if it has a progress callback or an abort signal.
+ */
+export function hasProgress(options?: ProgressOptions): boolean {
+  return Boolean(options?.onProgress || options?.signal);
+}
+
+/**
+ * Offsets the progress reported by an operation that is one step of a larger
+ * one, so the callback sees the totals of the whole.
+ * @param options - The progress options of the larger operation.
+ * @param done - The work done before this step.
+ * @returns Options to pass to the step.
+ */
+export function offsetProgress<T extends ProgressOptions>(
+  options: T,
+  done: Progress,
+): T {
+  const { onProgress } = options;
+  if (!onProgress) {
+    return options;
+  }
+
+  const { bytes, entries } = done;
+  return {
+    ...options,
+    onProgress: (progress: Progress) =>
+      onProgress({
+        bytes: bytes + progress.bytes,
+        entries: entries + progress.entries,
+      }),
+  };
+}
+
+/**
+ * Runs a native operation on a handle with progress reporting and
+ * cancellation. The last progress call of an entry comes once it has been
+ * written or extracted, too late to undo it: an operation that completes
+ * returns its result, and an abort from that call is seen by the next one.
+ * @param handleId - The handle the operation works on.
+ * @param options - The progress callback and abort signal.
+ * @param run - The operation.
+ * @param completed - Tells from its result whether the operation did all its
+ * work. By default returning at all means it did.
+ * @returns What `run` returned.
+ * @throws The signal's reason if it was aborted, or what `onProgress` threw,
+ * unless the operation completed anyway.
+ */
+export function withProgress<T>(
+  handleId: number,
+  options: ProgressOptions,
+  run: () => T,
+  completed: (result: T) => boolean = () => true,
+): T {
+  const { onProgress, signal } = options;
+  signal?.throwIfAborted();
+
+  callback ??= new JSCallback(
+    (id: number, bytes: number, entries: number) =>
+      (listeners.get(id)?.(bytes, entries) ?? true) ? 1 : 0,
+    { args: ["i32", "f64", "i32"], returns: "i32" },
+  );
+
+  // Errors can't cross the native frames, so they cancel the operation and
+  // are rethrown once it returns
+  let failure: { error: unknown } | undefined;
+  listeners.set(handleId, (bytes, entries) => {
+    try {
+      onProgress?.({ bytes, entries });
+    } catch (error) {
+      failure = { error };
+    }
+    return !failure && !signal?.aborted;
+  });
+  native().set_progress_callback(handleId, callback.ptr);
+
+  let result: T | undefined;
+  let returned = false;
+  try {
+    result = run();
+    returned = true;
+  } catch (error) {
+    // A cancelled operation fails, report why it was cancelled instead
+    if (!failure && !signal?.aborted) {
+      throw error;
+    }
+  } finally {
+    listeners.delete(handleId);
+    native().set_progress_callback(handleId, null);
+  }
+
+  if (returned && completed(result as T)) {
+    return result as T;
+  }
+  if (failure) {
+    throw failure.error;
+  }
+  signal?.throwIfAborted();
+  return result as T;
+}
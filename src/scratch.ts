@@ -0,0 +1,73 @@
+import { type Pointer, ptr } from "bun:ffi";
+
+const encoder = new TextEncoder();
+const decoder = new TextDecoder();
+
+/** Initial capacity of a name buffer, enough for most entry names. */
+const INITIAL_NAME_CAPACITY = 256;
+
+/**
+ * Reusable buffer for passing names to the native layer. Names are encoded
+ * in place with `TextEncoder.encodeInto`, so a lookup or add allocates
+ * nothing once the buffer has grown to fit the longest name seen.
+ */
+export class NameBuffer {
+  private bytes = new Uint8Array(INITIAL_NAME_CAPACITY);
+  private address = ptr(this.bytes);
+
+  /**
+   * Encodes a name as a NUL-terminated UTF-8 string. The result is only
+   * valid until the next call.
+   * @param name - The name to encode.
+   * @returns A pointer to the encoded name.
+   */
+  encode(name: string): Pointer {
+    // UTF-8 takes at most 3 bytes per UTF-16 code unit, plus the terminator
+    const capacity = name.length * 3 + 1;
+    if (capacity > this.bytes.length) {
+      this.bytes = new Uint8Array(Math.max(capacity, this.bytes.length * 2));
+      this.address = ptr(this.bytes);
+    }
+
+    const { written } = encoder.encodeInto(name, this.bytes);
+    this.bytes[written] = 0;
+    return this.address;
+  }
+}
+
+/**
+ * Encodes several names into one buffer, for native calls that take a table
+ * of them.
+ * @param names - The names to encode.
+ * @returns The buffer, which has to stay referenced for as long as the native
+ * side reads it, and the offset of each NUL-terminated name in it.
+ */
+export function encodeNames(names: string[]): {
+  buffer: Uint8Array;
+  offsets: number[];
+} {
+  let capacity = 0;
+  for (const name of names) {
+    capacity += name.length * 3 + 1;
+  }
+
+  const buffer = new Uint8Array(capacity);
+  const offsets: number[] = [];
+  let offset = 0;
+  for (const name of names) {
+    offsets.push(offset);
+    offset += encoder.encodeInto(name, buffer.subarray(offset)).written;
+    buffer[offset++] = 0;
+  }
+  return { buffer, offsets };
+}
+
+/**
+ * Decodes a NUL-terminated UTF-8 string from a fixed-size field.
+ * @param bytes - The field.
+ * @returns The string up to the first NUL, or the whole field without one.
+ */
+export function decodeString(bytes: Uint8Array): string {
+  const end = bytes.indexOf(0);
+  return decoder.decode(end < 0 ? bytes : bytes.subarray(0, end));
+}
@@ -0,0 +1,57 @@
+import { ptr } from "bun:ffi";
+import type { ZipStats } from "./interfaces/stats.ts";
+import { native } from "./symbols.ts";
+
+/** Number of 64-bit counters in the native zip_stats_t. */
+const STATS_COUNTERS = 11;
+
+function decodeStats(counters: BigUint64Array): ZipStats {
+  const counter = (index: number) => Number(counters[index]);
+  return {
+    bytesRead: counter(0),
+    bytesWritten: counter(1),
+    uncompressedBytes: counter(2),
+    compressedBytes: counter(3),
+    entries: counter(4),
+    allocations: counter(5),
+    ioCalls: counter(6),
+    deflateSeconds: counter(7) / 1e9,
+    inflateSeconds: counter(8) / 1e9,
+    crcSeconds: counter(9) / 1e9,
+    ioSeconds: counter(10) / 1e9,
+  };
+}
+
+/**
+ * Reads the counters of a native reader or writer handle.
+ * @param handleId - The native handle.
+ * @returns The counters, or undefined if the handle is not open.
+ */
+export function readHandleStats(handleId: number): ZipStats | undefined {
+  const counters = new BigUint64Array(STATS_COUNTERS);
+  if (!native().get_stats(handleId, ptr(counters))) {
+    return undefined;
+  }
+  return decodeStats(counters);
+}
+
+/**
+ * Gets the counters of every reader and writer of the process, open or
+ * already closed, for process-level metrics export.
+ * @returns The summed counters.
+ */
+export function getGlobalStats(): ZipStats {
+  const counters = new BigUint64Array(STATS_COUNTERS);
+  native().get_global_stats(ptr(counters));
+  return decodeStats(counters);
+}
+
+/**
+ * Enables or disables the inflate, CRC and I/O timers of all readers and
+ * writers. Reading the clock around every call costs a little, so they are
+ * off by default; byte, entry, allocation and call counters are always kept.
+ * @param enabled - Whether to measure time.
+ */
+export function setStatsTiming(enabled: boolean): void {
+  native().set_stats_timing(enabled ? 1 : 0);
+}
@@ -1,4 +1,4 @@
-import { cc } from "bun:ffi";
+import { cc, ptr } from "bun:ffi";
 import { join } from "node:path";
 
 function getIncludePath(): string | null {
@@ -19,74 +19,240 @@ if (!includePath) {
 
 const wrapperPath = join(includePath, "zip_wrapper.c");
 
-// Compile the C code with all the zip functions
-export const { symbols } = cc({
-  source: wrapperPath,
-  include: [includePath],
-  symbols: {
-    create_zip: {
-      args: ["cstring"],
-      returns: "i32",
-    },
-    add_file_to_zip: {
-      args: ["i32", "cstring", "ptr", "u64", "i32"],
-      returns: "i32",
-    },
-    finalize_zip: {
-      args: ["i32"],
-      returns: "i32",
-    },
-    create_zip_in_memory: {
-      args: [],
-      returns: "i32",
-    },
-    get_zip_final_size: {
-      args: ["i32"],
-      returns: "i32",
-    },
-    finalize_zip_in_memory_bytes: {
-      args: ["i32", "ptr", "u64"],
-      returns: "i32",
-    },
-    open_zip: {
-      args: ["cstring"],
-      returns: "i32",
-    },
-    open_zip_from_memory: {
-      args: ["ptr", "u64"],
-      returns: "i32",
-    },
-    get_file_count: {
-      args: ["i32"],
-      returns: "i32",
-    },
-    get_file_info: {
-      args: ["i32", "i32", "ptr"],
-      returns: "i32",
-    },
-    extract_file: {
-      args: ["i32", "i32", "ptr"],
-      returns: "ptr",
-    },
-    close_zip: {
-      args: ["i32"],
-      returns: "i32",
-    },
-    find_file: {
-      args: ["i32", "cstring"],
-      returns: "i32",
-    },
-    extract_file_by_name: {
-      args: ["i32", "cstring", "ptr"],
-      returns: "ptr",
-    },
-    free_extracted_data: {
-      args: ["ptr"],
-      returns: "void",
-    },
-    extract_file_to_buffer: {
-      args: ["i32", "i32", "ptr", "u64"],
-      returns: "i32",
+/**
+ * Compiles the C code with all the zip functions. This takes a while, so it
+ * only happens when the first archive is opened (or on {@link warmup}).
+ */
+function compile() {
+  // Opt-in native dependencies, linked against the system libraries: the
+  // libdeflate codec backend, and libcrypto for hardware-accelerated AES
+  const define: Record<string, string> = {};
+  const library: string[] = [];
+  if (process.env.ZIP_BUN_LIBDEFLATE === "1") {
+    define.ZIP_BUN_WITH_LIBDEFLATE = "1";
+    library.push("deflate");
+  }
+  if (process.env.ZIP_BUN_OPENSSL === "1") {
+    define.ZIP_BUN_WITH_OPENSSL = "1";
+    library.push("crypto");
+  }
+
+  const { symbols } = cc({
+    source: wrapperPath,
+    include: [includePath],
+    ...(library.length ? { define, library } : {}),
+    symbols: {
+      create_zip: {
+        args: ["cstring"],
+        returns: "i32",
+      },
+      add_file_to_zip: {
+        args: ["i32", "cstring", "ptr", "u64", "i32", "i32", "i32", "i32"],
+        returns: "i32",
+      },
+      add_files_to_zip: {
+        args: ["i32", "ptr", "i32", "i32"],
+        returns: "i32",
+      },
+      copy_entry: {
+        args: ["i32", "i32", "i32"],
+        returns: "i32",
+      },
+      add_files_to_shards: {
+        args: ["ptr", "i32"],
+        returns: "i32",
+      },
+      finalize_zip: {
+        args: ["i32"],
+        returns: "i32",
+      },
+      create_zip_in_memory: {
+        args: [],
+        returns: "i32",
+      },
+      reserve_zip_space: {
+        args: ["i32", "f64"],
+        returns: "i32",
+      },
+      set_alignment: {
+        args: ["i32", "i32"],
+        returns: "i32",
+      },
+      get_zip_final_size: {
+        args: ["i32"],
+        returns: "i32",
+      },
+      finalize_zip_in_memory_bytes: {
+        args: ["i32", "ptr", "u64"],
+        returns: "i32",
+      },
+      open_zip: {
+        args: ["cstring"],
+        returns: "i32",
+      },
+      open_zip_from_memory: {
+        args: ["ptr", "u64"],
+        returns: "i32",
+      },
+      get_file_count: {
+        args: ["i32"],
+        returns: "i32",
+      },
+      get_file_info: {
+        args: ["i32", "i32", "ptr"],
+        returns: "i32",
+      },
+      extract_file: {
+        args: ["i32", "i32", "ptr"],
+        returns: "ptr",
+      },
+      close_zip: {
+        args: ["i32"],
+        returns: "i32",
+      },
+      release_zip: {
+        args: ["i32"],
+        returns: "i32",
+      },
+      get_entry_data_offset: {
+        args: ["i32", "i32"],
+        returns: "f64",
+      },
+      find_file: {
+        args: ["i32", "cstring"],
+        returns: "i32",
+      },
+      extract_file_by_name: {
+        args: ["i32", "cstring", "ptr"],
+        returns: "ptr",
+      },
+      free_extracted_data: {
+        args: ["ptr"],
+        returns: "void",
+      },
+      extract_file_to_buffer: {
+        args: ["i32", "i32", "ptr", "u64", "i32"],
+        returns: "i32",
+      },
+      wait_deferred_crc: {
+        args: ["i32", "ptr", "i32"],
+        returns: "i32",
+      },
+      set_auto_store: {
+        args: ["i32", "i32"],
+        returns: "i32",
+      },
+      validate_zip: {
+        args: ["i32", "i32", "i32", "i32", "ptr", "ptr"],
+        returns: "i32",
+      },
+      set_password: {
+        args: ["i32", "cstring", "i32", "i32"],
+        returns: "i32",
+      },
+      set_adaptive_target: {
+        args: ["i32", "f64"],
+        returns: "i32",
+      },
+      set_extract_limits: {
+        args: ["i32", "f64", "f64", "f64", "f64"],
+        returns: "i32",
+      },
+      check_extract_limits: {
+        args: ["i32", "i32"],
+        returns: "i32",
+      },
+      get_limit_violation: {
+        args: ["i32"],
+        returns: "i32",
+      },
+      set_progress_callback: {
+        args: ["i32", "ptr"],
+        returns: "i32",
+      },
+      get_compression_report: {
+        args: ["i32", "ptr"],
+        returns: "i32",
+      },
+      get_stats: {
+        args: ["i32", "ptr"],
+        returns: "i32",
+      },
+      get_global_stats: {
+        args: ["ptr"],
+        returns: "void",
+      },
+      set_stats_timing: {
+        args: ["i32"],
+        returns: "void",
+      },
+      get_latency_histogram: {
+        args: ["i32", "ptr"],
+        returns: "i32",
+      },
+      get_handle_usage: {
+        args: ["ptr"],
+        returns: "void",
+      },
+      load_trace_probes: {
+        args: ["cstring"],
+        returns: "i32",
+      },
+      get_codec_backend_count: {
+        args: [],
+        returns: "i32",
+      },
+      get_codec_backend_name: {
+        args: ["i32", "ptr", "u64"],
+        returns: "i32",
+      },
+      get_codec_backend: {
+        args: [],
+        returns: "i32",
+      },
+      set_codec_backend: {
+        args: ["i32"],
+        returns: "i32",
+      },
     },
-  },
+  });
+
+  // Probes requested through the environment are loaded with the library
+  const probes = process.env.ZIP_BUN_PROBES;
+  if (probes && !symbols.load_trace_probes(ptr(Buffer.from(`${probes}\0`)))) {
+    throw new Error(`Failed to load trace probes: ${probes}`);
+  }
+  return symbols;
+}
+
+type NativeSymbols = ReturnType<typeof compile>;
+
+let loaded: NativeSymbols | undefined;
+
+/**
+ * Gets the native functions, compiling the library on first use so that
+ * importing zip-bun costs nothing until an archive is touched.
+ * @returns The native functions.
+ */
+export function native(): NativeSymbols {
+  loaded ??= compile();
+  return loaded;
+}
+
+/**
+ * Compiles and loads the native library now rather than on first use, for
+ * servers that prefer to pay the cost at boot instead of on their first
+ * request.
+ */
+export function warmup(): void {
+  native();
+}
+
+/**
+ * The native functions, for direct use. The library is compiled on first
+ * access of any of them.
+ */
+export const symbols = new Proxy({} as NativeSymbols, {
+  get: (_, name) => native()[name as keyof NativeSymbols],
+  has: (_, name) => name in native(),
 });
@@ -0,0 +1,75 @@
+import { ptr } from "bun:ffi";
+import type {
+  TraceCallback,
+  TraceOperation,
+  TraceSpan,
+} from "./interfaces/tracing.ts";
+import { native } from "./symbols.ts";
+
+/**
+ * The installed span callback. Readers and writers check it before timing
+ * anything, so operations cost nothing extra while it is unset.
+ */
+export let traceCallback: TraceCallback | undefined;
+
+/**
+ * Installs a callback that receives a span for every locate, extract, add,
+ * finalize and validate operation of any reader or writer, or removes it.
+ * The callback runs synchronously at the end of the operation.
+ * @param callback - The callback, or undefined to stop tracing.
+ */
+export function setTraceCallback(callback?: TraceCallback): void {
+  traceCallback = callback;
+}
+
+/**
+ * Starts a span, to be completed by {@link traced}.
+ * @param operation - The operation being traced.
+ * @param name - Entry name, if known up front.
+ * @returns The span, with its start time set.
+ */
+export function startSpan(
+  operation: TraceOperation,
+  name?: string,
+): TraceSpan {
+  return {
+    operation,
+    name,
+    startTime: performance.timeOrigin + performance.now(),
+    duration: 0,
+  };
+}
+
+/**
+ * Runs an operation and reports its span to the trace callback, with the
+ * error it threw, if any.
+ * @param span - The span from {@link startSpan}, which `fn` may fill in.
+ * @param fn - The operation.
+ * @returns What `fn` returned.
+ */
+export function traced<T>(span: TraceSpan, fn: () => T): T {
+  try {
+    return fn();
+  } catch (error) {
+    span.error = error;
+    throw error;
+  } finally {
+    span.duration = performance.timeOrigin + performance.now() - span.startTime;
+    traceCallback?.(span);
+  }
+}
+
+/**
+ * Loads the USDT probe library built from probes.c, after which the native
+ * operations, archive I/O and codec calls fire zip_bun:* tracepoints for
+ * bpftrace or perf. Also done when the native library is loaded if
+ * ZIP_BUN_PROBES names the probe library.
+ * @param path - Path of the shared library.
+ * @throws Error if the library cannot be loaded (or on Windows).
+ */
+export function loadProbes(path: string): void {
+  const pathBuffer = Buffer.from(`${path}\0`, "utf8");
+  if (!native().load_trace_probes(ptr(pathBuffer))) {
+    throw new Error(`Failed to load trace probes: ${path}`);
+  }
+}
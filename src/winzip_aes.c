@@ -0,0 +1,609 @@
+// WinZip AES encryption (AE-1 and AE-2, zip method 99)
+//
+// Included from zip_wrapper.c. An encrypted entry stores the real method in
+// an 0x9901 extra field, and its data is laid out as:
+//   salt (8/12/16 bytes) | password verifier (2) | AES-CTR ciphertext | HMAC (10)
+// Keys come from PBKDF2-HMAC-SHA1(password, salt, 1000 iterations). The
+// output is split into the AES key, the HMAC-SHA1 key and the verifier. The
+// counter is a little-endian block number starting at 1, and the HMAC covers
+// the ciphertext only. AE-1 keeps the CRC of the plaintext, AE-2 writes 0.
+//
+// Every entry has its own salt, so each entry needs its own PBKDF2 run. It
+// would be insecure to share a salt: the entries would reuse a keystream.
+// Two costs are cached per handle instead:
+// - The HMAC state keyed by the password. This halves the SHA-1 work of
+//   every derivation.
+// - Keys already derived for a salt. Reading an entry again costs nothing.
+//
+// The portable code below works under any compiler, including TinyCC. With
+// ZIP_BUN_WITH_OPENSSL the AES blocks and the HMAC of entry data go through
+// libcrypto, which uses AES-NI / ARMv8 crypto extensions and SHA instructions.
+// PBKDF2 stays here either way: with the password state cached it beats
+// libcrypto's, whose per-iteration overhead dominates 20-byte HMACs.
+
+#ifdef ZIP_BUN_WITH_OPENSSL
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#endif
+
+#if defined(__linux__)
+#include <errno.h>
+#include <sys/random.h>
+#endif
+
+#define ZIP_METHOD_AES 99
+#define ZIP_AES_EXTRA_ID 0x9901
+#define ZIP_AES_EXTRA_SIZE 11
+#define ZIP_AES_VERSION_NEEDED 51
+#define ZIP_AES_ITERATIONS 1000
+#define ZIP_AES_VERIFIER_SIZE 2
+#define ZIP_AES_MAC_SIZE 10
+#define ZIP_AES_KEY_CACHE_SIZE 16
+// Counter blocks encrypted per batch before being XORed into the data
+#define ZIP_AES_CTR_BATCH 64
+
+// SHA-1
+
+typedef struct {
+    mz_uint32 h[5];
+    mz_uint8 block[64];
+    size_t block_length;
+    mz_uint64 total;
+} zip_sha1_t;
+
+#define ZIP_ROL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static mz_uint32 zip_load_be32(const mz_uint8* p) {
+    return ((mz_uint32)p[0] << 24) | ((mz_uint32)p[1] << 16) | ((mz_uint32)p[2] << 8) | p[3];
+}
+
+static void zip_store_be32(mz_uint8* p, mz_uint32 v) {
+    p[0] = (mz_uint8)(v >> 24);
+    p[1] = (mz_uint8)(v >> 16);
+    p[2] = (mz_uint8)(v >> 8);
+    p[3] = (mz_uint8)v;
+}
+
+static void zip_sha1_compress(mz_uint32 h[5], const mz_uint8* block) {
+    // The message schedule is kept as a rolling window of 16 words
+    mz_uint32 w[16];
+    for (int i = 0; i < 16; i++) w[i] = zip_load_be32(block + i * 4);
+
+    mz_uint32 a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], t;
+
+#define ZIP_SHA1_W(i) \
+    ((i) < 16 ? w[(i)] : (w[(i) & 15] = ZIP_ROL32(w[((i) + 13) & 15] ^ w[((i) + 8) & 15] ^ w[((i) + 2) & 15] ^ w[(i) & 15], 1)))
+#define ZIP_SHA1_ROUND(f, k, i) \
+    t = ZIP_ROL32(a, 5) + (f) + e + (k) + ZIP_SHA1_W(i); \
+    e = d; \
+    d = c; \
+    c = ZIP_ROL32(b, 30); \
+    b = a; \
+    a = t;
+
+    for (int i = 0; i < 20; i++) {
+        ZIP_SHA1_ROUND(d ^ (b & (c ^ d)), 0x5A827999, i)
+    }
+    for (int i = 20; i < 40; i++) {
+        ZIP_SHA1_ROUND(b ^ c ^ d, 0x6ED9EBA1, i)
+    }
+    for (int i = 40; i < 60; i++) {
+        ZIP_SHA1_ROUND((b & c) | (d & (b | c)), 0x8F1BBCDC, i)
+    }
+    for (int i = 60; i < 80; i++) {
+        ZIP_SHA1_ROUND(b ^ c ^ d, 0xCA62C1D6, i)
+    }
+#undef ZIP_SHA1_ROUND
+#undef ZIP_SHA1_W
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+static void zip_sha1_init(zip_sha1_t* s) {
+    s->h[0] = 0x67452301;
+    s->h[1] = 0xEFCDAB89;
+    s->h[2] = 0x98BADCFE;
+    s->h[3] = 0x10325476;
+    s->h[4] = 0xC3D2E1F0;
+    s->block_length = 0;
+    s->total = 0;
+}
+
+static void zip_sha1_update(zip_sha1_t* s, const void* data, size_t length) {
+    const mz_uint8* p = (const mz_uint8*)data;
+    s->total += length;
+
+    if (s->block_length) {
+        size_t take = 64 - s->block_length;
+        if (take > length) take = length;
+        memcpy(s->block + s->block_length, p, take);
+        s->block_length += take;
+        p += take;
+        length -= take;
+        if (s->block_length < 64) return;
+        zip_sha1_compress(s->h, s->block);
+        s->block_length = 0;
+    }
+
+    for (; length >= 64; p += 64, length -= 64) zip_sha1_compress(s->h, p);
+
+    memcpy(s->block, p, length);
+    s->block_length = length;
+}
+
+static void zip_sha1_final(zip_sha1_t* s, mz_uint8 digest[20]) {
+    mz_uint64 bits = s->total * 8;
+    mz_uint8 pad = 0x80;
+    zip_sha1_update(s, &pad, 1);
+
+    pad = 0;
+    while (s->block_length != 56) zip_sha1_update(s, &pad, 1);
+
+    mz_uint8 length[8];
+    for (int i = 0; i < 8; i++) length[i] = (mz_uint8)(bits >> (56 - i * 8));
+    zip_sha1_update(s, length, 8);
+
+    for (int i = 0; i < 5; i++) zip_store_be32(digest + i * 4, s->h[i]);
+}
+
+// HMAC-SHA1 with the key already absorbed into the inner and outer states
+
+typedef struct {
+    zip_sha1_t inner;
+    zip_sha1_t outer;
+} zip_hmac_t;
+
+static void zip_hmac_init(zip_hmac_t* mac, const mz_uint8* key, size_t key_length) {
+    mz_uint8 pad[64], hashed[20];
+
+    if (key_length > 64) {
+        zip_sha1_init(&mac->inner);
+        zip_sha1_update(&mac->inner, key, key_length);
+        zip_sha1_final(&mac->inner, hashed);
+        key = hashed;
+        key_length = 20;
+    }
+
+    memset(pad, 0x36, sizeof(pad));
+    for (size_t i = 0; i < key_length; i++) pad[i] ^= key[i];
+    zip_sha1_init(&mac->inner);
+    zip_sha1_update(&mac->inner, pad, 64);
+
+    memset(pad, 0x5C, sizeof(pad));
+    for (size_t i = 0; i < key_length; i++) pad[i] ^= key[i];
+    zip_sha1_init(&mac->outer);
+    zip_sha1_update(&mac->outer, pad, 64);
+}
+
+static void zip_hmac(const zip_hmac_t* mac, const void* data, size_t length, mz_uint8 digest[20]) {
+    zip_sha1_t s = mac->inner;
+    zip_sha1_update(&s, data, length);
+    zip_sha1_final(&s, digest);
+
+    s = mac->outer;
+    zip_sha1_update(&s, digest, 20);
+    zip_sha1_final(&s, digest);
+}
+
+// HMAC of a 20-byte message, the inner loop of PBKDF2. Both hashes are a
+// single pre-padded block on top of the keyed states, 2 compressions in all.
+static void zip_hmac_20(const zip_hmac_t* mac, const mz_uint8 message[20], mz_uint8 digest[20]) {
+    mz_uint8 block[64];
+    mz_uint32 h[5];
+
+    memset(block, 0, sizeof(block));
+    memcpy(block, message, 20);
+    block[20] = 0x80;
+    // (64 + 20) bytes = 672 bits
+    block[62] = 0x02;
+    block[63] = 0xA0;
+
+    memcpy(h, mac->inner.h, sizeof(h));
+    zip_sha1_compress(h, block);
+    for (int i = 0; i < 5; i++) zip_store_be32(block + i * 4, h[i]);
+
+    memcpy(h, mac->outer.h, sizeof(h));
+    zip_sha1_compress(h, block);
+    for (int i = 0; i < 5; i++) zip_store_be32(digest + i * 4, h[i]);
+}
+
+static void zip_pbkdf2_sha1(const zip_hmac_t* password, const mz_uint8* salt, size_t salt_length, mz_uint8* out, size_t out_length) {
+    mz_uint8 first[16 + 4], u[20], t[20];
+
+    memcpy(first, salt, salt_length);
+    for (mz_uint32 block = 1; out_length; block++) {
+        zip_store_be32(first + salt_length, block);
+        zip_hmac(password, first, salt_length + 4, u);
+        memcpy(t, u, 20);
+
+        for (int i = 1; i < ZIP_AES_ITERATIONS; i++) {
+            zip_hmac_20(password, u, u);
+            for (int j = 0; j < 20; j++) t[j] ^= u[j];
+        }
+
+        size_t take = out_length < 20 ? out_length : 20;
+        memcpy(out, t, take);
+        out += take;
+        out_length -= take;
+    }
+}
+
+// AES encryption, all CTR mode needs. Classic 32-bit T-tables, built on
+// first use.
+
+static mz_uint8 zip_aes_sbox[256];
+static mz_uint32 zip_aes_te[4][256];
+static int zip_aes_tables_ready = 0;
+
+static mz_uint8 zip_aes_xtime(mz_uint8 x) {
+    return (mz_uint8)((x << 1) ^ ((x & 0x80) ? 0x1B : 0));
+}
+
+// Not thread-safe, runs when a password is set, before any worker can use it
+static void zip_aes_init_tables(void) {
+    if (zip_aes_tables_ready) return;
+
+    // Walk the multiplicative group with generator 3, pairing each element
+    // with its inverse to compute the S-box affine transform
+    mz_uint8 p = 1, q = 1;
+    do {
+        p = (mz_uint8)(p ^ zip_aes_xtime(p));
+        q ^= (mz_uint8)(q << 1);
+        q ^= (mz_uint8)(q << 2);
+        q ^= (mz_uint8)(q << 4);
+        if (q & 0x80) q ^= 0x09;
+
+        mz_uint8 x = q;
+        for (int r = 1; r < 5; r++) x ^= (mz_uint8)((q << r) | (q >> (8 - r)));
+        zip_aes_sbox[p] = (mz_uint8)(x ^ 0x63);
+    } while (p != 1);
+    zip_aes_sbox[0] = 0x63;
+
+    for (int i = 0; i < 256; i++) {
+        mz_uint8 s = zip_aes_sbox[i], s2 = zip_aes_xtime(s), s3 = (mz_uint8)(s2 ^ s);
+        mz_uint32 t = ((mz_uint32)s2 << 24) | ((mz_uint32)s << 16) | ((mz_uint32)s << 8) | s3;
+        zip_aes_te[0][i] = t;
+        zip_aes_te[1][i] = (t >> 8) | (t << 24);
+        zip_aes_te[2][i] = (t >> 16) | (t << 16);
+        zip_aes_te[3][i] = (t >> 24) | (t << 8);
+    }
+
+    zip_aes_tables_ready = 1;
+}
+
+typedef struct {
+    mz_uint32 round_keys[60];
+    int rounds;
+} zip_aes_key_t;
+
+static void zip_aes_expand_key(zip_aes_key_t* key, const mz_uint8* bytes, int key_length) {
+    int nk = key_length / 4;
+    int total = 4 * (nk + 7);
+    mz_uint8 rcon = 1;
+    mz_uint32* w = key->round_keys;
+
+    key->rounds = nk + 6;
+    for (int i = 0; i < nk; i++) w[i] = zip_load_be32(bytes + i * 4);
+
+    for (int i = nk; i < total; i++) {
+        mz_uint32 t = w[i - 1];
+        if (i % nk == 0) {
+            t = (t << 8) | (t >> 24);
+            t = ((mz_uint32)zip_aes_sbox[t >> 24] << 24) | ((mz_uint32)zip_aes_sbox[(t >> 16) & 0xFF] << 16) |
+                ((mz_uint32)zip_aes_sbox[(t >> 8) & 0xFF] << 8) | zip_aes_sbox[t & 0xFF];
+            t ^= (mz_uint32)rcon << 24;
+            rcon = zip_aes_xtime(rcon);
+        } else if (nk > 6 && i % nk == 4) {
+            t = ((mz_uint32)zip_aes_sbox[t >> 24] << 24) | ((mz_uint32)zip_aes_sbox[(t >> 16) & 0xFF] << 16) |
+                ((mz_uint32)zip_aes_sbox[(t >> 8) & 0xFF] << 8) | zip_aes_sbox[t & 0xFF];
+        }
+        w[i] = w[i - nk] ^ t;
+    }
+}
+
+static void zip_aes_encrypt_block(const zip_aes_key_t* key, const mz_uint8 in[16], mz_uint8 out[16]) {
+    const mz_uint32* rk = key->round_keys;
+    mz_uint32 s0 = zip_load_be32(in) ^ rk[0];
+    mz_uint32 s1 = zip_load_be32(in + 4) ^ rk[1];
+    mz_uint32 s2 = zip_load_be32(in + 8) ^ rk[2];
+    mz_uint32 s3 = zip_load_be32(in + 12) ^ rk[3];
+
+    for (int r = 1; r < key->rounds; r++) {
+        rk += 4;
+        mz_uint32 t0 = zip_aes_te[0][s0 >> 24] ^ zip_aes_te[1][(s1 >> 16) & 0xFF] ^ zip_aes_te[2][(s2 >> 8) & 0xFF] ^ zip_aes_te[3][s3 & 0xFF] ^ rk[0];
+        mz_uint32 t1 = zip_aes_te[0][s1 >> 24] ^ zip_aes_te[1][(s2 >> 16) & 0xFF] ^ zip_aes_te[2][(s3 >> 8) & 0xFF] ^ zip_aes_te[3][s0 & 0xFF] ^ rk[1];
+        mz_uint32 t2 = zip_aes_te[0][s2 >> 24] ^ zip_aes_te[1][(s3 >> 16) & 0xFF] ^ zip_aes_te[2][(s0 >> 8) & 0xFF] ^ zip_aes_te[3][s1 & 0xFF] ^ rk[2];
+        mz_uint32 t3 = zip_aes_te[0][s3 >> 24] ^ zip_aes_te[1][(s0 >> 16) & 0xFF] ^ zip_aes_te[2][(s1 >> 8) & 0xFF] ^ zip_aes_te[3][s2 & 0xFF] ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+
+    rk += 4;
+    const mz_uint8* sb = zip_aes_sbox;
+    zip_store_be32(out, (((mz_uint32)sb[s0 >> 24] << 24) | ((mz_uint32)sb[(s1 >> 16) & 0xFF] << 16) | ((mz_uint32)sb[(s2 >> 8) & 0xFF] << 8) | sb[s3 & 0xFF]) ^ rk[0]);
+    zip_store_be32(out + 4, (((mz_uint32)sb[s1 >> 24] << 24) | ((mz_uint32)sb[(s2 >> 16) & 0xFF] << 16) | ((mz_uint32)sb[(s3 >> 8) & 0xFF] << 8) | sb[s0 & 0xFF]) ^ rk[1]);
+    zip_store_be32(out + 8, (((mz_uint32)sb[s2 >> 24] << 24) | ((mz_uint32)sb[(s3 >> 16) & 0xFF] << 16) | ((mz_uint32)sb[(s0 >> 8) & 0xFF] << 8) | sb[s1 & 0xFF]) ^ rk[2]);
+    zip_store_be32(out + 12, (((mz_uint32)sb[s3 >> 24] << 24) | ((mz_uint32)sb[(s0 >> 16) & 0xFF] << 16) | ((mz_uint32)sb[(s1 >> 8) & 0xFF] << 8) | sb[s2 & 0xFF]) ^ rk[3]);
+}
+
+// Keys derived for one salt
+
+typedef struct {
+    int used;
+    int strength;
+    mz_uint8 salt[16];
+    mz_uint8 verifier[ZIP_AES_VERIFIER_SIZE];
+#ifdef ZIP_BUN_WITH_OPENSSL
+    EVP_CIPHER_CTX* cipher;
+    mz_uint8 mac_key[32];
+#else
+    zip_aes_key_t cipher;
+    zip_hmac_t mac;
+#endif
+} zip_aes_keys_t;
+
+typedef struct {
+    char* password;
+    size_t password_length;
+    // HMAC keyed with the password, the starting point of every PBKDF2 run
+    zip_hmac_t password_mac;
+    // Settings for new entries of a writer
+    int strength;
+    int version;
+    zip_aes_keys_t cache[ZIP_AES_KEY_CACHE_SIZE];
+    int cache_next;
+    // Reusable buffer for an encrypted entry being written
+    mz_uint8* buffer;
+    size_t buffer_capacity;
+} zip_aes_t;
+
+// Strength 1, 2 and 3 are AES-128, AES-192 and AES-256
+static int zip_aes_key_length(int strength) {
+    return 8 + strength * 8;
+}
+
+static int zip_aes_salt_length(int strength) {
+    return 4 + strength * 4;
+}
+
+static size_t zip_aes_overhead(int strength) {
+    return (size_t)zip_aes_salt_length(strength) + ZIP_AES_VERIFIER_SIZE + ZIP_AES_MAC_SIZE;
+}
+
+static int zip_aes_random(mz_uint8* out, size_t length) {
+#if defined(ZIP_BUN_WITH_OPENSSL)
+    return RAND_bytes(out, (int)length) == 1;
+#elif defined(_WIN32)
+    // rand_s draws from RtlGenRandom, the system CSPRNG
+    extern int rand_s(unsigned int* value);
+    for (size_t i = 0; i < length; i++) {
+        unsigned int value;
+        if (rand_s(&value)) return 0;
+        out[i] = (mz_uint8)value;
+    }
+    return 1;
+#elif defined(__linux__)
+    // Salts are far below the 256 bytes getrandom always returns in full,
+    // but a signal can still interrupt it
+    size_t got = 0;
+    while (got < length) {
+        ssize_t n = getrandom(out + got, length - got, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        got += (size_t)n;
+    }
+    return 1;
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+    arc4random_buf(out, length);
+    return 1;
+#else
+    // Opened once, unbuffered so a salt costs a single read. Shard threads
+    // can race to open it; the loser closes its copy.
+    static FILE* urandom;
+    FILE* file = __atomic_load_n(&urandom, __ATOMIC_ACQUIRE);
+    if (!file) {
+        file = fopen("/dev/urandom", "rb");
+        if (!file) return 0;
+        setvbuf(file, NULL, _IONBF, 0);
+
+        FILE* expected = NULL;
+        if (!__atomic_compare_exchange_n(&urandom, &expected, file, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            fclose(file);
+            file = expected;
+        }
+    }
+    return fread(out, 1, length, file) == length;
+#endif
+}
+
+static void zip_aes_release_keys(zip_aes_keys_t* keys) {
+#ifdef ZIP_BUN_WITH_OPENSSL
+    if (keys->cipher) EVP_CIPHER_CTX_free(keys->cipher);
+#endif
+    memset(keys, 0, sizeof(*keys));
+}
+
+static zip_aes_t* zip_aes_create(const char* password, size_t password_length, int strength, int version) {
+    zip_aes_t* aes = (zip_aes_t*)calloc(1, sizeof(zip_aes_t));
+    if (!aes) return NULL;
+
+    aes->password = (char*)malloc(password_length + 1);
+    if (!aes->password) {
+        free(aes);
+        return NULL;
+    }
+    memcpy(aes->password, password, password_length);
+    aes->password[password_length] = '\0';
+    aes->password_length = password_length;
+    aes->strength = strength;
+    aes->version = version;
+
+#ifndef ZIP_BUN_WITH_OPENSSL
+    zip_aes_init_tables();
+#endif
+    zip_hmac_init(&aes->password_mac, (const mz_uint8*)password, password_length);
+    return aes;
+}
+
+static void zip_aes_free(zip_aes_t* aes) {
+    if (!aes) return;
+    for (int i = 0; i < ZIP_AES_KEY_CACHE_SIZE; i++) zip_aes_release_keys(&aes->cache[i]);
+    memset(aes->password, 0, aes->password_length);
+    free(aes->password);
+    free(aes->buffer);
+    memset(aes, 0, sizeof(*aes));
+    free(aes);
+}
+
+// Derive (or find the cached) keys for a salt
+static const zip_aes_keys_t* zip_aes_keys(zip_aes_t* aes, int strength, const mz_uint8* salt) {
+    int salt_length = zip_aes_salt_length(strength);
+    int key_length = zip_aes_key_length(strength);
+
+    for (int i = 0; i < ZIP_AES_KEY_CACHE_SIZE; i++) {
+        zip_aes_keys_t* keys = &aes->cache[i];
+        if (keys->used && keys->strength == strength && !memcmp(keys->salt, salt, (size_t)salt_length)) return keys;
+    }
+
+    // AES key, HMAC key, then the verifier
+    mz_uint8 derived[32 + 32 + ZIP_AES_VERIFIER_SIZE];
+    zip_aes_keys_t* keys = &aes->cache[aes->cache_next];
+    aes->cache_next = (aes->cache_next + 1) % ZIP_AES_KEY_CACHE_SIZE;
+    zip_aes_release_keys(keys);
+
+    zip_pbkdf2_sha1(&aes->password_mac, salt, (size_t)salt_length, derived, (size_t)(key_length * 2 + ZIP_AES_VERIFIER_SIZE));
+
+#ifdef ZIP_BUN_WITH_OPENSSL
+    static const EVP_CIPHER* (*const ciphers[3])(void) = {EVP_aes_128_ecb, EVP_aes_192_ecb, EVP_aes_256_ecb};
+    keys->cipher = EVP_CIPHER_CTX_new();
+    if (!keys->cipher || !EVP_EncryptInit_ex(keys->cipher, ciphers[strength - 1](), NULL, derived, NULL)) {
+        zip_aes_release_keys(keys);
+        return NULL;
+    }
+    EVP_CIPHER_CTX_set_padding(keys->cipher, 0);
+    memcpy(keys->mac_key, derived + key_length, (size_t)key_length);
+#else
+    zip_aes_expand_key(&keys->cipher, derived, key_length);
+    zip_hmac_init(&keys->mac, derived + key_length, (size_t)key_length);
+#endif
+
+    memcpy(keys->salt, salt, (size_t)salt_length);
+    memcpy(keys->verifier, derived + key_length * 2, ZIP_AES_VERIFIER_SIZE);
+    keys->strength = strength;
+    keys->used = 1;
+    memset(derived, 0, sizeof(derived));
+    return keys;
+}
+
+// XOR the CTR keystream into src, writing dst (which may be src)
+static int zip_aes_ctr(const zip_aes_keys_t* keys, const mz_uint8* src, mz_uint8* dst, size_t length) {
+    mz_uint8 counters[ZIP_AES_CTR_BATCH * 16], stream[ZIP_AES_CTR_BATCH * 16];
+    mz_uint64 counter = 1;
+
+    memset(counters, 0, sizeof(counters));
+    while (length) {
+        size_t chunk = length < sizeof(stream) ? length : sizeof(stream);
+        int blocks = (int)((chunk + 15) / 16);
+
+        for (int b = 0; b < blocks; b++, counter++) {
+            for (int i = 0; i < 8; i++) counters[b * 16 + i] = (mz_uint8)(counter >> (i * 8));
+        }
+
+#ifdef ZIP_BUN_WITH_OPENSSL
+        // ECB over the counter blocks lets libcrypto pipeline the AES rounds;
+        // its own CTR mode counts big-endian and can't be used directly
+        int produced = 0;
+        if (!EVP_EncryptUpdate(keys->cipher, stream, &produced, counters, blocks * 16) || produced != blocks * 16) return 0;
+#else
+        for (int b = 0; b < blocks; b++) zip_aes_encrypt_block(&keys->cipher, counters + b * 16, stream + b * 16);
+#endif
+
+        size_t i = 0;
+        for (; i + 8 <= chunk; i += 8) {
+            mz_uint64 a, k;
+            memcpy(&a, src + i, 8);
+            memcpy(&k, stream + i, 8);
+            a ^= k;
+            memcpy(dst + i, &a, 8);
+        }
+        for (; i < chunk; i++) dst[i] = src[i] ^ stream[i];
+
+        src += chunk;
+        dst += chunk;
+        length -= chunk;
+    }
+    return 1;
+}
+
+static int zip_aes_mac(const zip_aes_keys_t* keys, const mz_uint8* data, size_t length, mz_uint8 mac[20]) {
+#ifdef ZIP_BUN_WITH_OPENSSL
+    unsigned int mac_length = 20;
+    return HMAC(EVP_sha1(), keys->mac_key, zip_aes_key_length(keys->strength), data, length, mac, &mac_length) != NULL;
+#else
+    zip_hmac(&keys->mac, data, length, mac);
+    return 1;
+#endif
+}
+
+// Grow the writer's output buffer
+static mz_uint8* zip_aes_buffer(zip_aes_t* aes, size_t size) {
+    if (size > aes->buffer_capacity) {
+        mz_uint8* grown = (mz_uint8*)realloc(aes->buffer, size);
+        if (!grown) return NULL;
+        aes->buffer = grown;
+        aes->buffer_capacity = size;
+    }
+    return aes->buffer;
+}
+
+// Encrypt data with a fresh salt into out, which must hold length plus
+// zip_aes_overhead bytes. Returns the encrypted size, or 0 on failure.
+static size_t zip_aes_encrypt(zip_aes_t* aes, const void* data, size_t length, mz_uint8* out) {
+    int salt_length = zip_aes_salt_length(aes->strength);
+    mz_uint8 mac[20];
+
+    if (!zip_aes_random(out, (size_t)salt_length)) return 0;
+    const zip_aes_keys_t* keys = zip_aes_keys(aes, aes->strength, out);
+    if (!keys) return 0;
+
+    mz_uint8* ciphertext = out + salt_length + ZIP_AES_VERIFIER_SIZE;
+    memcpy(out + salt_length, keys->verifier, ZIP_AES_VERIFIER_SIZE);
+    if (!zip_aes_ctr(keys, (const mz_uint8*)data, ciphertext, length)) return 0;
+    if (!zip_aes_mac(keys, ciphertext, length, mac)) return 0;
+
+    memcpy(ciphertext + length, mac, ZIP_AES_MAC_SIZE);
+    return length + zip_aes_overhead(aes->strength);
+}
+
+// Check and decrypt the data of an entry into out, which must hold
+// data_length minus zip_aes_overhead bytes. Fails on a wrong password or
+// tampered data.
+static int zip_aes_decrypt(zip_aes_t* aes, int strength, const mz_uint8* data, size_t data_length, mz_uint8* out) {
+    int salt_length = zip_aes_salt_length(strength);
+    mz_uint8 mac[20];
+
+    if (data_length < zip_aes_overhead(strength)) return 0;
+    size_t length = data_length - zip_aes_overhead(strength);
+    const mz_uint8* ciphertext = data + salt_length + ZIP_AES_VERIFIER_SIZE;
+
+    const zip_aes_keys_t* keys = zip_aes_keys(aes, strength, data);
+    if (!keys) return 0;
+    if (memcmp(keys->verifier, data + salt_length, ZIP_AES_VERIFIER_SIZE)) return 0;
+
+    // Authenticate before decrypting, comparing in constant time
+    if (!zip_aes_mac(keys, ciphertext, length, mac)) return 0;
+    mz_uint8 difference = 0;
+    for (int i = 0; i < ZIP_AES_MAC_SIZE; i++) difference |= mac[i] ^ ciphertext[length + i];
+    if (difference) return 0;
+
+    return zip_aes_ctr(keys, ciphertext, out, length);
+}
@@ -1,11 +1,37 @@
 import { afterAll, beforeAll, describe, expect, test } from "bun:test";
 
 import {
+  CodecBackend,
   CompressionLevel,
+  type CompressionLevelType,
+  CompressionStrategy,
   createArchive,
+  createMemoryArchive,
+  EncryptionStrength,
+  EncryptionVersion,
+  getCodecBackend,
+  getCodecBackends,
+  getGlobalStats,
+  loadProbes,
+  metrics,
+  nativeMemoryUsage,
   openArchive,
+  openMemoryArchive,
+  type Progress,
+  readAccessTrace,
+  readShardManifest,
+  repackArchive,
+  setCodecBackend,
+  ShardedZipWriter,
+  setStatsTiming,
+  setTraceCallback,
+  type TraceSpan,
+  validateArchive,
+  warmup,
   ZipArchiveReader,
   ZipArchiveWriter,
+  ZipCancelledError,
+  ZipLimitError,
 } from "./index.ts";
 
 const testDirectory = "test_directory";
@@ -115,6 +141,75 @@ describe("ZipArchiveWriter", () => {
     writer.finalize();
   });
 
+  test("should write entries across write buffer boundaries", () => {
+    const small = (i: number) =>
+      new TextEncoder().encode(JSON.stringify({ id: i }));
+
+    // Small entries around ones larger than the 4MB write buffer
+    const writer = createArchive(testZipFile);
+    for (let i = 0; i < 500; i++) {
+      writer.addFile(`small/${i}.json`, small(i), CompressionLevel.DEFAULT);
+      if (i === 100) {
+        writer.addFile("five_mb.txt", five_mb);
+      } else if (i === 300) {
+        writer.addFile("five_mb.bin", five_mb, CompressionLevel.DEFAULT);
+      }
+    }
+    writer.finalize();
+
+    const reader = openArchive(testZipFile);
+    expect(reader.getFileCount()).toBe(502);
+    expect(reader.extractFileByName("five_mb.txt")).toEqual(five_mb);
+    expect(reader.extractFileByName("five_mb.bin")).toEqual(five_mb);
+    for (const i of [0, 101, 250, 499]) {
+      expect(reader.extractFileByName(`small/${i}.json`)).toEqual(small(i));
+    }
+    reader.close();
+  });
+
+  test("should trim the space reserved for an expected size", async () => {
+    const writer = createArchive(testZipFile, {
+      expectedSize: 64 * 1024 * 1024,
+    });
+    writer.addFile("five_mb.txt", five_mb, CompressionLevel.DEFAULT);
+    writer.finalize();
+
+    const size = Bun.file(testZipFile).size;
+    expect(size).toBeLessThan(five_mb.length);
+    const reader = openMemoryArchive(
+      new Uint8Array(await Bun.file(testZipFile).arrayBuffer()),
+    );
+    expect(reader.extractFile(0)).toEqual(five_mb);
+    reader.close();
+
+    const memoryWriter = createMemoryArchive({ expectedSize: 1024 });
+    memoryWriter.addFile("five_mb.txt", five_mb);
+    expect(memoryWriter.finalizeToMemory().length).toBeGreaterThan(
+      five_mb.length,
+    );
+  });
+
+  test("should reject invalid expected sizes", () => {
+    for (const expectedSize of [0, -1, Number.NaN, Number.POSITIVE_INFINITY]) {
+      expect(() => createArchive(testZipFile, { expectedSize })).toThrow(
+        "Invalid expected size",
+      );
+    }
+  });
+
+  test("should patch encrypted entry headers in a file", () => {
+    const password = "correct horse";
+    const writer = createArchive(testZipFile, { encryption: { password } });
+    writer.addFile("five_mb.txt", five_mb, CompressionLevel.BEST_SPEED);
+    writer.addFile("binary.png", testBinaryData);
+    writer.finalize();
+
+    const reader = openArchive(testZipFile, { password });
+    expect(reader.extractFile(0)).toEqual(five_mb);
+    expect(reader.extractFile(1)).toEqual(testBinaryData);
+    reader.close();
+  });
+
   test("should create memory archive with empty filename", () => {
     const writer = createArchive("");
     expect(writer).toBeInstanceOf(ZipArchiveWriter);
@@ -142,6 +237,20 @@ describe("Memory-based ZipArchiveWriter", () => {
     expect(result).toBe(true);
   });
 
+  test("should finalize archives of many tiny entries", () => {
+    const writer = createMemoryArchive();
+    const name = "a/rather/long/directory/name/for/a/tiny/entry";
+    for (let i = 0; i < 20_000; i++) {
+      writer.addFile(`${name}-${i}.txt`, new Uint8Array([i & 0xff]));
+    }
+    const archive = writer.finalizeToMemory();
+
+    const reader = openMemoryArchive(archive);
+    expect(reader.getFileCount()).toBe(20_000);
+    expect(reader.extractFile(19_999)).toEqual(new Uint8Array([19_999 & 0xff]));
+    reader.close();
+  });
+
   test("should finalize memory archive to Uint8Array", async () => {
     const { createMemoryArchive } = await import("./index.ts");
     const writer = createMemoryArchive();
@@ -1076,3 +1185,1590 @@ describe("Memory-based ZipArchiveReader", () => {
     reader.close();
   });
 });
+
+describe("Codec backends", () => {
+  test("should always include the miniz backend as default", () => {
+    expect(getCodecBackends()).toContain(CodecBackend.MINIZ);
+    expect(getCodecBackend()).toBe(CodecBackend.MINIZ);
+  });
+
+  test("should reject unavailable backends", () => {
+    const unavailable = getCodecBackends().includes(CodecBackend.LIBDEFLATE)
+      ? ("missing" as typeof CodecBackend.LIBDEFLATE)
+      : CodecBackend.LIBDEFLATE;
+
+    expect(() => setCodecBackend(unavailable)).toThrow();
+    expect(getCodecBackend()).toBe(CodecBackend.MINIZ);
+  });
+
+  test("should round-trip every level through each backend", () => {
+    for (const backend of getCodecBackends()) {
+      setCodecBackend(backend);
+
+      const writer = createMemoryArchive();
+      for (const level of Object.values(CompressionLevel)) {
+        expect(writer.addFile(`level-${level}.bin`, five_mb, level)).toBe(true);
+      }
+      const reader = openMemoryArchive(writer.finalizeToMemory());
+
+      for (let i = 0; i < reader.getFileCount(); i++) {
+        expect(reader.extractFile(i)).toEqual(five_mb);
+      }
+      reader.close();
+    }
+
+    setCodecBackend(CodecBackend.MINIZ);
+  });
+
+  test("should store entries that do not shrink", () => {
+    const noise = crypto.getRandomValues(new Uint8Array(64 * 1024));
+
+    const writer = createMemoryArchive();
+    writer.addFile("noise.bin", noise, CompressionLevel.BEST_COMPRESSION);
+    const reader = openMemoryArchive(writer.finalizeToMemory());
+
+    const fileInfo = reader.getFileByIndex(0);
+    expect(fileInfo.compressedSize).toBe(noise.length);
+    expect(reader.extractFile(0)).toEqual(noise);
+    reader.close();
+  });
+
+  test("should compress tiny entries the same after other entries", () => {
+    const config = new TextEncoder().encode(
+      JSON.stringify({ name: "service", port: 8080, hosts: ["a", "b", "a"] }),
+    );
+    const compressedSize = (writer: ZipArchiveWriter) => {
+      const reader = openMemoryArchive(writer.finalizeToMemory());
+      const last = reader.getFileCount() - 1;
+      const size = reader.getFileByIndex(last).compressedSize;
+      expect(reader.extractFile(last)).toEqual(config);
+      reader.close();
+      return size;
+    };
+
+    const fresh = createMemoryArchive();
+    fresh.addFile("config.json", config, CompressionLevel.DEFAULT);
+
+    // Tiny and large entries before it leave the tables in different states
+    const reused = createMemoryArchive();
+    for (let i = 0; i < 20; i++) {
+      reused.addFile(`${i}.json`, config.subarray(i), CompressionLevel.DEFAULT);
+    }
+    reused.addFile("large.bin", five_mb, CompressionLevel.DEFAULT);
+    reused.addFile("small.json", config.subarray(5), CompressionLevel.DEFAULT);
+    reused.addFile("config.json", config, CompressionLevel.DEFAULT);
+
+    expect(compressedSize(reused)).toBe(compressedSize(fresh));
+  });
+});
+
+describe("Auto-store", () => {
+  const noise = crypto.getRandomValues(new Uint8Array(256 * 1024));
+  const text = new TextEncoder().encode(testTextData.repeat(2000));
+
+  test("should store incompressible entries when enabled", () => {
+    const writer = createMemoryArchive({ autoStore: true });
+    writer.addFile("noise.bin", noise, CompressionLevel.BEST_COMPRESSION);
+    writer.addFile("text.txt", text, CompressionLevel.BEST_COMPRESSION);
+    const reader = openMemoryArchive(writer.finalizeToMemory());
+
+    expect(reader.getFileByIndex(0).compressedSize).toBe(noise.length);
+    expect(reader.getFileByIndex(1).compressedSize).toBeLessThan(
+      text.length / 10,
+    );
+    expect(reader.extractFile(0)).toEqual(noise);
+    expect(reader.extractFile(1)).toEqual(text);
+    reader.close();
+  });
+
+  test("should store entries matching extension rules", () => {
+    const writer = createMemoryArchive({
+      autoStore: { extensions: [".JPG"] },
+    });
+    writer.addFile("photo.jpg", text, CompressionLevel.BEST_COMPRESSION);
+    writer.addFile("notes.txt", text, CompressionLevel.BEST_COMPRESSION);
+    const reader = openMemoryArchive(writer.finalizeToMemory());
+
+    expect(reader.getFileByIndex(0).compressedSize).toBe(text.length);
+    expect(reader.getFileByIndex(1).compressedSize).toBeLessThan(text.length);
+    reader.close();
+  });
+
+  test("should reject out of range thresholds", () => {
+    expect(() =>
+      createMemoryArchive({ autoStore: { entropyThreshold: 9 } }),
+    ).toThrow();
+  });
+});
+
+describe("Adaptive compression", () => {
+  const chunk = new TextEncoder().encode(testJsonData.repeat(4000));
+
+  test("should report totals, ratio and speed", () => {
+    const writer = createMemoryArchive();
+    writer.addFile("a.json", chunk, CompressionLevel.DEFAULT);
+    writer.addFile("b.json", chunk, CompressionLevel.NO_COMPRESSION);
+
+    const report = writer.getCompressionReport();
+    expect(report.entries).toBe(2);
+    expect(report.bytesIn).toBe(chunk.length * 2);
+    expect(report.bytesOut).toBeLessThan(report.bytesIn);
+    expect(report.bytesOut).toBeGreaterThan(chunk.length);
+    expect(report.throughput).toBeGreaterThan(0);
+    expect(report.level).toBe(-1);
+
+    writer.finalizeToMemory();
+    expect(writer.getCompressionReport().entries).toBe(2);
+  });
+
+  test("should drop to the fastest level for an unreachable target", () => {
+    const writer = createMemoryArchive({
+      adaptive: { targetThroughput: 1e9 },
+    });
+    for (let i = 0; i < 4; i++) {
+      writer.addFile(`${i}.json`, chunk);
+    }
+
+    expect(writer.getCompressionReport().level).toBe(
+      CompressionLevel.BEST_SPEED,
+    );
+    writer.finalizeToMemory();
+  });
+
+  test("should climb to the level ceiling for a generous target", () => {
+    const writer = createMemoryArchive({
+      adaptive: { targetThroughput: 1e-6 },
+    });
+    for (let i = 0; i < 16; i++) {
+      writer.addFile(`${i}.json`, chunk, CompressionLevel.DEFAULT);
+    }
+
+    expect(writer.getCompressionReport().level).toBe(CompressionLevel.DEFAULT);
+
+    const reader = openMemoryArchive(writer.finalizeToMemory());
+    expect(reader.extractFile(15)).toEqual(chunk);
+    reader.close();
+  });
+
+  test("should pace against a deadline", () => {
+    const writer = createMemoryArchive({
+      adaptive: { deadline: Date.now() - 1, expectedBytes: chunk.length * 4 },
+    });
+    for (let i = 0; i < 4; i++) {
+      writer.addFile(`${i}.json`, chunk);
+    }
+
+    expect(writer.getCompressionReport().level).toBe(
+      CompressionLevel.BEST_SPEED,
+    );
+    writer.finalizeToMemory();
+  });
+
+  test("should reject incomplete adaptive options", () => {
+    expect(() =>
+      createMemoryArchive({ adaptive: { deadline: Date.now() } }),
+    ).toThrow();
+    expect(() =>
+      createMemoryArchive({ adaptive: { targetThroughput: 0 } }),
+    ).toThrow();
+  });
+});
+
+describe("Compression tuning options", () => {
+  const text = new TextEncoder().encode(testTextData.repeat(2000));
+
+  test("should round-trip every strategy and uber level", () => {
+    const writer = createMemoryArchive();
+    for (const strategy of Object.values(CompressionStrategy)) {
+      expect(
+        writer.addFile(`strategy-${strategy}.txt`, text, {
+          level: CompressionLevel.DEFAULT,
+          strategy,
+        }),
+      ).toBe(true);
+    }
+    expect(
+      writer.addFile("uber.txt", text, CompressionLevel.UBER_COMPRESSION),
+    ).toBe(true);
+    expect(
+      writer.addFile("tuned.txt", text, {
+        level: 9,
+        probes: 4095,
+        greedy: true,
+      }),
+    ).toBe(true);
+    const reader = openMemoryArchive(writer.finalizeToMemory());
+
+    for (let i = 0; i < reader.getFileCount(); i++) {
+      expect(reader.getFileByIndex(i).compressedSize).toBeLessThan(text.length);
+      expect(reader.extractFile(i)).toEqual(text);
+    }
+    reader.close();
+  });
+
+  test("should reject invalid tuning values natively", () => {
+    const writer = createMemoryArchive();
+    expect(writer.addFile("a.txt", text, { level: 11 })).toBe(false);
+    expect(
+      writer.addFile("b.txt", text, {
+        level: 6,
+        strategy: 5 as typeof CompressionStrategy.DEFAULT,
+      }),
+    ).toBe(false);
+    expect(writer.addFile("c.txt", text, { level: 6, probes: 4096 })).toBe(
+      false,
+    );
+    expect(writer.addFile("d.txt", text, { level: 6 })).toBe(true);
+    writer.finalizeToMemory();
+  });
+});
+
+describe("Optimal parse", () => {
+  const text = new TextEncoder().encode(testTextData.repeat(500));
+  const json = new TextEncoder().encode(testJsonData.repeat(300));
+
+  test("should be no larger than level 9", () => {
+    const writer = createMemoryArchive();
+    writer.addFile("best.txt", text, CompressionLevel.BEST_COMPRESSION);
+    writer.addFile("max.txt", text, CompressionLevel.MAX_COMPRESSION);
+    const reader = openMemoryArchive(writer.finalizeToMemory());
+
+    expect(reader.getFileByIndex(1).compressedSize).toBeLessThanOrEqual(
+      reader.getFileByIndex(0).compressedSize,
+    );
+    expect(reader.extractFile(1)).toEqual(text);
+    reader.close();
+  });
+
+  test("should add batches on several threads", () => {
+    const entries = [
+      { filename: "a.txt", data: text },
+      { filename: "b.json", data: json },
+      { filename: "tiny.txt", data: new Uint8Array([1, 2, 3]) },
+      { filename: "c.txt", data: text.subarray(0, 1000) },
+    ];
+    const writer = createMemoryArchive();
+    expect(
+      writer.addFiles(entries, {
+        level: CompressionLevel.MAX_COMPRESSION,
+        threads: 2,
+      }),
+    ).toBe(true);
+    expect(writer.getCompressionReport().entries).toBe(entries.length);
+    const reader = openMemoryArchive(writer.finalizeToMemory());
+
+    for (const [i, entry] of entries.entries()) {
+      expect(reader.getFileByIndex(i).filename).toBe(entry.filename);
+      expect(reader.extractFile(i)).toEqual(entry.data);
+    }
+    reader.close();
+  });
+
+  test("should reject invalid thread counts", () => {
+    const writer = createMemoryArchive();
+    expect(() =>
+      writer.addFiles([{ filename: "a.txt", data: text }], {
+        level: CompressionLevel.MAX_COMPRESSION,
+        threads: 0,
+      }),
+    ).toThrow();
+    writer.finalizeToMemory();
+  });
+});
+
+describe("Deflate64", () => {
+  // Builds a one-entry archive around a raw Deflate64 stream
+  function deflate64Archive(
+    filename: string,
+    stream: Uint8Array,
+    data: Uint8Array,
+  ): Uint8Array {
+    const name = new TextEncoder().encode(filename);
+    const crc = Bun.hash.crc32(data);
+    const local = 30 + name.length + stream.length;
+    const central = 46 + name.length;
+    const archive = new Uint8Array(local + central + 22);
+    const view = new DataView(archive.buffer);
+
+    view.setUint32(0, 0x04034b50, true);
+    view.setUint16(4, 21, true);
+    view.setUint16(8, 9, true);
+    view.setUint32(14, crc, true);
+    view.setUint32(18, stream.length, true);
+    view.setUint32(22, data.length, true);
+    view.setUint16(26, name.length, true);
+    archive.set(name, 30);
+    archive.set(stream, 30 + name.length);
+
+    view.setUint32(local, 0x02014b50, true);
+    view.setUint16(local + 4, 21, true);
+    view.setUint16(local + 6, 21, true);
+    view.setUint16(local + 10, 9, true);
+    view.setUint32(local + 16, crc, true);
+    view.setUint32(local + 20, stream.length, true);
+    view.setUint32(local + 24, data.length, true);
+    view.setUint16(local + 28, name.length, true);
+    archive.set(name, local + 46);
+
+    const end = local + central;
+    view.setUint32(end, 0x06054b50, true);
+    view.setUint16(end + 8, 1, true);
+    view.setUint16(end + 10, 1, true);
+    view.setUint32(end + 12, central, true);
+    view.setUint32(end + 16, local, true);
+    return archive;
+  }
+
+  // Fixed Huffman block: "ab", a 40000 byte match (length code 285 with 16
+  // extra bits), "c", then 10 bytes copied from 40003 back (distance code 31)
+  const stream = new Uint8Array([
+    75, 76, 26, 237, 225, 132, 201, 136, 39, 196, 1, 0,
+  ]);
+  const expected = new TextEncoder().encode(`${"ab".repeat(20001)}cababababab`);
+
+  test("should extract lengths and distances beyond deflate's", () => {
+    const reader = openMemoryArchive(
+      deflate64Archive("enhanced.txt", stream, expected),
+    );
+
+    expect(reader.extractFile(0)).toEqual(expected);
+    expect(reader.extractFileByName("enhanced.txt")).toEqual(expected);
+    reader.close();
+  });
+
+  test("should extract Deflate64 entries written with deflate codes", () => {
+    // A deflate stream without 258 byte matches decodes the same as Deflate64,
+    // so shuffle words instead of repeating whole sentences
+    const words = testTextData.split(" ");
+    let seed = 1;
+    const shuffled = Array.from({ length: 5000 }, () => {
+      seed = (seed * 1103515245 + 12345) % 2 ** 31;
+      return words[seed % words.length];
+    });
+    const text = new TextEncoder().encode(shuffled.join(" "));
+    const writer = createMemoryArchive();
+    writer.addFile("text.txt", text, CompressionLevel.BEST_SPEED);
+    const deflated = writer.finalizeToMemory();
+    const view = new DataView(deflated.buffer);
+    const directory = view.getUint32(deflated.length - 22 + 16, true);
+    view.setUint16(8, 9, true);
+    view.setUint16(directory + 10, 9, true);
+
+    const reader = openMemoryArchive(deflated);
+    expect(reader.extractFile(0)).toEqual(text);
+    reader.close();
+  });
+
+  test("should extract a stored block whose header empties the bit buffer", () => {
+    // Dynamic block of 42 "a"s ending in a 12-bit end-of-block code, which
+    // leaves exactly the 3 bits of the stored block's header buffered
+    const storedStream = new Uint8Array([
+      4, 224, 73, 146, 36, 73, 146, 4, 65, 188, 21, 137, 69, 205, 35, 171, 231,
+      255, 231, 65, 0, 0, 0, 0, 0, 254, 63, 7, 0, 248, 255, 115, 116, 111, 114,
+      101, 100, 33,
+    ]);
+    const storedExpected = new TextEncoder().encode(`${"a".repeat(42)}stored!`);
+    const reader = openMemoryArchive(
+      deflate64Archive("stored.txt", storedStream, storedExpected),
+    );
+
+    expect(reader.extractFile(0)).toEqual(storedExpected);
+    reader.close();
+  });
+
+  test("should reject corrupt streams", () => {
+    const corrupt = stream.slice();
+    corrupt[5] ^= 0x40;
+    const reader = openMemoryArchive(
+      deflate64Archive("corrupt.txt", corrupt, expected),
+    );
+
+    expect(() => reader.extractFile(0)).toThrow();
+    reader.close();
+  });
+});
+
+describe("WinZip AES encryption", () => {
+  const password = "correct horse";
+  const text = new TextEncoder().encode(testTextData.repeat(100));
+
+  // hello.txt written with a fixed salt: AE-2, AES-256, stored
+  const reference = Buffer.from(
+    "UEsDBDMAAQBjAAAAAAAAAAAALgAAABIAAAAJAAsAaGVsbG8udHh0AZkHAAIAQUUDAAAAAQIDBAUGBwgJCgsMDQ4PLRXdhS7s+3CYmB39GvFXyPTKbd7p4k0PlQ0K4h9HUEsBAjMAMwABAGMAAAAAAAAAAAAuAAAAEgAAAAkACwAAAAAAAAAAAAAAAAAAAGhlbGxvLnR4dAGZBwACAEFFAwAAUEsFBgAAAAABAAEAQgAAAGAAAAAAAA==",
+    "base64",
+  );
+
+  test("should round-trip every key strength", () => {
+    for (const strength of Object.values(EncryptionStrength)) {
+      const writer = createMemoryArchive({
+        encryption: { password, strength },
+      });
+      writer.addFile("text.txt", text);
+      writer.addFile(
+        "binary.bin",
+        testBinaryData,
+        CompressionLevel.NO_COMPRESSION,
+      );
+      const zipData = writer.finalizeToMemory();
+
+      const reader = openMemoryArchive(zipData, { password });
+      expect(reader.getFileByIndex(0).encrypted).toBe(true);
+      expect(reader.extractFileByName("text.txt")).toEqual(text);
+      expect(reader.extractFileByName("binary.bin")).toEqual(testBinaryData);
+      reader.close();
+    }
+  });
+
+  test("should round-trip AE-1 entries", () => {
+    const writer = createMemoryArchive({
+      encryption: { password, version: EncryptionVersion.AE_1 },
+    });
+    writer.addFile("text.txt", text);
+    const zipData = writer.finalizeToMemory();
+
+    const reader = openMemoryArchive(zipData);
+    reader.setPassword(password);
+    expect(reader.extractFile(0)).toEqual(text);
+    reader.close();
+  });
+
+  test("should read entries written by other tools", () => {
+    const reader = openMemoryArchive(reference, { password });
+    expect(new TextDecoder().decode(reader.extractFile(0))).toBe(
+      "Hello, WinZip AES!",
+    );
+    reader.close();
+  });
+
+  test("should reject a wrong or missing password", () => {
+    const reader = openMemoryArchive(reference);
+    expect(() => reader.extractFile(0)).toThrow();
+
+    reader.setPassword("wrong horse");
+    expect(() => reader.extractFile(0)).toThrow();
+
+    reader.setPassword(password);
+    expect(reader.extractFile(0).length).toBe(18);
+    reader.close();
+  });
+
+  test("should reject invalid encryption options", () => {
+    expect(() =>
+      createMemoryArchive({ encryption: { password: "" } }),
+    ).toThrow();
+    expect(() =>
+      createMemoryArchive({
+        // @ts-expect-error - testing invalid strength
+        encryption: { password, strength: 512 },
+      }),
+    ).toThrow();
+    expect(() =>
+      createMemoryArchive({
+        // @ts-expect-error - testing invalid version
+        encryption: { password, version: 3 },
+      }),
+    ).toThrow();
+  });
+});
+
+describe("Archive validation", () => {
+  const testZipFile = "test_validate.zip";
+
+  afterAll(async () => {
+    // Clean up test files
+    if (await Bun.file(testZipFile).exists()) {
+      await Bun.file(testZipFile).delete();
+    }
+  });
+
+  function buildArchive(): Uint8Array {
+    const writer = createMemoryArchive();
+    for (let i = 0; i < 20; i++) {
+      writer.addFile(
+        `file${i}.txt`,
+        new TextEncoder().encode(testTextData.repeat(i + 1)),
+      );
+    }
+    writer.addFile("empty.txt", new Uint8Array(0));
+    return writer.finalizeToMemory();
+  }
+
+  // Offset of an entry's local header, from its central directory record
+  function localHeaderOffset(archive: Uint8Array, index: number): number {
+    const view = new DataView(archive.buffer, archive.byteOffset);
+    let offset = view.getUint32(archive.length - 22 + 16, true);
+    for (let i = 0; i < index; i++) {
+      offset +=
+        46 +
+        view.getUint16(offset + 28, true) +
+        view.getUint16(offset + 30, true) +
+        view.getUint16(offset + 32, true);
+    }
+    return view.getUint32(offset + 42, true);
+  }
+
+  test("should accept an intact archive", () => {
+    const reader = openMemoryArchive(buildArchive());
+    for (const threads of [1, 4]) {
+      expect(reader.validate({ threads })).toEqual({
+        valid: true,
+        entriesChecked: 21,
+        failures: [],
+      });
+    }
+    expect(reader.validate({ headersOnly: true }).valid).toBe(true);
+    reader.close();
+  });
+
+  test("should report corrupted data and headers", () => {
+    const archive = buildArchive();
+    const data = localHeaderOffset(archive, 3);
+    archive[data + 30 + "file3.txt".length + 5] ^= 0xff;
+    archive[localHeaderOffset(archive, 7) + 31] ^= 0x01;
+
+    const reader = openMemoryArchive(archive);
+    const result = reader.validate({ threads: 4 });
+    expect(result.valid).toBe(false);
+    expect(result.failures).toEqual([
+      { index: 3, filename: "file3.txt", reason: "data" },
+      { index: 7, filename: "file7.txt", reason: "header" },
+    ]);
+
+    // Header checks alone do not read the data
+    expect(reader.validate({ headersOnly: true }).failures).toEqual([
+      { index: 7, filename: "file7.txt", reason: "header" },
+    ]);
+
+    const first = reader.validate({ threads: 1, maxFailures: 1 });
+    expect(first.failures).toEqual([
+      { index: 3, filename: "file3.txt", reason: "data" },
+    ]);
+    expect(first.entriesChecked).toBe(4);
+    reader.close();
+  });
+
+  test("should validate file-based archives", async () => {
+    await Bun.write(testZipFile, buildArchive());
+
+    expect(validateArchive(testZipFile, { threads: 4 }).valid).toBe(true);
+  });
+
+  test("should need the password for encrypted entries", () => {
+    const writer = createMemoryArchive({ encryption: { password: "secret" } });
+    writer.addFile("secret.txt", new TextEncoder().encode(testTextData));
+    const archive = writer.finalizeToMemory();
+
+    const reader = openMemoryArchive(archive);
+    expect(reader.validate().failures[0]?.reason).toBe("password");
+    expect(reader.validate({ headersOnly: true }).valid).toBe(true);
+
+    reader.setPassword("secret");
+    expect(reader.validate().valid).toBe(true);
+    reader.close();
+  });
+
+  test("should reject invalid options", () => {
+    const reader = openMemoryArchive(buildArchive());
+    expect(() => reader.validate({ threads: 0 })).toThrow();
+    expect(() => reader.validate({ maxFailures: 0 })).toThrow();
+    reader.close();
+  });
+});
+
+describe("CRC modes", () => {
+  const text = new TextEncoder().encode(testTextData.repeat(50));
+
+  // Two entries, the CRC of "bad.txt" in the central directory flipped
+  function buildArchive(): Uint8Array {
+    const writer = createMemoryArchive();
+    writer.addFile("good.txt", text);
+    writer.addFile("bad.txt", text);
+    const archive = writer.finalizeToMemory();
+
+    const view = new DataView(archive.buffer, archive.byteOffset);
+    let offset = view.getUint32(archive.length - 22 + 16, true);
+    offset += 46 + view.getUint16(offset + 28, true);
+    view.setUint32(offset + 16, view.getUint32(offset + 16, true) ^ 1, true);
+    return archive;
+  }
+
+  test("should verify CRCs by default", () => {
+    const reader = openMemoryArchive(buildArchive());
+    expect(reader.extractFileByName("good.txt")).toEqual(text);
+    expect(() => reader.extractFileByName("bad.txt")).toThrow();
+    reader.close();
+  });
+
+  test("should skip CRCs per reader or per call", () => {
+    const reader = openMemoryArchive(buildArchive(), { crc: "skip" });
+    expect(reader.extractFile(1)).toEqual(text);
+    expect(() => reader.extractFile(1, { crc: "verify" })).toThrow();
+    reader.close();
+
+    const verifying = openMemoryArchive(buildArchive());
+    expect(verifying.readFileByName("bad.txt", { crc: "skip" })).toEqual(text);
+    verifying.close();
+  });
+
+  test("should report deferred CRC failures", () => {
+    const reader = openMemoryArchive(buildArchive(), { crc: "deferred" });
+    expect(reader.extractFile(0)).toEqual(text);
+    reader.verifyDeferred();
+
+    expect(reader.extractFile(1)).toEqual(text);
+    expect(() => reader.verifyDeferred()).toThrow("bad.txt");
+
+    // Failures are reported once
+    reader.verifyDeferred();
+    reader.close();
+  });
+
+  test("should report deferred CRC failures on close", () => {
+    const reader = openMemoryArchive(buildArchive());
+    reader.extractFileByName("bad.txt", { crc: "deferred" });
+    expect(() => reader.close()).toThrow("bad.txt");
+    expect(() => reader.close()).toThrow("already been closed");
+  });
+
+  test("should reject invalid CRC modes", () => {
+    // @ts-expect-error - testing invalid mode
+    expect(() => openMemoryArchive(buildArchive(), { crc: "later" })).toThrow();
+
+    const reader = openMemoryArchive(buildArchive());
+    // @ts-expect-error - testing invalid mode
+    expect(() => reader.extractFile(0, { crc: "later" })).toThrow();
+    reader.close();
+  });
+});
+
+describe("Stats", () => {
+  const text = new TextEncoder().encode(testTextData.repeat(50));
+
+  function buildArchive(): Uint8Array {
+    const writer = createMemoryArchive();
+    writer.addFile("a.txt", text, CompressionLevel.DEFAULT);
+    return writer.finalizeToMemory();
+  }
+
+  afterAll(() => {
+    setStatsTiming(false);
+  });
+
+  test("should count writer bytes and entries", () => {
+    const writer = createMemoryArchive();
+    writer.addFile("a.txt", text, CompressionLevel.DEFAULT);
+    writer.addFile("b.txt", text, CompressionLevel.NO_COMPRESSION);
+
+    const stats = writer.getStats();
+    expect(stats.entries).toBe(2);
+    expect(stats.uncompressedBytes).toBe(text.length * 2);
+    expect(stats.compressedBytes).toBe(writer.getCompressionReport().bytesOut);
+    expect(stats.bytesWritten).toBeGreaterThan(stats.compressedBytes);
+    expect(stats.ioCalls).toBeGreaterThan(0);
+    expect(stats.deflateSeconds).toBeGreaterThan(0);
+
+    writer.finalizeToMemory();
+    expect(writer.getStats().entries).toBe(2);
+  });
+
+  test("should count reader work and keep it after close", () => {
+    setStatsTiming(true);
+    const reader = openMemoryArchive(buildArchive());
+    reader.extractFile(0);
+    reader.extractFile(0, { crc: "skip" });
+
+    const stats = reader.getStats();
+    expect(stats.entries).toBe(2);
+    expect(stats.uncompressedBytes).toBe(text.length * 2);
+    expect(stats.bytesRead).toBeGreaterThan(0);
+    expect(stats.bytesWritten).toBe(0);
+    expect(stats.inflateSeconds).toBeGreaterThan(0);
+    expect(stats.crcSeconds).toBeGreaterThan(0);
+
+    // Validation threads add their own work
+    reader.validate({ threads: 2 });
+    expect(reader.getStats().entries).toBe(3);
+
+    reader.close();
+    expect(reader.getStats().entries).toBe(3);
+  });
+
+  test("should leave timers at zero unless enabled", () => {
+    setStatsTiming(false);
+    const reader = openMemoryArchive(buildArchive());
+    reader.extractFile(0);
+
+    const stats = reader.getStats();
+    expect(stats.entries).toBe(1);
+    expect(stats.inflateSeconds).toBe(0);
+    expect(stats.crcSeconds).toBe(0);
+    expect(stats.ioSeconds).toBe(0);
+    reader.close();
+  });
+
+  test("should include released handles in the global stats", () => {
+    const before = getGlobalStats();
+
+    const reader = openMemoryArchive(buildArchive());
+    reader.extractFile(0);
+    reader.close();
+
+    const after = getGlobalStats();
+    expect(after.entries - before.entries).toBe(2);
+    expect(after.uncompressedBytes - before.uncompressedBytes).toBe(
+      text.length * 2,
+    );
+  });
+});
+
+describe("Metrics", () => {
+  // Value of the first sample whose line starts with the prefix
+  function sample(text: string, prefix: string): number {
+    const line = text.split("\n").find((line) => line.startsWith(prefix));
+    return Number(line?.slice(line.lastIndexOf(" ") + 1));
+  }
+
+  const count = (text: string, operation: string) =>
+    sample(
+      text,
+      `zip_bun_operation_duration_seconds_count{operation="${operation}"}`,
+    );
+
+  test("should export latency histograms in Prometheus format", () => {
+    const before = metrics();
+
+    const writer = createMemoryArchive();
+    writer.addFile("a.txt", new TextEncoder().encode(testTextData));
+    const reader = openMemoryArchive(writer.finalizeToMemory());
+    reader.extractFileByName("a.txt");
+
+    const text = metrics();
+    expect(count(text, "add") - count(before, "add")).toBe(1);
+    expect(count(text, "finalize") - count(before, "finalize")).toBe(1);
+    expect(count(text, "extract") - count(before, "extract")).toBe(1);
+    expect(count(text, "locate") - count(before, "locate")).toBe(1);
+    expect(text).toContain(
+      "# TYPE zip_bun_operation_duration_seconds histogram",
+    );
+    expect(
+      sample(text, 'zip_bun_open_handles{kind="reader"}'),
+    ).toBeGreaterThanOrEqual(1);
+    expect(sample(text, "zip_bun_native_memory_bytes ")).toBeGreaterThan(0);
+    reader.close();
+  });
+
+  test("should count adds written on shard threads", async () => {
+    const before = metrics();
+
+    const writer = new ShardedZipWriter("test_metrics_sharded", { shards: 2 });
+    for (let i = 0; i < 5; i++) {
+      writer.addFile(`${i}.txt`, new TextEncoder().encode(testTextData));
+    }
+    writer.finalize();
+
+    const text = metrics();
+    expect(count(text, "add") - count(before, "add")).toBe(5);
+    expect(count(text, "finalize") - count(before, "finalize")).toBe(2);
+
+    for (const file of [
+      "test_metrics_sharded-0.zip",
+      "test_metrics_sharded-1.zip",
+      "test_metrics_sharded.json",
+    ]) {
+      await Bun.file(file).delete();
+    }
+  });
+
+  test("should keep histogram buckets cumulative", () => {
+    const prefix =
+      'zip_bun_operation_duration_seconds_bucket{operation="extract",';
+    const buckets = metrics()
+      .split("\n")
+      .filter((line) => line.startsWith(prefix))
+      .map((line) => Number(line.slice(line.lastIndexOf(" ") + 1)));
+
+    // One bucket per power of two from 2^10 to 2^36 ns, then +Inf
+    expect(buckets.length).toBe(28);
+    for (let i = 1; i < buckets.length; i++) {
+      expect(buckets[i]).toBeGreaterThanOrEqual(buckets[i - 1] as number);
+    }
+    expect(buckets[buckets.length - 1]).toBe(count(metrics(), "extract"));
+  });
+});
+
+describe("Tracing", () => {
+  test("should report spans to the trace callback", () => {
+    const spans: TraceSpan[] = [];
+    const data = new TextEncoder().encode(testTextData.repeat(10));
+    setTraceCallback((span) => spans.push(span));
+
+    try {
+      const writer = createMemoryArchive();
+      writer.addFile("a.txt", data, CompressionLevel.DEFAULT);
+      const archive = writer.finalizeToMemory();
+      const reader = openMemoryArchive(archive);
+      expect(reader.findFile("a.txt")).toBe(0);
+      reader.extractFile(0);
+      reader.extractFileByName("a.txt");
+      reader.close();
+
+      expect(spans.map((span) => span.operation)).toEqual([
+        "add",
+        "finalize",
+        "locate",
+        "extract",
+        "extract",
+      ]);
+      const [add, finalize, locate, extract, extractByName] = spans;
+      expect(add).toMatchObject({ name: "a.txt", bytesIn: data.length });
+      expect(add?.bytesOut).toBeLessThan(data.length);
+      expect(finalize?.bytesOut).toBe(archive.length);
+      expect(locate).toMatchObject({ name: "a.txt", index: 0 });
+      for (const span of [extract, extractByName]) {
+        expect(span).toMatchObject({
+          name: "a.txt",
+          index: 0,
+          bytesIn: add?.bytesOut,
+          bytesOut: data.length,
+        });
+      }
+      for (const span of spans) {
+        expect(span.duration).toBeGreaterThanOrEqual(0);
+        expect(span.startTime).toBeGreaterThan(Date.now() - 60_000);
+        expect(span.error).toBeUndefined();
+      }
+    } finally {
+      setTraceCallback();
+    }
+
+    const writer = createMemoryArchive();
+    writer.addFile("b.txt", data);
+    writer.finalizeToMemory();
+    expect(spans.length).toBe(5);
+  });
+
+  test("should report failed operations with their error", () => {
+    const spans: TraceSpan[] = [];
+    const writer = createMemoryArchive();
+    writer.addFile("a.txt", new TextEncoder().encode(testTextData));
+    const reader = openMemoryArchive(writer.finalizeToMemory());
+
+    setTraceCallback((span) => spans.push(span));
+    try {
+      expect(() => reader.extractFileByName("missing.txt")).toThrow(
+        "missing.txt",
+      );
+    } finally {
+      setTraceCallback();
+      reader.close();
+    }
+
+    expect(spans.length).toBe(1);
+    expect(spans[0]).toMatchObject({
+      operation: "extract",
+      name: "missing.txt",
+    });
+    expect(spans[0]?.error).toBeInstanceOf(Error);
+  });
+
+  test("should reject a missing probe library", () => {
+    expect(() => loadProbes("/nonexistent/libzip_bun_probes.so")).toThrow(
+      "Failed to load trace probes",
+    );
+  });
+});
+
+describe("Native memory", () => {
+  const megabyte = new Uint8Array(1024 * 1024).fill(7);
+
+  test("should report the native memory of open archives", () => {
+    const before = nativeMemoryUsage();
+    const writer = createMemoryArchive();
+    writer.addFile("a.bin", megabyte, CompressionLevel.NO_COMPRESSION);
+    expect(nativeMemoryUsage()).toBeGreaterThan(before + megabyte.length);
+
+    const archive = writer.finalizeToMemory();
+    expect(nativeMemoryUsage()).toBe(before);
+
+    const reader = openMemoryArchive(archive);
+    expect(nativeMemoryUsage()).toBeGreaterThan(before);
+    reader.close();
+    expect(nativeMemoryUsage()).toBe(before);
+  });
+
+  test("should release archives at the end of a using block", () => {
+    const before = nativeMemoryUsage();
+    let archive: Uint8Array;
+    {
+      using writer = createMemoryArchive();
+      writer.addFile("a.bin", megabyte);
+      archive = writer.finalizeToMemory();
+    }
+    let reader: ZipArchiveReader;
+    {
+      using scoped = openMemoryArchive(archive);
+      reader = scoped;
+      expect(reader.extractFile(0)).toEqual(megabyte);
+    }
+    expect(() => reader.close()).toThrow("already been closed");
+
+    {
+      using abandoned = createMemoryArchive();
+      abandoned.addFile("a.bin", megabyte);
+    }
+    expect(nativeMemoryUsage()).toBe(before);
+  });
+
+  test("should release archives that were never closed", async () => {
+    const before = nativeMemoryUsage();
+    const drop = () => {
+      for (let i = 0; i < 8; i++) {
+        createMemoryArchive().addFile("a.bin", megabyte);
+      }
+    };
+    drop();
+    const dropped = nativeMemoryUsage();
+    expect(dropped).toBeGreaterThan(before + 8 * megabyte.length);
+
+    for (let i = 0; i < 50 && nativeMemoryUsage() >= dropped; i++) {
+      Bun.gc(true);
+      await Bun.sleep(10);
+    }
+    expect(nativeMemoryUsage()).toBeLessThan(dropped);
+  });
+
+  test("should keep memory archive data alive while the reader is open", () => {
+    const writer = createMemoryArchive();
+    writer.addFile("a.txt", new TextEncoder().encode(testTextData));
+    const reader = openMemoryArchive(writer.finalizeToMemory().slice().buffer);
+
+    Bun.gc(true);
+    expect(new TextDecoder().decode(reader.extractFile(0))).toBe(testTextData);
+    reader.close();
+  });
+});
+
+describe("Lazy loading", () => {
+  test("should not load the native library on import", () => {
+    // Loading fails with a missing probe library, which only shows once the
+    // library is actually loaded
+    const index = JSON.stringify(`${import.meta.dir}/index.ts`);
+    const script = `
+      const zip = await import(${index});
+      console.log("imported");
+      zip.warmup();
+    `;
+    const child = Bun.spawnSync([process.execPath, "-e", script], {
+      env: { ...process.env, ZIP_BUN_PROBES: "/nonexistent/probes.so" },
+      stdout: "pipe",
+      stderr: "pipe",
+    });
+
+    expect(child.stdout.toString()).toContain("imported");
+    expect(child.stderr.toString()).toContain("Failed to load trace probes");
+    expect(child.success).toBe(false);
+  });
+
+  test("should warm up once", () => {
+    warmup();
+    warmup();
+    expect(getCodecBackends()).toContain(CodecBackend.MINIZ);
+  });
+});
+
+describe("Name encoding", () => {
+  const names = [
+    "a.txt",
+    "dossier/résumé.txt",
+    "日本語/ファイル.txt",
+    "x".repeat(200),
+  ];
+
+  test("should look up entries by name with reused buffers", () => {
+    const writer = createMemoryArchive();
+    for (const name of names) {
+      expect(writer.addFile(name, new TextEncoder().encode(name))).toBe(true);
+    }
+    const reader = openMemoryArchive(writer.finalizeToMemory());
+
+    // Long names first, so shorter ones must be terminated in the grown buffer
+    for (const name of names.slice().reverse()) {
+      const index = reader.findFile(name);
+      expect(reader.getFileByIndex(index).filename).toBe(name);
+      expect(new TextDecoder().decode(reader.extractFileByName(name))).toBe(
+        name,
+      );
+    }
+    expect(reader.findFile("a.tx")).toBe(-1);
+    expect(reader.findFile("a.txt/")).toBe(-1);
+    reader.close();
+  });
+
+  test("should encode the names of a parallel batch", () => {
+    const writer = createMemoryArchive();
+    const entries = names.map((filename) => ({
+      filename,
+      data: new TextEncoder().encode(filename),
+    }));
+    expect(writer.addFiles(entries, CompressionLevel.MAX_COMPRESSION)).toBe(
+      true,
+    );
+    const reader = openMemoryArchive(writer.finalizeToMemory());
+
+    expect(reader.files().map((file) => file.filename)).toEqual(names);
+    reader.close();
+  });
+});
+
+describe("Extraction limits", () => {
+  let archive: Uint8Array;
+
+  beforeAll(() => {
+    const writer = createMemoryArchive();
+    writer.addFile("small.txt", generateTextData(1000));
+    writer.addFile("large.txt", generateTextData(100_000));
+    writer.addFile("bomb", new Uint8Array(8 * 1024 * 1024), 9);
+    archive = writer.finalizeToMemory();
+  });
+
+  function limitOf(fn: () => unknown): string | undefined {
+    try {
+      fn();
+    } catch (error) {
+      if (error instanceof ZipLimitError) {
+        return error.limit;
+      }
+      throw error;
+    }
+    return undefined;
+  }
+
+  test("should reject entries over the size limit", () => {
+    const reader = openMemoryArchive(archive, {
+      limits: { maxEntrySize: 10_000 },
+    });
+    expect(reader.extractFile(0).length).toBe(1000);
+    expect(limitOf(() => reader.extractFileByName("large.txt"))).toBe(
+      "entrySize",
+    );
+    expect(() => reader.extractFile(1)).toThrow(
+      "Entry exceeds the size limit at index 1",
+    );
+    // The reader stays usable
+    expect(reader.extractFile(0).length).toBe(1000);
+    reader.close();
+  });
+
+  test("should count the total extracted", () => {
+    const reader = openMemoryArchive(archive, {
+      limits: { maxTotalSize: 150_000 },
+    });
+    reader.extractFile(1);
+    expect(limitOf(() => reader.extractFile(1))).toBe("totalSize");
+    reader.extractFile(0);
+
+    reader.setLimits({ maxTotalSize: 150_000 });
+    reader.extractFile(1);
+    reader.close();
+  });
+
+  test("should reject compression bombs", () => {
+    const reader = openMemoryArchive(archive, { limits: { maxRatio: 100 } });
+    expect(limitOf(() => reader.extractFileByName("bomb"))).toBe("ratio");
+    expect(reader.extractFileByName("large.txt").length).toBe(100_000);
+
+    reader.setLimits({});
+    expect(reader.extractFileByName("bomb").length).toBe(8 * 1024 * 1024);
+    reader.close();
+  });
+
+  test("should enforce deadlines", () => {
+    const reader = openMemoryArchive(archive, {
+      limits: { deadline: Date.now() + 60_000 },
+    });
+    expect(reader.extractFileByName("bomb").length).toBe(8 * 1024 * 1024);
+
+    reader.setLimits({ deadline: new Date(Date.now() - 1) });
+    expect(limitOf(() => reader.extractFile(0))).toBe("deadline");
+    reader.close();
+  });
+
+  test("should reject invalid limits", () => {
+    const reader = openMemoryArchive(archive);
+    expect(() => reader.setLimits({ maxEntrySize: -1 })).toThrow(
+      "Invalid maxEntrySize limit",
+    );
+    expect(() => reader.setLimits({ deadline: Number.NaN })).toThrow(
+      "Invalid deadline",
+    );
+    reader.close();
+  });
+});
+
+describe("Progress and cancellation", () => {
+  test("should report progress within large entries", () => {
+    const writer = createMemoryArchive();
+    const events: Progress[] = [];
+    writer.addFile("large.bin", five_mb, {
+      level: CompressionLevel.DEFAULT,
+      onProgress: (progress) => events.push(progress),
+    });
+    expect(events.length).toBeGreaterThan(2);
+    expect(events.at(-1)).toEqual({ bytes: five_mb.length, entries: 1 });
+
+    const reader = openMemoryArchive(writer.finalizeToMemory());
+    events.length = 0;
+    reader.extractFile(0, { onProgress: (progress) => events.push(progress) });
+    expect(events.length).toBeGreaterThan(2);
+    expect(events.at(-1)).toEqual({ bytes: five_mb.length, entries: 1 });
+    reader.close();
+  });
+
+  test("should add up the progress of several entries", () => {
+    const writer = createMemoryArchive();
+    const events: Progress[] = [];
+    writer.addFiles(
+      [
+        { filename: "a.txt", data: generateTextData(1000) },
+        { filename: "b.txt", data: generateTextData(2000) },
+      ],
+      { onProgress: (progress) => events.push(progress) },
+    );
+    expect(events).toEqual([
+      { bytes: 1000, entries: 1 },
+      { bytes: 3000, entries: 2 },
+    ]);
+    writer.finalizeToMemory();
+  });
+
+  test("should stop when aborted from the progress callback", () => {
+    const writer = createMemoryArchive();
+    const controller = new AbortController();
+    const onProgress = ({ bytes }: Progress) => {
+      if (bytes >= 2 * 1024 * 1024) {
+        controller.abort(new Error("stop"));
+      }
+    };
+
+    expect(() =>
+      writer.addFile("large.bin", five_mb, {
+        level: CompressionLevel.DEFAULT,
+        signal: controller.signal,
+        onProgress,
+      }),
+    ).toThrow("stop");
+    expect(() =>
+      writer.addFile("small.txt", generateTextData(10), {
+        signal: controller.signal,
+      }),
+    ).toThrow("stop");
+
+    // The archive is usable without the cancelled entry
+    writer.addFile("large.bin", five_mb, CompressionLevel.DEFAULT);
+    const reader = openMemoryArchive(writer.finalizeToMemory());
+    expect(reader.getFileCount()).toBe(1);
+
+    const aborted = new AbortController();
+    expect(() =>
+      reader.extractFile(0, {
+        signal: aborted.signal,
+        onProgress: () => aborted.abort(new Error("stop reading")),
+      }),
+    ).toThrow("stop reading");
+    expect(reader.extractFile(0)).toEqual(five_mb);
+    reader.close();
+  });
+
+  test("should keep an entry whose last progress call aborts", () => {
+    const writer = createMemoryArchive();
+    const controller = new AbortController();
+
+    expect(
+      writer.addFile("a.txt", generateTextData(1000), {
+        signal: controller.signal,
+        onProgress: ({ entries }) => {
+          if (entries > 0) {
+            controller.abort(new Error("stop"));
+          }
+        },
+      }),
+    ).toBe(true);
+    expect(() =>
+      writer.addFile("b.txt", generateTextData(10), {
+        signal: controller.signal,
+      }),
+    ).toThrow("stop");
+
+    const reader = openMemoryArchive(writer.finalizeToMemory());
+    expect(reader.files().map((file) => file.filename)).toEqual(["a.txt"]);
+    reader.close();
+  });
+
+  test("should report how many entries were added before cancelling", () => {
+    const entries = ["a.txt", "b.txt", "c.txt"].map((filename) => ({
+      filename,
+      data: generateTextData(1000),
+    }));
+
+    for (const level of [
+      CompressionLevel.DEFAULT,
+      CompressionLevel.MAX_COMPRESSION,
+    ]) {
+      const writer = createMemoryArchive();
+      const controller = new AbortController();
+      let error: unknown;
+      try {
+        writer.addFiles(entries, {
+          level,
+          signal: controller.signal,
+          onProgress: ({ entries }) => {
+            if (entries > 0) {
+              controller.abort(new Error("stop"));
+            }
+          },
+        });
+      } catch (caught) {
+        error = caught;
+      }
+      expect(error).toBeInstanceOf(ZipCancelledError);
+      expect((error as ZipCancelledError).added).toBe(1);
+      expect(((error as ZipCancelledError).cause as Error).message).toBe(
+        "stop",
+      );
+
+      const reader = openMemoryArchive(writer.finalizeToMemory());
+      expect(reader.getFileCount()).toBe(1);
+      reader.close();
+    }
+  });
+
+  test("should abort directory helpers between entries", async () => {
+    const { zipDirectoryToMemory } = await import("./index.ts");
+
+    await expect(
+      zipDirectoryToMemory("src", CompressionLevel.DEFAULT, {
+        signal: AbortSignal.abort(),
+      }),
+    ).rejects.toThrow("aborted");
+  });
+
+  test("should remove the output file of an aborted directory zip", async () => {
+    const { zipDirectory } = await import("./index.ts");
+    const outputFile = "test_aborted_directory.zip";
+    const controller = new AbortController();
+
+    try {
+      await expect(
+        zipDirectory("src", outputFile, CompressionLevel.DEFAULT, {
+          onProgress: (progress) => {
+            if (progress.entries > 0) {
+              controller.abort();
+            }
+          },
+          signal: controller.signal,
+        }),
+      ).rejects.toThrow("aborted");
+      expect(await Bun.file(outputFile).exists()).toBe(false);
+    } finally {
+      if (await Bun.file(outputFile).exists()) {
+        await Bun.file(outputFile).delete();
+      }
+    }
+  });
+});
+
+describe("Aligned entries", () => {
+  const testZipFile = "test_aligned.zip";
+
+  afterAll(async () => {
+    if (await Bun.file(testZipFile).exists()) {
+      await Bun.file(testZipFile).delete();
+    }
+  });
+
+  const weights = crypto.getRandomValues(new Uint8Array(10_000));
+
+  test("should map stored entries on the requested boundary", () => {
+    const writer = createArchive(testZipFile, { align: 4096 });
+    writer.addFile("a.txt", new TextEncoder().encode("unaligned name"));
+    writer.addFile("model/weights.bin", weights);
+    writer.addFile("notes.txt", five_mb, CompressionLevel.DEFAULT);
+    writer.addFile("odd/length/name.bin", weights.subarray(7));
+    writer.finalize();
+
+    const reader = openArchive(testZipFile);
+    const mapped = reader.mapFile(reader.findFile("model/weights.bin"));
+    expect(mapped).toEqual(weights);
+    expect(mapped.byteOffset % 4096).toBe(0);
+
+    const odd = reader.mapFile(3);
+    expect(odd).toEqual(weights.subarray(7));
+    expect(odd.byteOffset % 4096).toBe(0);
+
+    expect(() => reader.mapFile(2)).toThrow("cannot be mapped");
+    reader.close();
+    expect(mapped).toEqual(weights);
+  });
+
+  test("should map stored entries of memory archives", () => {
+    const writer = createMemoryArchive({ align: 64 });
+    writer.addFile("weights.bin", weights);
+    const archive = writer.finalizeToMemory();
+
+    const reader = openMemoryArchive(archive);
+    const mapped = reader.mapFile(0);
+    expect(mapped).toEqual(weights);
+    expect(mapped.buffer).toBe(archive.buffer);
+    expect((mapped.byteOffset - archive.byteOffset) % 64).toBe(0);
+    reader.close();
+  });
+
+  test("should reject invalid alignments", () => {
+    for (const align of [3, 65536, -4096, 1.5]) {
+      expect(() => createMemoryArchive({ align })).toThrow("Invalid alignment");
+    }
+  });
+});
+
+describe("Access traces", () => {
+  const sourceFile = "test_trace_source.zip";
+  const repackedFile = "test_trace_repacked.zip";
+  const traceFile = "test_trace.bin";
+
+  afterAll(async () => {
+    for (const file of [sourceFile, repackedFile, traceFile]) {
+      if (await Bun.file(file).exists()) {
+        await Bun.file(file).delete();
+      }
+    }
+  });
+
+  const contents = Array.from({ length: 6 }, (_, i) =>
+    new TextEncoder().encode(`entry ${i} `.repeat(100 * (i + 1))),
+  );
+
+  beforeAll(() => {
+    const writer = createArchive(sourceFile);
+    for (const [i, data] of contents.entries()) {
+      writer.addFile(`file${i}.txt`, data, CompressionLevel.DEFAULT);
+    }
+    writer.finalize();
+  });
+
+  test("should record the first access of each entry", () => {
+    const reader = openArchive(sourceFile, { accessTrace: traceFile });
+    reader.extractFile(4);
+    reader.extractFileByName("file1.txt");
+    reader.extractFile(4);
+    reader.readFile(2);
+    reader.close();
+
+    const trace = readAccessTrace(traceFile);
+    expect(trace.map((record) => record.index)).toEqual([4, 1, 2]);
+    expect(trace[0]?.time).toBeLessThanOrEqual(trace[2]?.time ?? 0);
+  });
+
+  test("should repack traced entries first", () => {
+    repackArchive(sourceFile, repackedFile, traceFile);
+
+    const reader = openArchive(repackedFile);
+    expect(reader.files().map((file) => file.filename)).toEqual([
+      "file4.txt",
+      "file1.txt",
+      "file2.txt",
+      "file0.txt",
+      "file3.txt",
+      "file5.txt",
+    ]);
+    for (const file of reader.files()) {
+      const original = Number(file.filename.slice(4, 5));
+      expect(reader.extractFileByName(file.filename)).toEqual(
+        contents[original] as Uint8Array,
+      );
+    }
+    expect(reader.validate().valid).toBe(true);
+    reader.close();
+    expect(Bun.file(repackedFile).size).toBe(Bun.file(sourceFile).size);
+  });
+
+  test("should copy entries between archives raw", () => {
+    const reader = openArchive(sourceFile);
+    const writer = createMemoryArchive();
+    expect(writer.copyFile(reader, 5)).toBe(true);
+    expect(writer.copyFile(reader, 42)).toBe(false);
+    expect(writer.getStats().compressedBytes).toBe(
+      reader.getFileByIndex(5).compressedSize,
+    );
+    reader.close();
+    expect(() => writer.copyFile(reader, 0)).toThrow("closed");
+
+    const copy = openMemoryArchive(writer.finalizeToMemory());
+    expect(copy.extractFile(0)).toEqual(contents[5] as Uint8Array);
+    copy.close();
+  });
+
+  test("should keep stored entries aligned when repacking", async () => {
+    const alignedFile = "test_trace_aligned.zip";
+    const weights = crypto.getRandomValues(new Uint8Array(10_000));
+
+    try {
+      const writer = createArchive(alignedFile, { align: 4096 });
+      writer.addFile("a.txt", contents[0] as Uint8Array);
+      writer.addFile("notes.txt", contents[1] as Uint8Array, 6);
+      writer.addFile("model/weights.bin", weights);
+      writer.addFile("odd/length/name.bin", weights.subarray(7));
+      writer.finalize();
+
+      repackArchive(alignedFile, repackedFile, [
+        { index: 3, time: 0 },
+        { index: 1, time: 1 },
+      ]);
+
+      const reader = openArchive(repackedFile);
+      expect(reader.files().map((file) => file.filename)).toEqual([
+        "odd/length/name.bin",
+        "notes.txt",
+        "a.txt",
+        "model/weights.bin",
+      ]);
+      for (const index of [0, 2, 3]) {
+        expect(reader.mapFile(index).byteOffset % 4096).toBe(0);
+      }
+      expect(reader.mapFile(3)).toEqual(weights);
+      expect(reader.validate().valid).toBe(true);
+      reader.close();
+    } finally {
+      await Bun.file(alignedFile).delete();
+    }
+  });
+
+  test("should reject traces of other archives", () => {
+    expect(() =>
+      repackArchive(sourceFile, repackedFile, [{ index: 6, time: 0 }]),
+    ).toThrow("Invalid entry index");
+  });
+});
+
+describe("Sharded writer", () => {
+  const basePath = "test_sharded";
+  const shardFiles = Array.from({ length: 4 }, (_, i) => `${basePath}-${i}.zip`);
+
+  afterAll(async () => {
+    for (const file of [...shardFiles, `${basePath}.json`]) {
+      if (await Bun.file(file).exists()) {
+        await Bun.file(file).delete();
+      }
+    }
+  });
+
+  const entries = Array.from({ length: 40 }, (_, i) => ({
+    filename: `dir/file${i}.txt`,
+    data: new TextEncoder().encode(`entry ${i} `.repeat(50 * ((i % 7) + 1))),
+  }));
+
+  test("should spread entries over the shards by size", () => {
+    const writer = new ShardedZipWriter(basePath, {
+      shards: 4,
+      batchSize: 10_000,
+    });
+    for (const { filename, data } of entries) {
+      writer.addFile(filename, data, CompressionLevel.DEFAULT);
+    }
+    const manifest = writer.finalize();
+    expect(manifest.shards).toEqual(shardFiles);
+
+    const read = readShardManifest(`${basePath}.json`);
+    expect(read.entries).toEqual(manifest.entries);
+
+    const sizes: number[] = [];
+    let total = 0;
+    for (const [i, path] of read.shards.entries()) {
+      const reader = openArchive(path);
+      let size = 0;
+      for (const file of reader.files()) {
+        expect(read.entries[file.filename]).toBe(i);
+        size += file.uncompressedSize;
+        total++;
+      }
+      for (const { filename, data } of entries) {
+        if (read.entries[filename] === i) {
+          expect(reader.extractFileByName(filename)).toEqual(data);
+        }
+      }
+      sizes.push(size);
+      reader.close();
+    }
+    expect(total).toBe(entries.length);
+    expect(Math.max(...sizes) - Math.min(...sizes)).toBeLessThan(4_000);
+  });
+
+  test("should route entries by name hash", () => {
+    const route = () => {
+      const writer = new ShardedZipWriter(basePath, {
+        shards: 4,
+        routing: "hash",
+      });
+      for (const { filename, data } of entries) {
+        writer.addFile(filename, data);
+      }
+      return writer.finalize().entries;
+    };
+    const first = route();
+    expect(route()).toEqual(first);
+    expect(new Set(Object.values(first)).size).toBeGreaterThan(1);
+  });
+
+  test("should keep names added again in their shard", () => {
+    const writer = new ShardedZipWriter(basePath, { shards: 4 });
+    const shard = writer.addFile("same.txt", new Uint8Array(1000));
+    for (let i = 0; i < 3; i++) {
+      writer.addFile(`other${i}.txt`, new Uint8Array(10));
+    }
+    expect(writer.addFile("same.txt", new Uint8Array(10))).toBe(shard);
+    const manifest = writer.finalize();
+    expect(manifest.entries["same.txt"]).toBe(shard);
+
+    const { shards } = readShardManifest(`${basePath}.json`);
+    for (const [i, path] of shards.entries()) {
+      const reader = openArchive(path);
+      const copies = reader
+        .files()
+        .filter((file) => file.filename === "same.txt").length;
+      expect(copies).toBe(i === shard ? 2 : 0);
+      reader.close();
+    }
+  });
+
+  test("should reject invalid options", () => {
+    expect(() => new ShardedZipWriter(basePath, { shards: 0 })).toThrow(
+      "Invalid shard count",
+    );
+    expect(
+      () =>
+        new ShardedZipWriter(basePath, {
+          routing: "random" as unknown as "hash",
+        }),
+    ).toThrow("Invalid shard routing");
+  });
+
+  test("should report entries that fail to be added", () => {
+    using writer = new ShardedZipWriter(basePath, { shards: 2 });
+    writer.addFile("ok.txt", new Uint8Array(10));
+    writer.addFile("bad.txt", new Uint8Array(10), 12 as CompressionLevelType);
+    expect(() => writer.flush()).toThrow("Failed to add bad.txt");
+  });
+
+  test("should leave entries that were not written out of the manifest", () => {
+    const writer = new ShardedZipWriter(basePath, { shards: 1 });
+    writer.addFile("ok.txt", new Uint8Array(10));
+    writer.addFile("bad.txt", new Uint8Array(10), 12 as CompressionLevelType);
+    writer.addFile("after.txt", new Uint8Array(10));
+    expect(() => writer.flush()).toThrow("Failed to add bad.txt");
+
+    const manifest = writer.finalize();
+    expect(Object.keys(manifest.entries)).toEqual(["ok.txt"]);
+    const reader = openArchive(`${basePath}-0.zip`);
+    expect(reader.files().map((file) => file.filename)).toEqual(["ok.txt"]);
+    reader.close();
+  });
+});
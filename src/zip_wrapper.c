@@ -25,48 +25,2368 @@
 
 #include "miniz.c"
 
+#ifdef ZIP_BUN_WITH_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+// Codec backends
+//
+// Entries are always added and extracted as whole buffers, so instead of
+// driving the streaming tdefl/tinfl interfaces through miniz's zip writer and
+// reader we hand the complete input to a single-shot codec. The output is
+// plain raw deflate, written through miniz's precompressed-data path, so any
+// backend produces archives every zip tool can read. miniz is always compiled
+// in and is the default; other backends are opt-in at compile time.
+typedef struct {
+    const char* name;
+    // Compresses src into dst. Returns the compressed size, or 0 when the
+    // output does not fit in dst_cap (the caller then stores the entry).
+    size_t (*deflate)(void** state, const void* src, size_t src_len, void* dst, size_t dst_cap, int level, mz_uint tdefl_flags);
+    // Inflates raw deflate data. Returns 1 only if exactly dst_len bytes were produced.
+    int (*inflate)(void** state, const void* src, size_t src_len, void* dst, size_t dst_len);
+    // Releases the per-handle state lazily allocated by deflate/inflate.
+    void (*release)(void* state);
+} codec_backend_t;
+
+// Inputs up to this size leave so little behind in the compressor that
+// undoing their writes is cheaper than tdefl_init clearing the 64KB hash
+// table and 32KB dictionary again
+#define DEFLATE_TINY_LIMIT 4096
+
+typedef struct {
+    tdefl_compressor comp;
+    // Whether the hash table and dictionary are known to be all zero
+    int clean;
+} miniz_deflate_state_t;
+
+// Restore the hash table and dictionary to the all-zero state tdefl_init
+// leaves them in, touching only what a stream of `length` bytes wrote.
+// Every position gets both the level 1 and the regular trigram hash, since
+// either parser may have produced the stream.
+static void miniz_reset_tiny(tdefl_compressor* comp, size_t length) {
+    const mz_uint8* dict = comp->m_dict;
+    for (size_t pos = 0; pos < length; pos++) {
+        mz_uint trigram = (mz_uint)dict[pos] | ((mz_uint)dict[pos + 1] << 8) | ((mz_uint)dict[pos + 2] << 16);
+        comp->m_hash[(trigram ^ (trigram >> (24 - (TDEFL_LZ_HASH_BITS - 8)))) & TDEFL_LEVEL1_HASH_SIZE_MASK] = 0;
+        comp->m_hash[((dict[pos] << (TDEFL_LZ_HASH_SHIFT * 2)) ^ (dict[pos + 1] << TDEFL_LZ_HASH_SHIFT) ^ dict[pos + 2]) & (TDEFL_LZ_HASH_SIZE - 1)] = 0;
+    }
+    memset(comp->m_dict, 0, length);
+    memset(comp->m_dict + TDEFL_LZ_DICT_SIZE, 0, MZ_MIN(length, TDEFL_MAX_MATCH_LEN - 1));
+}
+
+static size_t miniz_codec_deflate(void** state, const void* src, size_t src_len, void* dst, size_t dst_cap, int level, mz_uint tdefl_flags) {
+    // The compressor is ~300KB, so keep one per handle instead of allocating per entry
+    if (!*state) {
+        *state = malloc(sizeof(miniz_deflate_state_t));
+        if (!*state) return 0;
+        ((miniz_deflate_state_t*)*state)->clean = 0;
+    }
+
+    miniz_deflate_state_t* s = (miniz_deflate_state_t*)*state;
+    tdefl_compressor* comp = &s->comp;
+    size_t in_size = src_len;
+    size_t out_size = dst_cap;
+    (void)level;
+
+    // After a tiny stream the tables are already back to zero, so the
+    // output is the same as with a full clear
+    if (s->clean) tdefl_flags |= TDEFL_NONDETERMINISTIC_PARSING_FLAG;
+    if (tdefl_init(comp, NULL, NULL, (int)tdefl_flags) != TDEFL_STATUS_OKAY) return 0;
+
+    // Without a put-buf callback tdefl writes straight into dst and only
+    // reports DONE once the whole stream fit
+    tdefl_status status = tdefl_compress(comp, src, &in_size, dst, &out_size, TDEFL_FINISH);
+
+    s->clean = src_len <= DEFLATE_TINY_LIMIT;
+    if (s->clean) miniz_reset_tiny(comp, src_len);
+
+    return status == TDEFL_STATUS_DONE ? out_size : 0;
+}
+
+static int miniz_codec_inflate(void** state, const void* src, size_t src_len, void* dst, size_t dst_len) {
+    tinfl_decompressor inflator;
+    size_t in_size = src_len;
+    size_t out_size = dst_len;
+    (void)state;
+
+    tinfl_init(&inflator);
+    tinfl_status status = tinfl_decompress(&inflator, (const mz_uint8*)src, &in_size, (mz_uint8*)dst, (mz_uint8*)dst, &out_size, TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+
+    return status == TINFL_STATUS_DONE && out_size == dst_len;
+}
+
+static void miniz_codec_release(void* state) {
+    free(state);
+}
+
+#ifdef ZIP_BUN_WITH_LIBDEFLATE
+typedef struct {
+    struct libdeflate_compressor* compressor;
+    int compressor_level;
+    struct libdeflate_decompressor* decompressor;
+} libdeflate_state_t;
+
+static libdeflate_state_t* libdeflate_get_state(void** state) {
+    if (!*state) {
+        *state = calloc(1, sizeof(libdeflate_state_t));
+    }
+    return (libdeflate_state_t*)*state;
+}
+
+static size_t libdeflate_codec_deflate(void** state, const void* src, size_t src_len, void* dst, size_t dst_cap, int level, mz_uint tdefl_flags) {
+    libdeflate_state_t* s = libdeflate_get_state(state);
+    if (!s) return 0;
+    (void)tdefl_flags;
+
+    // miniz levels run 1-10, libdeflate levels run 1-12
+    int ld_level = level >= MZ_UBER_COMPRESSION ? 12 : level;
+
+    if (!s->compressor || s->compressor_level != ld_level) {
+        if (s->compressor) libdeflate_free_compressor(s->compressor);
+        s->compressor = libdeflate_alloc_compressor(ld_level);
+        s->compressor_level = ld_level;
+        if (!s->compressor) return 0;
+    }
+
+    return libdeflate_deflate_compress(s->compressor, src, src_len, dst, dst_cap);
+}
+
+static int libdeflate_codec_inflate(void** state, const void* src, size_t src_len, void* dst, size_t dst_len) {
+    libdeflate_state_t* s = libdeflate_get_state(state);
+    if (!s) return 0;
+
+    if (!s->decompressor) {
+        s->decompressor = libdeflate_alloc_decompressor();
+        if (!s->decompressor) return 0;
+    }
+
+    size_t actual = 0;
+    enum libdeflate_result result = libdeflate_deflate_decompress(s->decompressor, src, src_len, dst, dst_len, &actual);
+    return result == LIBDEFLATE_SUCCESS && actual == dst_len;
+}
+
+static void libdeflate_codec_release(void* state) {
+    libdeflate_state_t* s = (libdeflate_state_t*)state;
+    if (!s) return;
+    if (s->compressor) libdeflate_free_compressor(s->compressor);
+    if (s->decompressor) libdeflate_free_decompressor(s->decompressor);
+    free(s);
+}
+#endif
+
+static const codec_backend_t codec_backends[] = {
+    {"miniz", miniz_codec_deflate, miniz_codec_inflate, miniz_codec_release},
+#ifdef ZIP_BUN_WITH_LIBDEFLATE
+    {"libdeflate", libdeflate_codec_deflate, libdeflate_codec_inflate, libdeflate_codec_release},
+#endif
+};
+
+#define CODEC_BACKEND_COUNT ((int)(sizeof(codec_backends) / sizeof(codec_backends[0])))
+
+// Backend picked up by handles created from now on
+static int default_codec_backend = 0;
+
+#ifdef _WIN32
+#include <windows.h>
+
+static mz_uint64 monotonic_ns(void) {
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (mz_uint64)((double)counter.QuadPart * (1e9 / (double)frequency.QuadPart));
+}
+#else
+static mz_uint64 monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (mz_uint64)ts.tv_sec * 1000000000ull + (mz_uint64)ts.tv_nsec;
+}
+#endif
+
+// Adaptive level controller
+//
+// Writers with a throughput target pick the tdefl level and probe count per
+// entry from a ladder ordered by effort. Measured deflate speed at each step
+// is tracked as a byte-weighted moving average; steps that have not run yet
+// are estimated from the relative speed priors, scaled by how fast this
+// machine and data turned out to be on the steps that did run.
+typedef struct {
+    int level;
+    int probes;
+    // Speed relative to the first step, measured on mixed text and binary data
+    double relative_speed;
+} adaptive_step_t;
+
+static const adaptive_step_t adaptive_steps[] = {
+    {1, 1, 1.00},
+    {2, 6, 0.91},
+    {3, 32, 0.63},
+    {4, 16, 0.56},
+    {5, 32, 0.48},
+    {6, 64, 0.38},
+    {6, 128, 0.33},
+    {7, 256, 0.24},
+    {8, 512, 0.15},
+    {9, 768, 0.13},
+    {10, 1500, 0.11},
+};
+
+#define ADAPTIVE_STEP_COUNT ((int)(sizeof(adaptive_steps) / sizeof(adaptive_steps[0])))
+
+// Entries of this many bytes count fully towards the moving averages
+#define ADAPTIVE_FULL_WEIGHT_BYTES (1024 * 1024)
+
+// WinZip AES encryption of entries
+#include "winzip_aes.c"
+
+// Performance counters
+//
+// Every handle counts what passes through it. Byte, call and allocation
+// counters are always kept; reading the clock costs more than bumping a
+// counter, so the timers only run while timing is enabled (deflate time is
+// always measured, the compression report needs it). Stats of released
+// handles are folded into a process-wide total.
+typedef struct {
+    // Archive bytes read and written, including entry data read straight from memory
+    mz_uint64 bytes_read;
+    mz_uint64 bytes_written;
+    // Entry data before and after compression (added or extracted)
+    mz_uint64 uncompressed_bytes;
+    mz_uint64 compressed_bytes;
+    mz_uint64 entries;
+    mz_uint64 allocations;
+    // Calls into the archive's read and write callbacks
+    mz_uint64 io_calls;
+    mz_uint64 deflate_ns;
+    mz_uint64 inflate_ns;
+    mz_uint64 crc_ns;
+    mz_uint64 io_ns;
+} zip_stats_t;
+
+static int stats_timing = 0;
+static zip_stats_t retired_stats;
+
+// Start time of a timed section, 0 while timing is disabled
+static mz_uint64 stats_clock(void) {
+    return stats_timing ? monotonic_ns() : 0;
+}
+
+static void stats_elapsed(mz_uint64* counter, mz_uint64 start) {
+    if (start) *counter += monotonic_ns() - start;
+}
+
+static void stats_add(zip_stats_t* total, const zip_stats_t* stats) {
+    total->bytes_read += stats->bytes_read;
+    total->bytes_written += stats->bytes_written;
+    total->uncompressed_bytes += stats->uncompressed_bytes;
+    total->compressed_bytes += stats->compressed_bytes;
+    total->entries += stats->entries;
+    total->allocations += stats->allocations;
+    total->io_calls += stats->io_calls;
+    total->deflate_ns += stats->deflate_ns;
+    total->inflate_ns += stats->inflate_ns;
+    total->crc_ns += stats->crc_ns;
+    total->io_ns += stats->io_ns;
+}
+
+// Latency histograms
+//
+// Every public operation records its duration in a global log-linear
+// histogram per operation type, HDR style: each power of two from 1us up to
+// about 69s is split into four linear sub-buckets, which bounds the error of
+// any quantile to 25%. Operations record from the calling thread, and the
+// parallel add paths from their worker threads, either directly or by
+// merging a histogram they filled on their own, so the counters are updated
+// with relaxed atomics: nothing orders against them, they only must not lose
+// increments. GCC, Clang and TinyCC (whose predefined macros include
+// __ATOMIC_RELAXED along with the __atomic builtins) all have them; other
+// compilers get plain counters.
+#define LATENCY_OPEN 0
+#define LATENCY_LOCATE 1
+#define LATENCY_EXTRACT 2
+#define LATENCY_ADD 3
+#define LATENCY_FINALIZE 4
+#define LATENCY_OPERATIONS 5
+
+// Durations below 2^10 ns share the first bucket, from 2^36 ns the last
+#define LATENCY_MIN_SHIFT 10
+#define LATENCY_OCTAVES 26
+#define LATENCY_SUB_BUCKETS 4
+#define LATENCY_BUCKETS (LATENCY_OCTAVES * LATENCY_SUB_BUCKETS + 2)
+
+typedef struct {
+    mz_uint64 count;
+    mz_uint64 sum_ns;
+    mz_uint64 buckets[LATENCY_BUCKETS];
+} latency_histogram_t;
+
+static latency_histogram_t latency_histograms[LATENCY_OPERATIONS];
+
+#ifdef __ATOMIC_RELAXED
+#define latency_counter_add(counter, n) __atomic_fetch_add(counter, n, __ATOMIC_RELAXED)
+#define latency_counter_load(counter) __atomic_load_n(counter, __ATOMIC_RELAXED)
+#else
+#define latency_counter_add(counter, n) (*(counter) += (n))
+#define latency_counter_load(counter) (*(counter))
+#endif
+
+static int latency_bucket(mz_uint64 ns) {
+    if (ns < (1ull << LATENCY_MIN_SHIFT)) return 0;
+
+    int msb = LATENCY_MIN_SHIFT;
+    while (msb < 63 && (ns >> (msb + 1))) msb++;
+
+    int octave = msb - LATENCY_MIN_SHIFT;
+    if (octave >= LATENCY_OCTAVES) return LATENCY_BUCKETS - 1;
+
+    // The two bits below the leading one pick the sub-bucket
+    int sub = (int)((ns >> (msb - 2)) & (LATENCY_SUB_BUCKETS - 1));
+    return 1 + octave * LATENCY_SUB_BUCKETS + sub;
+}
+
+static void latency_histogram_add(latency_histogram_t* histogram, mz_uint64 ns) {
+    latency_counter_add(&histogram->count, 1);
+    latency_counter_add(&histogram->sum_ns, ns);
+    latency_counter_add(&histogram->buckets[latency_bucket(ns)], 1);
+}
+
+static void latency_add(int operation, mz_uint64 ns) {
+    latency_histogram_add(&latency_histograms[operation], ns);
+}
+
+// Fold a histogram filled on another thread into an operation's
+static void latency_merge(int operation, const latency_histogram_t* from) {
+    latency_histogram_t* histogram = &latency_histograms[operation];
+    latency_counter_add(&histogram->count, from->count);
+    latency_counter_add(&histogram->sum_ns, from->sum_ns);
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        if (from->buckets[i]) latency_counter_add(&histogram->buckets[i], from->buckets[i]);
+    }
+}
+
+// Record an operation that started at `start` (a monotonic_ns reading)
+static void latency_record(int operation, mz_uint64 start) {
+    latency_add(operation, monotonic_ns() - start);
+}
+
+// Tracing
+//
+// Static tracepoints for bpftrace, perf and friends. TinyCC can't emit the
+// .note.stapsdt sections USDT probes are made of, so the probes live in a
+// small library built with the system compiler (probes.c) and loaded on
+// request with load_trace_probes. Until then every probe site costs a NULL
+// check. Operations use the latency codes, plus close and validate.
+#define TRACE_CLOSE 5
+#define TRACE_VALIDATE 6
+
+#define TRACE_OP_START 0
+#define TRACE_OP_DONE 1
+#define TRACE_IO_START 2
+#define TRACE_IO_DONE 3
+#define TRACE_CODEC_START 4
+#define TRACE_CODEC_DONE 5
+
+#define TRACE_IO_READ 0
+#define TRACE_IO_WRITE 1
+
+#define TRACE_CODEC_DEFLATE 0
+#define TRACE_CODEC_INFLATE 1
+#define TRACE_CODEC_CRC 2
+
+typedef void (*trace_probe_t)(int probe, int kind, int handle_id, int index, const char* name, mz_uint64 a, mz_uint64 b);
+
+static trace_probe_t trace_probe = NULL;
+
+#define TRACE(probe, kind, handle_id, index, name, a, b) \
+    do { \
+        if (trace_probe) trace_probe(probe, kind, handle_id, index, name, a, b); \
+    } while (0)
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+// Load the probe library at `path`. Returns 1 once its probes fire, 0 if it
+// could not be loaded (always on Windows, which has no USDT).
+int load_trace_probes(const char* path) {
+#ifdef _WIN32
+    (void)path;
+    return 0;
+#else
+    void* library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!library) return 0;
+
+    trace_probe_t probe = (trace_probe_t)dlsym(library, "zip_bun_probe");
+    if (!probe) {
+        dlclose(library);
+        return 0;
+    }
+    trace_probe = probe;
+    return 1;
+#endif
+}
+
+// Start of a public operation on an entry (index and name when known) or a
+// whole archive (index -1). Returns the start time for op_done.
+static mz_uint64 op_start(int operation, int handle_id, int index, const char* name) {
+    TRACE(TRACE_OP_START, operation, handle_id, index, name, 0, 0);
+    return monotonic_ns();
+}
+
+// End of an operation that produced `bytes` bytes (entry or archive data).
+// Only successful operations count towards the latency histograms.
+static void op_done(int operation, int handle_id, int index, mz_uint64 start, mz_uint64 bytes, int ok) {
+    if (ok && operation < LATENCY_OPERATIONS) latency_record(operation, start);
+    TRACE(TRACE_OP_DONE, operation, handle_id, index, NULL, bytes, ok ? 1 : 0);
+}
+
+// Extraction budgets
+//
+// Readers can cap what extracting entries may cost, so a hostile or corrupt
+// archive fails fast instead of making us allocate gigabytes or spin on a
+// bomb. Sizes come from the central directory and are checked before the
+// output is allocated; inflating never produces more than the declared size,
+// so a lying header only makes the entry fail. A deadline is also checked
+// between chunks of a deflate stream while it inflates.
+#define LIMIT_NONE 0
+#define LIMIT_ENTRY_SIZE 1
+#define LIMIT_TOTAL_SIZE 2
+#define LIMIT_RATIO 3
+#define LIMIT_DEADLINE 4
+
+// Entry bytes inflated or deflated between two looks at the clock and the
+// progress callback
+#define CODEC_CHUNK_SIZE (1024 * 1024)
+
+typedef struct {
+    // Each limit is disabled while 0
+    mz_uint64 max_entry_size;
+    mz_uint64 max_total_size;
+    double max_ratio;
+    mz_uint64 deadline_ns;
+    // Bytes extracted so far, counted against max_total_size
+    mz_uint64 extracted;
+    // LIMIT_* that failed the last extraction, LIMIT_NONE if none did
+    int violation;
+} extract_limits_t;
+
+// Progress and cancellation
+//
+// Calls into the library are synchronous, so the callback runs on the
+// calling thread in the middle of an operation: every CODEC_CHUNK_SIZE bytes
+// of a large entry while it inflates or deflates, and as entries complete.
+// Its return value cancels the operation when 0; the codec loops stop at
+// the next chunk, and the I/O callbacks fail from then on until the
+// callback is replaced. bytes and entries count the entry data processed
+// since the callback was set.
+typedef int (*progress_fn_t)(int handle_id, double bytes, int entries);
+
 // Global storage for zip archives
 typedef struct {
-    mz_zip_archive archive;
-    int is_writer;
-} zip_handle_t;
+    mz_zip_archive archive;
+    int is_writer;
+    // Slot in zip_handles, reported by the trace probes
+    int id;
+    const codec_backend_t* codec;
+    void* codec_state;
+    // Reusable buffer for compressed entry data
+    void* scratch;
+    size_t scratch_capacity;
+    // Entropy (in millibits per byte) at or above which entries are stored
+    // without attempting compression, 0 disables the probe
+    int auto_store_threshold;
+    // Boundary the data of stored entries starts on, 0 leaves it unaligned
+    int alignment;
+    // Counters, which also hold the totals of the compression report
+    zip_stats_t stats;
+    mz_uint64 add_ns;
+    // miniz's own I/O callbacks, wrapped to count calls, bytes and time
+    mz_file_read_func io_read;
+    mz_file_write_func io_write;
+    void* io_opaque;
+    // Bytes currently allocated by miniz for the archive
+    mz_uint64 archive_bytes;
+    // Adaptive level controller, target in bytes per second (0 disables)
+    double adaptive_target;
+    int adaptive_step;
+    double adaptive_speed_scale;
+    double adaptive_step_speed[ADAPTIVE_STEP_COUNT];
+    // Password and derived keys for encrypted entries, NULL without a password
+    zip_aes_t* aes;
+    // Background CRC checks of extracted entries, created on first use
+    struct crc_queue_s* crc_queue;
+    // Write-behind buffer of a file writer, NULL when writes go straight to the file
+    struct write_buffer_s* write_buffer;
+    // Whether the file was extended by reserve_zip_space and needs truncating
+    int reserved;
+    // Extraction budgets of a reader
+    extract_limits_t limits;
+    // Progress callback, NULL without one, and the work it has been told about
+    progress_fn_t progress;
+    mz_uint64 progress_bytes;
+    mz_uint64 progress_next;
+    int progress_entries;
+    int cancelled;
+} zip_handle_t;
+
+// Global storage for zip archives
+#define MAX_HANDLES 100
+
+static zip_handle_t* zip_handles[MAX_HANDLES] = {NULL};
+
+// Find a free handle slot, reusing slots released by close/finalize
+static int find_free_handle_slot(void) {
+    for (int i = 0; i < MAX_HANDLES; i++) {
+        if (!zip_handles[i]) return i;
+    }
+    return -1;
+}
+
+// Blocks handed to miniz carry their size in front, so the handle knows how
+// much memory the archive holds
+#define ALLOC_HEADER_SIZE 16
+
+static void* stats_alloc(void* opaque, size_t items, size_t size) {
+    zip_handle_t* handle = (zip_handle_t*)opaque;
+    size_t bytes = items * size;
+    mz_uint64* block = (mz_uint64*)malloc(bytes + ALLOC_HEADER_SIZE);
+    if (!block) return NULL;
+
+    block[0] = bytes;
+    handle->stats.allocations++;
+    handle->archive_bytes += bytes;
+    return (mz_uint8*)block + ALLOC_HEADER_SIZE;
+}
+
+static void stats_free(void* opaque, void* address) {
+    if (!address) return;
+
+    mz_uint64* block = (mz_uint64*)((mz_uint8*)address - ALLOC_HEADER_SIZE);
+    ((zip_handle_t*)opaque)->archive_bytes -= block[0];
+    free(block);
+}
+
+static void* stats_realloc(void* opaque, void* address, size_t items, size_t size) {
+    if (!address) return stats_alloc(opaque, items, size);
+
+    zip_handle_t* handle = (zip_handle_t*)opaque;
+    size_t bytes = items * size;
+    mz_uint64* block = (mz_uint64*)((mz_uint8*)address - ALLOC_HEADER_SIZE);
+    mz_uint64 previous = block[0];
+    block = (mz_uint64*)realloc(block, bytes + ALLOC_HEADER_SIZE);
+    if (!block) return NULL;
+
+    block[0] = bytes;
+    handle->stats.allocations++;
+    handle->archive_bytes = handle->archive_bytes - previous + bytes;
+    return (mz_uint8*)block + ALLOC_HEADER_SIZE;
+}
+
+// Native memory held by a handle: the wrapper, its scratch buffer and
+// everything miniz allocated for the archive (central directory, in-memory
+// archive data)
+// The write-behind buffer is defined with the worker threads it flushes on
+static size_t write_buffer_write(zip_handle_t* handle, mz_uint64 file_ofs, const void* data, size_t n);
+static mz_uint64 write_buffer_memory(const zip_handle_t* handle);
+
+static mz_uint64 handle_memory(const zip_handle_t* handle) {
+    return sizeof(zip_handle_t) + handle->scratch_capacity + handle->archive_bytes + write_buffer_memory(handle);
+}
+
+static size_t stats_read(void* opaque, mz_uint64 file_ofs, void* buffer, size_t n) {
+    zip_handle_t* handle = (zip_handle_t*)opaque;
+    if (handle->cancelled) return 0;
+    TRACE(TRACE_IO_START, TRACE_IO_READ, handle->id, -1, NULL, file_ofs, n);
+    mz_uint64 start = stats_clock();
+    size_t read = handle->io_read(handle->io_opaque, file_ofs, buffer, n);
+
+    stats_elapsed(&handle->stats.io_ns, start);
+    TRACE(TRACE_IO_DONE, TRACE_IO_READ, handle->id, -1, NULL, file_ofs, read);
+    handle->stats.io_calls++;
+    handle->stats.bytes_read += read;
+    return read;
+}
+
+static size_t stats_write(void* opaque, mz_uint64 file_ofs, const void* buffer, size_t n) {
+    zip_handle_t* handle = (zip_handle_t*)opaque;
+    if (handle->cancelled) return 0;
+    TRACE(TRACE_IO_START, TRACE_IO_WRITE, handle->id, -1, NULL, file_ofs, n);
+    mz_uint64 start = stats_clock();
+    size_t written = handle->write_buffer ? write_buffer_write(handle, file_ofs, buffer, n) : handle->io_write(handle->io_opaque, file_ofs, buffer, n);
+
+    stats_elapsed(&handle->stats.io_ns, start);
+    TRACE(TRACE_IO_DONE, TRACE_IO_WRITE, handle->id, -1, NULL, file_ofs, written);
+    handle->stats.io_calls++;
+    handle->stats.bytes_written += written;
+    return written;
+}
+
+// Route the archive's I/O through the counting callbacks, once miniz has
+// installed its own
+static void track_io(zip_handle_t* handle) {
+    mz_zip_archive* archive = &handle->archive;
+    handle->io_read = archive->m_pRead;
+    handle->io_write = archive->m_pWrite;
+    handle->io_opaque = archive->m_pIO_opaque;
+    if (archive->m_pRead) archive->m_pRead = stats_read;
+    if (archive->m_pWrite) archive->m_pWrite = stats_write;
+    archive->m_pIO_opaque = handle;
+}
+
+// Put miniz's own callbacks back before ending the archive:
+// mz_zip_writer_end only frees a heap archive written by its own callback
+static void untrack_io(zip_handle_t* handle) {
+    mz_zip_archive* archive = &handle->archive;
+    archive->m_pRead = handle->io_read;
+    archive->m_pWrite = handle->io_write;
+    archive->m_pIO_opaque = handle->io_opaque;
+}
+
+static zip_handle_t* alloc_handle(int is_writer) {
+    zip_handle_t* handle = (zip_handle_t*)malloc(sizeof(zip_handle_t));
+    if (!handle) return NULL;
+
+    memset(handle, 0, sizeof(zip_handle_t));
+    handle->is_writer = is_writer;
+    handle->codec = &codec_backends[default_codec_backend];
+    handle->archive.m_pAlloc = stats_alloc;
+    handle->archive.m_pFree = stats_free;
+    handle->archive.m_pRealloc = stats_realloc;
+    handle->archive.m_pAlloc_opaque = handle;
+    return handle;
+}
+
+// Release everything owned by the handle wrapper itself (not the archive)
+static void free_handle(zip_handle_t* handle) {
+    if (handle->codec_state) handle->codec->release(handle->codec_state);
+    zip_aes_free(handle->aes);
+    free(handle->scratch);
+    free(handle);
+}
+
+// Publish a handle whose archive was just opened by an open operation that
+// started at `start`, or release it if opening failed
+static int open_done(int handle_id, zip_handle_t* handle, mz_bool status, mz_uint64 start) {
+    if (!status) {
+        if (handle) free_handle(handle);
+        op_done(LATENCY_OPEN, handle_id, -1, start, 0, 0);
+        return -1;
+    }
+
+    handle->id = handle_id;
+    track_io(handle);
+    zip_handles[handle_id] = handle;
+    op_done(LATENCY_OPEN, handle_id, -1, start, handle->archive.m_archive_size, 1);
+    return handle_id;
+}
+
+static void* ensure_scratch(zip_handle_t* handle, size_t size) {
+    if (size > handle->scratch_capacity) {
+        void* grown = realloc(handle->scratch, size);
+        if (!grown) return NULL;
+        handle->scratch = grown;
+        handle->scratch_capacity = size;
+        handle->stats.allocations++;
+    }
+    return handle->scratch;
+}
+
+// Count entry bytes (and a completed entry) towards the handle's progress,
+// calling its callback once at least CODEC_CHUNK_SIZE bytes have passed since
+// the last call, or when an entry completes. Returns 0 once cancelled.
+static int progress_step(zip_handle_t* handle, size_t bytes, int entry_done) {
+    handle->progress_bytes += bytes;
+    handle->progress_entries += entry_done;
+    if (!handle->progress || handle->cancelled) return !handle->cancelled;
+    
+    if (entry_done || handle->progress_bytes >= handle->progress_next) {
+        handle->progress_next = handle->progress_bytes + CODEC_CHUNK_SIZE;
+        if (!handle->progress(handle->id, (double)handle->progress_bytes, handle->progress_entries)) handle->cancelled = 1;
+    }
+    return !handle->cancelled;
+}
+
+// Get the number of compiled-in codec backends
+int get_codec_backend_count() {
+    return CODEC_BACKEND_COUNT;
+}
+
+// Copy the name of a codec backend into a buffer, returns its length or -1
+int get_codec_backend_name(int index, char* buffer, size_t buffer_size) {
+    if (index < 0 || index >= CODEC_BACKEND_COUNT || !buffer || buffer_size == 0) return -1;
+
+    size_t len = strlen(codec_backends[index].name);
+    if (len >= buffer_size) len = buffer_size - 1;
+
+    memcpy(buffer, codec_backends[index].name, len);
+    buffer[len] = '\0';
+    return (int)len;
+}
+
+// Get the index of the backend used for new handles
+int get_codec_backend() {
+    return default_codec_backend;
+}
+
+// Select the backend used for new handles
+int set_codec_backend(int index) {
+    if (index < 0 || index >= CODEC_BACKEND_COUNT) return 0;
+    default_codec_backend = index;
+    return 1;
+}
+
+// Entropy probe
+//
+// Deflating already-compressed data (JPEG, MP4, nested archives) burns the
+// full compression effort only to end up storing the entry. Sampling a few
+// windows of the input and measuring the byte-histogram entropy catches these
+// for a tiny fraction of the cost of compressing them.
+#define ENTROPY_PROBE_WINDOW 4096
+#define ENTROPY_PROBE_MIN_SIZE 4096
+
+// log2 for x > 0 without pulling in libm: split off the exponent, then use
+// log2(m) = 2/ln(2) * atanh((m - 1) / (m + 1)) for the mantissa in [1, 2)
+static double approx_log2(double x) {
+    int exponent = 0;
+    while (x >= 2.0) {
+        x *= 0.5;
+        exponent++;
+    }
+    while (x < 1.0) {
+        x *= 2.0;
+        exponent--;
+    }
+
+    double y = (x - 1.0) / (x + 1.0);
+    double y2 = y * y;
+    double series = y * (1.0 + y2 * (1.0 / 3.0 + y2 * (1.0 / 5.0 + y2 * (1.0 / 7.0))));
+    return exponent + series * 2.8853900817779268; // 2 / ln(2)
+}
+
+// Estimate the Shannon entropy of the data in millibits per byte, sampling
+// windows at the start, middle and end of larger inputs
+static int estimate_entropy(const void* data, size_t data_length) {
+    const mz_uint8* bytes = (const mz_uint8*)data;
+    mz_uint32 histogram[256];
+    size_t total = 0;
+
+    memset(histogram, 0, sizeof(histogram));
+
+    if (data_length <= ENTROPY_PROBE_WINDOW * 3) {
+        for (size_t i = 0; i < data_length; i++) histogram[bytes[i]]++;
+        total = data_length;
+    } else {
+        size_t starts[3] = {0, (data_length - ENTROPY_PROBE_WINDOW) / 2, data_length - ENTROPY_PROBE_WINDOW};
+        for (int w = 0; w < 3; w++) {
+            const mz_uint8* window = bytes + starts[w];
+            for (size_t i = 0; i < ENTROPY_PROBE_WINDOW; i++) histogram[window[i]]++;
+        }
+        total = ENTROPY_PROBE_WINDOW * 3;
+    }
+
+    if (!total) return 0;
+
+    // H = log2(N) - (1/N) * sum(c * log2(c))
+    double weighted = 0.0;
+    for (int i = 0; i < 256; i++) {
+        if (histogram[i] > 1) weighted += histogram[i] * approx_log2((double)histogram[i]);
+    }
+
+    double entropy = approx_log2((double)total) - weighted / (double)total;
+    return (int)(entropy * 1000.0);
+}
+
+// Optimal-parse encoder behind the "max" level
+#define ZIP_LEVEL_OPTIMAL 11
+
+#include "optimal_deflate.c"
+
+// Deflate64 decoder for entries written by Windows and 7-Zip
+#include "inflate64.c"
+
+// Worker threads
+//
+// Minimal portable wrappers for spreading independent jobs over a few
+// threads. The calling thread always takes part, so work still completes if
+// no extra thread can be started.
+#ifdef _WIN32
+typedef CRITICAL_SECTION worker_mutex_t;
+#define worker_mutex_init(m) InitializeCriticalSection(m)
+#define worker_mutex_lock(m) EnterCriticalSection(m)
+#define worker_mutex_unlock(m) LeaveCriticalSection(m)
+#define worker_mutex_destroy(m) DeleteCriticalSection(m)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t worker_mutex_t;
+#define worker_mutex_init(m) pthread_mutex_init(m, NULL)
+#define worker_mutex_lock(m) pthread_mutex_lock(m)
+#define worker_mutex_unlock(m) pthread_mutex_unlock(m)
+#define worker_mutex_destroy(m) pthread_mutex_destroy(m)
+#endif
+
+#define MAX_WORKER_THREADS 64
+
+typedef struct {
+    void (*run)(void* arg);
+    void* arg;
+} worker_task_t;
+
+#ifdef _WIN32
+typedef HANDLE worker_thread_t;
+
+static DWORD WINAPI worker_thread_main(LPVOID param) {
+    worker_task_t* task = (worker_task_t*)param;
+    task->run(task->arg);
+    return 0;
+}
+#else
+typedef pthread_t worker_thread_t;
+
+static void* worker_thread_main(void* param) {
+    worker_task_t* task = (worker_task_t*)param;
+    task->run(task->arg);
+    return NULL;
+}
+#endif
+
+// Start a thread running the task, which must outlive it. Returns 0 if no
+// thread could be started.
+static int worker_thread_start(worker_thread_t* thread, worker_task_t* task) {
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, worker_thread_main, task, 0, NULL);
+    return *thread != NULL;
+#else
+    return pthread_create(thread, NULL, worker_thread_main, task) == 0;
+#endif
+}
+
+static void worker_thread_join(worker_thread_t thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+// Run fn(arg) on up to `threads` threads including the caller and wait for all
+static void run_workers(int threads, void (*fn)(void* arg), void* arg) {
+    worker_task_t task = {fn, arg};
+    worker_thread_t workers[MAX_WORKER_THREADS];
+    int started = 0;
+
+    if (threads > MAX_WORKER_THREADS) threads = MAX_WORKER_THREADS;
+
+    for (int i = 1; i < threads; i++) {
+        if (worker_thread_start(&workers[started], &task)) started++;
+    }
+    fn(arg);
+    for (int i = 0; i < started; i++) worker_thread_join(workers[i]);
+}
+
+// Deferred CRC checks
+//
+// Readers can hand extracted data back before its CRC is known. The check is
+// queued and run on a background thread, which is started when work arrives
+// and exits once the queue is empty. The caller keeps the data alive and
+// unmodified until the checks are collected with crc_queue_wait.
+#define CRC_VERIFY 0
+#define CRC_SKIP 1
+#define CRC_DEFER 2
+
+typedef struct crc_job_s {
+    int file_index;
+    const mz_uint8* data;
+    size_t size;
+    mz_uint32 expected;
+    struct crc_job_s* next;
+} crc_job_t;
+
+typedef struct crc_queue_s {
+    worker_mutex_t lock;
+    worker_task_t task;
+    worker_thread_t thread;
+    int has_thread;
+    int running;
+    crc_job_t* head;
+    crc_job_t* tail;
+    // Indices of entries whose data did not match its CRC
+    int* failures;
+    int failure_count;
+    int failure_capacity;
+    // Time spent checking, handed to the handle's stats by crc_queue_wait
+    mz_uint64 crc_ns;
+} crc_queue_t;
+
+static void crc_queue_worker(void* arg) {
+    crc_queue_t* queue = (crc_queue_t*)arg;
+
+    for (;;) {
+        worker_mutex_lock(&queue->lock);
+        crc_job_t* job = queue->head;
+        if (!job) {
+            queue->running = 0;
+            worker_mutex_unlock(&queue->lock);
+            return;
+        }
+        queue->head = job->next;
+        if (!queue->head) queue->tail = NULL;
+        worker_mutex_unlock(&queue->lock);
+
+        mz_uint64 start = stats_clock();
+        int ok = mz_crc32(MZ_CRC32_INIT, job->data, job->size) == job->expected;
+
+        worker_mutex_lock(&queue->lock);
+        stats_elapsed(&queue->crc_ns, start);
+        if (!ok) {
+            if (queue->failure_count == queue->failure_capacity) {
+                int capacity = queue->failure_capacity ? queue->failure_capacity * 2 : 16;
+                int* grown = (int*)realloc(queue->failures, (size_t)capacity * sizeof(int));
+                if (grown) {
+                    queue->failures = grown;
+                    queue->failure_capacity = capacity;
+                }
+            }
+            // Without room the failure still counts, only its index is lost
+            if (queue->failure_count < queue->failure_capacity) queue->failures[queue->failure_count] = job->file_index;
+            queue->failure_count++;
+        }
+        worker_mutex_unlock(&queue->lock);
+        free(job);
+    }
+}
+
+// Queue a CRC check, returning 0 if it could not be deferred
+static int crc_queue_push(zip_handle_t* handle, int file_index, const void* data, size_t size, mz_uint32 expected) {
+    if (!handle->crc_queue) {
+        handle->crc_queue = (crc_queue_t*)calloc(1, sizeof(crc_queue_t));
+        if (!handle->crc_queue) return 0;
+        worker_mutex_init(&handle->crc_queue->lock);
+        handle->crc_queue->task.run = crc_queue_worker;
+        handle->crc_queue->task.arg = handle->crc_queue;
+    }
+    crc_queue_t* queue = handle->crc_queue;
+
+    crc_job_t* job = (crc_job_t*)malloc(sizeof(crc_job_t));
+    if (!job) return 0;
+    job->file_index = file_index;
+    job->data = (const mz_uint8*)data;
+    job->size = size;
+    job->expected = expected;
+    job->next = NULL;
+
+    worker_mutex_lock(&queue->lock);
+    if (queue->tail) {
+        queue->tail->next = job;
+    } else {
+        queue->head = job;
+    }
+    queue->tail = job;
+
+    int start = !queue->running;
+    if (start) queue->running = 1;
+    worker_mutex_unlock(&queue->lock);
+
+    if (start) {
+        // The previous thread has emptied the queue and is exiting
+        if (queue->has_thread) worker_thread_join(queue->thread);
+        queue->has_thread = worker_thread_start(&queue->thread, &queue->task);
+        if (!queue->has_thread) crc_queue_worker(queue);
+    }
+    return 1;
+}
+
+// Wait for queued checks. Copies up to max_failures failed entry indices,
+// forgets them, adds the time spent to crc_ns and returns how many checks
+// failed.
+static int crc_queue_wait(crc_queue_t* queue, int* failures, int max_failures, mz_uint64* crc_ns) {
+    if (!queue) return 0;
+
+    // Only the thread that queues checks waits for them, so nothing new can
+    // start while joining
+    if (queue->has_thread) {
+        worker_thread_join(queue->thread);
+        queue->has_thread = 0;
+    }
+
+    int count = queue->failure_count;
+    int stored = count < queue->failure_capacity ? count : queue->failure_capacity;
+    for (int i = 0; i < stored && i < max_failures; i++) failures[i] = queue->failures[i];
+    queue->failure_count = 0;
+    if (crc_ns) *crc_ns += queue->crc_ns;
+    queue->crc_ns = 0;
+    return count;
+}
+
+static void crc_queue_free(crc_queue_t* queue) {
+    if (!queue) return;
+    crc_queue_wait(queue, NULL, 0, NULL);
+    worker_mutex_destroy(&queue->lock);
+    free(queue->failures);
+    free(queue);
+}
+
+// Write-behind buffer
+//
+// miniz writes every entry of a file archive as several small writes (local
+// header, name, extra field, data, descriptor) and the AES path patches the
+// local header once the data is out. File writers collect these writes in a
+// WRITE_BUFFER_SIZE buffer instead, applying writes that land inside it in
+// place. A full buffer is swapped for a spare and written out on a
+// background thread while the next one fills, so the file only sees large
+// sequential writes, each ending on a WRITE_BUFFER_SIZE boundary of the
+// file. A write aimed anywhere else waits for the flush and goes straight
+// to the file.
+#define WRITE_BUFFER_SIZE (4 * 1024 * 1024)
+
+typedef struct write_buffer_s {
+    // Bytes collected so far, which belong at archive offset `offset`.
+    // Allocated on the first write.
+    mz_uint8* data;
+    mz_uint64 offset;
+    size_t length;
+    // The buffer last handed to the flush thread, reused once it is done
+    mz_uint8* spare;
+    const mz_uint8* flushing;
+    mz_uint64 flushing_offset;
+    size_t flushing_length;
+    worker_task_t task;
+    worker_thread_t thread;
+    int has_thread;
+    // Set by a failed write, which fails every write after it
+    int failed;
+    // miniz's own write callback, which the buffer is flushed through
+    mz_file_write_func write;
+    void* opaque;
+} write_buffer_t;
+
+static void write_buffer_worker(void* arg) {
+    write_buffer_t* buffer = (write_buffer_t*)arg;
+    if (buffer->write(buffer->opaque, buffer->flushing_offset, buffer->flushing, buffer->flushing_length) != buffer->flushing_length) {
+        buffer->failed = 1;
+    }
+}
+
+// Wait for the background write, returning 0 if any write has failed
+static int write_buffer_wait(write_buffer_t* buffer) {
+    if (buffer->has_thread) {
+        worker_thread_join(buffer->thread);
+        buffer->has_thread = 0;
+    }
+    return !buffer->failed;
+}
+
+// Hand the collected bytes to a flush thread and continue in the spare
+// buffer, writing them out directly when there is no spare or thread
+static int write_buffer_flush(zip_handle_t* handle) {
+    write_buffer_t* buffer = handle->write_buffer;
+    if (!write_buffer_wait(buffer)) return 0;
+    if (!buffer->length) return 1;
+
+    if (!buffer->spare) {
+        buffer->spare = (mz_uint8*)malloc(WRITE_BUFFER_SIZE);
+        if (buffer->spare) handle->stats.allocations++;
+    }
+
+    buffer->flushing = buffer->data;
+    buffer->flushing_offset = buffer->offset;
+    buffer->flushing_length = buffer->length;
+    buffer->offset += buffer->length;
+    buffer->length = 0;
+
+    if (buffer->spare) {
+        mz_uint8* next = buffer->spare;
+        buffer->spare = buffer->data;
+        buffer->data = next;
+        buffer->has_thread = worker_thread_start(&buffer->thread, &buffer->task);
+    }
+    if (!buffer->has_thread) write_buffer_worker(buffer);
+    return buffer->has_thread || !buffer->failed;
+}
+
+static size_t write_buffer_write(zip_handle_t* handle, mz_uint64 file_ofs, const void* data, size_t n) {
+    write_buffer_t* buffer = handle->write_buffer;
+    if (!buffer->data) {
+        buffer->data = (mz_uint8*)malloc(WRITE_BUFFER_SIZE);
+        if (!buffer->data) return buffer->write(buffer->opaque, file_ofs, data, n);
+        handle->stats.allocations++;
+    }
+
+    // Appends and patches of bytes still in the buffer
+    if (file_ofs >= buffer->offset && file_ofs <= buffer->offset + buffer->length) {
+        const mz_uint8* bytes = (const mz_uint8*)data;
+        size_t left = n;
+        while (left) {
+            // Fill up to the next boundary, so every flush after the first is aligned
+            size_t limit = WRITE_BUFFER_SIZE - (size_t)(buffer->offset % WRITE_BUFFER_SIZE);
+            size_t at = (size_t)(file_ofs - buffer->offset);
+            if (at == limit) {
+                if (!write_buffer_flush(handle)) return 0;
+                continue;
+            }
+
+            size_t chunk = MZ_MIN(left, limit - at);
+            memcpy(buffer->data + at, bytes, chunk);
+            if (at + chunk > buffer->length) buffer->length = at + chunk;
+            file_ofs += chunk;
+            bytes += chunk;
+            left -= chunk;
+        }
+        return n;
+    }
+
+    // Anything else is written in order with what came before it
+    if (!write_buffer_flush(handle) || !write_buffer_wait(buffer)) return 0;
+    if (buffer->write(buffer->opaque, file_ofs, data, n) != n) {
+        buffer->failed = 1;
+        return 0;
+    }
+    if (file_ofs + n > buffer->offset) buffer->offset = file_ofs + n;
+    return n;
+}
+
+// Route a file writer's writes through a write-behind buffer. Without
+// memory for one, writes keep going straight to the file.
+static void write_buffer_attach(zip_handle_t* handle) {
+    write_buffer_t* buffer = (write_buffer_t*)calloc(1, sizeof(write_buffer_t));
+    if (!buffer) return;
+
+    buffer->offset = handle->archive.m_archive_size;
+    buffer->task.run = write_buffer_worker;
+    buffer->task.arg = buffer;
+    buffer->write = handle->io_write;
+    buffer->opaque = handle->io_opaque;
+    handle->write_buffer = buffer;
+}
+
+// Write out everything buffered and go back to unbuffered writes, returning
+// 0 if any write failed
+static int write_buffer_detach(zip_handle_t* handle) {
+    write_buffer_t* buffer = handle->write_buffer;
+    if (!buffer) return 1;
+
+    int ok = write_buffer_flush(handle) && write_buffer_wait(buffer);
+    free(buffer->data);
+    free(buffer->spare);
+    free(buffer);
+    handle->write_buffer = NULL;
+    return ok;
+}
+
+static mz_uint64 write_buffer_memory(const zip_handle_t* handle) {
+    const write_buffer_t* buffer = handle->write_buffer;
+    if (!buffer) return 0;
+    return sizeof(write_buffer_t) + (buffer->data ? WRITE_BUFFER_SIZE : 0) + (buffer->spare ? WRITE_BUFFER_SIZE : 0);
+}
+
+// Preallocation
+//
+// A file writer that knows roughly how big the archive will be reserves the
+// space up front, so the file system can lay it out in one piece instead of
+// extending it write by write. On Linux posix_fallocate extends the file,
+// which finalize cuts back to the real size; Windows only sets the
+// allocation size. Elsewhere reserving is a no-op.
+#ifdef _WIN32
+#include <io.h>
+#elif defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static int file_reserve(FILE* file, mz_uint64 size) {
+#ifdef _WIN32
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = (LONGLONG)size;
+    return SetFileInformationByHandle((HANDLE)_get_osfhandle(_fileno(file)), FileAllocationInfo, &info, sizeof(info)) != 0;
+#elif defined(__linux__)
+    return posix_fallocate(fileno(file), 0, (off_t)size) == 0;
+#else
+    (void)file;
+    (void)size;
+    return 1;
+#endif
+}
+
+// Cut a preallocated file back to the bytes actually written. The file must
+// have been flushed.
+static int file_truncate(FILE* file, mz_uint64 size) {
+#if defined(__linux__)
+    return ftruncate(fileno(file), (off_t)size) == 0;
+#else
+    (void)file;
+    (void)size;
+    return 1;
+#endif
+}
+
+static mz_uint adaptive_step_flags(int step) {
+    mz_uint flags = tdefl_create_comp_flags_from_zip_params(adaptive_steps[step].level, -15, MZ_DEFAULT_STRATEGY);
+    return (flags & ~(mz_uint)TDEFL_MAX_PROBES_MASK) | (mz_uint)adaptive_steps[step].probes;
+}
+
+static double adaptive_estimate(const zip_handle_t* handle, int step) {
+    if (handle->adaptive_step_speed[step] > 0.0) return handle->adaptive_step_speed[step];
+    return handle->adaptive_speed_scale * adaptive_steps[step].relative_speed;
+}
+
+// Highest step the caller's level allows
+static int adaptive_max_step(int level) {
+    int max_step = 0;
+    for (int i = 0; i < ADAPTIVE_STEP_COUNT; i++) {
+        if (adaptive_steps[i].level <= level) max_step = i;
+    }
+    return max_step;
+}
+
+// Fold one deflate measurement into the controller and pick the next step
+static void adaptive_update(zip_handle_t* handle, int step, size_t bytes, mz_uint64 ns) {
+    if (!bytes || !ns) return;
+
+    double speed = (double)bytes * 1e9 / (double)ns;
+    double weight = bytes >= ADAPTIVE_FULL_WEIGHT_BYTES ? 1.0 : (double)bytes / ADAPTIVE_FULL_WEIGHT_BYTES;
+    double scale_sample = speed / adaptive_steps[step].relative_speed;
+
+    double* measured = &handle->adaptive_step_speed[step];
+    *measured = *measured > 0.0 ? *measured + (speed - *measured) * weight : speed;
+
+    double* scale = &handle->adaptive_speed_scale;
+    *scale = *scale > 0.0 ? *scale + (scale_sample - *scale) * weight : scale_sample;
+
+    // Pick the most thorough step expected to keep up with the target
+    int next = 0;
+    for (int i = ADAPTIVE_STEP_COUNT - 1; i > 0; i--) {
+        if (adaptive_estimate(handle, i) >= handle->adaptive_target) {
+            next = i;
+            break;
+        }
+    }
+
+    // Drop immediately when too slow, but only climb one step per entry
+    if (next > handle->adaptive_step + 1) next = handle->adaptive_step + 1;
+    handle->adaptive_step = next;
+}
+
+// Whether the entropy probe says the entry should be stored as is
+static int should_auto_store(const zip_handle_t* handle, const void* data, size_t data_length) {
+    return handle->auto_store_threshold > 0 && data_length >= ENTROPY_PROBE_MIN_SIZE &&
+           estimate_entropy(data, data_length) >= handle->auto_store_threshold;
+}
+
+// Encrypt the entry data (compressed, or stored when compressed_size is 0)
+// and add it as a WinZip AES entry. miniz only writes stored and deflated
+// entries, so the method, encryption flag and version needed are patched into
+// both headers after it has written them.
+static mz_bool write_encrypted_entry(zip_handle_t* handle, const char* filename, const void* data, size_t data_length, const void* compressed, size_t compressed_size, int level, size_t* stored_size) {
+    mz_zip_archive* archive = &handle->archive;
+    zip_aes_t* aes = handle->aes;
+    const void* payload = compressed_size ? compressed : data;
+    size_t payload_size = compressed_size ? compressed_size : data_length;
+
+    mz_uint8* encrypted = zip_aes_buffer(aes, payload_size + zip_aes_overhead(aes->strength));
+    if (!encrypted) return MZ_FALSE;
+    size_t encrypted_size = zip_aes_encrypt(aes, payload, payload_size, encrypted);
+    if (!encrypted_size) return MZ_FALSE;
+
+    // Vendor version, vendor ID "AE", strength and the real method
+    mz_uint8 extra[ZIP_AES_EXTRA_SIZE];
+    MZ_WRITE_LE16(extra, ZIP_AES_EXTRA_ID);
+    MZ_WRITE_LE16(extra + 2, ZIP_AES_EXTRA_SIZE - 4);
+    MZ_WRITE_LE16(extra + 4, aes->version);
+    extra[6] = 'A';
+    extra[7] = 'E';
+    extra[8] = (mz_uint8)aes->strength;
+    MZ_WRITE_LE16(extra + 9, compressed_size ? MZ_DEFLATED : 0);
+
+    // AE-2 leaves the CRC out so it can't leak anything about small entries
+    mz_uint64 start = stats_clock();
+    mz_uint32 crc = aes->version == 1 ? (mz_uint32)mz_crc32(MZ_CRC32_INIT, (const mz_uint8*)data, data_length) : 0;
+    stats_elapsed(&handle->stats.crc_ns, start);
+    mz_uint64 local_header_ofs = archive->m_archive_size + mz_zip_writer_compute_padding_needed_for_file_alignment(archive);
+
+    if (level < 1) level = 1;
+    if (level > MZ_UBER_COMPRESSION) level = MZ_UBER_COMPRESSION;
+    if (!mz_zip_writer_add_mem_ex_v2(archive, filename, encrypted, encrypted_size, NULL, 0, (mz_uint)level | MZ_ZIP_FLAG_COMPRESSED_DATA,
+                                     data_length, crc, NULL, (const char*)extra, ZIP_AES_EXTRA_SIZE, (const char*)extra, ZIP_AES_EXTRA_SIZE)) {
+        return MZ_FALSE;
+    }
+
+    mz_uint8* central = (mz_uint8*)mz_zip_get_cdh(archive, archive->m_total_files - 1);
+    mz_uint16 bit_flags = (mz_uint16)(MZ_READ_LE16(central + MZ_ZIP_CDH_BIT_FLAG_OFS) | MZ_ZIP_GENERAL_PURPOSE_BIT_FLAG_IS_ENCRYPTED);
+    MZ_WRITE_LE16(central + MZ_ZIP_CDH_VERSION_NEEDED_OFS, ZIP_AES_VERSION_NEEDED);
+    MZ_WRITE_LE16(central + MZ_ZIP_CDH_BIT_FLAG_OFS, bit_flags);
+    MZ_WRITE_LE16(central + MZ_ZIP_CDH_METHOD_OFS, ZIP_METHOD_AES);
+
+    // Version needed, flags and method sit next to each other in the local header
+    mz_uint8 local[6];
+    MZ_WRITE_LE16(local, ZIP_AES_VERSION_NEEDED);
+    MZ_WRITE_LE16(local + 2, bit_flags);
+    MZ_WRITE_LE16(local + 4, ZIP_METHOD_AES);
+    if (archive->m_pWrite(archive->m_pIO_opaque, local_header_ofs + MZ_ZIP_LDH_VERSION_NEEDED_OFS, local, sizeof(local)) != sizeof(local)) return MZ_FALSE;
+
+    // Empty entries get no data descriptor, so their local header needs the
+    // size of the salt, verifier and MAC that follow it
+    if (!(bit_flags & MZ_ZIP_LDH_BIT_FLAG_HAS_LOCATOR)) {
+        mz_uint8 sizes[4];
+        MZ_WRITE_LE32(sizes, encrypted_size);
+        if (archive->m_pWrite(archive->m_pIO_opaque, local_header_ofs + MZ_ZIP_LDH_COMPRESSED_SIZE_OFS, sizes, sizeof(sizes)) != sizeof(sizes)) return MZ_FALSE;
+    }
+
+    *stored_size = encrypted_size;
+    return MZ_TRUE;
+}
+
+// Stored entries can be padded so their data starts on an alignment boundary
+// and can be used in place. The padding is an extra field in the local
+// header only, in the format zipalign uses: the alignment as a 16-bit value
+// followed by zeros.
+#define ZIP_ALIGN_EXTRA_ID 0xD935
+#define ZIP_ALIGN_EXTRA_MIN_SIZE 6
+#define ZIP_MAX_ALIGNMENT 32768
+
+// Build the padding extra field for a stored entry of data_length bytes
+// about to be written, after other_extra_length bytes of other local extra
+// fields, returning its size
+static size_t build_align_extra(zip_handle_t* handle, int alignment, size_t filename_length, size_t other_extra_length, size_t data_length, mz_uint8* extra) {
+    mz_zip_archive* archive = &handle->archive;
+    mz_uint64 header_ofs = archive->m_archive_size;
+
+    // miniz adds a zip64 field to the local header of entries that are big
+    // or start past 4GB, once the archive has switched to zip64
+    int zip64 = archive->m_pState->m_zip64 || archive->m_total_files == MZ_UINT16_MAX || data_length > MZ_UINT32_MAX || header_ofs >= MZ_UINT32_MAX;
+    mz_uint64 zip64_size = 0;
+    if (zip64 && (data_length >= MZ_UINT32_MAX || header_ofs >= MZ_UINT32_MAX)) {
+        zip64_size = 4 + (data_length >= MZ_UINT32_MAX ? 16 : 0) + (header_ofs >= MZ_UINT32_MAX ? 8 : 0);
+    }
+
+    mz_uint64 data_ofs = archive->m_pState->m_file_archive_start_ofs + header_ofs + MZ_ZIP_LOCAL_DIR_HEADER_SIZE + filename_length + zip64_size + other_extra_length + ZIP_ALIGN_EXTRA_MIN_SIZE;
+    size_t padding = (size_t)((alignment - data_ofs % alignment) % alignment);
+
+    MZ_WRITE_LE16(extra, ZIP_ALIGN_EXTRA_ID);
+    MZ_WRITE_LE16(extra + 2, 2 + padding);
+    MZ_WRITE_LE16(extra + 4, alignment);
+    memset(extra + ZIP_ALIGN_EXTRA_MIN_SIZE, 0, padding);
+    return ZIP_ALIGN_EXTRA_MIN_SIZE + padding;
+}
+
+// Write an entry from data compressed elsewhere, or store it when
+// compressed_size is 0. The size of the entry data as written is returned
+// through stored_size.
+static mz_bool write_entry(zip_handle_t* handle, const char* filename, const void* data, size_t data_length, const void* compressed, size_t compressed_size, int level, size_t* stored_size) {
+    // Directories carry no data and stay unencrypted
+    size_t filename_length = strlen(filename);
+    if (handle->aes && !(filename_length && filename[filename_length - 1] == '/')) {
+        return write_encrypted_entry(handle, filename, data, data_length, compressed, compressed_size, level, stored_size);
+    }
+
+    if (compressed_size == 0) {
+        *stored_size = data_length;
+        // An entry of exactly 4GB - 1 bytes may or may not get a zip64 field,
+        // so it is left unaligned
+        if (handle->alignment && data_length && data_length != MZ_UINT32_MAX && filename_length && filename[filename_length - 1] != '/') {
+            mz_uint8 extra[ZIP_ALIGN_EXTRA_MIN_SIZE + ZIP_MAX_ALIGNMENT];
+            size_t extra_size = build_align_extra(handle, handle->alignment, filename_length, 0, data_length, extra);
+            return mz_zip_writer_add_mem_ex_v2(&handle->archive, filename, data, data_length, NULL, 0, 0, 0, 0, NULL, (const char*)extra, (mz_uint)extra_size, NULL, 0);
+        }
+        return mz_zip_writer_add_mem_ex_v2(&handle->archive, filename, data, data_length, NULL, 0, 0, 0, 0, NULL, NULL, 0, NULL, 0);
+    }
+
+    *stored_size = compressed_size;
+
+    // miniz only knows levels up to uber, which is what the header flags of
+    // optimal-parse entries should say anyway
+    if (level > MZ_UBER_COMPRESSION) level = MZ_UBER_COMPRESSION;
+
+    mz_uint64 start = stats_clock();
+    mz_uint32 crc = (mz_uint32)mz_crc32(MZ_CRC32_INIT, (const mz_uint8*)data, data_length);
+    stats_elapsed(&handle->stats.crc_ns, start);
+    return mz_zip_writer_add_mem_ex_v2(&handle->archive, filename, compressed, compressed_size, NULL, 0,
+                                       (mz_uint)level | MZ_ZIP_FLAG_COMPRESSED_DATA, data_length, crc, NULL, NULL, 0, NULL, 0);
+}
+
+// Deflate with tdefl, CODEC_CHUNK_SIZE bytes of input at a time, reporting
+// progress between chunks. Returns the compressed size, or 0 when the output
+// does not fit in dst_cap or the operation was cancelled.
+static size_t deflate_chunked(zip_handle_t* handle, const void* src, size_t src_len, void* dst, size_t dst_cap, mz_uint tdefl_flags) {
+    tdefl_compressor* comp = (tdefl_compressor*)malloc(sizeof(tdefl_compressor));
+    tdefl_status status = TDEFL_STATUS_BAD_PARAM;
+    size_t in_pos = 0;
+    size_t out_pos = 0;
+    if (!comp) return 0;
+    handle->stats.allocations++;
+
+    if (tdefl_init(comp, NULL, NULL, (int)tdefl_flags) == TDEFL_STATUS_OKAY) {
+        for (;;) {
+            size_t in_size = MZ_MIN(src_len - in_pos, CODEC_CHUNK_SIZE);
+            size_t out_size = dst_cap - out_pos;
+            tdefl_flush flush = in_pos + in_size == src_len ? TDEFL_FINISH : TDEFL_NO_FLUSH;
+            status = tdefl_compress(comp, (const mz_uint8*)src + in_pos, &in_size, (mz_uint8*)dst + out_pos, &out_size, flush);
+            in_pos += in_size;
+            out_pos += out_size;
+
+            // Done, failed, or out of room because the data doesn't shrink
+            if (status != TDEFL_STATUS_OKAY || out_pos == dst_cap || (!in_size && !out_size)) break;
+            if (!progress_step(handle, in_size, 0)) break;
+        }
+    }
+
+    free(comp);
+    return status == TDEFL_STATUS_DONE ? out_pos : 0;
+}
+
+// Compress a whole buffer with the handle's backend (or the optimal-parse
+// encoder) and add it as a deflated entry, falling back to storing when the
+// data does not shrink. The size of the entry data as written is returned
+// through stored_size.
+static mz_bool add_entry(zip_handle_t* handle, const char* filename, const void* data, size_t data_length, int level, mz_uint tdefl_flags, int adaptive, size_t* stored_size) {
+    // Skip compression entirely for data the probe considers incompressible,
+    // and send tiny and uncompressed entries straight through miniz
+    if (level <= 0 || data_length <= 3 || should_auto_store(handle, data, data_length)) {
+        return write_entry(handle, filename, data, data_length, NULL, 0, 0, stored_size);
+    }
+
+    // Output that is not smaller than the input is not worth keeping
+    void* compressed = ensure_scratch(handle, data_length);
+    if (!compressed) return MZ_FALSE;
+
+    int index = (int)handle->archive.m_total_files;
+    TRACE(TRACE_CODEC_START, TRACE_CODEC_DEFLATE, handle->id, index, NULL, data_length, 0);
+    mz_uint64 start = monotonic_ns();
+    // Large entries deflate in chunks through tdefl while a progress
+    // callback is set, so it gets to run (and cancel) in between
+    size_t compressed_size = level == ZIP_LEVEL_OPTIMAL ? optimal_deflate(data, data_length, compressed, data_length - 1, OPT_DEFAULT_ITERATIONS)
+                             : handle->progress && data_length > CODEC_CHUNK_SIZE ? deflate_chunked(handle, data, data_length, compressed, data_length - 1, tdefl_flags)
+                                                                                  : handle->codec->deflate(&handle->codec_state, data, data_length, compressed, data_length - 1, level, tdefl_flags);
+    mz_uint64 elapsed = monotonic_ns() - start;
+    TRACE(TRACE_CODEC_DONE, TRACE_CODEC_DEFLATE, handle->id, index, NULL, data_length, compressed_size);
+    if (handle->cancelled) return MZ_FALSE;
+
+    handle->stats.deflate_ns += elapsed;
+    if (adaptive) adaptive_update(handle, handle->adaptive_step, data_length, elapsed);
+
+    return write_entry(handle, filename, data, data_length, compressed, compressed_size, level, stored_size);
+}
+
+// Offset of an entry's data in the archive, past its local header, or 0 if
+// the header is unreadable or the data runs past the end of the archive
+static mz_uint64 entry_data_offset(zip_handle_t* handle, const mz_zip_archive_file_stat* file_stat) {
+    mz_zip_archive* archive = &handle->archive;
+    mz_uint32 local_header_u32[(MZ_ZIP_LOCAL_DIR_HEADER_SIZE + sizeof(mz_uint32) - 1) / sizeof(mz_uint32)];
+    mz_uint8* local_header = (mz_uint8*)local_header_u32;
+
+    mz_uint64 offset = file_stat->m_local_header_ofs;
+    if (archive->m_pRead(archive->m_pIO_opaque, offset, local_header, MZ_ZIP_LOCAL_DIR_HEADER_SIZE) != MZ_ZIP_LOCAL_DIR_HEADER_SIZE) return 0;
+    if (MZ_READ_LE32(local_header) != MZ_ZIP_LOCAL_DIR_HEADER_SIG) return 0;
+
+    offset += (mz_uint64)MZ_ZIP_LOCAL_DIR_HEADER_SIZE + MZ_READ_LE16(local_header + MZ_ZIP_LDH_FILENAME_LEN_OFS) + MZ_READ_LE16(local_header + MZ_ZIP_LDH_EXTRA_LEN_OFS);
+    if (offset + file_stat->m_comp_size > archive->m_archive_size) return 0;
+    return offset;
+}
+
+// Locate the compressed bytes of an entry, reading them into the handle's
+// scratch buffer unless the archive already lives in memory
+static const mz_uint8* read_entry_data(zip_handle_t* handle, const mz_zip_archive_file_stat* file_stat) {
+    mz_zip_archive* archive = &handle->archive;
+    mz_uint64 offset = entry_data_offset(handle, file_stat);
+    if (!offset) return NULL;
+
+    if (archive->m_pState->m_pMem) {
+        handle->stats.bytes_read += file_stat->m_comp_size;
+        return (const mz_uint8*)archive->m_pState->m_pMem + offset;
+    }
+
+    void* buffer = ensure_scratch(handle, (size_t)file_stat->m_comp_size);
+    if (!buffer) return NULL;
+
+    if (archive->m_pRead(archive->m_pIO_opaque, offset, buffer, (size_t)file_stat->m_comp_size) != file_stat->m_comp_size) return NULL;
+    return (const mz_uint8*)buffer;
+}
+
+// miniz only accepts stored and deflated entries, Deflate64 is decoded here.
+// Patched data (bit 5) needs the original file and stays unsupported.
+static int entry_is_supported(const mz_zip_archive_file_stat* file_stat) {
+    if (file_stat->m_is_supported) return 1;
+    return file_stat->m_method == ZIP_METHOD_DEFLATE64 && !file_stat->m_is_encrypted && !(file_stat->m_bit_flag & MZ_ZIP_GENERAL_PURPOSE_BIT_FLAG_COMPRESSED_PATCH_FLAG);
+}
+
+// WinZip AES settings of an entry, from its 0x9901 extra field
+typedef struct {
+    int version;
+    int strength;
+    int method;
+} aes_entry_t;
+
+static int read_aes_extra(zip_handle_t* handle, int file_index, aes_entry_t* entry) {
+    const mz_uint8* central = mz_zip_get_cdh(&handle->archive, (mz_uint)file_index);
+    if (!central) return 0;
+
+    const mz_uint8* extra = central + MZ_ZIP_CENTRAL_DIR_HEADER_SIZE + MZ_READ_LE16(central + MZ_ZIP_CDH_FILENAME_LEN_OFS);
+    size_t remaining = MZ_READ_LE16(central + MZ_ZIP_CDH_EXTRA_LEN_OFS);
+
+    while (remaining >= 4) {
+        mz_uint16 id = MZ_READ_LE16(extra);
+        size_t size = MZ_READ_LE16(extra + 2);
+        if (size > remaining - 4) return 0;
+
+        if (id == ZIP_AES_EXTRA_ID && size >= ZIP_AES_EXTRA_SIZE - 4 && extra[6] == 'A' && extra[7] == 'E') {
+            entry->version = MZ_READ_LE16(extra + 4);
+            entry->strength = extra[8];
+            entry->method = MZ_READ_LE16(extra + 9);
+            return (entry->version == 1 || entry->version == 2) && entry->strength >= 1 && entry->strength <= 3;
+        }
+
+        extra += 4 + size;
+        remaining -= 4 + size;
+    }
+    return 0;
+}
+
+// The budget an entry would exceed if extracted now, or LIMIT_NONE
+static int entry_over_limit(const zip_handle_t* handle, const mz_zip_archive_file_stat* file_stat) {
+    const extract_limits_t* limits = &handle->limits;
+    mz_uint64 size = file_stat->m_uncomp_size;
+
+    if (limits->max_entry_size && size > limits->max_entry_size) return LIMIT_ENTRY_SIZE;
+    if (limits->max_total_size && size > limits->max_total_size - MZ_MIN(limits->extracted, limits->max_total_size)) return LIMIT_TOTAL_SIZE;
+    if (limits->max_ratio > 0.0 && size && (double)size > limits->max_ratio * (double)file_stat->m_comp_size) return LIMIT_RATIO;
+    if (limits->deadline_ns && monotonic_ns() >= limits->deadline_ns) return LIMIT_DEADLINE;
+    return LIMIT_NONE;
+}
+
+// Inflate raw deflate data with tinfl, CODEC_CHUNK_SIZE bytes of output at a
+// time, reporting progress and giving up once the deadline passes or the
+// operation is cancelled. Returns 1 only if exactly dst_len bytes were produced.
+static int inflate_chunked(zip_handle_t* handle, const void* src, size_t src_len, void* dst, size_t dst_len) {
+    tinfl_decompressor inflator;
+    size_t in_pos = 0;
+    size_t out_pos = 0;
+
+    tinfl_init(&inflator);
+    for (;;) {
+        size_t in_size = src_len - in_pos;
+        size_t out_size = MZ_MIN(dst_len - out_pos, CODEC_CHUNK_SIZE);
+        tinfl_status status = tinfl_decompress(&inflator, (const mz_uint8*)src + in_pos, &in_size, (mz_uint8*)dst, (mz_uint8*)dst + out_pos, &out_size, TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+        in_pos += in_size;
+        out_pos += out_size;
+
+        if (status == TINFL_STATUS_DONE) return out_pos == dst_len;
+        // More output than the entry declared, or a broken stream
+        if (status != TINFL_STATUS_HAS_MORE_OUTPUT || out_pos == dst_len) return 0;
+        if (handle->limits.deadline_ns && monotonic_ns() >= handle->limits.deadline_ns) {
+            handle->limits.violation = LIMIT_DEADLINE;
+            return 0;
+        }
+        if (!progress_step(handle, out_size, 0)) return 0;
+    }
+}
+
+// Finish the progress of an entry of `size` bytes, part of which the codec
+// loops may have counted already since the count was `before`
+static void progress_entry(zip_handle_t* handle, mz_uint64 before, mz_uint64 size) {
+    mz_uint64 counted = handle->progress_bytes - before;
+    progress_step(handle, (size_t)(size > counted ? size - counted : 0), 1);
+}
+
+// Inflate an entry into a caller-provided buffer with the handle's backend,
+// decrypting WinZip AES entries first. crc_mode is CRC_VERIFY, CRC_SKIP or
+// CRC_DEFER to check the output on the background thread.
+static mz_bool extract_entry(zip_handle_t* handle, int file_index, void* output_buffer, size_t buffer_size, mz_zip_archive_file_stat* file_stat, int crc_mode) {
+    handle->limits.violation = LIMIT_NONE;
+    if (!mz_zip_reader_file_stat(&handle->archive, file_index, file_stat)) return MZ_FALSE;
+    if ((handle->limits.violation = entry_over_limit(handle, file_stat))) return MZ_FALSE;
+
+    // A directory or zero length file
+    if (file_stat->m_is_directory || !file_stat->m_uncomp_size) {
+        handle->stats.entries++;
+        return MZ_TRUE;
+    }
+
+    aes_entry_t aes = {0, 0, (int)file_stat->m_method};
+    if (file_stat->m_method == ZIP_METHOD_AES) {
+        // Once decrypted the data is an ordinary stored, deflated or Deflate64 stream
+        if (!handle->aes || !read_aes_extra(handle, file_index, &aes)) return MZ_FALSE;
+        if (aes.method != 0 && aes.method != MZ_DEFLATED && aes.method != ZIP_METHOD_DEFLATE64) return MZ_FALSE;
+    } else if (!entry_is_supported(file_stat)) {
+        return MZ_FALSE;
+    }
+    if (buffer_size < file_stat->m_uncomp_size) return MZ_FALSE;
+
+    const mz_uint8* source = read_entry_data(handle, file_stat);
+    if (!source) return MZ_FALSE;
+    size_t source_size = (size_t)file_stat->m_comp_size;
+
+    if (aes.version) {
+        if (source_size < zip_aes_overhead(aes.strength)) return MZ_FALSE;
+        source_size -= zip_aes_overhead(aes.strength);
+        if (aes.method == 0 && source_size != file_stat->m_uncomp_size) return MZ_FALSE;
+
+        // Stored data decrypts straight into the output. Compressed data goes
+        // to the scratch buffer, in place when it was read from a file.
+        mz_uint8* plain = aes.method == 0 ? (mz_uint8*)output_buffer
+                          : source == handle->scratch ? (mz_uint8*)handle->scratch
+                                                      : (mz_uint8*)ensure_scratch(handle, source_size);
+        if (!plain || !zip_aes_decrypt(handle->aes, aes.strength, source, (size_t)file_stat->m_comp_size, plain)) return MZ_FALSE;
+        source = plain;
+    }
+
+    TRACE(TRACE_CODEC_START, TRACE_CODEC_INFLATE, handle->id, file_index, NULL, source_size, 0);
+    mz_uint64 start = stats_clock();
+    mz_bool inflated = MZ_TRUE;
+    if (aes.method == 0) {
+        if (source_size != file_stat->m_uncomp_size) inflated = MZ_FALSE;
+        else if (source != output_buffer) memcpy(output_buffer, source, source_size);
+    } else if (aes.method == ZIP_METHOD_DEFLATE64) {
+        inflated = inflate64(source, source_size, output_buffer, (size_t)file_stat->m_uncomp_size);
+    } else if (handle->limits.deadline_ns || (handle->progress && file_stat->m_uncomp_size > CODEC_CHUNK_SIZE)) {
+        // Single-shot backends can't be interrupted, so a deadline or a
+        // progress callback inflates through tinfl
+        inflated = inflate_chunked(handle, source, source_size, output_buffer, (size_t)file_stat->m_uncomp_size);
+    } else {
+        inflated = handle->codec->inflate(&handle->codec_state, source, source_size, output_buffer, (size_t)file_stat->m_uncomp_size);
+    }
+    stats_elapsed(&handle->stats.inflate_ns, start);
+    TRACE(TRACE_CODEC_DONE, TRACE_CODEC_INFLATE, handle->id, file_index, NULL, source_size, inflated ? file_stat->m_uncomp_size : 0);
+    if (!inflated) return MZ_FALSE;
+
+    handle->stats.entries++;
+    handle->stats.uncompressed_bytes += file_stat->m_uncomp_size;
+    handle->stats.compressed_bytes += file_stat->m_comp_size;
+    handle->limits.extracted += file_stat->m_uncomp_size;
+
+    // AE-2 entries have no CRC, their MAC already authenticated the data
+    if (aes.version == 2 || crc_mode == CRC_SKIP) return MZ_TRUE;
+    if (crc_mode == CRC_DEFER && crc_queue_push(handle, file_index, output_buffer, (size_t)file_stat->m_uncomp_size, file_stat->m_crc32)) return MZ_TRUE;
+
+    TRACE(TRACE_CODEC_START, TRACE_CODEC_CRC, handle->id, file_index, NULL, file_stat->m_uncomp_size, 0);
+    start = stats_clock();
+    mz_bool crc_ok = mz_crc32(MZ_CRC32_INIT, (const mz_uint8*)output_buffer, (size_t)file_stat->m_uncomp_size) == file_stat->m_crc32;
+    stats_elapsed(&handle->stats.crc_ns, start);
+    TRACE(TRACE_CODEC_DONE, TRACE_CODEC_CRC, handle->id, file_index, NULL, file_stat->m_uncomp_size, crc_ok);
+    return crc_ok;
+}
+
+// Extract an entry into a new heap block, released with free_extracted_data
+static void* extract_entry_to_heap(zip_handle_t* handle, int file_index, size_t* size) {
+    mz_zip_archive_file_stat file_stat;
+    if (!mz_zip_reader_file_stat(&handle->archive, file_index, &file_stat)) return NULL;
+    if ((mz_uint64)(size_t)file_stat.m_uncomp_size != file_stat.m_uncomp_size) return NULL;
+    if ((handle->limits.violation = entry_over_limit(handle, &file_stat))) return NULL;
+
+    // One spare byte so empty entries still get a block to hand back
+    void* data = malloc((size_t)file_stat.m_uncomp_size + 1);
+    if (!data) return NULL;
+    handle->stats.allocations++;
+
+    mz_uint64 progress_before = handle->progress_bytes;
+    if (!extract_entry(handle, file_index, data, (size_t)file_stat.m_uncomp_size, &file_stat, CRC_VERIFY)) {
+        free(data);
+        return NULL;
+    }
+    progress_entry(handle, progress_before, file_stat.m_uncomp_size);
+
+    if (size) *size = (size_t)file_stat.m_uncomp_size;
+    return data;
+}
+
+// Create a new zip archive
+int create_zip(const char* filename) {
+    int handle_id = find_free_handle_slot();
+    if (handle_id < 0) return -1;
+    
+    mz_uint64 start = op_start(LATENCY_OPEN, handle_id, -1, filename);
+    zip_handle_t* handle = alloc_handle(1);
+    mz_bool status = handle && mz_zip_writer_init_file(&handle->archive, filename, 0);
+    
+    handle_id = open_done(handle_id, handle, status, start);
+    if (handle_id >= 0) write_buffer_attach(zip_handles[handle_id]);
+    return handle_id;
+}
+
+// Pad stored entries added from now on so their data starts on a multiple
+// of alignment (a power of two up to ZIP_MAX_ALIGNMENT), 0 turns it off
+int set_alignment(int handle_id, int alignment) {
+    if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || !zip_handles[handle_id]->is_writer) {
+        return 0;
+    }
+    if (alignment < 0 || alignment > ZIP_MAX_ALIGNMENT || (alignment & (alignment - 1))) return 0;
+    
+    zip_handles[handle_id]->alignment = alignment;
+    return 1;
+}
+
+// Reserve room for the archive a writer is about to write: disk space for a
+// file archive (see file_reserve), heap capacity for a memory archive
+int reserve_zip_space(int handle_id, double bytes) {
+    if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || !zip_handles[handle_id]->is_writer) {
+        return 0;
+    }
+    if (!(bytes > 0) || bytes >= (double)SIZE_MAX) return 0;
+    
+    zip_handle_t* handle = zip_handles[handle_id];
+    mz_zip_internal_state* state = handle->archive.m_pState;
+    if (state->m_pFile) {
+        if (!file_reserve(state->m_pFile, state->m_file_archive_start_ofs + (mz_uint64)bytes)) return 0;
+        handle->reserved = 1;
+        return 1;
+    }
+    
+    // Grow the heap block once instead of doubling it up to this size
+    if ((size_t)bytes <= state->m_mem_capacity) return 1;
+    void* block = handle->archive.m_pRealloc(handle->archive.m_pAlloc_opaque, state->m_pMem, 1, (size_t)bytes);
+    if (!block) return 0;
+    state->m_pMem = block;
+    state->m_mem_capacity = (size_t)bytes;
+    return 1;
+}
+
+// Add a file to zip archive
+// strategy is one of MZ_DEFAULT_STRATEGY..MZ_FIXED, probes overrides the level's
+// match finder probe count (0 keeps it), greedy is 1/0 to force greedy/lazy
+// parsing or -1 to keep the level's choice
+int add_file_to_zip(int handle_id, const char* filename, const void* data, size_t data_length, int compression_level, int strategy, int probes, int greedy) {
+    if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || !zip_handles[handle_id]->is_writer) {
+        return 0;
+    }
+    
+    // Negative levels select the default, anything above the optimal parse is invalid
+    if (compression_level < 0) compression_level = MZ_DEFAULT_LEVEL;
+    if (compression_level > ZIP_LEVEL_OPTIMAL) return 0;
+    if (strategy < MZ_DEFAULT_STRATEGY || strategy > MZ_FIXED) return 0;
+    if (probes < 0 || probes > TDEFL_MAX_PROBES_MASK) return 0;
+    if (greedy < -1 || greedy > 1) return 0;
+    
+    zip_handle_t* handle = zip_handles[handle_id];
+    mz_uint tdefl_flags = tdefl_create_comp_flags_from_zip_params(compression_level, -15, strategy);
+    
+    // Huffman-only works by dropping every probe, so a probe count can't apply to it
+    if (probes > 0 && strategy != MZ_HUFFMAN_ONLY) {
+        tdefl_flags = (tdefl_flags & ~TDEFL_MAX_PROBES_MASK) | (mz_uint)probes;
+    }
+    if (greedy == 1) tdefl_flags |= TDEFL_GREEDY_PARSING_FLAG;
+    if (greedy == 0) tdefl_flags &= ~TDEFL_GREEDY_PARSING_FLAG;
+    
+    // The adaptive controller picks the effort, the caller's level is the ceiling.
+    // Explicit tuning or the optimal parse takes the entry out of its hands.
+    int tuned = strategy != MZ_DEFAULT_STRATEGY || probes > 0 || greedy >= 0 || compression_level == ZIP_LEVEL_OPTIMAL;
+    int adaptive = handle->adaptive_target > 0.0 && compression_level > 0 && !tuned;
+    int max_step = adaptive_max_step(compression_level);
+    if (adaptive) {
+        if (handle->adaptive_step > max_step) handle->adaptive_step = max_step;
+        
+        compression_level = adaptive_steps[handle->adaptive_step].level;
+        tdefl_flags = adaptive_step_flags(handle->adaptive_step);
+    }
+    
+    int index = (int)handle->archive.m_total_files;
+    mz_uint64 start = op_start(LATENCY_ADD, handle_id, index, filename);
+    mz_uint64 progress_before = handle->progress_bytes;
+    size_t stored_size = 0;
+    
+    mz_bool status = add_entry(handle, filename, data, data_length, compression_level, tdefl_flags, adaptive, &stored_size);
+    if (adaptive && handle->adaptive_step > max_step) handle->adaptive_step = max_step;
+    
+    if (status) {
+        handle->stats.entries++;
+        handle->stats.uncompressed_bytes += data_length;
+        handle->stats.compressed_bytes += stored_size;
+        progress_entry(handle, progress_before, data_length);
+    }
+    handle->add_ns += monotonic_ns() - start;
+    op_done(LATENCY_ADD, handle_id, index, start, stored_size, status);
+    
+    return status ? 1 : 0;
+}
+
+// Copy the extra fields of a header except zip64 and padding fields, which
+// a re-laid-out copy of the entry writes afresh. Returns the size copied, or
+// -1 when the fields are malformed.
+static int copy_extra_fields(const mz_uint8* src, size_t src_length, mz_uint8* dst) {
+    size_t length = 0;
+    while (src_length) {
+        if (src_length < 4) return -1;
+        size_t field_size = 4 + MZ_READ_LE16(src + 2);
+        if (field_size > src_length) return -1;
+
+        mz_uint16 id = MZ_READ_LE16(src);
+        if (id != MZ_ZIP64_EXTENDED_INFORMATION_FIELD_HEADER_ID && id != ZIP_ALIGN_EXTRA_ID) {
+            memcpy(dst + length, src, field_size);
+            length += field_size;
+        }
+        src += field_size;
+        src_length -= field_size;
+    }
+    return (int)length;
+}
+
+// Alignment a padding field among the extra fields claims, 0 without one
+static int claimed_alignment(const mz_uint8* extra, size_t extra_length) {
+    while (extra_length >= 4) {
+        size_t field_size = 4 + MZ_READ_LE16(extra + 2);
+        if (field_size > extra_length) break;
+        if (MZ_READ_LE16(extra) == ZIP_ALIGN_EXTRA_ID && field_size >= ZIP_ALIGN_EXTRA_MIN_SIZE) return MZ_READ_LE16(extra + 4);
+        extra += field_size;
+        extra_length -= field_size;
+    }
+    return 0;
+}
+
+// Copy a stored, unencrypted entry under a new local header whose padding
+// field aligns its data to the larger of the writer's alignment and the one
+// the source claimed, dropping a padding field that would no longer hold.
+// Returns -1 for entries it leaves to miniz's raw copy: those with nothing
+// to align, or big or far enough out to need zip64 fields.
+static int copy_stored_entry(zip_handle_t* handle, zip_handle_t* source, int file_index, const mz_zip_archive_file_stat* file_stat) {
+    mz_zip_archive* archive = &handle->archive;
+    mz_zip_archive* source_archive = &source->archive;
+    const mz_uint8* central = mz_zip_get_cdh(source_archive, (mz_uint)file_index);
+    if (!central || file_stat->m_is_directory || !file_stat->m_comp_size) return -1;
+    if (file_stat->m_comp_size >= MZ_UINT32_MAX || file_stat->m_local_header_ofs >= MZ_UINT32_MAX) return -1;
+    if (!archive->m_pState->m_zip64 && archive->m_total_files == MZ_UINT16_MAX) return -1;
+
+    mz_uint8 local_header[MZ_ZIP_LOCAL_DIR_HEADER_SIZE];
+    mz_uint64 src_ofs = file_stat->m_local_header_ofs;
+    if (source_archive->m_pRead(source_archive->m_pIO_opaque, src_ofs, local_header, MZ_ZIP_LOCAL_DIR_HEADER_SIZE) != MZ_ZIP_LOCAL_DIR_HEADER_SIZE) return 0;
+    if (MZ_READ_LE32(local_header) != MZ_ZIP_LOCAL_DIR_HEADER_SIG) return 0;
+
+    size_t name_length = MZ_READ_LE16(central + MZ_ZIP_CDH_FILENAME_LEN_OFS);
+    size_t central_extra_length = MZ_READ_LE16(central + MZ_ZIP_CDH_EXTRA_LEN_OFS);
+    size_t comment_length = MZ_READ_LE16(central + MZ_ZIP_CDH_COMMENT_LEN_OFS);
+    size_t local_name_length = MZ_READ_LE16(local_header + MZ_ZIP_LDH_FILENAME_LEN_OFS);
+    size_t local_extra_length = MZ_READ_LE16(local_header + MZ_ZIP_LDH_EXTRA_LEN_OFS);
+
+    // Source local extra fields, then the copies of both headers' fields
+    // and a padding field of up to ZIP_MAX_ALIGNMENT bytes
+    mz_uint8* buffer = (mz_uint8*)ensure_scratch(handle, 3 * 65536 + ZIP_ALIGN_EXTRA_MIN_SIZE + ZIP_MAX_ALIGNMENT);
+    if (!buffer) return 0;
+    mz_uint8* local_extra = buffer + 65536;
+    mz_uint8* central_extra = buffer + 2 * 65536;
+    if (source_archive->m_pRead(source_archive->m_pIO_opaque, src_ofs + MZ_ZIP_LOCAL_DIR_HEADER_SIZE + local_name_length, buffer, local_extra_length) != local_extra_length) return 0;
+
+    int alignment = claimed_alignment(buffer, local_extra_length);
+    if (alignment > ZIP_MAX_ALIGNMENT || (alignment & (alignment - 1))) alignment = 0;
+    if (handle->alignment > alignment) alignment = handle->alignment;
+    if (!alignment) return -1;
+
+    int kept_local = copy_extra_fields(buffer, local_extra_length, local_extra);
+    int kept_central = copy_extra_fields(central + MZ_ZIP_CENTRAL_DIR_HEADER_SIZE + name_length, central_extra_length, central_extra);
+    if (kept_local < 0 || kept_central < 0) return 0;
+
+    mz_uint64 header_ofs = archive->m_archive_size + mz_zip_writer_compute_padding_needed_for_file_alignment(archive);
+    if (header_ofs >= MZ_UINT32_MAX) return -1;
+    size_t align_length = build_align_extra(handle, alignment, name_length, (size_t)kept_local, (size_t)file_stat->m_comp_size, local_extra + kept_local);
+    size_t extra_length = (size_t)kept_local + align_length;
+    if (extra_length > 65535) return -1;
+
+    // The sizes are known, so the copy has them in its local header instead
+    // of a data descriptor
+    mz_uint16 bit_flags = (mz_uint16)(MZ_READ_LE16(central + MZ_ZIP_CDH_BIT_FLAG_OFS) & ~MZ_ZIP_LDH_BIT_FLAG_HAS_LOCATOR);
+    mz_uint16 dos_time = MZ_READ_LE16(central + MZ_ZIP_CDH_FILE_TIME_OFS);
+    mz_uint16 dos_date = MZ_READ_LE16(central + MZ_ZIP_CDH_FILE_DATE_OFS);
+    mz_uint8 new_header[MZ_ZIP_LOCAL_DIR_HEADER_SIZE];
+    mz_zip_writer_create_local_dir_header(archive, new_header, (mz_uint16)name_length, (mz_uint16)extra_length, file_stat->m_uncomp_size,
+                                          file_stat->m_comp_size, file_stat->m_crc32, 0, bit_flags, dos_time, dos_date);
+
+    if (!mz_zip_writer_write_zeros(archive, archive->m_archive_size, (mz_uint32)(header_ofs - archive->m_archive_size))) return 0;
+    mz_uint64 dst_ofs = header_ofs;
+    if (archive->m_pWrite(archive->m_pIO_opaque, dst_ofs, new_header, MZ_ZIP_LOCAL_DIR_HEADER_SIZE) != MZ_ZIP_LOCAL_DIR_HEADER_SIZE) return 0;
+    dst_ofs += MZ_ZIP_LOCAL_DIR_HEADER_SIZE;
+    if (archive->m_pWrite(archive->m_pIO_opaque, dst_ofs, central + MZ_ZIP_CENTRAL_DIR_HEADER_SIZE, name_length) != name_length) return 0;
+    dst_ofs += name_length;
+    if (archive->m_pWrite(archive->m_pIO_opaque, dst_ofs, local_extra, extra_length) != extra_length) return 0;
+    dst_ofs += extra_length;
+
+    // The data goes through the start of the scratch buffer, whose local
+    // extra fields are no longer needed
+    src_ofs += MZ_ZIP_LOCAL_DIR_HEADER_SIZE + local_name_length + local_extra_length;
+    mz_uint64 remaining = file_stat->m_comp_size;
+    while (remaining) {
+        size_t n = (size_t)MZ_MIN(remaining, (mz_uint64)65536);
+        if (source_archive->m_pRead(source_archive->m_pIO_opaque, src_ofs, buffer, n) != n) return 0;
+        if (archive->m_pWrite(archive->m_pIO_opaque, dst_ofs, buffer, n) != n) return 0;
+        src_ofs += n;
+        dst_ofs += n;
+        remaining -= n;
+    }
+
+    if (!mz_zip_writer_add_to_central_dir(archive, (const char*)central + MZ_ZIP_CENTRAL_DIR_HEADER_SIZE, (mz_uint16)name_length, central_extra, (mz_uint16)kept_central,
+                                          central + MZ_ZIP_CENTRAL_DIR_HEADER_SIZE + name_length + central_extra_length, (mz_uint16)comment_length,
+                                          file_stat->m_uncomp_size, file_stat->m_comp_size, file_stat->m_crc32, 0, bit_flags, dos_time, dos_date, header_ofs,
+                                          MZ_READ_LE32(central + MZ_ZIP_CDH_EXTERNAL_ATTR_OFS), NULL, 0)) {
+        return 0;
+    }
+
+    archive->m_total_files++;
+    archive->m_archive_size = dst_ofs;
+    return 1;
+}
+
+// Copy an entry of an open reader into a writer as is: its headers and
+// compressed (or encrypted) data are copied raw, without inflating them.
+// Stored entries are re-padded when the writer or the entry asks for an
+// alignment, so their data stays aligned in the copy.
+int copy_entry(int handle_id, int source_handle_id, int file_index) {
+    if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || !zip_handles[handle_id]->is_writer) {
+        return 0;
+    }
+    if (source_handle_id < 0 || source_handle_id >= MAX_HANDLES || !zip_handles[source_handle_id] || zip_handles[source_handle_id]->is_writer) {
+        return 0;
+    }
+
+    zip_handle_t* handle = zip_handles[handle_id];
+    zip_handle_t* source = zip_handles[source_handle_id];
+    mz_zip_archive_file_stat file_stat;
+    if (!mz_zip_reader_file_stat(&source->archive, (mz_uint)file_index, &file_stat)) return 0;
+
+    // miniz only copies out of a zip64 archive into one that is zip64 too,
+    // which adding a large entry would switch the writer to anyway
+    if (source->archive.m_pState->m_zip64) handle->archive.m_pState->m_zip64 = MZ_TRUE;
+
+    int index = (int)handle->archive.m_total_files;
+    mz_uint64 start = op_start(LATENCY_ADD, handle_id, index, file_stat.m_filename);
+    mz_uint64 progress_before = handle->progress_bytes;
+
+    int copied = -1;
+    if (file_stat.m_method == 0 && !file_stat.m_is_encrypted && file_stat.m_comp_size == file_stat.m_uncomp_size) {
+        copied = copy_stored_entry(handle, source, file_index, &file_stat);
+    }
+    mz_bool status = copied < 0 ? mz_zip_writer_add_from_zip_reader(&handle->archive, &source->archive, (mz_uint)file_index) : copied;
+    if (status) {
+        handle->stats.entries++;
+        handle->stats.uncompressed_bytes += file_stat.m_uncomp_size;
+        handle->stats.compressed_bytes += file_stat.m_comp_size;
+        progress_entry(handle, progress_before, file_stat.m_uncomp_size);
+    }
+    handle->add_ns += monotonic_ns() - start;
+    op_done(LATENCY_ADD, handle_id, index, start, (size_t)file_stat.m_comp_size, status);
+
+    return status ? 1 : 0;
+}
+
+// One entry of an add_files_to_zip batch, as laid out by the caller
+typedef struct {
+    mz_uint64 filename;
+    mz_uint64 data;
+    mz_uint64 data_length;
+    int level;
+    int reserved;
+} batch_entry_desc_t;
+
+typedef struct {
+    const batch_entry_desc_t* entries;
+    int count;
+    const zip_handle_t* handle;
+    mz_uint8** compressed;
+    size_t* compressed_size;
+    mz_uint64* deflate_ns;
+    worker_mutex_t lock;
+    int next;
+} batch_job_t;
+
+static int batch_is_parallel(const batch_entry_desc_t* entry) {
+    return entry->level == ZIP_LEVEL_OPTIMAL && entry->data_length > 3;
+}
+
+// Compress optimal-parse entries of the batch until none are left
+static void batch_worker(void* arg) {
+    batch_job_t* job = (batch_job_t*)arg;
+
+    for (;;) {
+        worker_mutex_lock(&job->lock);
+        int i = job->next++;
+        worker_mutex_unlock(&job->lock);
+        if (i >= job->count) break;
+
+        const batch_entry_desc_t* entry = &job->entries[i];
+        const void* data = (const void*)(uintptr_t)entry->data;
+        size_t data_length = (size_t)entry->data_length;
+        if (!batch_is_parallel(entry) || should_auto_store(job->handle, data, data_length)) continue;
+
+        // A failed allocation leaves the size at 0 and the entry gets stored
+        mz_uint64 start = monotonic_ns();
+        job->compressed[i] = (mz_uint8*)malloc(data_length);
+        if (job->compressed[i]) {
+            job->compressed_size[i] = optimal_deflate(data, data_length, job->compressed[i], data_length - 1, OPT_DEFAULT_ITERATIONS);
+        }
+        job->deflate_ns[i] = monotonic_ns() - start;
+    }
+}
+
+// Add a batch of entries. Optimal-parse entries are compressed on up to
+// `threads` threads first, then everything is written in order. Returns the
+// number of entries added, stopping at the first failure.
+int add_files_to_zip(int handle_id, const batch_entry_desc_t* entries, int count, int threads) {
+    if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || !zip_handles[handle_id]->is_writer) {
+        return 0;
+    }
+    if (count <= 0 || threads <= 0) return 0;
+
+    zip_handle_t* handle = zip_handles[handle_id];
+    batch_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.entries = entries;
+    job.count = count;
+    job.handle = handle;
+    job.compressed = (mz_uint8**)calloc((size_t)count, sizeof(mz_uint8*));
+    job.compressed_size = (size_t*)calloc((size_t)count, sizeof(size_t));
+    job.deflate_ns = (mz_uint64*)calloc((size_t)count, sizeof(mz_uint64));
+
+    int added = 0;
+    if (job.compressed && job.compressed_size && job.deflate_ns) {
+        int parallel = 0;
+        for (int i = 0; i < count; i++) parallel += batch_is_parallel(&entries[i]);
+
+        mz_uint64 start = monotonic_ns();
+        if (parallel > 0) {
+            worker_mutex_init(&job.lock);
+            run_workers(threads < parallel ? threads : parallel, batch_worker, &job);
+            worker_mutex_destroy(&job.lock);
+        }
+        handle->add_ns += monotonic_ns() - start;
+
+        for (; added < count && !handle->cancelled; added++) {
+            const batch_entry_desc_t* entry = &entries[added];
+            const char* filename = (const char*)(uintptr_t)entry->filename;
+            const void* data = (const void*)(uintptr_t)entry->data;
+            size_t data_length = (size_t)entry->data_length;
+
+            if (!batch_is_parallel(entry)) {
+                if (!add_file_to_zip(handle_id, filename, data, data_length, entry->level, MZ_DEFAULT_STRATEGY, 0, -1)) break;
+                continue;
+            }
+
+            int index = (int)handle->archive.m_total_files;
+            TRACE(TRACE_OP_START, LATENCY_ADD, handle_id, index, filename, 0, 0);
+            start = monotonic_ns();
+            size_t stored_size = 0;
+            mz_bool status = write_entry(handle, filename, data, data_length, job.compressed[added], job.compressed_size[added], entry->level, &stored_size);
+            mz_uint64 elapsed = monotonic_ns() - start;
+            handle->add_ns += elapsed;
+            TRACE(TRACE_OP_DONE, LATENCY_ADD, handle_id, index, NULL, stored_size, status);
+            if (!status) break;
+
+            // The entry's share of the parallel phase is its own compression time
+            latency_add(LATENCY_ADD, elapsed + job.deflate_ns[added]);
+
+            handle->stats.entries++;
+            handle->stats.uncompressed_bytes += data_length;
+            handle->stats.compressed_bytes += stored_size;
+            handle->stats.deflate_ns += job.deflate_ns[added];
+            progress_entry(handle, handle->progress_bytes, data_length);
+        }
+    }
+
+    if (job.compressed) {
+        for (int i = 0; i < count; i++) free(job.compressed[i]);
+    }
+    free(job.compressed);
+    free(job.compressed_size);
+    free(job.deflate_ns);
+    return added;
+}
+
+// Sharded writes
+//
+// A sharded writer splits its entries across several archives so they can be
+// written, and later read, in parallel. Each shard of an add_files_to_shards
+// call gets a thread that compresses and writes its entries to its own
+// writer handle, so those threads only touch their handle's state: their add
+// latencies go to a histogram per shard, merged into the global ones once
+// every thread is done, and progress callbacks (which call into JS) must not
+// be set on shard handles.
+typedef struct {
+    int handle_id;
+    int count;
+    mz_uint64 entries;
+    // Set to the number of entries added, stopping at the first failure
+    int added;
+    int reserved;
+} shard_batch_desc_t;
 
-// Global storage for zip archives
-#define MAX_HANDLES 100
+typedef struct {
+    shard_batch_desc_t* shards;
+    // The add latencies of each shard
+    latency_histogram_t* latency;
+    int count;
+    worker_mutex_t lock;
+    int next;
+} shard_job_t;
 
-static zip_handle_t* zip_handles[MAX_HANDLES] = {NULL};
-static int next_handle_id = 0;
+// Add one entry of a shard batch at the level it asks for
+static mz_bool add_shard_entry(zip_handle_t* handle, int handle_id, const batch_entry_desc_t* entry, latency_histogram_t* latency) {
+    const char* filename = (const char*)(uintptr_t)entry->filename;
+    const void* data = (const void*)(uintptr_t)entry->data;
+    size_t data_length = (size_t)entry->data_length;
+    int level = entry->level < 0 ? MZ_DEFAULT_LEVEL : entry->level;
+    if (level > ZIP_LEVEL_OPTIMAL) return MZ_FALSE;
 
-// Create a new zip archive
-int create_zip(const char* filename) {
-    if (next_handle_id >= MAX_HANDLES) return -1;
+    int index = (int)handle->archive.m_total_files;
+    TRACE(TRACE_OP_START, LATENCY_ADD, handle_id, index, filename, 0, 0);
+    mz_uint64 start = monotonic_ns();
+    size_t stored_size = 0;
+    mz_uint tdefl_flags = tdefl_create_comp_flags_from_zip_params(level, -15, MZ_DEFAULT_STRATEGY);
+    mz_bool status = add_entry(handle, filename, data, data_length, level, tdefl_flags, 0, &stored_size);
+    mz_uint64 elapsed = monotonic_ns() - start;
+    handle->add_ns += elapsed;
+    TRACE(TRACE_OP_DONE, LATENCY_ADD, handle_id, index, NULL, stored_size, status);
+
+    if (status) {
+        latency_histogram_add(latency, elapsed);
+        handle->stats.entries++;
+        handle->stats.uncompressed_bytes += data_length;
+        handle->stats.compressed_bytes += stored_size;
+    }
+    return status;
+}
+
+// Write whole shards until none are left
+static void shard_worker(void* arg) {
+    shard_job_t* job = (shard_job_t*)arg;
+
+    for (;;) {
+        worker_mutex_lock(&job->lock);
+        int i = job->next++;
+        worker_mutex_unlock(&job->lock);
+        if (i >= job->count) break;
+
+        shard_batch_desc_t* shard = &job->shards[i];
+        zip_handle_t* handle = zip_handles[shard->handle_id];
+        const batch_entry_desc_t* entries = (const batch_entry_desc_t*)(uintptr_t)shard->entries;
+        while (shard->added < shard->count && add_shard_entry(handle, shard->handle_id, &entries[shard->added], &job->latency[i])) {
+            shard->added++;
+        }
+    }
+}
+
+// Add a batch of entries to each of `count` writers, one thread per writer.
+// Returns 1 if every entry was added; each shard's `added` says how far it got.
+int add_files_to_shards(shard_batch_desc_t* shards, int count) {
+    if (!shards || count <= 0) return 0;
+
+    for (int i = 0; i < count; i++) {
+        int handle_id = shards[i].handle_id;
+        if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || !zip_handles[handle_id]->is_writer) {
+            return 0;
+        }
+        if (zip_handles[handle_id]->progress || shards[i].count < 0) return 0;
+        // Two threads on one handle would interleave its entries
+        for (int j = 0; j < i; j++) {
+            if (shards[j].handle_id == handle_id) return 0;
+        }
+        shards[i].added = 0;
+    }
+
+    shard_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.shards = shards;
+    job.latency = (latency_histogram_t*)calloc((size_t)count, sizeof(latency_histogram_t));
+    job.count = count;
+    if (!job.latency) return 0;
+
+    worker_mutex_init(&job.lock);
+    run_workers(count, shard_worker, &job);
+    worker_mutex_destroy(&job.lock);
+
+    for (int i = 0; i < count; i++) latency_merge(LATENCY_ADD, &job.latency[i]);
+    free(job.latency);
+
+    for (int i = 0; i < count; i++) {
+        if (shards[i].added < shards[i].count) return 0;
+    }
+    return 1;
+}
+
+// Set the adaptive controller's target in bytes per second (0 disables it)
+int set_adaptive_target(int handle_id, double bytes_per_second) {
+    if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || !zip_handles[handle_id]->is_writer) {
+        return 0;
+    }
     
-    zip_handle_t* handle = (zip_handle_t*)malloc(sizeof(zip_handle_t));
-    if (!handle) return -1;
+    if (!(bytes_per_second >= 0.0)) return 0;
     
-    memset(handle, 0, sizeof(zip_handle_t));
-    handle->is_writer = 1;
+    zip_handles[handle_id]->adaptive_target = bytes_per_second;
+    return 1;
+}
+
+// Set the extraction budgets of a reader: the largest entry, the total bytes
+// extracted from now on and the highest uncompressed to compressed ratio, 0
+// disabling each, and a deadline in milliseconds from now (negative for none).
+int set_extract_limits(int handle_id, double max_entry_size, double max_total_size, double max_ratio, double timeout_ms) {
+    if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || zip_handles[handle_id]->is_writer) {
+        return 0;
+    }
     
-    mz_bool status = mz_zip_writer_init_file(&handle->archive, filename, 0);
+    if (!(max_entry_size >= 0.0) || !(max_total_size >= 0.0) || !(max_ratio >= 0.0) || timeout_ms != timeout_ms) return 0;
     
-    if (!status) {
-        free(handle);
+    extract_limits_t* limits = &zip_handles[handle_id]->limits;
+    limits->max_entry_size = (mz_uint64)max_entry_size;
+    limits->max_total_size = (mz_uint64)max_total_size;
+    limits->max_ratio = max_ratio;
+    // Deadlines are capped at about 30 years so the conversion can't overflow
+    limits->deadline_ns = timeout_ms >= 0.0 ? monotonic_ns() + (mz_uint64)(MZ_MIN(timeout_ms, 1e12) * 1e6) : 0;
+    limits->extracted = 0;
+    limits->violation = LIMIT_NONE;
+    return 1;
+}
+
+// Check an entry against the reader's budgets before extracting it. Returns
+// the LIMIT_* it would exceed, LIMIT_NONE, or -1 for an invalid handle or index.
+int check_extract_limits(int handle_id, int file_index) {
+    if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || zip_handles[handle_id]->is_writer) {
         return -1;
     }
     
-    zip_handles[next_handle_id] = handle;
-    return next_handle_id++;
+    zip_handle_t* handle = zip_handles[handle_id];
+    mz_zip_archive_file_stat file_stat;
+    if (!mz_zip_reader_file_stat(&handle->archive, file_index, &file_stat)) return -1;
+    
+    handle->limits.violation = entry_over_limit(handle, &file_stat);
+    return handle->limits.violation;
 }
 
-// Add a file to zip archive
-int add_file_to_zip(int handle_id, const char* filename, const void* data, size_t data_length, int compression_level) {
+// The budget that failed the reader's last extraction, LIMIT_NONE if it
+// failed (or succeeded) for another reason, or -1 for an invalid handle
+int get_limit_violation(int handle_id) {
+    if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || zip_handles[handle_id]->is_writer) {
+        return -1;
+    }
+    
+    return zip_handles[handle_id]->limits.violation;
+}
+
+// Set the progress callback of a reader or writer, NULL to remove it. The
+// counts it reports start again from zero, and a cancelled handle is usable
+// again.
+int set_progress_callback(int handle_id, progress_fn_t callback) {
+    if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id]) {
+        return 0;
+    }
+    
+    zip_handle_t* handle = zip_handles[handle_id];
+    handle->progress = callback;
+    handle->progress_bytes = 0;
+    handle->progress_next = CODEC_CHUNK_SIZE;
+    handle->progress_entries = 0;
+    handle->cancelled = 0;
+    return 1;
+}
+
+// Totals and controller state reported by get_compression_report
+typedef struct {
+    mz_uint64 entries;
+    mz_uint64 bytes_in;
+    mz_uint64 bytes_out;
+    mz_uint64 add_ns;
+    mz_uint64 deflate_ns;
+    int level;
+    int probes;
+} compression_report_t;
+
+int get_compression_report(int handle_id, compression_report_t* report) {
     if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || !zip_handles[handle_id]->is_writer) {
         return 0;
     }
     
     zip_handle_t* handle = zip_handles[handle_id];
-    mz_bool status = mz_zip_writer_add_mem(&handle->archive, filename, data, data_length, compression_level);
-    return status ? 1 : 0;
+    report->entries = handle->stats.entries;
+    report->bytes_in = handle->stats.uncompressed_bytes;
+    report->bytes_out = handle->stats.compressed_bytes;
+    report->add_ns = handle->add_ns;
+    report->deflate_ns = handle->stats.deflate_ns;
+    report->level = handle->adaptive_target > 0.0 ? adaptive_steps[handle->adaptive_step].level : -1;
+    report->probes = handle->adaptive_target > 0.0 ? adaptive_steps[handle->adaptive_step].probes : -1;
+    return 1;
+}
+
+// Enable the entropy probe for a writer, threshold in millibits per byte (0 disables)
+int set_auto_store(int handle_id, int threshold) {
+    if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || !zip_handles[handle_id]->is_writer) {
+        return 0;
+    }
+    
+    if (threshold < 0 || threshold > 8000) return 0;
+    
+    zip_handles[handle_id]->auto_store_threshold = threshold;
+    return 1;
+}
+
+// Copy the counters of a reader or writer
+int get_stats(int handle_id, zip_stats_t* stats) {
+    if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id]) {
+        return 0;
+    }
+    
+    *stats = zip_handles[handle_id]->stats;
+    return 1;
+}
+
+// Sum the counters of every handle, open or already released
+void get_global_stats(zip_stats_t* stats) {
+    *stats = retired_stats;
+    for (int i = 0; i < MAX_HANDLES; i++) {
+        if (zip_handles[i]) stats_add(stats, &zip_handles[i]->stats);
+    }
+}
+
+// Copy the latency histogram of an operation type: count, sum in
+// nanoseconds, then the LATENCY_BUCKETS bucket counts. Returns the number of
+// buckets, or -1 for an unknown operation.
+int get_latency_histogram(int operation, mz_uint64* histogram) {
+    if (operation < 0 || operation >= LATENCY_OPERATIONS) return -1;
+
+    latency_histogram_t* from = &latency_histograms[operation];
+    histogram[0] = latency_counter_load(&from->count);
+    histogram[1] = latency_counter_load(&from->sum_ns);
+    for (int i = 0; i < LATENCY_BUCKETS; i++) histogram[2 + i] = latency_counter_load(&from->buckets[i]);
+    return LATENCY_BUCKETS;
+}
+
+// Count the open readers and writers and the native memory they hold
+typedef struct {
+    int readers;
+    int writers;
+    mz_uint64 memory_bytes;
+} handle_usage_t;
+
+void get_handle_usage(handle_usage_t* usage) {
+    memset(usage, 0, sizeof(*usage));
+    for (int i = 0; i < MAX_HANDLES; i++) {
+        zip_handle_t* handle = zip_handles[i];
+        if (!handle) continue;
+
+        if (handle->is_writer) {
+            usage->writers++;
+        } else {
+            usage->readers++;
+        }
+        usage->memory_bytes += handle_memory(handle);
+    }
+}
+
+// Enable (1) or disable (0) the inflate, CRC and I/O timers for all handles
+void set_stats_timing(int enabled) {
+    stats_timing = enabled ? 1 : 0;
+}
+
+// Set the password for WinZip AES entries, NULL or empty clears it. Writers
+// encrypt every entry added afterwards with strength 1-3 (AES-128/192/256)
+// and version 1 or 2 (AE-1/AE-2); readers ignore both.
+int set_password(int handle_id, const char* password, int strength, int version) {
+    if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id]) {
+        return 0;
+    }
+    
+    zip_handle_t* handle = zip_handles[handle_id];
+    size_t password_length = password ? strlen(password) : 0;
+    if (password_length && handle->is_writer && (strength < 1 || strength > 3 || version < 1 || version > 2)) return 0;
+    
+    zip_aes_t* aes = NULL;
+    if (password_length) {
+        aes = zip_aes_create(password, password_length, strength, version);
+        if (!aes) return 0;
+    }
+    
+    zip_aes_free(handle->aes);
+    handle->aes = aes;
+    return 1;
 }
 
 // Finalize and close zip archive
@@ -75,35 +2395,35 @@ int finalize_zip(int handle_id) {
         return 0;
     }
     
+    mz_uint64 start = op_start(LATENCY_FINALIZE, handle_id, -1, NULL);
     zip_handle_t* handle = zip_handles[handle_id];
-    mz_bool status = mz_zip_writer_finalize_archive(&handle->archive);
+    // The central directory is written and flushed unbuffered
+    mz_bool status = write_buffer_detach(handle) && mz_zip_writer_finalize_archive(&handle->archive);
+    mz_uint64 size = handle->archive.m_archive_size;
+    if (status && handle->reserved) {
+        mz_zip_internal_state* state = handle->archive.m_pState;
+        status = file_truncate(state->m_pFile, state->m_file_archive_start_ofs + size);
+    }
     mz_zip_writer_end(&handle->archive);
     
-    free(handle);
+    stats_add(&retired_stats, &handle->stats);
+    free_handle(handle);
     zip_handles[handle_id] = NULL;
     
+    op_done(LATENCY_FINALIZE, handle_id, -1, start, size, status);
     return status ? 1 : 0;
 }
 
 // Open an existing zip archive for reading
 int open_zip(const char* filename) {
-    if (next_handle_id >= MAX_HANDLES) return -1;
-    
-    zip_handle_t* handle = (zip_handle_t*)malloc(sizeof(zip_handle_t));
-    if (!handle) return -1;
+    int handle_id = find_free_handle_slot();
+    if (handle_id < 0) return -1;
     
-    memset(handle, 0, sizeof(zip_handle_t));
-    handle->is_writer = 0;
-    
-    mz_bool status = mz_zip_reader_init_file(&handle->archive, filename, 0);
-    
-    if (!status) {
-        free(handle);
-        return -1;
-    }
+    mz_uint64 start = op_start(LATENCY_OPEN, handle_id, -1, filename);
+    zip_handle_t* handle = alloc_handle(0);
+    mz_bool status = handle && mz_zip_reader_init_file(&handle->archive, filename, 0);
     
-    zip_handles[next_handle_id] = handle;
-    return next_handle_id++;
+    return open_done(handle_id, handle, status, start);
 }
 
 // Get number of files in zip archive
@@ -164,8 +2484,12 @@ void* extract_file(int handle_id, int file_index, size_t* size) {
         return NULL;
     }
     
-    zip_handle_t* handle = zip_handles[handle_id];
-    void* data = mz_zip_reader_extract_to_heap(&handle->archive, file_index, size, 0);
+    size_t extracted = 0;
+    mz_uint64 start = op_start(LATENCY_EXTRACT, handle_id, file_index, NULL);
+    void* data = extract_entry_to_heap(zip_handles[handle_id], file_index, &extracted);
+    op_done(LATENCY_EXTRACT, handle_id, file_index, start, extracted, data != NULL);
+    
+    if (size) *size = extracted;
     return data;
 }
 
@@ -175,23 +2499,73 @@ int close_zip(int handle_id) {
         return 0;
     }
     
+    mz_uint64 start = op_start(TRACE_CLOSE, handle_id, -1, NULL);
     zip_handle_t* handle = zip_handles[handle_id];
     mz_bool status = mz_zip_reader_end(&handle->archive);
     
-    free(handle);
+    crc_queue_wait(handle->crc_queue, NULL, 0, &handle->stats.crc_ns);
+    crc_queue_free(handle->crc_queue);
+    stats_add(&retired_stats, &handle->stats);
+    free_handle(handle);
     zip_handles[handle_id] = NULL;
     
+    op_done(TRACE_CLOSE, handle_id, -1, start, 0, status);
     return status ? 1 : 0;
 }
 
+// Release a handle whose reader or writer was dropped without being closed or
+// finalized. Readers are closed; writers are abandoned without writing the
+// central directory, so a file-based archive is left incomplete.
+int release_zip(int handle_id) {
+    if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id]) {
+        return 0;
+    }
+    
+    zip_handle_t* handle = zip_handles[handle_id];
+    if (!handle->is_writer) return close_zip(handle_id);
+    
+    write_buffer_detach(handle);
+    // Give back the space reserved past what was written
+    if (handle->reserved) {
+        mz_zip_internal_state* state = handle->archive.m_pState;
+        if (MZ_FFLUSH(state->m_pFile) == 0) file_truncate(state->m_pFile, state->m_file_archive_start_ofs + handle->archive.m_archive_size);
+    }
+    untrack_io(handle);
+    mz_zip_writer_end(&handle->archive);
+    
+    stats_add(&retired_stats, &handle->stats);
+    free_handle(handle);
+    zip_handles[handle_id] = NULL;
+    return 1;
+}
+
+// Position of a stored, unencrypted entry's data in the archive file (or
+// memory block), for using it in place. -1 for any other entry.
+double get_entry_data_offset(int handle_id, int file_index) {
+    if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || zip_handles[handle_id]->is_writer) {
+        return -1;
+    }
+    
+    zip_handle_t* handle = zip_handles[handle_id];
+    mz_zip_archive_file_stat file_stat;
+    if (!mz_zip_reader_file_stat(&handle->archive, (mz_uint)file_index, &file_stat)) return -1;
+    if (file_stat.m_method != 0 || file_stat.m_is_encrypted || !file_stat.m_is_supported || file_stat.m_comp_size != file_stat.m_uncomp_size) return -1;
+    
+    mz_uint64 offset = entry_data_offset(handle, &file_stat);
+    if (!offset) return -1;
+    return (double)(handle->archive.m_pState->m_file_archive_start_ofs + offset);
+}
+
 // Find file by name in zip archive
 int find_file(int handle_id, const char* filename) {
     if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || zip_handles[handle_id]->is_writer) {
         return -1;
     }
     
-    zip_handle_t* handle = zip_handles[handle_id];
-    return mz_zip_reader_locate_file(&handle->archive, filename, NULL, 0);
+    mz_uint64 start = op_start(LATENCY_LOCATE, handle_id, -1, filename);
+    int file_index = mz_zip_reader_locate_file(&zip_handles[handle_id]->archive, filename, NULL, 0);
+    op_done(LATENCY_LOCATE, handle_id, file_index, start, 0, 1);
+    return file_index;
 }
 
 // Extract file by name
@@ -201,11 +2575,19 @@ void* extract_file_by_name(int handle_id, const char* filename, size_t* size) {
     }
     
     zip_handle_t* handle = zip_handles[handle_id];
+    mz_uint64 start = op_start(LATENCY_LOCATE, handle_id, -1, filename);
     int file_index = mz_zip_reader_locate_file(&handle->archive, filename, NULL, 0);
+    op_done(LATENCY_LOCATE, handle_id, file_index, start, 0, 1);
     
     if (file_index < 0) return NULL;
     
-    return mz_zip_reader_extract_to_heap(&handle->archive, file_index, size, 0);
+    size_t extracted = 0;
+    start = op_start(LATENCY_EXTRACT, handle_id, file_index, filename);
+    void* data = extract_entry_to_heap(handle, file_index, &extracted);
+    op_done(LATENCY_EXTRACT, handle_id, file_index, start, extracted, data != NULL);
+    
+    if (size) *size = extracted;
+    return data;
 }
 
 // Helper function to free extracted data
@@ -215,65 +2597,320 @@ void free_extracted_data(void* data) {
     }
 }
 
-// Optimized function to extract file data directly to a buffer
-int extract_file_to_buffer(int handle_id, int file_index, void* output_buffer, size_t buffer_size) {
+// Optimized function to extract file data directly to a buffer. crc_mode 0
+// verifies the CRC, 1 skips it and 2 defers it to wait_deferred_crc.
+int extract_file_to_buffer(int handle_id, int file_index, void* output_buffer, size_t buffer_size, int crc_mode) {
     if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || zip_handles[handle_id]->is_writer) {
         return -1;
     }
     
     zip_handle_t* handle = zip_handles[handle_id];
-    size_t extracted_size = 0;
+    mz_zip_archive_file_stat file_stat;
     
-    mz_bool status = mz_zip_reader_extract_to_mem(&handle->archive, file_index, output_buffer, buffer_size, 0);
+    if (crc_mode < CRC_VERIFY || crc_mode > CRC_DEFER) return -1;
+    mz_uint64 start = op_start(LATENCY_EXTRACT, handle_id, file_index, NULL);
+    mz_uint64 progress_before = handle->progress_bytes;
+    mz_bool status = extract_entry(handle, file_index, output_buffer, buffer_size, &file_stat, crc_mode);
+    op_done(LATENCY_EXTRACT, handle_id, file_index, start, status ? file_stat.m_uncomp_size : 0, status);
     
     if (!status) return -1;
+    progress_entry(handle, progress_before, file_stat.m_uncomp_size);
     
-    // Get the actual size of the extracted data
-    mz_zip_archive_file_stat file_stat;
-    if (mz_zip_reader_file_stat(&handle->archive, file_index, &file_stat)) {
-        extracted_size = file_stat.m_uncomp_size;
+    return (int)file_stat.m_uncomp_size;
+}
+
+// Wait for CRC checks deferred by extract_file_to_buffer. Up to max_failures
+// indices of entries that failed are written to `failures`. Returns the
+// number of failed checks since the last call, or -1 for an invalid handle.
+int wait_deferred_crc(int handle_id, int* failures, int max_failures) {
+    if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || zip_handles[handle_id]->is_writer) {
+        return -1;
     }
     
-    return (int)extracted_size;
+    zip_handle_t* handle = zip_handles[handle_id];
+    return crc_queue_wait(handle->crc_queue, failures, max_failures, &handle->stats.crc_ns);
+}
+
+// Archive validation
+//
+// Entries are checked independently, so they are spread over worker threads.
+// Each worker gets its own copy of the handle: the central directory is
+// shared read-only, but the codec state, scratch buffer and AES key cache are
+// per thread, and file-backed archives are read with positioned reads instead
+// of miniz's seek-then-read callback.
+#define VALIDATE_HEADER 1
+#define VALIDATE_UNSUPPORTED 2
+#define VALIDATE_PASSWORD 3
+#define VALIDATE_DATA 4
+#define VALIDATE_READ 5
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// A failed entry and why, as laid out for the caller
+typedef struct {
+    int index;
+    int reason;
+} validate_failure_t;
+
+typedef struct {
+    zip_handle_t* handle;
+    int file_count;
+    int headers_only;
+    int max_failures;
+    validate_failure_t* failures;
+    int failure_count;
+    int checked;
+    int next;
+    int stop;
+    worker_mutex_t lock;
+#ifdef _WIN32
+    HANDLE file;
+#else
+    int fd;
+#endif
+    mz_uint64 file_start;
+} validate_job_t;
+
+static size_t validate_file_read(void* opaque, mz_uint64 file_ofs, void* buffer, size_t n) {
+    validate_job_t* job = (validate_job_t*)opaque;
+    mz_uint64 offset = job->file_start + file_ofs;
+    size_t total = 0;
+
+    while (total < n) {
+#ifdef _WIN32
+        OVERLAPPED overlapped;
+        DWORD chunk = n - total > 0x40000000 ? 0x40000000 : (DWORD)(n - total);
+        DWORD got = 0;
+        memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.Offset = (DWORD)(offset + total);
+        overlapped.OffsetHigh = (DWORD)((offset + total) >> 32);
+        if (!ReadFile(job->file, (mz_uint8*)buffer + total, chunk, &got, &overlapped) || !got) break;
+#else
+        ssize_t got = pread(job->fd, (mz_uint8*)buffer + total, n - total, (off_t)(offset + total));
+        if (got <= 0) break;
+#endif
+        total += (size_t)got;
+    }
+    return total;
+}
+
+// Compare the local header (and data descriptor) of an entry with its central
+// directory record
+static int validate_entry_headers(zip_handle_t* handle, int file_index, const mz_zip_archive_file_stat* file_stat) {
+    mz_zip_archive* archive = &handle->archive;
+    mz_uint8 local_header[MZ_ZIP_LOCAL_DIR_HEADER_SIZE];
+
+    const mz_uint8* central = mz_zip_get_cdh(archive, (mz_uint)file_index);
+    if (!central) return VALIDATE_HEADER;
+
+    mz_uint64 offset = file_stat->m_local_header_ofs;
+    if (archive->m_pRead(archive->m_pIO_opaque, offset, local_header, MZ_ZIP_LOCAL_DIR_HEADER_SIZE) != MZ_ZIP_LOCAL_DIR_HEADER_SIZE) return VALIDATE_HEADER;
+    if (MZ_READ_LE32(local_header) != MZ_ZIP_LOCAL_DIR_HEADER_SIG) return VALIDATE_HEADER;
+    if (MZ_READ_LE16(local_header + MZ_ZIP_LDH_METHOD_OFS) != file_stat->m_method) return VALIDATE_HEADER;
+
+    size_t name_length = MZ_READ_LE16(central + MZ_ZIP_CDH_FILENAME_LEN_OFS);
+    if (MZ_READ_LE16(local_header + MZ_ZIP_LDH_FILENAME_LEN_OFS) != name_length) return VALIDATE_HEADER;
+
+    mz_uint8* name = (mz_uint8*)ensure_scratch(handle, name_length + 1);
+    if (!name) return VALIDATE_READ;
+    if (archive->m_pRead(archive->m_pIO_opaque, offset + MZ_ZIP_LOCAL_DIR_HEADER_SIZE, name, name_length) != name_length) return VALIDATE_HEADER;
+    if (memcmp(name, central + MZ_ZIP_CENTRAL_DIR_HEADER_SIZE, name_length) != 0) return VALIDATE_HEADER;
+
+    // Sizes of 0xFFFFFFFF live in the zip64 extra field, which miniz already
+    // parsed into the stat
+    int has_locator = (MZ_READ_LE16(local_header + MZ_ZIP_LDH_BIT_FLAG_OFS) & MZ_ZIP_LDH_BIT_FLAG_HAS_LOCATOR) != 0;
+    if (!has_locator) {
+        mz_uint32 comp_size = MZ_READ_LE32(local_header + MZ_ZIP_LDH_COMPRESSED_SIZE_OFS);
+        mz_uint32 uncomp_size = MZ_READ_LE32(local_header + MZ_ZIP_LDH_DECOMPRESSED_SIZE_OFS);
+        if (MZ_READ_LE32(local_header + MZ_ZIP_LDH_CRC32_OFS) != file_stat->m_crc32) return VALIDATE_HEADER;
+        if (comp_size != MZ_UINT32_MAX && comp_size != file_stat->m_comp_size) return VALIDATE_HEADER;
+        if (uncomp_size != MZ_UINT32_MAX && uncomp_size != file_stat->m_uncomp_size) return VALIDATE_HEADER;
+    }
+
+    offset += (mz_uint64)MZ_ZIP_LOCAL_DIR_HEADER_SIZE + name_length + MZ_READ_LE16(local_header + MZ_ZIP_LDH_EXTRA_LEN_OFS);
+    if (offset + file_stat->m_comp_size > archive->m_archive_size) return VALIDATE_HEADER;
+    if (!has_locator) return 0;
+
+    // The descriptor signature is optional, and sizes are 64-bit in zip64 archives
+    mz_uint8 descriptor[MZ_ZIP_DATA_DESCRIPTER_SIZE64];
+    offset += file_stat->m_comp_size;
+    size_t available = archive->m_archive_size - offset < sizeof(descriptor) ? (size_t)(archive->m_archive_size - offset) : sizeof(descriptor);
+    if (archive->m_pRead(archive->m_pIO_opaque, offset, descriptor, available) != available) return VALIDATE_HEADER;
+
+    const mz_uint8* fields = descriptor;
+    if (available >= 4 && MZ_READ_LE32(fields) == MZ_ZIP_DATA_DESCRIPTOR_ID) {
+        fields += 4;
+        available -= 4;
+    }
+    if (available < 12 || MZ_READ_LE32(fields) != file_stat->m_crc32) return VALIDATE_HEADER;
+    if (MZ_READ_LE32(fields + 4) == file_stat->m_comp_size && MZ_READ_LE32(fields + 8) == file_stat->m_uncomp_size) return 0;
+    if (available >= 20 && MZ_READ_LE64(fields + 4) == file_stat->m_comp_size && MZ_READ_LE64(fields + 12) == file_stat->m_uncomp_size) return 0;
+    return VALIDATE_HEADER;
+}
+
+// Check one entry, returning 0 when it is intact or the reason it is not
+static int validate_entry(zip_handle_t* handle, int file_index, int headers_only, void** output, size_t* output_capacity) {
+    mz_zip_archive_file_stat file_stat;
+    if (!mz_zip_reader_file_stat(&handle->archive, (mz_uint)file_index, &file_stat)) return VALIDATE_HEADER;
+
+    int reason = validate_entry_headers(handle, file_index, &file_stat);
+    if (reason || headers_only || file_stat.m_is_directory) return reason;
+
+    if (file_stat.m_method == ZIP_METHOD_AES) {
+        if (!handle->aes) return VALIDATE_PASSWORD;
+    } else if (!entry_is_supported(&file_stat)) {
+        return VALIDATE_UNSUPPORTED;
+    }
+
+    if ((mz_uint64)(size_t)file_stat.m_uncomp_size != file_stat.m_uncomp_size) return VALIDATE_READ;
+    if (file_stat.m_uncomp_size > *output_capacity) {
+        void* grown = realloc(*output, (size_t)file_stat.m_uncomp_size);
+        if (!grown) return VALIDATE_READ;
+        *output = grown;
+        *output_capacity = (size_t)file_stat.m_uncomp_size;
+    }
+
+    return extract_entry(handle, file_index, *output, *output_capacity, &file_stat, CRC_VERIFY) ? 0 : VALIDATE_DATA;
+}
+
+static void validate_worker(void* arg) {
+    validate_job_t* job = (validate_job_t*)arg;
+    void* output = NULL;
+    size_t output_capacity = 0;
+
+    // The archive struct is copied, its state (the central directory) is
+    // shared. Counters are kept per worker and added up at the end.
+    zip_handle_t* handle = alloc_handle(0);
+    if (handle) {
+        handle->archive = job->handle->archive;
+        handle->archive.m_pAlloc_opaque = handle;
+        handle->id = job->handle->id;
+        handle->codec = job->handle->codec;
+        if (job->handle->aes) {
+            zip_aes_t* aes = job->handle->aes;
+            handle->aes = zip_aes_create(aes->password, aes->password_length, aes->strength, aes->version);
+        }
+        if (handle->archive.m_pState->m_pMem) {
+            handle->archive.m_pRead = job->handle->io_read;
+            handle->archive.m_pIO_opaque = job->handle->io_opaque;
+        } else {
+            handle->archive.m_pRead = validate_file_read;
+            handle->archive.m_pIO_opaque = job;
+        }
+        track_io(handle);
+    }
+
+    for (;;) {
+        worker_mutex_lock(&job->lock);
+        int i = job->stop ? job->file_count : job->next++;
+        worker_mutex_unlock(&job->lock);
+        if (i >= job->file_count) break;
+
+        int reason = handle && (!job->handle->aes || handle->aes) ? validate_entry(handle, i, job->headers_only, &output, &output_capacity) : VALIDATE_READ;
+
+        worker_mutex_lock(&job->lock);
+        job->checked++;
+        if (reason && job->failure_count < job->max_failures) {
+            job->failures[job->failure_count].index = i;
+            job->failures[job->failure_count].reason = reason;
+            if (++job->failure_count == job->max_failures) job->stop = 1;
+        }
+        worker_mutex_unlock(&job->lock);
+    }
+
+    free(output);
+    if (handle) {
+        worker_mutex_lock(&job->lock);
+        stats_add(&job->handle->stats, &handle->stats);
+        worker_mutex_unlock(&job->lock);
+        free_handle(handle);
+    }
+}
+
+// Validate every entry on up to `threads` threads: local headers always, data
+// (inflated and checked against its CRC or MAC) unless headers_only is set.
+// Up to max_failures failures are written to `failures`, and the run stops
+// early once that many are found. Returns the number of failures, or -1 if
+// the handle is not a reader.
+int validate_zip(int handle_id, int threads, int headers_only, int max_failures, validate_failure_t* failures, int* checked) {
+    if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || zip_handles[handle_id]->is_writer) {
+        return -1;
+    }
+    if (threads <= 0 || max_failures <= 0) return -1;
+
+    zip_handle_t* handle = zip_handles[handle_id];
+    mz_zip_archive* archive = &handle->archive;
+    validate_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.handle = handle;
+    job.file_count = (int)mz_zip_reader_get_num_files(archive);
+    job.headers_only = headers_only;
+    job.max_failures = max_failures;
+    job.failures = failures;
+
+    if (!archive->m_pState->m_pMem) {
+        MZ_FILE* file = archive->m_pState->m_pFile;
+        if (!file) return -1;
+#ifdef _WIN32
+        job.file = (HANDLE)_get_osfhandle(_fileno(file));
+#else
+        job.fd = fileno(file);
+#endif
+        job.file_start = archive->m_pState->m_file_archive_start_ofs;
+    }
+
+    mz_uint64 start = op_start(TRACE_VALIDATE, handle_id, -1, NULL);
+    worker_mutex_init(&job.lock);
+    run_workers(threads < job.file_count ? threads : job.file_count, validate_worker, &job);
+    worker_mutex_destroy(&job.lock);
+    op_done(TRACE_VALIDATE, handle_id, -1, start, (mz_uint64)job.checked, 1);
+
+#ifdef _WIN32
+    // Positioned reads move the file pointer on Windows, so make stdio seek
+    // before miniz reads from the file again
+    if (!archive->m_pState->m_pMem) fseek(archive->m_pState->m_pFile, 0, SEEK_SET);
+#endif
+
+    if (checked) *checked = job.checked;
+    return job.failure_count;
 }
 
 // Create a new zip archive in memory
 int create_zip_in_memory() {
-    if (next_handle_id >= MAX_HANDLES) return -1;
-    
-    zip_handle_t* handle = (zip_handle_t*)malloc(sizeof(zip_handle_t));
-    if (!handle) return -1;
+    int handle_id = find_free_handle_slot();
+    if (handle_id < 0) return -1;
     
-    memset(handle, 0, sizeof(zip_handle_t));
-    handle->is_writer = 1;
-    
-    mz_bool status = mz_zip_writer_init_heap(&handle->archive, 0, 0);
-    
-    if (!status) {
-        free(handle);
-        return -1;
-    }
+    mz_uint64 start = op_start(LATENCY_OPEN, handle_id, -1, NULL);
+    zip_handle_t* handle = alloc_handle(1);
+    mz_bool status = handle && mz_zip_writer_init_heap(&handle->archive, 0, 0);
     
-    zip_handles[next_handle_id] = handle;
-    return next_handle_id++;
+    return open_done(handle_id, handle, status, start);
+}
+
+// Size of the archive once mz_zip_writer_finalize_archive has appended the
+// central directory, the zip64 end records when the archive needs them, and
+// the end of central directory record
+static mz_uint64 final_archive_size(const zip_handle_t* handle) {
+    const mz_zip_archive* archive = &handle->archive;
+    mz_uint64 size = archive->m_archive_size + MZ_ZIP_END_OF_CENTRAL_DIR_HEADER_SIZE;
+    if (archive->m_total_files) size += archive->m_pState->m_central_dir.m_size;
+    if (archive->m_pState->m_zip64) size += MZ_ZIP64_END_OF_CENTRAL_DIR_HEADER_SIZE + MZ_ZIP64_END_OF_CENTRAL_DIR_LOCATOR_SIZE;
+    return size;
 }
 
-// Get the size of the final archive without finalizing
+// Get the exact size of the final archive without finalizing, or -1 if it
+// does not fit in an int
 int get_zip_final_size(int handle_id) {
     if (handle_id < 0 || handle_id >= MAX_HANDLES || !zip_handles[handle_id] || !zip_handles[handle_id]->is_writer) {
         return -1;
     }
     
-    zip_handle_t* handle = zip_handles[handle_id];
-    
-    // Get the current size of the archive
-    size_t current_size = handle->archive.m_pState->m_mem_size;
-    
-    // Estimate the final size (this is approximate)
-    // The final size will be larger due to central directory and other metadata
-    size_t estimated_final_size = current_size + (1024 * 1024); // Add 1MB for metadata
-    
-    return (int)estimated_final_size;
+    mz_uint64 size = final_archive_size(zip_handles[handle_id]);
+    return size > 0x7FFFFFFF ? -1 : (int)size;
 }
 
 // Return data directly as bytes
@@ -282,52 +2919,60 @@ int finalize_zip_in_memory_bytes(int handle_id, void* output_buffer, size_t buff
         return -1;
     }
     
+    mz_uint64 start = op_start(LATENCY_FINALIZE, handle_id, -1, NULL);
     zip_handle_t* handle = zip_handles[handle_id];
     
-    // Use mz_zip_writer_finalize_heap_archive which handles the memory allocation properly
-    void* data = NULL;
-    size_t size = 0;
+    // Check the buffer before finalizing, so a caller can retry with a
+    // larger one
+    mz_uint64 final_size = final_archive_size(handle);
+    if (final_size > 0x7FFFFFFF) {
+        op_done(LATENCY_FINALIZE, handle_id, -1, start, 0, 0);
+        return -1;
+    }
+    if (buffer_size < final_size) {
+        op_done(LATENCY_FINALIZE, handle_id, -1, start, 0, 0);
+        return -2; // Buffer too small
+    }
     
-    mz_bool status = mz_zip_writer_finalize_heap_archive(&handle->archive, &data, &size);
-    if (!status || !data || size == 0) {
+    // The heap block holds the whole archive once the central directory is
+    // written. mz_zip_writer_finalize_heap_archive would refuse to write it
+    // through the counting callback.
+    if (!mz_zip_writer_finalize_archive(&handle->archive)) {
+        op_done(LATENCY_FINALIZE, handle_id, -1, start, 0, 0);
         return -1;
     }
     
-    // Check if buffer is large enough
-    if (buffer_size < size) {
-        return -2; // Buffer too small
+    // Bytes past the end records are what a failed add left behind
+    void* data = handle->archive.m_pState->m_pMem;
+    size_t size = (size_t)final_size;
+    if (!data || handle->archive.m_pState->m_mem_size < size) {
+        op_done(LATENCY_FINALIZE, handle_id, -1, start, 0, 0);
+        return -1;
     }
     
     // Copy the data directly to the output buffer
     memcpy(output_buffer, data, size);
     
-    // The mz_zip_writer_finalize_heap_archive already handles cleanup
-    // We just need to free our handle
-    free(handle);
+    // Release our handle and the heap archive
+    untrack_io(handle);
+    mz_zip_writer_end(&handle->archive);
+    stats_add(&retired_stats, &handle->stats);
+    free_handle(handle);
     zip_handles[handle_id] = NULL;
     
+    op_done(LATENCY_FINALIZE, handle_id, -1, start, size, 1);
     return (int)size;
 }
 
 // Open a zip archive from memory
 int open_zip_from_memory(const void* data, size_t size) {
-    if (next_handle_id >= MAX_HANDLES) return -1;
+    int handle_id = find_free_handle_slot();
+    if (handle_id < 0) return -1;
     
-    zip_handle_t* handle = (zip_handle_t*)malloc(sizeof(zip_handle_t));
-    if (!handle) return -1;
-    
-    memset(handle, 0, sizeof(zip_handle_t));
-    handle->is_writer = 0;
-    
-    // Use the correct miniz function for memory-based reading
-    mz_bool status = mz_zip_reader_init_mem(&handle->archive, data, size, 0);
-    
-    if (!status) {
-        free(handle);
-        return -1;
-    }
+    mz_uint64 start = op_start(LATENCY_OPEN, handle_id, -1, NULL);
+    zip_handle_t* handle = alloc_handle(0);
+    mz_bool status = handle && mz_zip_reader_init_mem(&handle->archive, data, size, 0);
     
-    zip_handles[next_handle_id] = handle;
-    return next_handle_id++;
+    return open_done(handle_id, handle, status, start);
 }
 